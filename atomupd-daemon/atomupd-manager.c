@@ -42,11 +42,11 @@
 #include <json-glib/json-glib.h>
 
 #define _send_atomupd_message(_bus, _method, _body, _reply_out, _error)                  \
-   _send_message(_bus, AU_ATOMUPD1_PATH, AU_ATOMUPD1_INTERFACE, _method, _body,          \
+   _send_message(_bus, atomupd_path, AU_ATOMUPD1_INTERFACE, _method, _body,              \
                  _reply_out, _error)
 
 #define _send_properties_message(_bus, _method, _body, _reply_out, _error)               \
-   _send_message(_bus, AU_ATOMUPD1_PATH, "org.freedesktop.DBus.Properties", _method,     \
+   _send_message(_bus, atomupd_path, "org.freedesktop.DBus.Properties", _method,         \
                  _body, _reply_out, _error)
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(sd_journal, sd_journal_close)
@@ -56,12 +56,16 @@ static const gchar *AU_DEV_CONFIG = "client-dev.conf";
 
 static GMainLoop *main_loop = NULL;
 static int main_loop_result = EXIT_SUCCESS;
+/* Object path of the managed target */
+static gchar *atomupd_path = NULL;
 
 static gboolean opt_session = FALSE;
 static gboolean opt_verbose = FALSE;
 static gboolean opt_penultimate = FALSE;
+static gboolean opt_ignore_rollout = FALSE;
 static gboolean opt_version = FALSE;
 static gboolean opt_skip_reload = FALSE;
+static gchar *opt_target = NULL;
 static gchar **opt_additional_variants = NULL;
 static gchar *opt_username = NULL;
 static gchar *opt_password = NULL;
@@ -69,6 +73,10 @@ static gchar *opt_password = NULL;
 static gchar *opt_branch = NULL;
 static gchar *opt_variant = NULL;
 
+#define BENCH_DEFAULT_ITERATIONS 10
+static gint opt_iterations = BENCH_DEFAULT_ITERATIONS;
+static gboolean opt_json = FALSE;
+
 static GOptionEntry options[] = {
    { "session", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_session,
      "Use the session bus instead of the system bus", NULL },
@@ -76,6 +84,10 @@ static GOptionEntry options[] = {
      "Be more verbose, including debug messages from atomupd-daemon.", NULL },
    { "penultimate-update", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
      &opt_penultimate, "Request the penultimate update that has been released", NULL },
+   { "ignore-rollout", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_ignore_rollout,
+     "Also list the updates that are not yet rolled out to this machine", NULL },
+   { "target", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &opt_target,
+     "Manage this additional target, instead of the running system", "NAME" },
    { "version", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_version,
      "Print version number and exit.", NULL },
    { NULL }
@@ -109,6 +121,14 @@ static GOptionEntry create_custom_update_options[] = {
    { NULL }
 };
 
+static GOptionEntry create_bench_options[] = {
+   { "iterations", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &opt_iterations,
+     "How many times each call is repeated, defaults to 10", "N" },
+   { "json", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_json,
+     "Print the results in JSON format", NULL },
+   { NULL }
+};
+
 static void
 log_handler(const gchar *log_domain,
             GLogLevelFlags log_level,
@@ -464,6 +484,10 @@ check_updates(GOptionContext *context,
    if (opt_penultimate)
       g_variant_builder_add(&builder, "{sv}", "penultimate", g_variant_new_boolean(TRUE));
 
+   if (opt_ignore_rollout)
+      g_variant_builder_add(&builder, "{sv}", "ignore_rollout",
+                            g_variant_new_boolean(TRUE));
+
    ret = _send_atomupd_message(bus, "CheckForUpdates", g_variant_new("(a{sv})", &builder),
                                &reply, &error);
 
@@ -531,7 +555,7 @@ launch_update(GDBusConnection *bus,
    proxy = g_dbus_proxy_new_for_bus_sync(
       opt_session ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM, G_DBUS_PROXY_FLAGS_NONE,
       NULL, /* GDBusInterfaceInfo */
-      AU_ATOMUPD1_BUS_NAME, AU_ATOMUPD1_PATH, AU_ATOMUPD1_INTERFACE,
+      AU_ATOMUPD1_BUS_NAME, atomupd_path, AU_ATOMUPD1_INTERFACE,
       NULL, /* GCancellable */
       &error);
 
@@ -966,47 +990,55 @@ list_builds(G_GNUC_UNUSED GOptionContext *context,
             GDBusConnection *bus,
             G_GNUC_UNUSED const gchar *argument)
 {
-   g_autofree gchar *variant = NULL;
-   g_autofree gchar *builds_list_path = NULL;
-   g_autoptr(JsonParser) parser = NULL;
+   g_autoptr(GVariant) variant_reply = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) builds = NULL;
    g_autoptr(GError) error = NULL;
-   JsonNode *json_node = NULL;   /* borrowed */
-   JsonArray *json_array = NULL; /* borrowed */
-   guint json_length;
+   g_auto(GVariantBuilder) builder;
+   const gchar *variant;
+   GVariantIter iter;
+   GVariant *build = NULL;
 
-   builds_list_path = get_builds_list_path(bus, opt_variant, &variant, &error);
-   if (builds_list_path == NULL) {
-      g_print("An error occurred while getting the list of builds: %s\n", error->message);
-      return EXIT_FAILURE;
+   g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sv}"));
+
+   if (opt_variant) {
+      variant = opt_variant;
+   } else {
+      variant_reply = get_atomupd_property(bus, "Variant", &error);
+      if (variant_reply == NULL) {
+         g_print("An error occurred while getting the list of builds: %s\n",
+                 error->message);
+         return EXIT_FAILURE;
+      }
+      variant = g_variant_get_string(variant_reply, NULL);
    }
 
-   parser = json_parser_new();
-   if (!json_parser_load_from_file(parser, builds_list_path, &error)) {
-      g_print("Error parsing the JSON list: %s\n", error->message);
+   /* Apply the eventual branch filter */
+   if (opt_branch != NULL)
+      g_variant_builder_add(&builder, "{sv}", "branch", g_variant_new_string(opt_branch));
+
+   if (!_send_atomupd_message(bus, "QueryBuilds",
+                              g_variant_new("(sa{sv}u)", variant, &builder, 0), &reply,
+                              &error)) {
+      g_print("An error occurred while getting the list of builds: %s\n", error->message);
       return EXIT_FAILURE;
    }
 
-   json_node = json_parser_get_root(parser);
-   json_array = json_node_get_array(json_node);
-   json_length = json_array_get_length(json_array);
+   builds = g_variant_get_child_value(reply, 0);
 
    printf("Available %s builds:\n", variant);
 
-   for (gsize i = 0; i < json_length; i++) {
-      const gchar *branch;
-      const gchar *buildid;
-      const gchar *version;
-      JsonObject *obj = json_array_get_object_element(json_array, i);
+   g_variant_iter_init(&iter, builds);
+   while (g_variant_iter_loop(&iter, "@a{sv}", &build)) {
+      const gchar *buildid = NULL;
+      const gchar *version = NULL;
+      const gchar *branch = NULL;
 
-      branch = json_object_get_string_member(obj, "branch");
-      /* Apply the eventual branch filter */
-      if (opt_branch != NULL && !g_str_equal(opt_branch, branch))
-         continue;
+      g_variant_lookup(build, "buildid", "&s", &buildid);
+      g_variant_lookup(build, "version", "&s", &version);
+      g_variant_lookup(build, "branch", "&s", &branch);
 
-      buildid = json_object_get_string_member(obj, "buildid");
-      version = json_object_get_string_member(obj, "version");
-
-      printf("ID: %s - version: %s - branch: %s\n", buildid, version, branch);
+      print_image_info(buildid, version, branch);
    }
 
    return EXIT_SUCCESS;
@@ -1043,6 +1075,309 @@ update_status(G_GNUC_UNUSED GOptionContext *context,
    return EXIT_SUCCESS;
 }
 
+static int
+memory_usage(G_GNUC_UNUSED GOptionContext *context,
+             GDBusConnection *bus,
+             G_GNUC_UNUSED const gchar *argument)
+{
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) usage = NULL;
+   g_autoptr(GError) error = NULL;
+   GVariantIter iter;
+   const gchar *key;
+   GVariant *value = NULL;
+
+   if (!_send_atomupd_message(bus, "GetMemoryUsage", NULL, &reply, &error)) {
+      g_print("An error occurred while getting the memory usage: %s\n", error->message);
+      return EXIT_FAILURE;
+   }
+
+   usage = g_variant_get_child_value(reply, 0);
+
+   g_variant_iter_init(&iter, usage);
+   while (g_variant_iter_loop(&iter, "{&sv}", &key, &value)) {
+      if (!g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64))
+         continue;
+
+      g_print("%s: %" G_GUINT64_FORMAT "\n", key, g_variant_get_uint64(value));
+   }
+
+   return EXIT_SUCCESS;
+}
+
+static int
+helper_stats(G_GNUC_UNUSED GOptionContext *context,
+             GDBusConnection *bus,
+             G_GNUC_UNUSED const gchar *argument)
+{
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) stats = NULL;
+   g_autoptr(GError) error = NULL;
+   GVariantIter kinds_iter;
+   const gchar *kind;
+   GVariant *kind_stats = NULL;
+
+   if (!_send_atomupd_message(bus, "GetHelperStats", NULL, &reply, &error)) {
+      g_print("An error occurred while getting the helpers statistics: %s\n",
+              error->message);
+      return EXIT_FAILURE;
+   }
+
+   stats = g_variant_get_child_value(reply, 0);
+
+   g_variant_iter_init(&kinds_iter, stats);
+   while (g_variant_iter_loop(&kinds_iter, "{&s@a{sv}}", &kind, &kind_stats)) {
+      GVariantIter iter;
+      const gchar *key;
+      GVariant *value = NULL;
+
+      g_print("%s:\n", kind);
+
+      g_variant_iter_init(&iter, kind_stats);
+      while (g_variant_iter_loop(&iter, "{&sv}", &key, &value)) {
+         if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT64))
+            g_print("  %s: %" G_GUINT64_FORMAT "\n", key, g_variant_get_uint64(value));
+         else if (g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32))
+            g_print("  %s: %u\n", key, g_variant_get_uint32(value));
+      }
+   }
+
+   return EXIT_SUCCESS;
+}
+
+static int
+flight_recorder(G_GNUC_UNUSED GOptionContext *context,
+                GDBusConnection *bus,
+                G_GNUC_UNUSED const gchar *argument)
+{
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *events = NULL;
+
+   if (!_send_atomupd_message(bus, "DumpFlightRecorder", NULL, &reply, &error)) {
+      g_print("An error occurred while dumping the flight recorder: %s\n",
+              error->message);
+      return EXIT_FAILURE;
+   }
+
+   g_variant_get(reply, "(&s)", &events);
+   g_print("%s", events);
+
+   return EXIT_SUCCESS;
+}
+
+typedef enum {
+   BENCH_GET_ALL_PROPERTIES,
+   BENCH_CHECK_FOR_UPDATES,
+   BENCH_UPDATES_AVAILABLE,
+   BENCH_GET_BUILDS,
+   BENCH_SWITCH_BRANCH,
+   BENCH_PAUSE_RESUME,
+} BenchCall;
+
+typedef struct {
+   BenchCall call;
+   const gchar *name;
+} BenchCase;
+
+static const BenchCase bench_cases[] = {
+   { BENCH_GET_ALL_PROPERTIES, "get-all-properties" },
+   /* Every call launches the helper, that asks the meta server */
+   { BENCH_CHECK_FOR_UPDATES, "check-for-updates" },
+   /* The result of the last check, as cached by the daemon */
+   { BENCH_UPDATES_AVAILABLE, "updates-available" },
+   /* Only the first call downloads the builds list, if it wasn't already there */
+   { BENCH_GET_BUILDS, "get-builds" },
+   /* Switching to the tracked branch is authorized with polkit, and then it
+    * doesn't change anything */
+   { BENCH_SWITCH_BRANCH, "switch-branch-noop" },
+   { BENCH_PAUSE_RESUME, "pause-resume" },
+};
+
+static gboolean
+bench_call(GDBusConnection *bus, BenchCall call, const gchar *branch, GError **error)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+
+   switch (call) {
+   case BENCH_GET_ALL_PROPERTIES:
+      return _send_properties_message(bus, "GetAll",
+                                      g_variant_new("(s)", AU_ATOMUPD1_INTERFACE),
+                                      NULL, error);
+
+   case BENCH_CHECK_FOR_UPDATES:
+      return _send_atomupd_message(bus, "CheckForUpdates",
+                                   g_variant_new("(a{sv})", &builder), NULL, error);
+
+   case BENCH_UPDATES_AVAILABLE:
+      return _send_properties_message(
+         bus, "Get", g_variant_new("(ss)", AU_ATOMUPD1_INTERFACE, "UpdatesAvailable"),
+         NULL, error);
+
+   case BENCH_GET_BUILDS:
+      return _send_atomupd_message(bus, "GetBuilds",
+                                   g_variant_new("(a{sv})", &builder), NULL, error);
+
+   case BENCH_SWITCH_BRANCH:
+      return _send_atomupd_message(bus, "SwitchToBranch", g_variant_new("(s)", branch),
+                                   NULL, error);
+
+   case BENCH_PAUSE_RESUME:
+      return _send_atomupd_message(bus, "PauseUpdate", NULL, NULL, error) &&
+             _send_atomupd_message(bus, "ResumeUpdate", NULL, NULL, error);
+
+   default:
+      g_return_val_if_reached(FALSE);
+   }
+}
+
+/*
+ * bench_percentile:
+ * @samples: Durations in microseconds, sorted in ascending order
+ * @percentile: From 0 to 100
+ *
+ * Returns: The nearest-rank @percentile of @samples, in milliseconds
+ */
+static gdouble
+bench_percentile(GArray *samples, guint percentile)
+{
+   guint rank = (percentile * samples->len + 99) / 100;
+
+   if (rank > 0)
+      rank--;
+
+   return g_array_index(samples, gint64, rank) / 1000.0;
+}
+
+static gint
+bench_compare_samples(gconstpointer a, gconstpointer b)
+{
+   gint64 sample_a = *(const gint64 *)a;
+   gint64 sample_b = *(const gint64 *)b;
+
+   return (sample_a > sample_b) - (sample_a < sample_b);
+}
+
+static int
+bench_command(G_GNUC_UNUSED GOptionContext *context,
+              GDBusConnection *bus,
+              G_GNUC_UNUSED const gchar *argument)
+{
+   g_autoptr(JsonBuilder) builder = json_builder_new();
+   g_autoptr(GVariant) status_reply = NULL;
+   g_autoptr(GVariant) branch_reply = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *branch;
+   int ret = EXIT_SUCCESS;
+   gsize i;
+
+   if (opt_iterations <= 0) {
+      g_print("The number of iterations must be a positive number\n");
+      return EXIT_FAILURE;
+   }
+
+   branch_reply = get_atomupd_property(bus, "Branch", &error);
+   if (branch_reply != NULL)
+      status_reply = get_atomupd_property(bus, "UpdateStatus", &error);
+
+   if (status_reply == NULL) {
+      g_print("An error occurred while contacting the daemon: %s\n", error->message);
+      return EXIT_FAILURE;
+   }
+
+   branch = g_variant_get_string(branch_reply, NULL);
+
+   json_builder_begin_object(builder);
+   json_builder_set_member_name(builder, "iterations");
+   json_builder_add_int_value(builder, opt_iterations);
+   json_builder_set_member_name(builder, "results");
+   json_builder_begin_object(builder);
+
+   for (i = 0; i < G_N_ELEMENTS(bench_cases); i++) {
+      const BenchCase *bench = &bench_cases[i];
+      g_autoptr(GArray) samples = g_array_sized_new(FALSE, FALSE, sizeof(gint64),
+                                                    opt_iterations);
+      gint64 first = 0;
+      gint j;
+
+      json_builder_set_member_name(builder, bench->name);
+      json_builder_begin_object(builder);
+
+      /* Pausing is only possible while an update is running */
+      if (bench->call == BENCH_PAUSE_RESUME &&
+          g_variant_get_uint32(status_reply) != AU_UPDATE_STATUS_IN_PROGRESS) {
+         json_builder_set_member_name(builder, "skipped");
+         json_builder_add_string_value(builder, "no update in progress");
+         json_builder_end_object(builder);
+
+         if (!opt_json)
+            g_print("%-20s skipped, no update in progress\n", bench->name);
+         continue;
+      }
+
+      for (j = 0; j < opt_iterations; j++) {
+         gint64 start = g_get_monotonic_time();
+         gint64 duration;
+
+         if (!bench_call(bus, bench->call, branch, &error))
+            break;
+
+         duration = g_get_monotonic_time() - start;
+         g_array_append_val(samples, duration);
+
+         if (j == 0)
+            first = duration;
+      }
+
+      if (error != NULL) {
+         json_builder_set_member_name(builder, "error");
+         json_builder_add_string_value(builder, error->message);
+         json_builder_end_object(builder);
+
+         if (!opt_json)
+            g_print("%-20s failed: %s\n", bench->name, error->message);
+
+         g_clear_error(&error);
+         ret = EXIT_FAILURE;
+         continue;
+      }
+
+      g_array_sort(samples, bench_compare_samples);
+
+      json_builder_set_member_name(builder, "min_ms");
+      json_builder_add_double_value(builder, bench_percentile(samples, 0));
+      json_builder_set_member_name(builder, "p50_ms");
+      json_builder_add_double_value(builder, bench_percentile(samples, 50));
+      json_builder_set_member_name(builder, "p99_ms");
+      json_builder_add_double_value(builder, bench_percentile(samples, 99));
+      json_builder_set_member_name(builder, "first_ms");
+      json_builder_add_double_value(builder, first / 1000.0);
+      json_builder_end_object(builder);
+
+      if (!opt_json)
+         g_print("%-20s min %.2f ms, p50 %.2f ms, p99 %.2f ms, first %.2f ms\n",
+                 bench->name, bench_percentile(samples, 0),
+                 bench_percentile(samples, 50), bench_percentile(samples, 99),
+                 first / 1000.0);
+   }
+
+   json_builder_end_object(builder);
+   json_builder_end_object(builder);
+
+   if (opt_json) {
+      g_autoptr(JsonGenerator) generator = json_generator_new();
+      g_autoptr(JsonNode) root = json_builder_get_root(builder);
+      g_autofree gchar *json = NULL;
+
+      json_generator_set_root(generator, root);
+      json_generator_set_pretty(generator, TRUE);
+      json = json_generator_to_data(generator, NULL);
+      g_print("%s\n", json);
+   }
+
+   return ret;
+}
+
 static int
 create_dev_conf(G_GNUC_UNUSED GOptionContext *context,
                 GDBusConnection *bus,
@@ -1198,6 +1533,30 @@ static const LaunchCommands launch_commands[] = {
       .command_function = update_status,
    },
 
+   {
+      .command = "memory-usage",
+      .description = "Get the memory usage of the daemon, in bytes",
+      .command_function = memory_usage,
+   },
+
+   {
+      .command = "helper-stats",
+      .description = "Get the resources used by the helper processes of the daemon",
+      .command_function = helper_stats,
+   },
+
+   {
+      .command = "flight-recorder",
+      .description = "Print the last events recorded by the daemon",
+      .command_function = flight_recorder,
+   },
+
+   {
+      .command = "bench",
+      .description = "Measure the latency of the most common daemon calls",
+      .command_function = bench_command,
+   },
+
    {
       .command = "create-dev-conf",
       .description = "Create a custom client-dev.conf file for the atomic updates",
@@ -1270,6 +1629,7 @@ main(int argc, char *argv[])
    GOptionGroup *dev_config_group = NULL;
    GOptionGroup *list_builds_group = NULL;
    GOptionGroup *custom_update_group = NULL;
+   GOptionGroup *bench_group = NULL;
    g_autoptr(GDBusConnection) bus = NULL;
    g_autofree gchar *summary = NULL;
    GLogLevelFlags log_levels = G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_WARNING;
@@ -1299,6 +1659,11 @@ main(int argc, char *argv[])
    g_option_group_add_entries(custom_update_group, create_custom_update_options);
    g_option_context_add_group(context, custom_update_group);
 
+   bench_group = g_option_group_new("bench", "bench Options:", "Show bench help options",
+                                    NULL, NULL);
+   g_option_group_add_entries(bench_group, create_bench_options);
+   g_option_context_add_group(context, bench_group);
+
    if (!g_option_context_parse(context, &argc, &argv, &error)) {
       g_print("%s\n", error->message);
       return print_usage(context);
@@ -1327,6 +1692,12 @@ main(int argc, char *argv[])
          return print_usage(context);
    }
 
+   if (!g_str_equal(argv[1], "bench")) {
+      /* These options are only relevant for the bench command */
+      if (opt_iterations != BENCH_DEFAULT_ITERATIONS || opt_json)
+         return print_usage(context);
+   }
+
    if (!g_str_equal(argv[1], "list-builds")) {
       /* This option is only relevant for the list-builds command */
       if (opt_variant != NULL)
@@ -1341,6 +1712,17 @@ main(int argc, char *argv[])
    if ((opt_username == NULL && opt_password != NULL) || (opt_username != NULL && opt_password == NULL))
       return print_usage(context);
 
+   if (opt_target != NULL)
+      atomupd_path = g_strdup_printf("%s/%s", AU_ATOMUPD1_PATH, opt_target);
+   else
+      atomupd_path = g_strdup(AU_ATOMUPD1_PATH);
+
+   if (!g_variant_is_object_path(atomupd_path) ||
+       (opt_target != NULL && strchr(opt_target, '/') != NULL)) {
+      g_print("Invalid target name '%s'\n", opt_target);
+      return print_usage(context);
+   }
+
    bus = g_bus_get_sync(opt_session ? G_BUS_TYPE_SESSION : G_BUS_TYPE_SYSTEM, NULL, NULL);
 
    for (gsize i = 0; i < G_N_ELEMENTS(launch_commands); i++) {
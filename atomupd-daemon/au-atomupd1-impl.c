@@ -25,9 +25,15 @@
 
 #include <errno.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <gio/gunixinputstream.h>
 #include <glib-unix.h>
 #include <glib.h>
@@ -35,17 +41,126 @@
 #include <polkit/polkit.h>
 
 #include "au-atomupd1-impl.h"
+#include "builds-catalog.h"
+#include "chunk-scrubber.h"
+#include "flight-recorder.h"
+#include "memory-usage.h"
+#include "mirror-proxy.h"
+#include "peer-server.h"
+#include "power-state.h"
+#include "pressure.h"
+#include "proxy-probe.h"
+#include "rollout.h"
+#include "supervisor.h"
 #include "utils.h"
 
 #include <json-glib/json-glib.h>
 
 /* The version of this interface, exposed in the "Version" property */
-guint ATOMUPD_VERSION = 8;
+guint ATOMUPD_VERSION = 22;
 
 const gchar *AU_CONFIG = "client.conf";
 const gchar *AU_DEV_CONFIG = "client-dev.conf";
 const gchar *AU_REMOTE_INFO = "remote-info.conf";
+const gchar *AU_PREFERENCES = "preferences.conf";
+const gchar *AU_UPDATES_JSON = "atomupd-updates.json";
 const gchar *AU_BUILDS_LIST = "builds.json";
+/* Maximum number of builds lists that are prefetched at the same time */
+const guint AU_BUILDS_PREFETCH_MAX_JOBS = 2;
+/* Maximum number of targets, and of concurrent helpers, for CheckForUpdatesMulti() */
+const guint AU_CHECK_MULTI_MAX_TARGETS = 16;
+const guint AU_CHECK_MULTI_MAX_JOBS = 3;
+/* Default maximum size of an update bundle that we are allowed to pre-warm */
+const guint64 AU_PREWARM_DEFAULT_MAX_SIZE = 64 * 1024 * 1024;
+/* Default TCP port used to serve the local chunk cache to the other machines */
+const guint16 AU_PEER_SERVER_DEFAULT_PORT = 7878;
+/* Values of the "PauseReason" property */
+const gchar *AU_PAUSE_REASON_USER = "user";
+const gchar *AU_PAUSE_REASON_NETWORK_OFFLINE = "network-offline";
+const gchar *AU_PAUSE_REASON_NETWORK_METERED = "network-metered";
+const gchar *AU_PAUSE_REASON_BATTERY_LOW = "battery-low";
+const gchar *AU_PAUSE_REASON_OVERHEATING = "overheating";
+/* Values of the "ThrottleState" property */
+const gchar *AU_THROTTLE_STATE_NONE = "none";
+const gchar *AU_THROTTLE_STATE_REDUCED = "reduced";
+const gchar *AU_THROTTLE_STATE_IDLE = "idle";
+/* Seconds between two checks of the power and thermal state during an update */
+const guint AU_POWER_POLL_INTERVAL = 30;
+/* Margin, in Celsius and battery percentage, required before resuming an update
+ * that has been paused by the power policy. This avoids continuously pausing and
+ * resuming it when we are near the thresholds. */
+const gint AU_POWER_HYSTERESIS = 5;
+/* Niceness and best-effort I/O priority level of the throttled install processes */
+const gint AU_THROTTLE_NICENESS = 10;
+const gint AU_THROTTLE_IO_LEVEL = 7;
+/* Niceness of the install processes when they should only use the idle time */
+const gint AU_THROTTLE_IDLE_NICENESS = 19;
+const gchar *AU_SYSFS_PATH = "/sys";
+/* Limits of SubscribeProgress(), the intervals are in milliseconds */
+const guint AU_PROGRESS_MAX_SUBSCRIBERS = 32;
+const guint AU_PROGRESS_MAX_SUBSCRIBERS_PER_USER = 4;
+const guint AU_PROGRESS_DEFAULT_INTERVAL = 1000;
+const guint AU_PROGRESS_MIN_INTERVAL = 50;
+const guint AU_PROGRESS_MAX_INTERVAL = 60000;
+/* Seconds to wait after a large transient work before releasing the free memory,
+ * so that a burst of requests only causes a single release */
+const guint AU_MEMORY_RELEASE_DELAY = 2;
+const gchar *AU_PROC_STATUS_PATH = "/proc/self/status";
+const gchar *AU_PROC_PATH = "/proc";
+/* Seconds after which an update query is considered failed */
+const guint AU_QUERY_DEFAULT_TIMEOUT = 120;
+/* Milliseconds to wait before hedging a query, while we don't have enough samples
+ * of the usual query latency */
+const guint AU_QUERY_HEDGE_DEFAULT_DELAY = 10000;
+const guint AU_QUERY_HEDGE_MIN_DELAY = 1000;
+/* Queries slower than this percentile of the previous ones get hedged */
+const guint AU_QUERY_HEDGE_PERCENTILE = 95;
+const guint AU_QUERY_LATENCY_MIN_SAMPLES = 5;
+#define AU_QUERY_LATENCY_SAMPLES 32
+/* The original query and the hedged one */
+#define AU_QUERY_MAX_ATTEMPTS 2
+const gchar *AU_HEDGE_CONFIG = "client-hedge.conf";
+/* Configuration of the update helper, when it goes through the mirror proxy */
+const gchar *AU_UPDATE_CONFIG = "client-update.conf";
+/* Seconds for which the reachability of the meta server is cached */
+const guint AU_REACHABILITY_CACHE_TIME = 30;
+const gchar *AU_ERROR_OFFLINE = "com.steampowered.Atomupd1.Error.Offline";
+/* Seconds without any progress after which a running update is considered stalled */
+const guint AU_STALL_DEFAULT_TIMEOUT = 300;
+/* How many times a stalled update is restarted before giving up */
+const guint AU_STALL_DEFAULT_RETRIES = 3;
+/* Maximum seconds a WaitForChange() request can wait for */
+const guint AU_WAIT_FOR_CHANGE_MAX_TIMEOUT = 600;
+/* Maximum WaitForChange() requests that can be pending, in total and for each user */
+const guint AU_WAIT_FOR_CHANGE_MAX_PENDING = 64;
+const guint AU_WAIT_FOR_CHANGE_MAX_PER_USER = 8;
+/* Written in the run directory when an update fails */
+const gchar *AU_FLIGHT_RECORDER_DUMP = "flight-recorder.log";
+/* Default seconds between two scrubs of the chunk cache, each one reads it all */
+const guint AU_SCRUB_DEFAULT_INTERVAL = 7 * 24 * 60 * 60;
+/* Seconds between two checks of whether the system is idle enough to scrub */
+const guint AU_SCRUB_POLL_INTERVAL = 60;
+/* Share of CPU time used by the other tasks above which the scrub is paused */
+const guint AU_SCRUB_MAX_BUSY_PERCENTAGE = 25;
+const gchar *AU_PROC_STAT_PATH = "/proc/stat";
+/* Seconds between two samples of the pressure stall information during an update */
+const guint AU_PRESSURE_POLL_INTERVAL = 2;
+/* Default share of time, in percent, in which the foreground tasks can be
+ * stalled before the update backs off, and below which it speeds up again */
+const gdouble AU_PRESSURE_DEFAULT_HIGH = 10;
+const gdouble AU_PRESSURE_DEFAULT_LOW = 2;
+/* Consecutive calm samples required before speeding up the update by one level */
+const guint AU_PRESSURE_CALM_SAMPLES = 5;
+const gchar *AU_CGROUP_PATH = "/sys/fs/cgroup";
+/* Default cgroup of the foreground tasks, relative to AU_CGROUP_PATH */
+const gchar *AU_PRESSURE_DEFAULT_FOREGROUND_CGROUP = "user.slice";
+/* Default seconds between two probes of the HTTP proxy and of the direct path */
+const guint AU_PROXY_PROBE_DEFAULT_INTERVAL = 300;
+/* Minimum seconds between two probes triggered by failed downloads */
+const guint AU_PROXY_PROBE_MIN_INTERVAL = 30;
+/* Stable identifier of this device, used to place it in the staged rollouts */
+const gchar *AU_MACHINE_ID_PATH = "/etc/machine-id";
+
 const gchar *AU_DEFAULT_MANIFEST = "/etc/steamos-atomupd/manifest.json";
 const gchar *AU_DEFAULT_UPDATE_JSON = "/run/atomupd-daemon/atomupd-updates.json";
 const gchar *AU_DEFAULT_TRUSTED_KEYS = "/etc/rauc/trusted_keys";
@@ -75,6 +190,23 @@ const gchar *AU_DESYNC_CONFIG_PATH = "/etc/desync/config.json";
 
 const gchar *AU_NETRC_PATH = "/root/.netrc";
 
+/* Servers that can be reached either through the HTTP proxy or directly */
+typedef enum {
+   AU_PROXY_HOST_META,
+   AU_PROXY_HOST_IMAGES,
+   AU_N_PROXY_HOSTS,
+} AuProxyHost;
+
+typedef struct {
+   AuProxyRoute route;
+   /* Latencies measured by the last probe, in microseconds, -1 if the path
+    * didn't work */
+   gint64 proxy_latency;
+   gint64 direct_latency;
+   /* Unix time of the last probe, or 0 if it has never been probed */
+   guint64 last_probe;
+} AuProxyHostState;
+
 struct _AuAtomupd1Impl {
    AuAtomupd1Skeleton parent_instance;
 
@@ -82,7 +214,16 @@ struct _AuAtomupd1Impl {
    gulong debug_controller_id;
    PolkitAuthority *authority;
    GPid install_pid;
-   guint install_event_source;
+   /* The running update helper, owned by the supervisor */
+   AuChild *install_child;
+   /* PID of the install helper that has been throttled, or 0, and the priority
+    * that it had before being throttled */
+   GPid throttled_pid;
+   gint install_niceness;
+   gint install_ioprio;
+   /* PID -> AuPriority, the priority that each RAUC process had before being
+    * throttled */
+   GHashTable *rauc_priorities;
    gchar *config_path;
    gchar *config_directory;
    gchar *manifest_path;
@@ -90,7 +231,27 @@ struct _AuAtomupd1Impl {
    gchar *product;
    gchar *architecture;
    gchar *meta_url;
+   /* Additional servers with the same content of meta_url, or %NULL */
+   gchar **meta_mirrors;
+   /* Seconds after which an update query is considered failed */
+   guint query_timeout;
+   /* Ring buffer with the duration of the latest successful queries, in microseconds */
+   gint64 query_latencies[AU_QUERY_LATENCY_SAMPLES];
+   guint n_query_latencies;
+   guint next_query_latency;
    gchar *images_url;
+   /* Additional servers with the same content of images_url, or %NULL */
+   gchar **images_mirrors;
+   AuMirrorProxy *mirror_proxy;
+   /* Choose, for each server, whether to go through the HTTP proxy or not */
+   gboolean proxy_auto_select;
+   /* Seconds between two probes, 0 to only probe after a failed download */
+   guint proxy_probe_interval;
+   guint proxy_probe_source;
+   gboolean proxy_probe_in_progress;
+   /* Monotonic time of the start of the last probe */
+   gint64 proxy_last_probe;
+   AuProxyHostState proxy_hosts[AU_N_PROXY_HOSTS];
    GFile *updates_json_file;
    GFile *updates_json_copy;
    GDataInputStream *start_update_stdout_stream;
@@ -98,6 +259,106 @@ struct _AuAtomupd1Impl {
    gint64 buildid_increment;
    gboolean info_dl_in_progress;
    gboolean is_using_dev_config;
+   /* Build ID -> AuRollout, from the remote info */
+   GHashTable *rollouts;
+   /* Variant name -> AuBuildsCatalog */
+   GHashTable *builds_catalogs;
+   /* Variant name -> GPtrArray of BuildsData waiting for the download to complete */
+   GHashTable *builds_downloads;
+   /* Variant names whose builds list needs to be prefetched */
+   GQueue *builds_prefetch_queue;
+   guint n_builds_prefetches;
+   /* Whether the update bundle should be downloaded right after CheckForUpdates() */
+   gboolean prewarm_enabled;
+   guint64 prewarm_max_size;
+   /* Buildid of the update bundle that is currently being pre-warmed, if any */
+   gchar *prewarm_in_progress;
+   /* Desync local chunk store that is shared with the other machines in the network */
+   gchar *chunk_cache;
+   /* URLs of the chunk stores served by the other machines in the network */
+   gchar **peer_stores;
+   AuPeerServer *peer_server;
+   /* Verifies the chunk cache while the system is idle, or %NULL */
+   AuChunkScrubber *chunk_scrubber;
+   /* Seconds between two scrubs */
+   guint scrub_interval;
+   guint scrub_poll_source;
+   /* CPU times at the previous check of whether the system is idle */
+   AuCpuTimes scrub_cpu_times;
+   /* Network conditions that automatically pause a running update */
+   gboolean pause_when_offline;
+   gboolean pause_when_metered;
+   GNetworkMonitor *network_monitor;
+   gulong network_changed_id;
+   gulong network_metered_id;
+   gulong network_connectivity_id;
+   GFileMonitor *network_state_monitor;
+   /* Cached reachability of the meta server, valid until the monotonic time
+    * reachability_expiry */
+   gboolean meta_reachable;
+   gint64 reachability_expiry;
+   /* An update check was skipped because we were offline, repeat it once the
+    * connectivity returns */
+   gboolean recheck_when_online;
+   /* At least one update check succeeded, so the UpdatesAvailable properties
+    * can be used as a cached result */
+   gboolean have_query_result;
+   /* Power and thermal conditions that throttle or pause a running update,
+    * zero if not set */
+   gboolean throttle_on_battery;
+   gint pause_below_battery_level;
+   gint throttle_above_temperature;
+   gint pause_above_temperature;
+   guint power_poll_source;
+   /* Slows down the running update while the foreground tasks are stalled, or
+    * %NULL if the pressure policy is disabled */
+   AuPressureController *pressure_controller;
+   guint pressure_poll_source;
+   /* Directory of the cgroup whose stalls are measured */
+   gchar *pressure_foreground_dir;
+   /* Name of this additional target, or %NULL for the image of the running system */
+   gchar *target_name;
+   /* For additional targets, the object of the running system (borrowed) */
+   AuAtomupd1Impl *primary;
+   /* For the running system, its additional targets */
+   GPtrArray *targets;
+   /* Paths used instead of the system wide ones, for additional targets */
+   gchar *target_run_path;
+   gchar *target_preferences_path;
+   gchar *target_remote_info_path;
+   /* Estimated download size of the update in progress, 0 if unknown */
+   guint64 update_size;
+   /* Estimated downloaded bytes and download rate of the update in progress */
+   guint64 progress_bytes;
+   guint64 progress_rate;
+   /* Monotonic time of the last progress update */
+   gint64 progress_timestamp;
+   /* ProgressSubscriber */
+   GPtrArray *progress_subscribers;
+   /* Used to forget the requests of the clients that leave the bus */
+   GDBusConnection *bus;
+   guint name_owner_changed_id;
+   /* Seconds without progress after which the update is restarted, 0 if disabled */
+   guint stall_timeout;
+   guint stall_retries;
+   guint stall_watchdog_source;
+   /* Monotonic time of the last forward progress of the update, and the
+    * percentage and bytes transferred by the install processes at that time */
+   gint64 last_progress_time;
+   gdouble last_progress_percentage;
+   guint64 last_io_bytes;
+   /* Helper command line of the update in progress, used to restart it */
+   GPtrArray *update_argv;
+   guint memory_release_source;
+   /* Resident memory given back to the system so far, in bytes */
+   guint64 memory_released;
+   /* Incremented every time one of the exported properties changes */
+   guint64 state_generation;
+   /* D-Bus property name -> guint64 generation of its last change */
+   GHashTable *property_generations;
+   /* StateWaiter */
+   GPtrArray *state_waiters;
+   guint state_waiters_source;
 };
 
 typedef struct {
@@ -107,14 +368,102 @@ typedef struct {
 
 typedef struct {
    RequestData *req;
-   gint standard_output;
+   GBytes *standard_output;
+   /* Last message printed by the helper on its standard error, if any */
+   gchar *helper_message;
+   gboolean ignore_rollout;
 } QueryData;
 
 typedef struct {
    RequestData *req;
+   gboolean penultimate;
+   gboolean allow_cached;
+   gboolean ignore_rollout;
+} ReachabilityData;
+
+typedef struct _QueryRace QueryRace;
+
+typedef struct {
+   QueryRace *race; /* borrowed */
+   AuChild *child;  /* borrowed, owned by the supervisor */
+   gint64 start_time;
+   gboolean running;
+} QueryAttempt;
+
+/* A CheckForUpdates() request, with its original query and the eventual hedged
+ * query against an alternate meta server */
+struct _QueryRace {
+   AuAtomupd1 *object;
+   /* %NULL once the request has been answered */
+   QueryData *data;
+   QueryAttempt attempts[AU_QUERY_MAX_ATTEMPTS];
+   guint n_attempts;
+   guint n_running;
+   guint hedge_source;
+   guint timeout_source;
+   gchar *variant;
+   gchar *branch;
+   gboolean penultimate;
+};
+
+typedef struct {
+   RequestData *req;
+   gchar *variant;
    gchar *builds_path;
+   /* %NULL for GetBuilds() requests */
+   AuBuildsQuery *query;
+   guint limit;
 } BuildsData;
 
+typedef struct {
+   AuAtomupd1Impl *self;
+   gchar *variant;
+   gboolean is_prefetch;
+} BuildsDownloadData;
+
+typedef struct {
+   RequestData *req;
+   /* Queue of MultiQueryTarget that still need to be launched */
+   GQueue *pending;
+   /* "variant/branch" -> a{sv} with the result of the query */
+   GHashTable *results;
+   /* The "variant/branch" keys, in the requested order */
+   GPtrArray *keys;
+   guint n_running;
+   gboolean penultimate;
+   gboolean ignore_rollout;
+} MultiQueryData;
+
+typedef struct {
+   MultiQueryData *multi; /* borrowed */
+   gchar *variant;
+   gchar *branch;
+   gchar *key;
+} MultiQueryTarget;
+
+typedef struct {
+   AuAtomupd1Impl *self; /* borrowed */
+   /* Unique bus name of the client */
+   gchar *sender;
+   /* Unix user of the client, a user can open several connections */
+   guint32 uid;
+   gint fd;
+   guint source_id;
+} ProgressSubscriber;
+
+typedef struct {
+   AuAtomupd1Impl *self; /* borrowed */
+   GDBusMethodInvocation *invocation;
+   /* Unique bus name of the client */
+   gchar *sender;
+   /* Unix user of the client, a user can open several connections */
+   guint32 uid;
+   guint64 known_generation;
+   /* %NULL to wait for any property */
+   GStrv properties;
+   guint timeout_source;
+} StateWaiter;
+
 typedef struct {
    const gchar *expanded;
    const gchar *contracted;
@@ -166,31 +515,147 @@ _query_data_free(QueryData *self)
 {
    _request_data_free(self->req);
 
-   if (self->standard_output > -1)
-      g_close(self->standard_output, NULL);
+   g_clear_pointer(&self->standard_output, g_bytes_unref);
+   g_free(self->helper_message);
 
    g_slice_free(QueryData, self);
 }
 
+static void
+_reachability_data_free(ReachabilityData *self)
+{
+   _request_data_free(self->req);
+
+   g_slice_free(ReachabilityData, self);
+}
+
+static void
+_query_race_free(QueryRace *self)
+{
+   g_clear_handle_id(&self->hedge_source, g_source_remove);
+   g_clear_handle_id(&self->timeout_source, g_source_remove);
+
+   g_clear_pointer(&self->data, _query_data_free);
+   g_clear_object(&self->object);
+   g_free(self->variant);
+   g_free(self->branch);
+
+   g_slice_free(QueryRace, self);
+}
+
 static void
 _builds_data_free(BuildsData *self)
 {
    _request_data_free(self->req);
 
+   g_free(self->variant);
    g_free(self->builds_path);
 
+   if (self->query != NULL) {
+      au_builds_query_clear(self->query);
+      g_free(self->query);
+   }
+
    g_slice_free(BuildsData, self);
 }
 
+static void
+_builds_download_data_free(BuildsDownloadData *self)
+{
+   g_clear_object(&self->self);
+   g_free(self->variant);
+
+   g_slice_free(BuildsDownloadData, self);
+}
+
+static void
+_multi_query_target_free(MultiQueryTarget *self)
+{
+   g_free(self->variant);
+   g_free(self->branch);
+   g_free(self->key);
+
+   g_slice_free(MultiQueryTarget, self);
+}
+
+static void
+_multi_query_data_free(MultiQueryData *self)
+{
+   _request_data_free(self->req);
+
+   g_queue_free_full(self->pending, (GDestroyNotify)_multi_query_target_free);
+   g_hash_table_unref(self->results);
+   g_ptr_array_unref(self->keys);
+
+   g_slice_free(MultiQueryData, self);
+}
+
+static void
+_progress_subscriber_free(ProgressSubscriber *self)
+{
+   g_clear_handle_id(&self->source_id, g_source_remove);
+
+   if (self->fd > -1)
+      g_close(self->fd, NULL);
+
+   g_free(self->sender);
+   g_slice_free(ProgressSubscriber, self);
+}
+
+static void
+_state_waiter_free(StateWaiter *self)
+{
+   g_clear_handle_id(&self->timeout_source, g_source_remove);
+
+   if (self->invocation != NULL)
+      g_dbus_method_invocation_return_error(g_steal_pointer(&self->invocation),
+                                            G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                                            "Request was freed without being handled");
+
+   g_strfreev(self->properties);
+   g_free(self->sender);
+
+   g_slice_free(StateWaiter, self);
+}
+
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(RequestData, _request_data_free)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(QueryData, _query_data_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(QueryRace, _query_race_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(ReachabilityData, _reachability_data_free)
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(BuildsData, _builds_data_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(BuildsDownloadData, _builds_download_data_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(MultiQueryData, _multi_query_data_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(MultiQueryTarget, _multi_query_target_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(StateWaiter, _state_waiter_free)
 
 static QueryData *
 au_query_data_new(void)
 {
    QueryData *data = g_slice_new0(QueryData);
-   data->standard_output = -1;
+
+   data->req = g_slice_new0(RequestData);
+
+   return data;
+}
+
+static ReachabilityData *
+au_reachability_data_new(void)
+{
+   ReachabilityData *data = g_slice_new0(ReachabilityData);
+
+   data->req = g_slice_new0(RequestData);
+
+   return data;
+}
+
+static MultiQueryData *
+au_multi_query_data_new(void)
+{
+   MultiQueryData *data = g_slice_new0(MultiQueryData);
+   data->pending = g_queue_new();
+   data->results = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                         (GDestroyNotify)g_variant_unref);
+   data->keys = g_ptr_array_new_with_free_func(g_free);
 
    data->req = g_slice_new0(RequestData);
 
@@ -201,7 +666,9 @@ static BuildsData *
 au_builds_data_new(void)
 {
    BuildsData *data = g_slice_new0(BuildsData);
+   data->variant = NULL;
    data->builds_path = NULL;
+   data->query = NULL;
 
    data->req = g_slice_new0(RequestData);
 
@@ -271,10 +738,13 @@ _au_get_fallback_config_path(void)
 }
 
 static const gchar *
-_au_get_user_preferences_file_path(void)
+_au_get_user_preferences_file_path(AuAtomupd1Impl *self)
 {
    static const gchar *user_preferences_file = NULL;
 
+   if (self->target_name != NULL)
+      return self->target_preferences_path;
+
    if (user_preferences_file == NULL) {
       /* This environment variable is used for debugging and automated tests */
       user_preferences_file = g_getenv("AU_USER_PREFERENCES_FILE");
@@ -287,10 +757,13 @@ _au_get_user_preferences_file_path(void)
 }
 
 static const gchar *
-_au_get_remote_info_path(void)
+_au_get_remote_info_path(AuAtomupd1Impl *self)
 {
    static const gchar *remote_info = NULL;
 
+   if (self->target_name != NULL)
+      return self->target_remote_info_path;
+
    if (remote_info == NULL) {
       /* This environment variable is used for debugging and automated tests */
       remote_info = g_getenv("AU_REMOTE_INFO_PATH");
@@ -302,8 +775,71 @@ _au_get_remote_info_path(void)
    return remote_info;
 }
 
+static const gchar *
+_au_get_run_path(AuAtomupd1Impl *self)
+{
+   const gchar *run_path = NULL;
+
+   if (self->target_name != NULL)
+      return self->target_run_path;
+
+   /* This environment variable is used for debugging and automated tests */
+   run_path = g_getenv("AU_RUN_PATH");
+   if (run_path == NULL)
+      run_path = AU_RUN_PATH;
+
+   return run_path;
+}
+
+/*
+ * _au_read_test_network_state:
+ * @network_state_out: (out) (transfer full) (nullable): Used to return the
+ *  network state to assume, either "online", "offline" or "metered", or
+ *  %NULL if it is not known
+ *
+ * Returns: %TRUE if the network state is taken from the file set in
+ *  `AU_NETWORK_STATE_PATH`, instead of the GNetworkMonitor
+ */
+static gboolean
+_au_read_test_network_state(gchar **network_state_out)
+{
+   const gchar *network_state_path;
+   g_autofree gchar *network_state = NULL;
+
+   *network_state_out = NULL;
+
+   /* This environment variable is used for debugging and automated tests */
+   network_state_path = g_getenv("AU_NETWORK_STATE_PATH");
+   if (network_state_path == NULL)
+      return FALSE;
+
+   if (g_file_get_contents(network_state_path, &network_state, NULL, NULL))
+      *network_state_out = g_strstrip(g_steal_pointer(&network_state));
+
+   return TRUE;
+}
+
+/*
+ * _au_get_prewarm_path:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @buildid: (not nullable): The buildid of the update
+ *
+ * Returns: (transfer full): The path where the pre-warmed RAUC bundle of
+ *  @buildid is stored
+ */
+static gchar *
+_au_get_prewarm_path(AuAtomupd1Impl *self, const gchar *buildid)
+{
+   g_autofree gchar *prewarm_filename = NULL;
+
+   prewarm_filename = g_strdup_printf("prewarm-%s.raucb", buildid);
+
+   return g_build_filename(_au_get_run_path(self), prewarm_filename, NULL);
+}
+
 /*
  * _au_update_user_preferences:
+ * @user_prefs_path: (not nullable): Path to the preferences file
  * @variant: Which variant to track
  * @branch: Which branch to track
  * @http_proxy: (nullable): Which HTTP/HTTPS proxy to use, if any
@@ -312,12 +848,12 @@ _au_get_remote_info_path(void)
  * Returns: %TRUE if the user preferences were successfully written to a file
  */
 static gboolean
-_au_update_user_preferences(const gchar *variant,
+_au_update_user_preferences(const gchar *user_prefs_path,
+                            const gchar *variant,
                             const gchar *branch,
                             GVariant *http_proxy,
                             GError **error)
 {
-   const gchar *user_prefs_path = _au_get_user_preferences_file_path();
    g_autoptr(GKeyFile) preferences = g_key_file_new();
    g_autoptr(GError) local_error = NULL;
 
@@ -392,6 +928,7 @@ _au_convert_from_legacy_variant(const gchar *legacy_variant,
 /*
  * _au_load_legacy_preferences:
  * @branch_file_path: (not nullable): Path to the legacy steamos-branch file
+ * @user_prefs_path: (not nullable): Path to the preferences file to migrate to
  * @variant_out: (out): Used to return the tracked variant
  * @branch_out: (out): Used to return the tracked branch
  * @error: Used to raise an error on failure
@@ -403,6 +940,7 @@ _au_convert_from_legacy_variant(const gchar *legacy_variant,
  */
 static gboolean
 _au_load_legacy_preferences(const gchar *branch_file_path,
+                            const gchar *user_prefs_path,
                             gchar **variant_out,
                             gchar **branch_out,
                             GError **error)
@@ -411,7 +949,6 @@ _au_load_legacy_preferences(const gchar *branch_file_path,
    g_autofree gchar *branch = NULL;
    g_autofree gchar *legacy_variant = NULL;
    gsize len;
-   const gchar *user_prefs_path = _au_get_user_preferences_file_path();
 
    g_return_val_if_fail(branch_file_path != NULL, FALSE);
    g_return_val_if_fail(variant_out != NULL && *variant_out == NULL, FALSE);
@@ -461,7 +998,7 @@ _au_load_legacy_preferences(const gchar *branch_file_path,
                             branch_file_path);
    }
 
-   if (!_au_update_user_preferences(variant, branch, NULL, error)) {
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, NULL, error)) {
       g_warning("An error occurred while migrating to the new '%s' file: %s",
                 user_prefs_path, (*error)->message);
       return FALSE;
@@ -568,6 +1105,7 @@ _au_get_default_branch(const gchar *manifest);
 /*
  * _au_load_preferences_from_manifest:
  * @manifest_path: (not nullable): Path to the image manifest file
+ * @user_prefs_path: (not nullable): Path to the preferences file to update
  * @variant_out: (out): Used to return the tracked variant
  * @branch_out: (out): Used to return the tracked branch
  * @error: Used to raise an error on failure
@@ -578,6 +1116,7 @@ _au_get_default_branch(const gchar *manifest);
  */
 static gboolean
 _au_load_preferences_from_manifest(const gchar *manifest_path,
+                                   const gchar *user_prefs_path,
                                    gchar **variant_out,
                                    gchar **branch_out,
                                    GError **error)
@@ -602,7 +1141,8 @@ _au_load_preferences_from_manifest(const gchar *manifest_path,
 
    branch = _au_get_default_branch(manifest_path);
 
-   if (!_au_update_user_preferences(variant, branch, NULL, &local_error)) {
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, NULL,
+                                    &local_error)) {
       /* If we can't save the preferences file, e.g. because /etc is full, we
        * try to continue anyway */
       g_warning("Failed to save the preferences: %s", local_error->message);
@@ -1252,22 +1792,287 @@ _au_switch_to_variant(AuAtomupd1 *object,
                       gboolean clear_available_updates,
                       GError **error);
 
+static void
+_au_prefetch_builds_lists(AuAtomupd1Impl *self);
+
+static void
+_au_prewarm_update_bundle(AuAtomupd1Impl *self, const gchar *output, GVariant *available);
+
 static gboolean
 _au_switch_to_branch(AuAtomupd1 *object, gchar *branch, GError **error);
 
+/*
+ * _au_parse_query_output:
+ * @standard_output: (not nullable): The output of the helper
+ * @updated_build_id: (nullable): Build ID of the update that has already been
+ *  applied, if any
+ * @output_out: (out) (transfer full): Used to return the JSON printed by the
+ *  helper, or %NULL if there are no available updates
+ * @available: (out) (transfer full) (not optional): Map of available updates
+ * @available_later: (out) (transfer full) (not optional): Map of updates that
+ *  require a newer system version
+ * @replacement_eol_variant: (out) (transfer full) (not optional): The variant
+ *  proposed by the server as a replacement, if the requested one is EOL
+ * @error: Used to raise an error on failure
+ *
+ * Read and parse the output of `steamos-atomupd-client --query-only`.
+ *
+ * Returns: %TRUE on success
+ */
+static gboolean
+_au_parse_query_output(GBytes *standard_output,
+                       const gchar *updated_build_id,
+                       gchar **output_out,
+                       GVariant **available,
+                       GVariant **available_later,
+                       gchar **replacement_eol_variant,
+                       GError **error)
+{
+   g_autoptr(JsonNode) json_node = NULL;
+   g_autoptr(GError) local_error = NULL;
+   g_autofree gchar *output = NULL;
+   gconstpointer out_data;
+   gsize out_length;
+
+   g_return_val_if_fail(standard_output != NULL, FALSE);
+   g_return_val_if_fail(output_out != NULL && *output_out == NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   out_data = g_bytes_get_data(standard_output, &out_length);
+   output = g_strndup(out_data, out_length);
+
+   if (out_length == 0 || output[0] == '\0') {
+      /* In theory when no updates are available we should receive an empty
+       * JSON object (i.e. {}). Is it okay to assume no updates or should we
+       * throw an error here? */
+      *available = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
+      *available_later = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
+      return TRUE;
+   }
+
+   if (out_length != strlen(output)) {
+      /* This might happen if there is the terminating null byte '\0' followed
+       * by some other data */
+      return au_throw_error(error, "Helper output is not valid JSON: contains \\0");
+   }
+
+   json_node = json_from_string(output, &local_error);
+   if (json_node == NULL) {
+      if (local_error == NULL) {
+         /* The helper returned an empty JSON, there are no available updates */
+         *available = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
+         *available_later = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
+         return TRUE;
+      } else {
+         return au_throw_error(error, "The helper output is not a valid JSON: %s",
+                               local_error->message);
+      }
+   }
+
+   if (!_au_parse_candidates(json_node, updated_build_id, available, available_later,
+                             replacement_eol_variant, &local_error)) {
+      return au_throw_error(error,
+                            "An error occurred while parsing the helper output JSON: %s",
+                            local_error->message);
+   }
+
+   *output_out = g_steal_pointer(&output);
+   return TRUE;
+}
+
+static gboolean
+_au_memory_release_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+   AuMemoryUsage before;
+   AuMemoryUsage after;
+
+   self->memory_release_source = 0;
+
+   au_memory_usage_read(AU_PROC_STATUS_PATH, &before);
+   au_memory_release();
+   au_memory_usage_read(AU_PROC_STATUS_PATH, &after);
+
+   if (before.rss > after.rss)
+      self->memory_released += before.rss - after.rss;
+
+   g_debug("Released the free memory, RSS went from %" G_GUINT64_FORMAT
+           " kB to %" G_GUINT64_FORMAT " kB",
+           before.rss / 1024, after.rss / 1024);
+
+   return G_SOURCE_REMOVE;
+}
+
+/*
+ * _au_schedule_memory_release:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Give the free memory back to the system shortly after a large transient
+ * work, e.g. parsing the helper output or a builds list. The JsonParser trees
+ * are freed right away, but the allocator rarely returns their arenas.
+ */
+static void
+_au_schedule_memory_release(AuAtomupd1Impl *self)
+{
+   if (self->memory_release_source != 0)
+      return;
+
+   self->memory_release_source =
+      g_timeout_add_seconds(AU_MEMORY_RELEASE_DELAY, _au_memory_release_cb, self);
+}
+
+/*
+ * _au_query_return_error:
+ * @data: (not nullable): The update query
+ * @code: A #GDBusError
+ * @format: printf()-style format of the error message
+ *
+ * Reply to the CheckForUpdates() request with an error. Automatic update
+ * checks don't have anybody to reply to, so their errors are just logged.
+ */
+static void G_GNUC_PRINTF(3, 4)
+_au_query_return_error(QueryData *data, GDBusError code, const gchar *format, ...)
+{
+   g_autofree gchar *message = NULL;
+   va_list args;
+
+   va_start(args, format);
+   message = g_strdup_vprintf(format, args);
+   va_end(args);
+
+   au_flight_record(AU_FLIGHT_EVENT_ERROR, code, message);
+
+   if (data->req->invocation == NULL) {
+      g_info("The automatic update check failed: %s", message);
+      return;
+   }
+
+   g_dbus_method_invocation_return_error_literal(g_steal_pointer(&data->req->invocation),
+                                                 G_DBUS_ERROR, code, message);
+}
+
+/*
+ * _au_apply_rollout_gate:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @available: (inout) (not optional): Map of available updates
+ * @available_later: (inout) (not optional): Map of updates that require a newer
+ *  system version
+ *
+ * Hide the builds whose staged rollout, from the remote info, has not reached
+ * this device yet. Each update requires the previous one, so all the builds
+ * after a hidden one are hidden too.
+ */
+static void
+_au_apply_rollout_gate(AuAtomupd1Impl *self,
+                       GVariant **available,
+                       GVariant **available_later)
+{
+   GVariant **maps[] = { available, available_later };
+   g_autofree gchar *machine_id = NULL;
+   const gchar *machine_id_path;
+   gboolean hidden = FALSE;
+   gint64 now;
+   gsize i;
+
+   if (self->rollouts == NULL || g_hash_table_size(self->rollouts) == 0)
+      return;
+
+   /* This environment variable is used for debugging and automated tests */
+   machine_id_path = g_getenv("AU_MACHINE_ID_PATH");
+   if (machine_id_path == NULL)
+      machine_id_path = AU_MACHINE_ID_PATH;
+
+   machine_id = au_rollout_read_machine_id(machine_id_path);
+   if (machine_id == NULL) {
+      g_debug("Unable to read the machine ID, the staged rollouts are ignored");
+      return;
+   }
+
+   now = g_get_real_time() / G_USEC_PER_SEC;
+
+   for (i = 0; i < G_N_ELEMENTS(maps); i++) {
+      g_auto(GVariantBuilder) builder =
+         G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sa{sv}}"));
+      const gchar *build_id = NULL; /* borrowed */
+      GVariant *values = NULL;      /* borrowed */
+      GVariantIter iter;
+
+      g_variant_iter_init(&iter, *maps[i]);
+      while (g_variant_iter_loop(&iter, "{&s@a{sv}}", &build_id, &values)) {
+         const AuRollout *rollout = g_hash_table_lookup(self->rollouts, build_id);
+
+         if (!hidden && rollout != NULL &&
+             !au_rollout_is_exposed(rollout, machine_id, build_id, now)) {
+            g_info("The update %s is currently rolled out to %.2f%% of the devices, "
+                   "not including this one",
+                   build_id, au_rollout_get_percentage(rollout, now));
+            hidden = TRUE;
+         }
+
+         if (!hidden)
+            g_variant_builder_add(&builder, "{s@a{sv}}", build_id, values);
+      }
+
+      g_variant_unref(*maps[i]);
+      *maps[i] = g_variant_ref_sink(g_variant_builder_end(&builder));
+   }
+}
+
+/*
+ * _au_dup_helper_message:
+ * @child: (not nullable): A helper that exited
+ *
+ * The helpers print the reason of their failures on the standard error, that
+ * otherwise only ends up in the journal.
+ *
+ * Returns: (transfer full) (nullable): The last line that @child printed on its
+ *  standard error, or %NULL if it didn't print anything
+ */
+static gchar *
+_au_dup_helper_message(const AuChild *child)
+{
+   g_autofree gchar *tail = g_strdup(au_child_get_stderr(child));
+   const gchar *last_line;
+
+   g_strchomp(tail);
+   last_line = strrchr(tail, '\n');
+   last_line = last_line == NULL ? tail : last_line + 1;
+
+   if (last_line[0] == '\0')
+      return NULL;
+
+   return g_strdup(last_line);
+}
+
+/*
+ * _au_add_helper_message:
+ * @error: (not nullable): The error about a failed helper
+ * @helper_message: (nullable): The last message of the helper, as returned by
+ *  _au_dup_helper_message()
+ */
+static void
+_au_add_helper_message(GError *error, const gchar *helper_message)
+{
+   gchar *message;
+
+   if (helper_message == NULL)
+      return;
+
+   message = g_strdup_printf("%s (%s)", error->message, helper_message);
+   g_free(error->message);
+   error->message = message;
+}
+
 static void
-on_query_completed(GPid pid, gint wait_status, gpointer user_data)
+on_query_completed(gint wait_status, gpointer user_data)
 {
    g_autoptr(QueryData) data = user_data;
-   g_autoptr(GIOChannel) stdout_channel = NULL;
    g_autoptr(GVariant) available = NULL;
    g_autoptr(GVariant) available_later = NULL;
    g_autofree gchar *replacement_eol_variant = NULL;
-   g_autoptr(JsonNode) json_node = NULL;
    g_autoptr(GError) error = NULL;
    g_autofree gchar *output = NULL;
    const gchar *updated_build_id = NULL;
-   gsize out_length;
    AuUpdateStatus current_status;
    AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(data->req->object);
 
@@ -1283,11 +2088,10 @@ on_query_completed(GPid pid, gint wait_status, gpointer user_data)
 
          variant = _au_get_default_variant(self->manifest_path, &local_error);
          if (variant == NULL) {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-               "The server query returned HTTP 4xx and parsing the default variant from "
-               "the image manifest failed: %s",
-               local_error->message);
+            _au_query_return_error(data, G_DBUS_ERROR_FAILED,
+                                   "The server query returned HTTP 4xx and parsing the "
+                                   "default variant from the image manifest failed: %s",
+                                   local_error->message);
             return;
          }
 
@@ -1298,10 +2102,10 @@ on_query_completed(GPid pid, gint wait_status, gpointer user_data)
 
          if (g_strcmp0(initial_variant, variant) == 0 &&
              g_strcmp0(initial_branch, branch) == 0) {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-               "The server query returned HTTP 4xx. We are already following the default "
-               "variant and branch, nothing else we can do...");
+            _au_query_return_error(data, G_DBUS_ERROR_FAILED,
+                                   "The server query returned HTTP 4xx. We are already "
+                                   "following the default variant and branch, nothing "
+                                   "else we can do...");
             return;
          }
 
@@ -1311,96 +2115,60 @@ on_query_completed(GPid pid, gint wait_status, gpointer user_data)
             variant, branch);
 
          if (!_au_switch_to_variant(data->req->object, variant, TRUE, &local_error)) {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+            _au_query_return_error(
+               data, G_DBUS_ERROR_FAILED,
                "An error occurred while switching to the default variant '%s': %s",
                variant, local_error->message);
             return;
          }
 
          if (!_au_switch_to_branch(data->req->object, branch, &local_error)) {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+            _au_query_return_error(
+               data, G_DBUS_ERROR_FAILED,
                "An error occurred while switching to the default branch '%s': %s",
                variant, local_error->message);
             return;
          }
 
-         g_dbus_method_invocation_return_error(
-            g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-            "The server query returned HTTP 4xx. The tracked variant and branch have "
-            "been reverted to the default values: '%s', '%s'",
-            variant, branch);
+         _au_query_return_error(data, G_DBUS_ERROR_FAILED,
+                                "The server query returned HTTP 4xx. The tracked variant "
+                                "and branch have been reverted to the default values: "
+                                "'%s', '%s'",
+                                variant, branch);
          return;
       }
 
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+      _au_add_helper_message(error, data->helper_message);
+      _au_query_return_error(
+         data, G_DBUS_ERROR_FAILED,
          "An error occurred calling the 'steamos-atomupd-client' helper: %s",
          error->message);
       return;
    }
 
-   stdout_channel = g_io_channel_unix_new(data->standard_output);
-   if (g_io_channel_read_to_end(stdout_channel, &output, &out_length, &error) !=
-       G_IO_STATUS_NORMAL) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred reading the output of 'steamos-atomupd-client' helper: %s",
-         error->message);
-      return;
-   }
-
-   if (out_length == 0 || output[0] == '\0') {
-      /* In theory when no updates are available we should receive an empty
-       * JSON object (i.e. {}). Is it okay to assume no updates or should we
-       * throw an error here? */
-      available = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
-      available_later = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
-      goto success;
-   }
-
-   if (out_length != strlen(output)) {
-      /* This might happen if there is the terminating null byte '\0' followed
-       * by some other data */
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Helper output is not valid JSON: contains \\0");
-      return;
-   }
-
-   json_node = json_from_string(output, &error);
-   if (json_node == NULL) {
-      if (error == NULL) {
-         /* The helper returned an empty JSON, there are no available updates */
-         available = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
-         available_later = g_variant_ref_sink(g_variant_new("a{sa{sv}}", NULL));
-         goto success;
-      } else {
-         g_dbus_method_invocation_return_error(
-            g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-            "The helper output is not a valid JSON: %s", error->message);
-         return;
-      }
-   }
-
    current_status = au_atomupd1_get_update_status(data->req->object);
    if (current_status == AU_UPDATE_STATUS_SUCCESSFUL)
       updated_build_id = au_atomupd1_get_update_build_id(data->req->object);
 
-   if (!_au_parse_candidates(json_node, updated_build_id, &available, &available_later,
-                             &replacement_eol_variant, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred while parsing the helper output JSON: %s", error->message);
+   if (!_au_parse_query_output(data->standard_output, updated_build_id, &output,
+                               &available, &available_later, &replacement_eol_variant,
+                               &error)) {
+      _au_query_return_error(data, G_DBUS_ERROR_FAILED, "%s", error->message);
       return;
    }
 
-   if (!g_file_replace_contents(self->updates_json_file, output, out_length, NULL, FALSE,
-                                G_FILE_CREATE_NONE, NULL, NULL, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred while storing the helper output JSON: %s", error->message);
+   if (!data->ignore_rollout)
+      _au_apply_rollout_gate(self, &available, &available_later);
+
+   /* The helper didn't print anything, there are no available updates */
+   if (output == NULL)
+      goto success;
+
+   if (!g_file_replace_contents(self->updates_json_file, output, strlen(output), NULL,
+                                FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error)) {
+      _au_query_return_error(data, G_DBUS_ERROR_FAILED,
+                             "An error occurred while storing the helper output JSON: %s",
+                             error->message);
       return;
    }
 
@@ -1410,8 +2178,8 @@ on_query_completed(GPid pid, gint wait_status, gpointer user_data)
 
       if (!_au_switch_to_variant(data->req->object, replacement_eol_variant, FALSE,
                                  &error)) {
-         g_dbus_method_invocation_return_error(
-            g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         _au_query_return_error(
+            data, G_DBUS_ERROR_FAILED,
             "An error occurred while switching to the new variant '%s': %s",
             replacement_eol_variant, error->message);
          return;
@@ -1419,11 +2187,23 @@ on_query_completed(GPid pid, gint wait_status, gpointer user_data)
    }
 
 success:
+   self->have_query_result = TRUE;
    au_atomupd1_set_updates_available(data->req->object, available);
    au_atomupd1_set_updates_available_later(data->req->object, available_later);
-   au_atomupd1_complete_check_for_updates(data->req->object,
-                                          g_steal_pointer(&data->req->invocation),
-                                          available, available_later);
+   /* Automatic checks have nobody to reply to */
+   if (data->req->invocation != NULL)
+      au_atomupd1_complete_check_for_updates(data->req->object,
+                                             g_steal_pointer(&data->req->invocation),
+                                             available, available_later);
+
+   if (output != NULL)
+      _au_prewarm_update_bundle(self, output, available);
+
+   /* The client periodically checks for updates, use it as a chance to retry
+    * the builds lists that we were not able to prefetch before */
+   _au_prefetch_builds_lists(self);
+
+   _au_schedule_memory_release(self);
 }
 
 static gboolean
@@ -1434,6 +2214,8 @@ _au_switch_to_variant(AuAtomupd1 *object,
 {
    const gchar *branch = au_atomupd1_get_branch(object);
    GVariant *http_proxy = au_atomupd1_get_http_proxy(object); /* borrowed */
+   const gchar *user_prefs_path =
+      _au_get_user_preferences_file_path((AuAtomupd1Impl *)object);
    g_autoptr(GError) local_error = NULL;
 
    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
@@ -1443,7 +2225,8 @@ _au_switch_to_variant(AuAtomupd1 *object,
       return TRUE;
    }
 
-   if (!_au_update_user_preferences(variant, branch, http_proxy, &local_error)) {
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, http_proxy,
+                                    &local_error)) {
       /* If we can't save the preferences file, e.g. because /etc is full, we
        * try to continue anyway */
       g_warning("Failed to save the preferences: %s", local_error->message);
@@ -1546,6 +2329,8 @@ _au_switch_to_branch(AuAtomupd1 *object, gchar *branch, GError **error)
 {
    const gchar *variant = au_atomupd1_get_variant(object);
    GVariant *http_proxy = au_atomupd1_get_http_proxy(object); /* borrowed */
+   const gchar *user_prefs_path =
+      _au_get_user_preferences_file_path((AuAtomupd1Impl *)object);
    g_autoptr(GError) local_error = NULL;
 
    g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
@@ -1555,7 +2340,8 @@ _au_switch_to_branch(AuAtomupd1 *object, gchar *branch, GError **error)
       return TRUE;
    }
 
-   if (!_au_update_user_preferences(variant, branch, http_proxy, &local_error)) {
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, http_proxy,
+                                    &local_error)) {
       /* If we can't save the preferences file, e.g. because /etc is full, we
        * try to continue anyway */
       g_warning("Failed to save the preferences: %s", local_error->message);
@@ -1617,6 +2403,330 @@ _au_get_http_proxy_address_and_port(AuAtomupd1 *object)
    return g_strdup_printf("%s:%i", address, port);
 }
 
+static const gchar *const proxy_host_names[AU_N_PROXY_HOSTS] = {
+   [AU_PROXY_HOST_META] = "meta",
+   [AU_PROXY_HOST_IMAGES] = "images",
+};
+
+static const gchar *
+_au_get_proxy_host_url(AuAtomupd1Impl *self, AuProxyHost host)
+{
+   return host == AU_PROXY_HOST_META ? self->meta_url : self->images_url;
+}
+
+/*
+ * _au_get_http_proxy_for_host:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @host: The server that is going to be contacted
+ *
+ * Returns: (transfer full) (nullable): The HTTP proxy to use to reach @host,
+ *  or %NULL to reach it directly
+ */
+static gchar *
+_au_get_http_proxy_for_host(AuAtomupd1Impl *self, AuProxyHost host)
+{
+   if (self->proxy_auto_select && self->proxy_hosts[host].route == AU_PROXY_ROUTE_DIRECT)
+      return NULL;
+
+   return _au_get_http_proxy_address_and_port((AuAtomupd1 *)self);
+}
+
+/*
+ * _au_environ_set_http_proxy:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @envp: (transfer full): The environment of a helper
+ *
+ * Set the HTTP proxy in @envp. The servers that are reached directly, because
+ * they are faster that way, are added to `no_proxy`.
+ *
+ * Returns: (transfer full): The updated environment
+ */
+static gchar **
+_au_environ_set_http_proxy(AuAtomupd1Impl *self, gchar **envp)
+{
+   g_autofree gchar *http_proxy = NULL;
+   g_autoptr(GString) no_proxy = NULL;
+   gboolean use_proxy = FALSE;
+   gsize i;
+
+   http_proxy = _au_get_http_proxy_address_and_port((AuAtomupd1 *)self);
+   if (http_proxy == NULL)
+      return envp;
+
+   no_proxy = g_string_new(g_environ_getenv(envp, "no_proxy"));
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      const gchar *url = _au_get_proxy_host_url(self, i);
+      g_autoptr(GUri) uri = NULL;
+
+      if (!self->proxy_auto_select ||
+          self->proxy_hosts[i].route != AU_PROXY_ROUTE_DIRECT || url == NULL) {
+         use_proxy = TRUE;
+         continue;
+      }
+
+      uri = g_uri_parse(url, G_URI_FLAGS_NONE, NULL);
+      if (uri == NULL || g_uri_get_host(uri) == NULL) {
+         use_proxy = TRUE;
+         continue;
+      }
+
+      if (no_proxy->len > 0)
+         g_string_append_c(no_proxy, ',');
+      g_string_append(no_proxy, g_uri_get_host(uri));
+   }
+
+   if (!use_proxy) {
+      envp = g_environ_unsetenv(envp, "https_proxy");
+      envp = g_environ_unsetenv(envp, "http_proxy");
+      return envp;
+   }
+
+   envp = g_environ_setenv(envp, "https_proxy", http_proxy, TRUE);
+   envp = g_environ_setenv(envp, "http_proxy", http_proxy, TRUE);
+
+   if (no_proxy->len > 0)
+      envp = g_environ_setenv(envp, "no_proxy", no_proxy->str, TRUE);
+
+   return envp;
+}
+
+static void
+_au_update_proxy_routes(AuAtomupd1Impl *self)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sv}"));
+   g_autofree gchar *http_proxy = NULL;
+   gsize i;
+
+   http_proxy = _au_get_http_proxy_address_and_port((AuAtomupd1 *)self);
+
+   for (i = 0; self->proxy_auto_select && http_proxy != NULL && i < AU_N_PROXY_HOSTS;
+        i++) {
+      const AuProxyHostState *state = &self->proxy_hosts[i];
+      const gchar *url = _au_get_proxy_host_url(self, i);
+      g_auto(GVariantBuilder) host_builder =
+         G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sv}"));
+
+      g_variant_builder_add(&host_builder, "{sv}", "url",
+                            g_variant_new_string(url != NULL ? url : ""));
+      g_variant_builder_add(&host_builder, "{sv}", "route",
+                            g_variant_new_string(au_proxy_route_to_string(state->route)));
+      g_variant_builder_add(&host_builder, "{sv}", "proxy_latency",
+                            g_variant_new_int64(state->proxy_latency));
+      g_variant_builder_add(&host_builder, "{sv}", "direct_latency",
+                            g_variant_new_int64(state->direct_latency));
+      g_variant_builder_add(&host_builder, "{sv}", "last_probe",
+                            g_variant_new_uint64(state->last_probe));
+      g_variant_builder_add(&builder, "{sv}", proxy_host_names[i],
+                            g_variant_builder_end(&host_builder));
+   }
+
+   au_atomupd1_set_http_proxy_routes((AuAtomupd1 *)self, g_variant_builder_end(&builder));
+
+   /* The meta server might now be reached through a different path */
+   self->reachability_expiry = 0;
+}
+
+typedef struct {
+   gchar *urls[AU_N_PROXY_HOSTS];
+   gchar *http_proxy;
+   gint64 proxy_latency[AU_N_PROXY_HOSTS];
+   gint64 direct_latency[AU_N_PROXY_HOSTS];
+} ProxyProbeData;
+
+static void
+proxy_probe_data_free(ProxyProbeData *data)
+{
+   gsize i;
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++)
+      g_free(data->urls[i]);
+
+   g_free(data->http_proxy);
+   g_slice_free(ProxyProbeData, data);
+}
+
+static void
+_au_proxy_probe_thread_func(GTask *task,
+                            gpointer source_object,
+                            gpointer task_data,
+                            GCancellable *cancellable)
+{
+   ProxyProbeData *data = task_data;
+   gsize i;
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      g_autoptr(GError) proxy_error = NULL;
+      g_autoptr(GError) direct_error = NULL;
+
+      data->proxy_latency[i] =
+         au_proxy_probe(data->urls[i], data->http_proxy, &proxy_error);
+      if (proxy_error != NULL)
+         g_debug("Failed to reach %s through %s: %s", data->urls[i], data->http_proxy,
+                 proxy_error->message);
+
+      data->direct_latency[i] = au_proxy_probe(data->urls[i], NULL, &direct_error);
+      if (direct_error != NULL)
+         g_debug("Failed to reach %s directly: %s", data->urls[i], direct_error->message);
+   }
+
+   g_task_return_boolean(task, TRUE);
+}
+
+static void
+_au_start_proxy_probe(AuAtomupd1Impl *self);
+
+static void
+_au_proxy_probe_done(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+   g_autoptr(AuAtomupd1) object = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_autofree gchar *http_proxy = NULL;
+   ProxyProbeData *data = g_task_get_task_data(G_TASK(res));
+   gsize i;
+
+   self->proxy_probe_in_progress = FALSE;
+
+   if (!self->proxy_auto_select)
+      return;
+
+   /* If the configuration changed in the meantime, these results are not
+    * relevant anymore */
+   http_proxy = _au_get_http_proxy_address_and_port(object);
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      if (g_strcmp0(data->urls[i], _au_get_proxy_host_url(self, i)) != 0 ||
+          g_strcmp0(data->http_proxy, http_proxy) != 0) {
+         _au_start_proxy_probe(self);
+         return;
+      }
+   }
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      AuProxyHostState *state = &self->proxy_hosts[i];
+      AuProxyRoute route;
+
+      state->proxy_latency = data->proxy_latency[i];
+      state->direct_latency = data->direct_latency[i];
+      state->last_probe = g_get_real_time() / G_USEC_PER_SEC;
+
+      route = au_proxy_route_choose(state->route, state->proxy_latency,
+                                    state->direct_latency);
+      if (route != state->route) {
+         g_info("Reaching the %s server %s from now on", proxy_host_names[i],
+                route == AU_PROXY_ROUTE_PROXY ? "through the HTTP proxy" : "directly");
+         state->route = route;
+      }
+   }
+
+   _au_update_proxy_routes(self);
+}
+
+/*
+ * _au_start_proxy_probe:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * In a separate thread, measure how long it takes to reach each server through
+ * the HTTP proxy and directly, then choose the faster path that works.
+ */
+static void
+_au_start_proxy_probe(AuAtomupd1Impl *self)
+{
+   g_autoptr(GTask) task = NULL;
+   g_autofree gchar *http_proxy = NULL;
+   ProxyProbeData *data = NULL;
+   gsize i;
+
+   if (!self->proxy_auto_select || self->proxy_probe_in_progress)
+      return;
+
+   http_proxy = _au_get_http_proxy_address_and_port((AuAtomupd1 *)self);
+   if (http_proxy == NULL)
+      return;
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      if (_au_get_proxy_host_url(self, i) == NULL)
+         return;
+   }
+
+   data = g_slice_new0(ProxyProbeData);
+   data->http_proxy = g_steal_pointer(&http_proxy);
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++)
+      data->urls[i] = g_strdup(_au_get_proxy_host_url(self, i));
+
+   self->proxy_probe_in_progress = TRUE;
+   self->proxy_last_probe = g_get_monotonic_time();
+
+   task = g_task_new(NULL, NULL, _au_proxy_probe_done, g_object_ref(self));
+   g_task_set_task_data(task, data, (GDestroyNotify)proxy_probe_data_free);
+   g_task_run_in_thread(task, _au_proxy_probe_thread_func);
+}
+
+static gboolean
+_au_proxy_probe_cb(gpointer user_data)
+{
+   _au_start_proxy_probe(user_data);
+
+   return G_SOURCE_CONTINUE;
+}
+
+/*
+ * _au_proxy_download_failed:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * A download failed, maybe because the path that we chose stopped working.
+ * Probe again without waiting for the next scheduled probe, so that we can
+ * fail over to the other path.
+ */
+static void
+_au_proxy_download_failed(AuAtomupd1Impl *self)
+{
+   if (g_get_monotonic_time() - self->proxy_last_probe <
+       AU_PROXY_PROBE_MIN_INTERVAL * G_USEC_PER_SEC)
+      return;
+
+   _au_start_proxy_probe(self);
+}
+
+/*
+ * _au_update_proxy_probe:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Start over with the HTTP proxy for every server, and schedule the probes if
+ * the automatic selection is enabled. Called when either the configuration or
+ * the HTTP proxy changes.
+ */
+static void
+_au_update_proxy_probe(AuAtomupd1Impl *self)
+{
+   gsize i;
+
+   g_clear_handle_id(&self->proxy_probe_source, g_source_remove);
+
+   for (i = 0; i < AU_N_PROXY_HOSTS; i++) {
+      self->proxy_hosts[i].route = AU_PROXY_ROUTE_PROXY;
+      self->proxy_hosts[i].proxy_latency = -1;
+      self->proxy_hosts[i].direct_latency = -1;
+      self->proxy_hosts[i].last_probe = 0;
+   }
+
+   _au_update_proxy_routes(self);
+
+   if (!self->proxy_auto_select)
+      return;
+
+   _au_start_proxy_probe(self);
+
+   if (self->proxy_probe_interval > 0)
+      self->proxy_probe_source =
+         g_timeout_add_seconds(self->proxy_probe_interval, _au_proxy_probe_cb, self);
+}
+
+static void
+_au_http_proxy_notify_cb(AuAtomupd1 *object, GParamSpec *pspec, gpointer user_data)
+{
+   _au_update_proxy_probe((AuAtomupd1Impl *)object);
+}
+
 static gboolean
 _au_select_and_load_configuration(AuAtomupd1Impl *atomupd, GError **error);
 
@@ -1631,6 +2741,7 @@ _au_remote_info_done(GObject *source, GAsyncResult *res, gpointer user_data)
 
    if (!g_task_propagate_boolean(G_TASK(res), &error)) {
       g_info("An error occurred while downloading the remote info: %s", error->message);
+      _au_proxy_download_failed(self);
       return;
    }
 
@@ -1644,6 +2755,8 @@ _au_remote_info_done(GObject *source, GAsyncResult *res, gpointer user_data)
    }
 
    g_debug("Reloaded the config to include the remote info");
+
+   _au_prefetch_builds_lists(self);
 }
 
 static gboolean
@@ -1679,9 +2792,9 @@ _au_download_remote_info(AuAtomupd1Impl *atomupd, GError **error)
       g_build_filename(meta_url, atomupd->release, atomupd->product,
                        atomupd->architecture, variant, AU_REMOTE_INFO, NULL);
 
-   http_proxy = _au_get_http_proxy_address_and_port((AuAtomupd1 *)atomupd);
+   http_proxy = _au_get_http_proxy_for_host(atomupd, AU_PROXY_HOST_META);
 
-   data->target = g_strdup(_au_get_remote_info_path());
+   data->target = g_strdup(_au_get_remote_info_path(atomupd));
    data->url = g_steal_pointer(&remote_info_url);
    data->proxy = g_steal_pointer(&http_proxy);
 
@@ -1694,67 +2807,46 @@ _au_download_remote_info(AuAtomupd1Impl *atomupd, GError **error)
    return TRUE;
 }
 
-static void
-au_check_for_updates_authorized_cb(AuAtomupd1 *object,
-                                   GDBusMethodInvocation *invocation,
-                                   gpointer arg_options_pointer)
+/*
+ * _au_spawn_query_helper:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @config_path: (nullable): Client configuration to use, or %NULL for the one
+ *  of @self
+ * @variant: (not nullable): Variant to query
+ * @branch: (not nullable): Branch to query
+ * @penultimate: If %TRUE, ask for the penultimate update
+ * @timeout: Seconds after which the helper is killed, or 0 for no timeout
+ * @exit_func: Called with the captured output when the helper exits
+ * @user_data: Passed to @exit_func
+ * @user_data_free: (nullable): Used to free @user_data after @exit_func
+ * @error: Used to raise an error on failure
+ *
+ * Launch `steamos-atomupd-client --query-only` for @variant and @branch.
+ *
+ * Returns: (transfer none): The helper, or %NULL on failure
+ */
+static AuChild *
+_au_spawn_query_helper(AuAtomupd1Impl *self,
+                       const gchar *config_path,
+                       const gchar *variant,
+                       const gchar *branch,
+                       gboolean penultimate,
+                       guint timeout,
+                       AuChildExitFunc exit_func,
+                       gpointer user_data,
+                       GDestroyNotify user_data_free,
+                       GError **error)
 {
-   GVariant *arg_options = arg_options_pointer;
-   const gchar *variant = NULL;
-   const gchar *branch = NULL;
-   g_autofree gchar *http_proxy = NULL;
-   const gchar *key = NULL;
-   GVariant *value = NULL;
-   gboolean penultimate = FALSE;
-   GVariantIter iter;
-   GPid child_pid;
-   g_autoptr(QueryData) data = au_query_data_new();
-   g_auto(GStrv) launch_environ = g_get_environ();
+   AuSupervisor *supervisor = au_supervisor_get_default();
+   g_auto(GStrv) launch_environ = au_supervisor_dup_environ(supervisor);
    g_autoptr(GPtrArray) argv = NULL;
-   g_autoptr(GError) error = NULL;
-   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
-
-   g_return_if_fail(self->config_path != NULL);
-   g_return_if_fail(self->manifest_path != NULL);
-
-   if (!g_file_test(_au_get_remote_info_path(), G_FILE_TEST_EXISTS)) {
-      g_debug("We don't have a remote info file, trying to download it again...");
-      _au_download_remote_info(self, NULL);
-   }
-
-   g_variant_iter_init(&iter, arg_options);
-
-   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
-      if (g_str_equal(key, "penultimate")) {
-         if (g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
-            penultimate = g_variant_get_boolean(value);
-         } else {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-               "The argument '%s' must have a boolean value", key);
-         }
-         continue;
-      }
-
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "The argument '%s' is not a valid option", key);
-      return;
-   }
 
-   http_proxy = _au_get_http_proxy_address_and_port(object);
-   if (http_proxy != NULL) {
-      launch_environ = g_environ_setenv(launch_environ, "https_proxy", http_proxy, TRUE);
-      launch_environ = g_environ_setenv(launch_environ, "http_proxy", http_proxy, TRUE);
-   }
-
-   variant = au_atomupd1_get_variant(object);
-   branch = au_atomupd1_get_branch(object);
+   launch_environ = _au_environ_set_http_proxy(self, launch_environ);
 
    argv = g_ptr_array_new_with_free_func(g_free);
    g_ptr_array_add(argv, g_strdup("steamos-atomupd-client"));
    g_ptr_array_add(argv, g_strdup("--config"));
-   g_ptr_array_add(argv, g_strdup(self->config_path));
+   g_ptr_array_add(argv, g_strdup(config_path != NULL ? config_path : self->config_path));
    g_ptr_array_add(argv, g_strdup("--manifest-file"));
    g_ptr_array_add(argv, g_strdup(self->manifest_path));
    g_ptr_array_add(argv, g_strdup("--variant"));
@@ -1772,1601 +2864,4925 @@ au_check_for_updates_authorized_cb(AuAtomupd1 *object,
 
    g_ptr_array_add(argv, NULL);
 
-   if (!g_spawn_async_with_pipes(NULL, /* working directory */
-                                 (gchar **)argv->pdata, launch_environ,
-                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                 NULL,                         /* child setup */
-                                 NULL,                         /* user data */
-                                 &child_pid, NULL,             /* standard input */
-                                 &data->standard_output, NULL, /* standard error */
-                                 &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred calling the 'steamos-atomupd-client' helper: %s",
-         error->message);
-      return;
-   }
-
-   data->req->invocation = g_steal_pointer(&invocation);
-   data->req->object = g_object_ref(object);
-   g_child_watch_add(child_pid, on_query_completed, g_steal_pointer(&data));
+   return au_supervisor_spawn(supervisor, AU_HELPER_KIND_QUERY,
+                              (const gchar *const *)argv->pdata,
+                              (const gchar *const *)launch_environ,
+                              AU_CHILD_FLAGS_CAPTURE_STDOUT, timeout, exit_func,
+                              user_data, user_data_free, error);
 }
 
-static gboolean
-au_atomupd1_impl_handle_check_for_updates(AuAtomupd1 *object,
-                                          GDBusMethodInvocation *invocation,
-                                          GVariant *arg_options)
+/*
+ * _au_get_query_timeout:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Returns: Seconds after which an update query is considered failed
+ */
+static guint
+_au_get_query_timeout(AuAtomupd1Impl *self)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.check-for-updates",
-                  au_check_for_updates_authorized_cb, invocation,
-                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
+   const gchar *timeout_env;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   /* This environment variable is used for debugging and automated tests */
+   timeout_env = g_getenv("AU_QUERY_TIMEOUT");
+   if (timeout_env != NULL && g_ascii_strtoull(timeout_env, NULL, 10) > 0)
+      return g_ascii_strtoull(timeout_env, NULL, 10);
+
+   return self->query_timeout > 0 ? self->query_timeout : AU_QUERY_DEFAULT_TIMEOUT;
 }
 
-static void
-_au_atomupd1_set_update_status_and_error(AuAtomupd1 *object,
-                                         guint status,
-                                         const gchar *error_code,
-                                         const gchar *error_message)
+static gint
+_au_compare_latencies(gconstpointer a, gconstpointer b)
 {
-   g_return_if_fail(object != NULL);
+   gint64 latency_a = *(const gint64 *)a;
+   gint64 latency_b = *(const gint64 *)b;
 
-   au_atomupd1_set_update_status(object, status);
-   au_atomupd1_set_failure_code(object, error_code);
-   au_atomupd1_set_failure_message(object, error_message);
-   g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+   return (latency_a > latency_b) - (latency_a < latency_b);
 }
 
 /*
- * Returns: The RAUC service PID or -1 if an error occurred.
+ * _au_get_query_hedge_delay:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Returns: Milliseconds after which a query that didn't complete yet should be
+ *  hedged. That is the AU_QUERY_HEDGE_PERCENTILE of the latest query latencies,
+ *  so only the unusually slow queries get hedged.
  */
-static gint64
-_au_get_rauc_service_pid(GError **error)
+static guint
+_au_get_query_hedge_delay(AuAtomupd1Impl *self)
 {
-   g_autofree gchar *output = NULL;
-   gchar *endptr = NULL;
-   gint wait_status = 0;
-   gint64 rauc_pid;
-
-   const gchar *systemctl_argv[] = {
-      "systemctl", "show", "--property", "MainPID", "rauc", NULL,
-   };
+   gint64 sorted[AU_QUERY_LATENCY_SAMPLES];
+   const gchar *delay_env;
+   gint64 delay;
+   guint index;
 
-   g_return_val_if_fail(error == NULL || *error == NULL, -1);
+   /* This environment variable is used for debugging and automated tests */
+   delay_env = g_getenv("AU_QUERY_HEDGE_DELAY");
+   if (delay_env != NULL)
+      return g_ascii_strtoull(delay_env, NULL, 10);
 
-   if (!g_spawn_sync(NULL,                           /* working directory */
-                     (gchar **)systemctl_argv, NULL, /* envp */
-                     G_SPAWN_SEARCH_PATH, NULL,      /* child setup */
-                     NULL,                           /* user data */
-                     &output, NULL,                  /* stderr */
-                     &wait_status, error)) {
-      return -1;
-   }
+   if (self->n_query_latencies < AU_QUERY_LATENCY_MIN_SAMPLES)
+      return AU_QUERY_HEDGE_DEFAULT_DELAY;
 
-   if (!g_spawn_check_wait_status(wait_status, error))
-      return -1;
+   memcpy(sorted, self->query_latencies, self->n_query_latencies * sizeof(gint64));
+   qsort(sorted, self->n_query_latencies, sizeof(gint64), _au_compare_latencies);
 
-   if (!g_str_has_prefix(output, "MainPID=")) {
-      g_debug("Systemctl output is '%s' instead of the expected 'MainPID=X'", output);
-      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                  "An error occurred while trying to gather the RAUC PID");
-      return -1;
-   }
+   index = (self->n_query_latencies * AU_QUERY_HEDGE_PERCENTILE + 99) / 100 - 1;
+   delay = sorted[index] / 1000;
 
-   rauc_pid = g_ascii_strtoll(output + strlen("MainPID="), &endptr, 10);
-   if (endptr == NULL || output + strlen("MainPID=") == (const char *)endptr) {
-      g_debug("Unable to parse Systemctl output: %s", output);
-      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                  "An error occurred while trying to gather the RAUC PID");
-      return -1;
-   }
+   return CLAMP(delay, AU_QUERY_HEDGE_MIN_DELAY, _au_get_query_timeout(self) * 1000);
+}
 
-   return rauc_pid;
+static void
+_au_record_query_latency(AuAtomupd1Impl *self, gint64 latency)
+{
+   self->query_latencies[self->next_query_latency] = latency;
+   self->next_query_latency = (self->next_query_latency + 1) % AU_QUERY_LATENCY_SAMPLES;
+   self->n_query_latencies = MIN(self->n_query_latencies + 1, AU_QUERY_LATENCY_SAMPLES);
 }
 
 /*
- * Returns: The @process PID or -1 if it's not available or an error occurred.
+ * _au_write_config_copy:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @filename: (not nullable): Name of the copy, in the run directory
+ * @key: (not nullable): The "Server" key to replace, e.g. "MetaUrl"
+ * @url: (not nullable): The server to use instead
+ * @error: Used to raise an error on failure
+ *
+ * The helper takes its servers from its configuration, so write a copy of
+ * our configuration that points to @url instead.
+ *
+ * Returns: (transfer full): The path to the new configuration, or %NULL on failure
  */
-static gint64
-_au_get_process_pid(const gchar *process, GError **error)
+static gchar *
+_au_write_config_copy(AuAtomupd1Impl *self,
+                      const gchar *filename,
+                      const gchar *key,
+                      const gchar *url,
+                      GError **error)
 {
-   g_autofree gchar *output = NULL;
-   gchar *endptr = NULL;
-   gint wait_status = 0;
-   gint64 pid;
+   g_autoptr(GKeyFile) client_config = g_key_file_new();
+   g_autofree gchar *config_copy_path = NULL;
+   g_autofree gchar *content = NULL;
+   gsize length;
 
-   g_return_val_if_fail(process != NULL, -1);
-   g_return_val_if_fail(error == NULL || *error == NULL, -1);
+   if (!g_key_file_load_from_file(client_config, self->config_path,
+                                  G_KEY_FILE_KEEP_COMMENTS, error))
+      return NULL;
 
-   const gchar *argv[] = {
-      "pidof", "--single-shot", "-x", process, NULL,
-   };
+   g_key_file_set_string(client_config, "Server", key, url);
+   content = g_key_file_to_data(client_config, &length, NULL);
 
-   if (!g_spawn_sync(NULL,                      /* working directory */
-                     (gchar **)argv, NULL,      /* envp */
-                     G_SPAWN_SEARCH_PATH, NULL, /* child setup */
-                     NULL,                      /* user data */
-                     &output, NULL,             /* stderr */
-                     &wait_status, error))
-      return -1;
+   /* The configuration might include the HTTP auth credentials, so keep it
+    * readable only by root, like the netrc and the Desync config */
+   config_copy_path = g_build_filename(_au_get_run_path(self), filename, NULL);
+   if (!g_file_set_contents_full(config_copy_path, content, length,
+                                 G_FILE_SET_CONTENTS_CONSISTENT, 0600, error))
+      return NULL;
 
-   if (WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 1) {
-      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                  "There isn't a running process for %s", process);
-      return -1;
-   }
+   return g_steal_pointer(&config_copy_path);
+}
 
-   if (!g_spawn_check_wait_status(wait_status, error))
-      return -1;
+static void
+_au_query_race_kill_running(QueryRace *race)
+{
+   guint i;
 
-   pid = g_ascii_strtoll(output, &endptr, 10);
-   if (endptr == NULL || output == (const char *)endptr) {
-      g_debug("Unable to parse pidof output: %s", output);
-      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                  "An error occurred while trying to gather the %s PID", process);
-      return -1;
+   for (i = 0; i < race->n_attempts; i++) {
+      /* The query helper doesn't change anything on the system, so it can be
+       * killed right away */
+      if (race->attempts[i].running)
+         au_child_send_signal(race->attempts[i].child, SIGKILL, NULL);
    }
-
-   return pid;
 }
 
 static void
-_au_ensure_pid_is_killed(GPid pid)
+_au_query_attempt_completed_cb(AuChild *child, gint wait_status, gpointer user_data)
 {
-   gsize i;
-   int status;
-   int pgid = getpgid(pid);
+   QueryAttempt *attempt = user_data;
+   QueryRace *race = attempt->race;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(race->object);
+   gboolean succeeded = g_spawn_check_wait_status(wait_status, NULL);
 
-   if (pid < 1)
-      return;
+   attempt->running = FALSE;
+   attempt->child = NULL;
+   race->n_running--;
 
-   g_debug("Sending SIGTERM to PID %i", pid);
+   /* A failed query only wins if there is nothing else left to wait for */
+   if (race->data != NULL && (succeeded || race->n_running == 0)) {
+      QueryData *data = g_steal_pointer(&race->data);
 
-   if (kill(pid, SIGTERM) == 0) {
-      /* The PIDs we are trying to stop usually do it in less than a second.
-       * We wait up to 2s and, if they are still running, we will send a
-       * SIGKILL. */
-      for (i = 0; i < 4; i++) {
-         if (waitpid(pid, &status, WNOHANG | WUNTRACED) > 0) {
-            if (WIFEXITED(status))
-               goto success;
+      if (succeeded)
+         _au_record_query_latency(self, g_get_monotonic_time() - attempt->start_time);
 
-            if (WIFSTOPPED(status)) {
-               g_debug("PID %i is currently paused, sending SIGCONT to the group %i", pid,
-                       pgid);
-               killpg(pgid, SIGCONT);
-            }
-         } else {
-            int saved_errno = errno;
+      if (attempt != &race->attempts[0])
+         g_debug("The hedged query against the alternate meta server completed first");
 
-            if (saved_errno == ESRCH)
-               goto success;
-
-            if (saved_errno == ECHILD) {
-               /* The PID may not be our child, i.e. the rauc service.
-                * It is still safe to kill it, because it is the process
-                * responsible for applying an update and will gracefully
-                * handle the kill(). When we'll try to apply another update
-                * this service will be automatically executed again. */
-               if (kill(pid, 0) != 0)
-                  goto success;
-
-               /* If this process is not our child, we can't use waitpid() and
-                * WIFSTOPPED(). Instead we send a SIGCONT regardless of the status of the
-                * process. */
-               g_debug("Sending SIGCONT to the group %i to ensure that the PIDs are not "
-                       "paused",
-                       pgid);
-               killpg(pgid, SIGCONT);
-            }
-         }
+      g_clear_handle_id(&race->hedge_source, g_source_remove);
+      g_clear_handle_id(&race->timeout_source, g_source_remove);
+      _au_query_race_kill_running(race);
 
-         g_debug("PID %i is still running", pid);
-         g_usleep(0.5 * G_USEC_PER_SEC);
-      }
+      data->standard_output = au_child_get_stdout(child);
+      data->helper_message = _au_dup_helper_message(child);
+      on_query_completed(wait_status, data);
+   } else if (race->data != NULL) {
+      g_debug("One of the hedged queries failed, waiting for the other one");
    }
 
-   g_debug("Sending SIGKILL to PID %i", pid);
-   kill(pid, SIGKILL);
-   waitpid(pid, NULL, 0);
-
-success:
-   g_debug("PID %i terminated successfully", pid);
+   /* Every helper has been reaped, nobody else is referencing the race */
+   if (race->n_running == 0)
+      _query_race_free(race);
 }
 
-static void
-_au_cancel_async(GTask *task,
-                 gpointer source_object,
-                 gpointer data,
-                 GCancellable *cancellable)
+/*
+ * _au_query_race_spawn:
+ * @race: (not nullable): The CheckForUpdates() request
+ * @config_path: (nullable): Client configuration to use, or %NULL for the
+ *  default one
+ * @error: Used to raise an error on failure
+ *
+ * Returns: %TRUE if a new query helper has been launched
+ */
+static gboolean
+_au_query_race_spawn(QueryRace *race, const gchar *config_path, GError **error)
 {
-   gint64 rauc_pid;
-   g_autoptr(GError) error = NULL;
-   GPid pid = GPOINTER_TO_INT(data);
+   QueryAttempt *attempt = NULL;
 
-   /* The first thing to kill is the install helper. Otherwise, if we kill
-    * RAUC while the helper is still running, the helper might execute RAUC
-    * again before we are able to send the termination signal to the helper. */
-   _au_ensure_pid_is_killed(pid);
+   g_return_val_if_fail(race->n_attempts < AU_QUERY_MAX_ATTEMPTS, FALSE);
 
-   /* At the moment a RAUC operation can't be cancelled using its D-Bus API.
-    * For this reason we get its PID number and send a SIGTERM/SIGKILL to it. */
-   rauc_pid = _au_get_rauc_service_pid(&error);
+   attempt = &race->attempts[race->n_attempts];
+   attempt->race = race;
 
-   if (rauc_pid < 0) {
-      g_task_return_error(task, g_steal_pointer(&error));
-      return;
-   }
+   /* The whole race has its own timeout */
+   attempt->child = _au_spawn_query_helper(
+      AU_ATOMUPD1_IMPL(race->object), config_path, race->variant, race->branch,
+      race->penultimate, 0, _au_query_attempt_completed_cb, attempt, NULL, error);
+   if (attempt->child == NULL)
+      return FALSE;
 
-   _au_ensure_pid_is_killed(rauc_pid);
+   attempt->start_time = g_get_monotonic_time();
+   attempt->running = TRUE;
+   race->n_attempts++;
+   race->n_running++;
 
-   g_task_return_boolean(task, TRUE);
+   return TRUE;
 }
 
-static void
-cancel_callback(GObject *source_object, GAsyncResult *result, gpointer user_data)
+static gboolean
+_au_query_hedge_cb(gpointer user_data)
 {
+   QueryRace *race = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(race->object);
+   g_autofree gchar *hedge_config_path = NULL;
    g_autoptr(GError) error = NULL;
-   g_autoptr(RequestData) data = user_data;
 
-   if (g_task_propagate_boolean(G_TASK(result), &error)) {
-      au_atomupd1_set_update_status(data->object, AU_UPDATE_STATUS_CANCELLED);
-      au_atomupd1_complete_cancel_update(data->object,
-                                         g_steal_pointer(&data->invocation));
-   } else {
-      /* We failed to cancel a running update, probably the update is still
-       * running, but we don't know for certain. */
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to cancel an update: %s", error->message);
-   }
+   race->hedge_source = 0;
+
+   g_debug("The update query is taking longer than usual, hedging it against %s",
+           self->meta_mirrors[0]);
+
+   hedge_config_path = _au_write_config_copy(self, AU_HEDGE_CONFIG, "MetaUrl",
+                                             self->meta_mirrors[0], &error);
+   if (hedge_config_path == NULL ||
+       !_au_query_race_spawn(race, hedge_config_path, &error))
+      g_debug("Failed to launch the hedged query: %s", error->message);
+
+   return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_au_query_timeout_cb(gpointer user_data)
+{
+   QueryRace *race = user_data;
+   g_autoptr(QueryData) data = g_steal_pointer(&race->data);
+
+   race->timeout_source = 0;
+   g_clear_handle_id(&race->hedge_source, g_source_remove);
+   _au_query_race_kill_running(race);
+
+   /* The race is freed once the killed helpers have been reaped */
+   _au_query_return_error(data, G_DBUS_ERROR_TIMEOUT,
+                          "The update query did not complete within %u seconds",
+                          _au_get_query_timeout(AU_ATOMUPD1_IMPL(race->object)));
+
+   return G_SOURCE_REMOVE;
 }
 
+/*
+ * _au_start_update_query:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @invocation: (transfer full) (nullable): The CheckForUpdates() request to reply
+ *  to, or %NULL for an automatic update check
+ * @penultimate: Whether to ask for the penultimate update
+ * @ignore_rollout: If %TRUE, also list the builds that are not yet rolled out
+ *  to this device
+ */
 static void
-au_cancel_update_authorized_cb(AuAtomupd1 *object,
-                               GDBusMethodInvocation *invocation,
-                               gpointer data_pointer)
+_au_start_update_query(AuAtomupd1Impl *self,
+                       GDBusMethodInvocation *invocation,
+                       gboolean penultimate,
+                       gboolean ignore_rollout)
 {
-   g_autoptr(RequestData) data = g_slice_new0(RequestData);
-   g_autoptr(GTask) task = NULL;
-   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   AuAtomupd1 *object = (AuAtomupd1 *)self;
+   g_autoptr(QueryRace) race = NULL;
+   g_autoptr(GError) error = NULL;
 
-   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_IN_PROGRESS &&
-       au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_PAUSED) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "There isn't an update in progress that can be cancelled");
+   race = g_slice_new0(QueryRace);
+   race->object = g_object_ref(object);
+   race->variant = g_strdup(au_atomupd1_get_variant(object));
+   race->branch = g_strdup(au_atomupd1_get_branch(object));
+   race->penultimate = penultimate;
+   race->data = au_query_data_new();
+   race->data->req->invocation = invocation;
+   race->data->req->object = g_object_ref(object);
+   race->data->ignore_rollout = ignore_rollout;
+
+   if (!_au_query_race_spawn(race, NULL, &error)) {
+      _au_query_return_error(
+         race->data, G_DBUS_ERROR_FAILED,
+         "An error occurred calling the 'steamos-atomupd-client' helper: %s",
+         error->message);
       return;
    }
 
-   /* Remove the previous child watch callback */
-   if (self->install_event_source != 0)
-      g_source_remove(self->install_event_source);
-
-   self->install_event_source = 0;
-
-   data->invocation = g_steal_pointer(&invocation);
-   data->object = g_object_ref(object);
+   /* If the meta server is unusually slow, also ask one of its mirrors and take
+    * whichever answers first */
+   if (self->meta_mirrors != NULL)
+      race->hedge_source =
+         g_timeout_add(_au_get_query_hedge_delay(self), _au_query_hedge_cb, race);
 
-   task = g_task_new(NULL, NULL, cancel_callback, g_steal_pointer(&data));
+   race->timeout_source =
+      g_timeout_add_seconds(_au_get_query_timeout(self), _au_query_timeout_cb, race);
 
-   g_task_set_task_data(task, GINT_TO_POINTER(self->install_pid), NULL);
-   g_task_run_in_thread(task, _au_cancel_async);
+   /* The race frees itself once all its helpers have been reaped */
+   g_steal_pointer(&race);
 }
 
-static gboolean
-au_atomupd1_impl_handle_cancel_update(AuAtomupd1 *object,
-                                      GDBusMethodInvocation *invocation)
+/*
+ * _au_reply_offline:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @invocation: (transfer full) (nullable): The CheckForUpdates() request to reply
+ *  to, or %NULL for an automatic update check
+ * @allow_cached: If %TRUE, reply with the result of the previous check, if any
+ *
+ * The meta server is not reachable, answer without launching the helper, which
+ * would otherwise wait for its full connection timeout before failing.
+ */
+static void
+_au_reply_offline(AuAtomupd1Impl *self,
+                  GDBusMethodInvocation *invocation,
+                  gboolean allow_cached)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
-                  au_cancel_update_authorized_cb, invocation, NULL, NULL);
+   AuAtomupd1 *object = (AuAtomupd1 *)self;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   /* Check again as soon as the connectivity returns */
+   self->recheck_when_online = TRUE;
+
+   if (invocation == NULL) {
+      g_debug("Still offline, postponing the automatic update check");
+      return;
+   }
+
+   if (allow_cached && self->have_query_result) {
+      g_debug("The meta server is not reachable, replying with the cached updates");
+      au_atomupd1_complete_check_for_updates(
+         object, invocation, au_atomupd1_get_updates_available(object),
+         au_atomupd1_get_updates_available_later(object));
+      return;
+   }
+
+   g_dbus_method_invocation_return_dbus_error(
+      invocation, AU_ERROR_OFFLINE,
+      "The meta server is not reachable, the machine appears to be offline");
 }
 
 /*
- * _au_send_signal_to_install_procs:
- * @self: A AuAtomupd1Impl object
- * @sig: Signal that will be sent to the processes
- * @error: Used to raise an error on failure
- *
- * Send @sig to the install helper PID and to the RAUC service process group ID
+ * _au_get_cached_reachability:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @offline_out: (out) (not optional): Used to return whether the meta server is
+ *  not reachable
  *
- * Returns: %TRUE if the signal was successfully sent
+ * Returns: %TRUE if the reachability of the meta server is known without
+ *  asking the GNetworkMonitor
  */
 static gboolean
-_au_send_signal_to_install_procs(AuAtomupd1Impl *self, int sig, GError **error)
+_au_get_cached_reachability(AuAtomupd1Impl *self, gboolean *offline_out)
 {
-   gint64 rauc_pid;
-   int saved_errno;
+   g_autofree gchar *network_state = NULL;
 
-   g_return_val_if_fail(self != NULL, FALSE);
-   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+   *offline_out = FALSE;
 
-   if (self->install_pid == 0) {
-      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                  "Unexpectedly the PID of the install helper is not set");
-      return FALSE;
+   if (_au_read_test_network_state(&network_state)) {
+      *offline_out = (g_strcmp0(network_state, "offline") == 0);
+      return TRUE;
    }
 
-   g_debug("Sending signal %i to the install helper with PID %i", sig, self->install_pid);
+   /* When in doubt, let the helper find out */
+   if (self->network_monitor == NULL || self->meta_url == NULL)
+      return TRUE;
 
-   if (kill(self->install_pid, sig) < 0) {
-      saved_errno = errno;
-      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                  "Unable to send signal %i to the update helper: %s", sig,
-                  g_strerror(saved_errno));
-      return FALSE;
+   if (!g_network_monitor_get_network_available(self->network_monitor)) {
+      *offline_out = TRUE;
+      return TRUE;
    }
 
-   rauc_pid = _au_get_rauc_service_pid(error);
-   if (rauc_pid < 0)
-      return FALSE;
-
-   if (rauc_pid > 0) {
-      /* Send the signal to the entire PGID, to include the eventual Desync process */
-      int rauc_pgid = getpgid(rauc_pid);
-      g_debug("Sending signal %i to the RAUC service PGID %i", sig, rauc_pgid);
-
-      if (killpg(rauc_pgid, sig) < 0) {
-         saved_errno = errno;
-         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-                     "Unable to send signal %i to the RAUC service: %s", sig,
-                     g_strerror(saved_errno));
-         return FALSE;
-      }
+   if (g_get_monotonic_time() < self->reachability_expiry) {
+      *offline_out = !self->meta_reachable;
+      return TRUE;
    }
-   return TRUE;
+
+   return FALSE;
 }
 
 static void
-au_pause_update_authorized_cb(AuAtomupd1 *object,
-                              GDBusMethodInvocation *invocation,
-                              gpointer data_pointer)
+_au_can_reach_meta_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
 {
+   g_autoptr(ReachabilityData) data = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(data->req->object);
    g_autoptr(GError) error = NULL;
-   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   gboolean offline = FALSE;
 
-   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_IN_PROGRESS) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "There isn't an update in progress that can be paused");
-      return;
+   if (!g_network_monitor_can_reach_finish(G_NETWORK_MONITOR(source_object), result,
+                                           &error)) {
+      g_debug("Unable to reach the meta server, or its HTTP proxy: %s", error->message);
+      /* Only trust the errors that clearly mean we can't get there, anything else
+       * is left to the helper to report */
+      offline = g_error_matches(error, G_IO_ERROR, G_IO_ERROR_NETWORK_UNREACHABLE) ||
+                g_error_matches(error, G_IO_ERROR, G_IO_ERROR_HOST_UNREACHABLE);
    }
 
-   if (!_au_send_signal_to_install_procs(self, SIGSTOP, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), error->domain, error->code,
-         "An error occurred while attempting to pause the installation process: %s",
-         error->message);
-      return;
-   }
+   self->meta_reachable = !offline;
+   self->reachability_expiry =
+      g_get_monotonic_time() + AU_REACHABILITY_CACHE_TIME * G_USEC_PER_SEC;
 
-   au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_PAUSED);
-   au_atomupd1_complete_pause_update(object, g_steal_pointer(&invocation));
-}
-
-static gboolean
-au_atomupd1_impl_handle_pause_update(AuAtomupd1 *object,
-                                     GDBusMethodInvocation *invocation)
-{
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
-                  au_pause_update_authorized_cb, invocation, NULL, NULL);
-
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   if (offline)
+      _au_reply_offline(self, g_steal_pointer(&data->req->invocation),
+                        data->allow_cached);
+   else
+      _au_start_update_query(self, g_steal_pointer(&data->req->invocation),
+                             data->penultimate, data->ignore_rollout);
 }
 
+/*
+ * _au_query_when_reachable:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @invocation: (transfer full) (nullable): The CheckForUpdates() request to reply
+ *  to, or %NULL for an automatic update check
+ * @penultimate: Whether to ask for the penultimate update
+ * @allow_cached: If %TRUE, reply with the result of the previous check when
+ *  the meta server is not reachable
+ * @ignore_rollout: If %TRUE, also list the builds that are not yet rolled out
+ *  to this device
+ *
+ * Launch the update query, unless we already know that it would fail because
+ * the meta server is not reachable. When the meta server is reached through
+ * the HTTP proxy, it is the proxy that must be reachable from here.
+ */
 static void
-_au_client_stdout_update_cb(GObject *object_stream,
-                            GAsyncResult *result,
-                            gpointer user_data)
+_au_query_when_reachable(AuAtomupd1Impl *self,
+                         GDBusMethodInvocation *invocation,
+                         gboolean penultimate,
+                         gboolean allow_cached,
+                         gboolean ignore_rollout)
 {
-   GDataInputStream *stream = (GDataInputStream *)object_stream;
-   g_autoptr(AuAtomupd1) object = user_data;
-   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
-   size_t len;
-   const gchar *cursor = NULL;
-   gchar *endptr = NULL;
+   g_autoptr(ReachabilityData) data = NULL;
+   g_autoptr(GSocketConnectable) address = NULL;
    g_autoptr(GError) error = NULL;
-   g_autofree gchar *line = NULL;
-   g_auto(GStrv) parts = NULL;
-   g_autoptr(GDateTime) time_estimation = g_date_time_new_now_utc();
+   g_autofree gchar *http_proxy = NULL;
+   gboolean offline;
 
-   if (self->start_update_stdout_stream != stream)
+   if (_au_get_cached_reachability(self, &offline)) {
+      if (offline)
+         _au_reply_offline(self, invocation, allow_cached);
+      else
+         _au_start_update_query(self, invocation, penultimate, ignore_rollout);
       return;
+   }
 
-   /* steamos-atomupd-client will periodically print updates regarding the
-    * upgrade process. These updates are formatted as "XX.XX% DdHhMMmSSs".
-    * The estimated remaining time may be missing if we are either using Casync
-    * or if it is currently unknown.
-    * Examples of valid values include: "15.85% 08m44s", "0.00%", "4.31% 00m56s",
-    * "47.00% 1h12m05s" and "100%". */
-
-   line = g_data_input_stream_read_line_finish(stream, result, NULL, &error);
+   http_proxy = _au_get_http_proxy_for_host(self, AU_PROXY_HOST_META);
+   if (http_proxy == NULL)
+      address = g_network_address_parse_uri(self->meta_url, 443, &error);
+   else if (strstr(http_proxy, "://") != NULL)
+      address = g_network_address_parse_uri(http_proxy, 0, &error);
+   else
+      address = g_network_address_parse(http_proxy, 0, &error);
 
-   if (error != NULL) {
-      g_debug("Unable to read the update progress: %s", error->message);
+   if (address == NULL) {
+      g_debug("Unable to parse the %s URL: %s",
+              http_proxy == NULL ? "meta server" : "HTTP proxy", error->message);
+      _au_start_update_query(self, invocation, penultimate, ignore_rollout);
       return;
    }
 
-   /* If there is nothing more to read, just return */
-   if (line == NULL)
-      return;
+   data = au_reachability_data_new();
+   data->req->invocation = invocation;
+   data->req->object = g_object_ref((AuAtomupd1 *)self);
+   data->penultimate = penultimate;
+   data->allow_cached = allow_cached;
+   data->ignore_rollout = ignore_rollout;
 
-   parts = g_strsplit(g_strstrip(line), " ", 2);
+   g_network_monitor_can_reach_async(self->network_monitor, address, NULL,
+                                     _au_can_reach_meta_cb, g_steal_pointer(&data));
+}
 
-   len = strlen(parts[0]);
-   if (len < 2 || parts[0][len - 1] != '%') {
-      g_debug("Unable to parse the completed percentage: %s", parts[0]);
-      return;
+static void
+au_check_for_updates_authorized_cb(AuAtomupd1 *object,
+                                   GDBusMethodInvocation *invocation,
+                                   gpointer arg_options_pointer)
+{
+   GVariant *arg_options = arg_options_pointer;
+   const gchar *key = NULL;
+   GVariant *value = NULL;
+   gboolean penultimate = FALSE;
+   gboolean allow_cached = FALSE;
+   gboolean ignore_rollout = FALSE;
+   GVariantIter iter;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   g_return_if_fail(self->config_path != NULL);
+   g_return_if_fail(self->manifest_path != NULL);
+
+   if (!g_file_test(_au_get_remote_info_path(self), G_FILE_TEST_EXISTS)) {
+      g_debug("We don't have a remote info file, trying to download it again...");
+      _au_download_remote_info(self, NULL);
    }
 
-   /* Remove the percentage sign */
-   parts[0][len - 1] = '\0';
+   g_variant_iter_init(&iter, arg_options);
 
-   /* The percentage here is not locale dependent, we don't have to worry
-    * about comma vs period for the decimals. */
-   au_atomupd1_set_progress_percentage(object, g_ascii_strtod(parts[0], NULL));
+   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
+      if (g_str_equal(key, "penultimate")) {
+         if (g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+            penultimate = g_variant_get_boolean(value);
+         } else {
+            g_dbus_method_invocation_return_error(
+               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+               "The argument '%s' must have a boolean value", key);
+         }
+         continue;
+      }
 
-   g_data_input_stream_read_line_async(stream, G_PRIORITY_DEFAULT, NULL,
-                                       _au_client_stdout_update_cb, g_object_ref(object));
+      if (g_str_equal(key, "allow_cached")) {
+         if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+            g_dbus_method_invocation_return_error(
+               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+               "The argument '%s' must have a boolean value", key);
+            return;
+         }
+         allow_cached = g_variant_get_boolean(value);
+         continue;
+      }
 
-   if (parts[1] == NULL) {
-      au_atomupd1_set_estimated_completion_time(object, 0);
-      g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+      if (g_str_equal(key, "ignore_rollout")) {
+         if (!g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+            g_dbus_method_invocation_return_error(
+               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+               "The argument '%s' must have a boolean value", key);
+            return;
+         }
+         ignore_rollout = g_variant_get_boolean(value);
+         continue;
+      }
+
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "The argument '%s' is not a valid option", key);
       return;
    }
 
-   cursor = parts[1];
-   while (*cursor != '\0') {
-      g_autoptr(GDateTime) updated_estimation = NULL;
-      guint64 value;
+   _au_query_when_reachable(self, g_steal_pointer(&invocation), penultimate,
+                            allow_cached, ignore_rollout);
+}
 
-      endptr = NULL;
-      value = g_ascii_strtoull(cursor, &endptr, 10);
+static gboolean
+au_atomupd1_impl_handle_check_for_updates(AuAtomupd1 *object,
+                                          GDBusMethodInvocation *invocation,
+                                          GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.check-for-updates",
+                  au_check_for_updates_authorized_cb, invocation,
+                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
 
-      if (endptr == NULL || cursor == (const char *)endptr) {
-         g_debug("Unable to parse the expected remaining time: %s", parts[1]);
-         au_atomupd1_set_estimated_completion_time(object, 0);
-         g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
-         return;
-      }
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-      cursor = endptr + 1;
+static void
+_au_multi_query_launch_next(MultiQueryData *multi);
 
-      switch (endptr[0]) {
-      case 'd':
-         updated_estimation = g_date_time_add_days(time_estimation, value);
-         break;
+/*
+ * _au_multi_query_share_result:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @output: (nullable): The JSON printed by the helper
+ * @available: (not nullable): Map of available updates
+ * @available_later: (not nullable): Map of updates that require a newer system version
+ *
+ * Store the result of a CheckForUpdatesMulti() target that matches the tracked
+ * variant and branch, as if it came from CheckForUpdates(). In this way a
+ * following StartUpdate() doesn't need an additional query.
+ */
+static void
+_au_multi_query_share_result(AuAtomupd1Impl *self,
+                             const gchar *output,
+                             GVariant *available,
+                             GVariant *available_later)
+{
+   g_autoptr(GError) error = NULL;
 
-      case 'h':
-         updated_estimation = g_date_time_add_hours(time_estimation, value);
-         break;
+   if (output != NULL &&
+       !g_file_replace_contents(self->updates_json_file, output, strlen(output), NULL,
+                                FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error)) {
+      g_debug("Unable to store the helper output JSON: %s", error->message);
+      return;
+   }
 
-      case 'm':
-         updated_estimation = g_date_time_add_minutes(time_estimation, value);
-         break;
+   au_atomupd1_set_updates_available((AuAtomupd1 *)self, available);
+   au_atomupd1_set_updates_available_later((AuAtomupd1 *)self, available_later);
+}
 
-      case 's':
-         updated_estimation = g_date_time_add_seconds(time_estimation, value);
-         break;
+static void
+_au_multi_query_complete(MultiQueryData *multi)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sa{sv}}"));
+   guint i;
 
-      default:
-         g_debug("Unable to parse the expected remaining time: %s", parts[1]);
-         au_atomupd1_set_estimated_completion_time(object, 0);
-         g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
-         return;
-      }
+   for (i = 0; i < multi->keys->len; i++) {
+      const gchar *key = g_ptr_array_index(multi->keys, i);
+      GVariant *result = g_hash_table_lookup(multi->results, key);
 
-      g_date_time_unref(time_estimation);
-      time_estimation = g_steal_pointer(&updated_estimation);
+      g_variant_builder_add(&builder, "{s@a{sv}}", key, result);
    }
 
-   au_atomupd1_set_estimated_completion_time(object,
-                                             g_date_time_to_unix(time_estimation));
-   g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+   au_atomupd1_complete_check_for_updates_multi(multi->req->object,
+                                                g_steal_pointer(&multi->req->invocation),
+                                                g_variant_builder_end(&builder));
+
+   _au_schedule_memory_release(AU_ATOMUPD1_IMPL(multi->req->object));
 }
 
 static void
-au_start_update_clear(AuAtomupd1Impl *self)
+_au_multi_query_set_error(MultiQueryTarget *target, const GError *error)
 {
-   g_clear_object(&self->start_update_stdout_stream);
-   self->install_event_source = 0;
-   self->install_pid = 0;
+   g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+
+   g_debug("The query for %s failed: %s", target->key, error->message);
+
+   g_variant_dict_insert(&dict, "error", "s", error->message);
+   g_hash_table_replace(target->multi->results, g_strdup(target->key),
+                        g_variant_ref_sink(g_variant_dict_end(&dict)));
 }
 
 static void
-child_watch_cb(GPid pid, gint wait_status, gpointer user_data)
+on_multi_query_target_completed(AuChild *child, gint wait_status, gpointer user_data)
 {
-   g_autoptr(AuAtomupd1) object = user_data;
+   MultiQueryTarget *target = user_data;
+   MultiQueryData *multi = target->multi;
+   AuAtomupd1 *object = multi->req->object;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+   g_autoptr(GVariant) available = NULL;
+   g_autoptr(GVariant) available_later = NULL;
+   g_autofree gchar *replacement_eol_variant = NULL;
+   g_autofree gchar *output = NULL;
+   g_autoptr(GBytes) standard_output = NULL;
    g_autoptr(GError) error = NULL;
+   const gchar *updated_build_id = NULL;
 
-   if (g_spawn_check_wait_status(wait_status, &error)) {
-      g_debug("The update has been successfully applied");
-      _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_SUCCESSFUL, NULL,
-                                               NULL);
-   } else {
-      g_debug("'steamos-atomupd-client' helper returned an error: %s", error->message);
-      _au_atomupd1_set_update_status_and_error(
-         object, AU_UPDATE_STATUS_FAILED, "org.freedesktop.DBus.Error", error->message);
+   /* The supervisor killed the helper when it reached the query timeout */
+   if (au_child_get_timed_out(child)) {
+      g_set_error(&error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                  "The query did not complete within %u seconds",
+                  _au_get_query_timeout(self));
+      _au_multi_query_set_error(target, error);
+      goto out;
    }
 
-   au_start_update_clear((AuAtomupd1Impl *)object);
+   if (!g_spawn_check_wait_status(wait_status, &error)) {
+      g_autofree gchar *helper_message = _au_dup_helper_message(child);
+
+      _au_add_helper_message(error, helper_message);
+      _au_multi_query_set_error(target, error);
+      goto out;
+   }
+
+   if (au_atomupd1_get_update_status(object) == AU_UPDATE_STATUS_SUCCESSFUL)
+      updated_build_id = au_atomupd1_get_update_build_id(object);
+
+   standard_output = au_child_get_stdout(child);
+   if (!_au_parse_query_output(standard_output, updated_build_id, &output,
+                               &available, &available_later, &replacement_eol_variant,
+                               &error)) {
+      _au_multi_query_set_error(target, error);
+      goto out;
+   }
+
+   if (!multi->ignore_rollout)
+      _au_apply_rollout_gate(self, &available, &available_later);
+
+   g_variant_dict_insert_value(&dict, "available", available);
+   g_variant_dict_insert_value(&dict, "available_later", available_later);
+   if (replacement_eol_variant != NULL)
+      g_variant_dict_insert(&dict, "replacement_eol_variant", "s",
+                            replacement_eol_variant);
+
+   g_hash_table_replace(multi->results, g_strdup(target->key),
+                        g_variant_ref_sink(g_variant_dict_end(&dict)));
+
+   /* Unlike CheckForUpdates(), we never switch away from an EOL variant here,
+    * so its result can't be reused */
+   if (!multi->penultimate && replacement_eol_variant == NULL &&
+       g_strcmp0(target->variant, au_atomupd1_get_variant(object)) == 0 &&
+       g_strcmp0(target->branch, au_atomupd1_get_branch(object)) == 0)
+      _au_multi_query_share_result(self, output, available, available_later);
+
+out:
+   multi->n_running--;
+   _au_multi_query_launch_next(multi);
 }
 
 /*
- * @buildid: The build ID to validate
- * @date_out: (out) (optional): Used to return the date of @buildid
- * @inc_out: (out) (optional): Used to return the incremental number of @buildid
- * @error: (out) (optional): Used to return an error on failure
- *
- * Parse @buildid and perform some sanity checks.
- * @buildid is expected to have a "date" part that follows the ISO-8601
- * standard, without hyphens. Optionally, after the date, there is a dot and
- * an increment. I.e. YYYYMMDD[.N]
- *
- * If this standard will ever change, please keep it in sync with the
- * BuildId class in `steamos-atomupd.git`
+ * _au_multi_query_launch_next:
+ * @multi: (transfer full): The CheckForUpdatesMulti() request
  *
- * Returns: %TRUE if the @buildid has the expected form
+ * Launch the pending queries, up to AU_CHECK_MULTI_MAX_JOBS at the same time.
+ * When there are no more queries left, complete the request and free @multi.
  */
-gboolean
-_is_buildid_valid(const gchar *buildid, gint64 *date_out, gint64 *inc_out, GError **error)
+static void
+_au_multi_query_launch_next(MultiQueryData *multi)
 {
-   gint64 month = 0;
-   gint64 day = 0;
-   gint64 inc = 0;
-   gint64 date = 0;
-   char *endptr;
-   g_auto(GStrv) requested_parts = NULL;
-   const gchar *date_str;
-   gsize i;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(multi->req->object);
 
-   if (buildid == NULL || g_strcmp0(buildid, "") == 0)
-      return au_throw_error(error, "The provided Buildid is either NULL or empty");
+   while (multi->n_running < AU_CHECK_MULTI_MAX_JOBS) {
+      g_autoptr(MultiQueryTarget) target = g_queue_pop_head(multi->pending);
+      g_autoptr(GError) error = NULL;
 
-   requested_parts = g_strsplit(buildid, ".", 2);
-   date_str = requested_parts[0];
+      if (target == NULL)
+         break;
 
-   /* The date is expected to be in the form of YYYYMMDD, which
-    * g_date_time_new_from_iso8601() doesn't cover because without the time part.
-    * Instead, we parse it ourselves. */
+      if (_au_spawn_query_helper(self, NULL, target->variant, target->branch,
+                                 multi->penultimate, _au_get_query_timeout(self),
+                                 on_multi_query_target_completed, target,
+                                 (GDestroyNotify)_multi_query_target_free,
+                                 &error) == NULL) {
+         _au_multi_query_set_error(target, error);
+         continue;
+      }
 
-   date = g_ascii_strtoll(date_str, &endptr, 10);
-   if (date < 0 || date > G_MAXINT || endptr == date_str || *endptr != '\0') {
-      return au_throw_error(
-         error, "Buildid '%s' doesn't follow the expected YYYYMMDD[.N] format", buildid);
+      /* The target is now owned by the supervisor */
+      g_steal_pointer(&target);
+      multi->n_running++;
    }
 
-   if (strlen(date_str) != 8) {
-      return au_throw_error(
-         error, "Buildid '%s' doesn't follow the expected YYYYMMDD[.N] format", buildid);
-   }
-   for (i = 4; i < 6; i++) {
-      month = month * 10 + (date_str[i] - '0');
-   }
-   for (i = 6; i < 8; i++) {
-      day = day * 10 + (date_str[i] - '0');
+   if (multi->n_running == 0) {
+      g_autoptr(MultiQueryData) owned_multi = multi;
+      _au_multi_query_complete(owned_multi);
    }
+}
 
-   if (month > 12 || day > 31)
-      return au_throw_error(error, "The date in the buildid '%s' is not valid", buildid);
-
-   if (requested_parts[1] != NULL) {
-      inc = g_ascii_strtoll(requested_parts[1], &endptr, 10);
-
-      if (inc < 0 || inc > G_MAXINT || endptr == requested_parts[1] || *endptr != '\0') {
-         return au_throw_error(
-            error, "The increment part of the buildid is unexpected: '%s'", buildid);
-      }
-   }
+static void
+au_check_for_updates_multi_authorized_cb(AuAtomupd1 *object,
+                                         GDBusMethodInvocation *invocation,
+                                         gpointer arg_multi_data_pointer)
+{
+   GVariant *arg_multi_data = arg_multi_data_pointer;
+   g_autoptr(GVariantIter) targets_iter = NULL;
+   g_autoptr(GVariant) options = NULL;
+   g_autoptr(MultiQueryData) multi = au_multi_query_data_new();
+   const gchar *key = NULL;
+   GVariant *value = NULL;
+   const gchar *variant = NULL;
+   const gchar *branch = NULL;
+   GVariantIter iter;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
 
-   if (date_out != NULL)
-      *date_out = date;
-   if (inc_out != NULL)
-      *inc_out = inc;
+   g_return_if_fail(self->config_path != NULL);
+   g_return_if_fail(self->manifest_path != NULL);
 
-   return TRUE;
-}
+   g_variant_get(arg_multi_data, "(a(ss)@a{sv})", &targets_iter, &options);
 
-static gboolean
-_au_spawn_update_helper(AuAtomupd1 *object, const GPtrArray *argv, GError **error)
-{
-   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
-   g_autofree gchar *http_proxy = NULL;
-   g_auto(GStrv) launch_environ = g_get_environ();
-   g_autoptr(GInputStream) unix_stream = NULL;
-   gint client_stdout;
+   g_variant_iter_init(&iter, options);
 
-   http_proxy = _au_get_http_proxy_address_and_port(object);
-   if (http_proxy != NULL) {
-      launch_environ = g_environ_setenv(launch_environ, "https_proxy", http_proxy, TRUE);
-      launch_environ = g_environ_setenv(launch_environ, "http_proxy", http_proxy, TRUE);
-   }
+   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
+      if (g_str_equal(key, "penultimate") &&
+          g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+         multi->penultimate = g_variant_get_boolean(value);
+         continue;
+      }
 
-   au_start_update_clear(self);
-   if (!g_spawn_async_with_pipes(NULL, /* working directory */
-                                 (gchar **)argv->pdata, launch_environ,
-                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-                                 NULL,                     /* child setup */
-                                 NULL,                     /* user data */
-                                 &self->install_pid, NULL, /* standard input */
-                                 &client_stdout, NULL,     /* standard error */
-                                 error)) {
+      if (g_str_equal(key, "ignore_rollout") &&
+          g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN)) {
+         multi->ignore_rollout = g_variant_get_boolean(value);
+         continue;
+      }
 
-      return FALSE;
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         "The argument '%s' is either not a valid option or it has an unexpected type",
+         key);
+      return;
    }
 
-   unix_stream = g_unix_input_stream_new(client_stdout, TRUE);
-   self->start_update_stdout_stream = g_data_input_stream_new(unix_stream);
+   if (g_variant_iter_n_children(targets_iter) > AU_CHECK_MULTI_MAX_TARGETS) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         "At most %u targets can be queried at the same time",
+         AU_CHECK_MULTI_MAX_TARGETS);
+      return;
+   }
 
-   g_data_input_stream_read_line_async(self->start_update_stdout_stream,
-                                       G_PRIORITY_DEFAULT, NULL,
-                                       _au_client_stdout_update_cb, g_object_ref(object));
+   while (g_variant_iter_next(targets_iter, "(&s&s)", &variant, &branch)) {
+      MultiQueryTarget *target = NULL;
+      g_autofree gchar *target_key = NULL;
 
-   self->install_event_source = g_child_watch_add(
-      self->install_pid, (GChildWatchFunc)child_watch_cb, g_object_ref(object));
+      if (variant[0] == '\0' || branch[0] == '\0' || strstr(variant, "..") != NULL ||
+          strstr(branch, "..") != NULL || strpbrk(variant, "/ ") != NULL ||
+          strpbrk(branch, "/ ") != NULL) {
+         g_dbus_method_invocation_return_error(
+            g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+            "Invalid target '%s', '%s': the variant and branch must not be empty or "
+            "contain spaces, slashes, or '..'",
+            variant, branch);
+         return;
+      }
 
-   return TRUE;
-}
+      target_key = g_strdup_printf("%s/%s", variant, branch);
 
-static void
-au_start_update_authorized_cb(AuAtomupd1 *object,
-                              GDBusMethodInvocation *invocation,
-                              gpointer arg_id_pointer)
-{
-   const gchar *arg_id = arg_id_pointer;
-   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
-   g_autoptr(GPtrArray) argv = NULL;
-   g_autoptr(GFileIOStream) stream = NULL;
-   GVariant *updates_available = NULL; /* borrowed */
-   g_autoptr(GVariantIter) updates_iter = NULL;
-   gboolean found_buildid = FALSE;
-   g_autoptr(GError) error = NULL;
-   AuUpdateStatus current_status;
+      /* Skip the duplicated targets */
+      if (g_hash_table_contains(multi->results, target_key))
+         continue;
 
-   current_status = au_atomupd1_get_update_status(object);
-   if (current_status == AU_UPDATE_STATUS_IN_PROGRESS ||
-       current_status == AU_UPDATE_STATUS_PAUSED) {
-      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
-                                            G_DBUS_ERROR_FAILED,
-                                            "Failed to start a new update because one "
-                                            "is already in progress");
-      return;
+      target = g_slice_new0(MultiQueryTarget);
+      target->multi = multi;
+      target->variant = g_strdup(variant);
+      target->branch = g_strdup(branch);
+      target->key = g_strdup(target_key);
+
+      /* Placeholder, replaced by the actual result when the query completes */
+      g_hash_table_insert(multi->results, g_strdup(target_key),
+                          g_variant_ref_sink(g_variant_new("a{sv}", NULL)));
+      g_ptr_array_add(multi->keys, g_steal_pointer(&target_key));
+      g_queue_push_tail(multi->pending, target);
    }
 
-   if (!g_file_query_exists(self->updates_json_file, NULL)) {
-      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
-                                            G_DBUS_ERROR_FAILED,
-                                            "It is not possible to start an update "
-                                            "before calling \"CheckForUpdates\"");
-      return;
+   if (!g_file_test(_au_get_remote_info_path(self), G_FILE_TEST_EXISTS)) {
+      g_debug("We don't have a remote info file, trying to download it again...");
+      _au_download_remote_info(self, NULL);
    }
 
-   au_atomupd1_set_update_build_id(object, arg_id);
+   multi->req->invocation = g_steal_pointer(&invocation);
+   multi->req->object = g_object_ref(object);
+   _au_multi_query_launch_next(g_steal_pointer(&multi));
+}
 
-   updates_available = au_atomupd1_get_updates_available(object);
-   if (updates_available != NULL) {
-      gchar *buildid = NULL;   /* borrowed */
-      GVariant *values = NULL; /* borrowed */
+static gboolean
+au_atomupd1_impl_handle_check_for_updates_multi(AuAtomupd1 *object,
+                                                GDBusMethodInvocation *invocation,
+                                                GVariant *arg_targets,
+                                                GVariant *arg_options)
+{
+   g_autoptr(GVariant) multi_data = g_variant_ref_sink(
+      g_variant_new("(@a(ss)@a{sv})", arg_targets, arg_options));
 
-      g_variant_get(updates_available, "a{?*}", &updates_iter);
-      while (g_variant_iter_loop(updates_iter, "{s@a{sv}}", &buildid, &values)) {
-         if (g_str_equal(arg_id, buildid)) {
-            g_autoptr(GVariant) version = NULL;
+   _au_check_auth(object, "com.steampowered.atomupd1.check-for-updates",
+                  au_check_for_updates_multi_authorized_cb, invocation,
+                  g_steal_pointer(&multi_data), (GDestroyNotify)g_variant_unref);
 
-            version = g_variant_lookup_value(values, "version", G_VARIANT_TYPE_STRING);
-            au_atomupd1_set_update_version(object, g_variant_get_string(version, NULL));
-            found_buildid = TRUE;
-            break;
-         }
-      }
-   }
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-   if (!found_buildid) {
-      g_warning("The chosen buildid '%s' doesn't seem to be available, the update "
-                "is expected to fail",
-                arg_id);
+static void
+_au_atomupd1_set_update_status_and_error(AuAtomupd1 *object,
+                                         guint status,
+                                         const gchar *error_code,
+                                         const gchar *error_message)
+{
+   g_return_if_fail(object != NULL);
 
-      /* Clear any previous value we might have */
-      au_atomupd1_set_update_version(object, NULL);
-   }
+   /* Record the error first, so that it's part of the dump taken on failure */
+   if (error_message != NULL)
+      au_flight_record(AU_FLIGHT_EVENT_ERROR, 0, error_message);
 
-   /* Create a copy of the json file because we will pass that to the
-    * 'steamos-atomupd-client' helper and, if in the meantime we check again
-    * for updates, we may replace that file with a newer version. */
+   au_atomupd1_set_update_status(object, status);
+   au_atomupd1_set_failure_code(object, error_code);
+   au_atomupd1_set_failure_message(object, error_message);
+   g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+}
 
-   if (self->updates_json_copy != NULL) {
-      g_file_delete(self->updates_json_copy, NULL, NULL);
-      g_clear_object(&self->updates_json_copy);
-   }
+/*
+ * Returns: The RAUC service PID or -1 if an error occurred.
+ */
+static gint64
+_au_get_rauc_service_pid(GError **error)
+{
+   g_autofree gchar *output = NULL;
+   gchar *endptr = NULL;
+   gint wait_status = 0;
+   gint64 rauc_pid;
 
-   self->updates_json_copy =
-      g_file_new_tmp("steamos-atomupd-XXXXXX.json", &stream, &error);
-   if (self->updates_json_copy == NULL) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to create a copy of the JSON update file %s", error->message);
-      return;
-   }
-   if (!g_file_copy(self->updates_json_file, self->updates_json_copy,
-                    G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to create a copy of the JSON update file %s", error->message);
-      return;
-   }
+   const gchar *systemctl_argv[] = {
+      "systemctl", "show", "--property", "MainPID", "rauc", NULL,
+   };
 
-   argv = g_ptr_array_new_with_free_func(g_free);
-   g_ptr_array_add(argv, g_strdup("steamos-atomupd-client"));
-   g_ptr_array_add(argv, g_strdup("--config"));
-   g_ptr_array_add(argv, g_strdup(self->config_path));
-   g_ptr_array_add(argv, g_strdup("--update-file"));
-   g_ptr_array_add(argv, g_file_get_path(self->updates_json_copy));
-   g_ptr_array_add(argv, g_strdup("--update-version"));
-   g_ptr_array_add(argv, g_strdup(arg_id));
+   g_return_val_if_fail(error == NULL || *error == NULL, -1);
 
-   if (g_debug_controller_get_debug_enabled(self->debug_controller))
-      g_ptr_array_add(argv, g_strdup("--debug"));
+   if (!au_supervisor_run_sync(au_supervisor_get_default(), AU_HELPER_KIND_TOOL,
+                               systemctl_argv, &output, &wait_status, error)) {
+      return -1;
+   }
 
-   g_ptr_array_add(argv, NULL);
+   if (!g_spawn_check_wait_status(wait_status, error))
+      return -1;
 
-   if (!_au_spawn_update_helper(object, argv, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to launch the \"steamos-atomupd-client\" helper: %s", error->message);
-      return;
+   if (!g_str_has_prefix(output, "MainPID=")) {
+      g_debug("Systemctl output is '%s' instead of the expected 'MainPID=X'", output);
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "An error occurred while trying to gather the RAUC PID");
+      return -1;
    }
 
-   au_atomupd1_set_progress_percentage(object, 0);
-   _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_IN_PROGRESS, NULL,
-                                            NULL);
+   rauc_pid = g_ascii_strtoll(output + strlen("MainPID="), &endptr, 10);
+   if (endptr == NULL || output + strlen("MainPID=") == (const char *)endptr) {
+      g_debug("Unable to parse Systemctl output: %s", output);
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "An error occurred while trying to gather the RAUC PID");
+      return -1;
+   }
 
-   au_atomupd1_complete_start_update(object, g_steal_pointer(&invocation));
+   return rauc_pid;
 }
 
-static gboolean
-au_atomupd1_impl_handle_start_update(AuAtomupd1 *object,
-                                     GDBusMethodInvocation *invocation,
-                                     const gchar *arg_id)
+/*
+ * Returns: The @process PID or -1 if it's not available or an error occurred.
+ */
+static gint64
+_au_get_process_pid(const gchar *process, GError **error)
 {
-   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
-   gint64 request_buildid_date;
-   gint64 request_buildid_increment;
-   const gchar *action_id = "com.steampowered.atomupd1.start-upgrade";
-   g_autoptr(GError) error = NULL;
+   g_autofree gchar *output = NULL;
+   gchar *endptr = NULL;
+   gint wait_status = 0;
+   gint64 pid;
 
-   if (!_is_buildid_valid(arg_id, &request_buildid_date, &request_buildid_increment,
-                          &error)) {
-      g_dbus_method_invocation_return_error_literal(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-         error->message);
-      return G_DBUS_METHOD_INVOCATION_HANDLED;
-   }
+   g_return_val_if_fail(process != NULL, -1);
+   g_return_val_if_fail(error == NULL || *error == NULL, -1);
 
-   if (request_buildid_date < self->buildid_date ||
-       (request_buildid_date == self->buildid_date &&
-        request_buildid_increment < self->buildid_increment)) {
-      action_id = "com.steampowered.atomupd1.start-downgrade";
+   const gchar *argv[] = {
+      "pidof", "--single-shot", "-x", process, NULL,
+   };
+
+   if (!au_supervisor_run_sync(au_supervisor_get_default(), AU_HELPER_KIND_TOOL, argv,
+                               &output, &wait_status, error))
+      return -1;
+
+   if (WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 1) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                  "There isn't a running process for %s", process);
+      return -1;
    }
 
-   _au_check_auth(object, action_id, au_start_update_authorized_cb, invocation,
-                  g_strdup(arg_id), g_free);
+   if (!g_spawn_check_wait_status(wait_status, error))
+      return -1;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   pid = g_ascii_strtoll(output, &endptr, 10);
+   if (endptr == NULL || output == (const char *)endptr) {
+      g_debug("Unable to parse pidof output: %s", output);
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                  "An error occurred while trying to gather the %s PID", process);
+      return -1;
+   }
+
+   return pid;
 }
 
 static void
-au_start_custom_update_authorized_cb(AuAtomupd1 *object,
-                                     GDBusMethodInvocation *invocation,
+_au_cancel_async(GTask *task,
+                 gpointer source_object,
+                 gpointer data,
+                 GCancellable *cancellable)
+{
+   gint64 rauc_pid;
+   g_autoptr(GError) error = NULL;
+   GPid pid = GPOINTER_TO_INT(data);
+
+   /* The first thing to kill is the install helper. Otherwise, if we kill
+    * RAUC while the helper is still running, the helper might execute RAUC
+    * again before we are able to send the termination signal to the helper. */
+   au_terminate_pid(pid);
+
+   /* At the moment a RAUC operation can't be cancelled using its D-Bus API.
+    * For this reason we get its PID number and send a SIGTERM/SIGKILL to it. */
+   rauc_pid = _au_get_rauc_service_pid(&error);
+
+   if (rauc_pid < 0) {
+      g_task_return_error(task, g_steal_pointer(&error));
+      return;
+   }
+
+   au_terminate_pid(rauc_pid);
+
+   g_task_return_boolean(task, TRUE);
+}
+
+static void
+cancel_callback(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+   g_autoptr(GError) error = NULL;
+   g_autoptr(RequestData) data = user_data;
+
+   if (g_task_propagate_boolean(G_TASK(result), &error)) {
+      au_atomupd1_set_update_status(data->object, AU_UPDATE_STATUS_CANCELLED);
+      au_atomupd1_complete_cancel_update(data->object,
+                                         g_steal_pointer(&data->invocation));
+   } else {
+      /* We failed to cancel a running update, probably the update is still
+       * running, but we don't know for certain. */
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&data->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to cancel an update: %s", error->message);
+   }
+}
+
+static void
+au_cancel_update_authorized_cb(AuAtomupd1 *object,
+                               GDBusMethodInvocation *invocation,
+                               gpointer data_pointer)
+{
+   g_autoptr(RequestData) data = g_slice_new0(RequestData);
+   g_autoptr(GTask) task = NULL;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_IN_PROGRESS &&
+       au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_PAUSED) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "There isn't an update in progress that can be cancelled");
+      return;
+   }
+
+   /* The helper is terminated and reaped by _au_cancel_async() */
+   if (self->install_child != NULL)
+      au_child_detach(g_steal_pointer(&self->install_child));
+
+   g_clear_handle_id(&self->stall_watchdog_source, g_source_remove);
+
+   data->invocation = g_steal_pointer(&invocation);
+   data->object = g_object_ref(object);
+
+   task = g_task_new(NULL, NULL, cancel_callback, g_steal_pointer(&data));
+
+   g_task_set_task_data(task, GINT_TO_POINTER(self->install_pid), NULL);
+   g_task_run_in_thread(task, _au_cancel_async);
+}
+
+static gboolean
+au_atomupd1_impl_handle_cancel_update(AuAtomupd1 *object,
+                                      GDBusMethodInvocation *invocation)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
+                  au_cancel_update_authorized_cb, invocation, NULL, NULL);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+/*
+ * _au_send_signal_to_install_procs:
+ * @self: A AuAtomupd1Impl object
+ * @sig: Signal that will be sent to the processes
+ * @error: Used to raise an error on failure
+ *
+ * Send @sig to the install helper PID and to the RAUC service process group ID
+ *
+ * Returns: %TRUE if the signal was successfully sent
+ */
+static gboolean
+_au_send_signal_to_install_procs(AuAtomupd1Impl *self, int sig, GError **error)
+{
+   g_autoptr(GError) local_error = NULL;
+   gint64 rauc_pid;
+   int saved_errno;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   if (self->install_child == NULL) {
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "Unexpectedly the PID of the install helper is not set");
+      return FALSE;
+   }
+
+   g_debug("Sending signal %i to the install helper with PID %i", sig, self->install_pid);
+
+   if (!au_child_send_signal(self->install_child, sig, &local_error)) {
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "Unable to send signal %i to the update helper: %s", sig,
+                  local_error->message);
+      return FALSE;
+   }
+
+   rauc_pid = _au_get_rauc_service_pid(error);
+   if (rauc_pid < 0)
+      return FALSE;
+
+   if (rauc_pid > 0) {
+      /* Send the signal to the entire PGID, to include the eventual Desync process */
+      int rauc_pgid = getpgid(rauc_pid);
+      g_debug("Sending signal %i to the RAUC service PGID %i", sig, rauc_pgid);
+
+      if (killpg(rauc_pgid, sig) < 0) {
+         saved_errno = errno;
+         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                     "Unable to send signal %i to the RAUC service: %s", sig,
+                     g_strerror(saved_errno));
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+static gboolean
+_au_is_automatic_pause_reason(const gchar *reason)
+{
+   return g_strcmp0(reason, AU_PAUSE_REASON_NETWORK_OFFLINE) == 0 ||
+          g_strcmp0(reason, AU_PAUSE_REASON_NETWORK_METERED) == 0 ||
+          g_strcmp0(reason, AU_PAUSE_REASON_BATTERY_LOW) == 0 ||
+          g_strcmp0(reason, AU_PAUSE_REASON_OVERHEATING) == 0;
+}
+
+typedef struct {
+   gint niceness;
+   gint ioprio;
+} AuPriority;
+
+/*
+ * _au_get_priority:
+ * @pid: The process ID
+ * @niceness: (out) (not optional): Used to return the niceness
+ * @ioprio: (out) (not optional): Used to return the I/O priority
+ *
+ * Returns: %TRUE on success, otherwise %FALSE with errno set
+ */
+static gboolean
+_au_get_priority(GPid pid, gint *niceness, gint *ioprio)
+{
+   /* getpriority() can legitimately return -1 */
+   errno = 0;
+   *niceness = getpriority(PRIO_PROCESS, pid);
+   if (*niceness == -1 && errno != 0)
+      return FALSE;
+
+   *ioprio = syscall(SYS_ioprio_get, AU_IOPRIO_WHO_PROCESS, pid);
+
+   return *ioprio >= 0;
+}
+
+/*
+ * _au_set_priority:
+ * @pid: The process ID
+ * @niceness: The niceness to set
+ * @ioprio: The I/O priority to set
+ *
+ * Returns: %TRUE on success, otherwise %FALSE with errno set
+ */
+static gboolean
+_au_set_priority(GPid pid, gint niceness, gint ioprio)
+{
+   return setpriority(PRIO_PROCESS, pid, niceness) == 0 &&
+          syscall(SYS_ioprio_set, AU_IOPRIO_WHO_PROCESS, pid, ioprio) == 0;
+}
+
+/*
+ * _au_get_rauc_pids:
+ * @error: Used to raise an error if it was not possible to get the PID of the
+ *  RAUC service
+ *
+ * Returns: (transfer full) (element-type GPid): The processes in the RAUC
+ *  service process group, including the eventual Desync process, or %NULL if
+ *  the RAUC service is not running
+ */
+static GArray *
+_au_get_rauc_pids(GError **error)
+{
+   gint64 rauc_pid;
+   GPid rauc_pgid;
+
+   rauc_pid = _au_get_rauc_service_pid(error);
+   if (rauc_pid <= 0)
+      return NULL;
+
+   rauc_pgid = getpgid(rauc_pid);
+   if (rauc_pgid <= 0)
+      return NULL;
+
+   return _au_get_pgrp_pids(AU_PROC_PATH, rauc_pgid);
+}
+
+/*
+ * _au_save_rauc_priorities:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @rauc_pids: (element-type GPid): The processes in the RAUC service process
+ *  group
+ * @error: Used to raise an error on failure
+ *
+ * Save the priority of each RAUC process, because they don't necessarily
+ * share the same one, so that _au_restore_rauc_priority() can give each of
+ * them back its own.
+ *
+ * Returns: %TRUE on success
+ */
+static gboolean
+_au_save_rauc_priorities(AuAtomupd1Impl *self, GArray *rauc_pids, GError **error)
+{
+   gsize i;
+
+   if (self->rauc_priorities == NULL)
+      self->rauc_priorities = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+
+   g_hash_table_remove_all(self->rauc_priorities);
+
+   for (i = 0; i < rauc_pids->len; i++) {
+      GPid pid = g_array_index(rauc_pids, GPid, i);
+      g_autofree AuPriority *priority = g_new0(AuPriority, 1);
+
+      if (!_au_get_priority(pid, &priority->niceness, &priority->ioprio)) {
+         int saved_errno = errno;
+
+         /* The process already exited */
+         if (saved_errno == ESRCH)
+            continue;
+
+         g_hash_table_remove_all(self->rauc_priorities);
+         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                     "Unable to get the priority of the RAUC process %i: %s", pid,
+                     g_strerror(saved_errno));
+         return FALSE;
+      }
+
+      g_hash_table_insert(self->rauc_priorities, GINT_TO_POINTER(pid),
+                          g_steal_pointer(&priority));
+   }
+
+   return TRUE;
+}
+
+/*
+ * _au_restore_rauc_priority:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * When a throttled update ends the install helper is gone, but the RAUC
+ * service keeps running, so give each of its processes back the priority it
+ * had before. The processes that have been spawned after the throttling
+ * inherited the lowered priority, so they get the one that the RAUC service
+ * main process had.
+ */
+static void
+_au_restore_rauc_priority(AuAtomupd1Impl *self)
+{
+   g_autoptr(GArray) rauc_pids = NULL;
+   const AuPriority *fallback = NULL;
+   gint64 rauc_pid;
+   gsize i;
+
+   if (self->throttled_pid == 0)
+      return;
+
+   self->throttled_pid = 0;
+
+   if (self->rauc_priorities == NULL || g_hash_table_size(self->rauc_priorities) == 0)
+      return;
+
+   rauc_pid = _au_get_rauc_service_pid(NULL);
+   if (rauc_pid > 0)
+      fallback = g_hash_table_lookup(self->rauc_priorities, GINT_TO_POINTER(rauc_pid));
+
+   rauc_pids = _au_get_rauc_pids(NULL);
+
+   for (i = 0; rauc_pids != NULL && i < rauc_pids->len; i++) {
+      GPid pid = g_array_index(rauc_pids, GPid, i);
+      const AuPriority *priority;
+
+      priority = g_hash_table_lookup(self->rauc_priorities, GINT_TO_POINTER(pid));
+      if (priority == NULL)
+         priority = fallback;
+
+      /* Without a saved priority, e.g. because the RAUC service has been
+       * restarted in the meantime, there is nothing to give back */
+      if (priority == NULL)
+         continue;
+
+      if (!_au_set_priority(pid, priority->niceness, priority->ioprio) &&
+          errno != ESRCH) {
+         int saved_errno = errno;
+
+         g_warning("Unable to restore the priority of the RAUC process %i: %s", pid,
+                   g_strerror(saved_errno));
+      }
+   }
+
+   g_hash_table_remove_all(self->rauc_priorities);
+}
+
+/*
+ * _au_set_install_procs_throttled:
+ * @self: A AuAtomupd1Impl object
+ * @throttle_state: (not nullable): One of the values of the "ThrottleState"
+ *  property, to lower the CPU and I/O priority accordingly, or restore the
+ *  original one
+ * @error: Used to raise an error on failure
+ *
+ * Change the priority of the install helper PID and of each process in the
+ * RAUC service process group, like _au_send_signal_to_install_procs() does
+ * with signals. Before throttling them, their current priority is saved, so
+ * that going back to %AU_THROTTLE_STATE_NONE restores it, instead of resetting
+ * it to the default one, e.g. when the helper was launched with a low priority.
+ *
+ * Returns: %TRUE if the priority was successfully changed
+ */
+static gboolean
+_au_set_install_procs_throttled(AuAtomupd1Impl *self,
+                                const gchar *throttle_state,
+                                GError **error)
+{
+   g_autoptr(GArray) rauc_pids = NULL;
+   g_autoptr(GError) local_error = NULL;
+   gboolean restore = FALSE;
+   gint niceness = 0;
+   gint ioprio = 0;
+   int saved_errno;
+   gsize i;
+
+   if (g_str_equal(throttle_state, AU_THROTTLE_STATE_IDLE)) {
+      niceness = AU_THROTTLE_IDLE_NICENESS;
+      ioprio = AU_IOPRIO_PRIO_VALUE(AU_IOPRIO_CLASS_IDLE, 0);
+   } else if (g_str_equal(throttle_state, AU_THROTTLE_STATE_REDUCED)) {
+      niceness = AU_THROTTLE_NICENESS;
+      ioprio = AU_IOPRIO_PRIO_VALUE(AU_IOPRIO_CLASS_BE, AU_THROTTLE_IO_LEVEL);
+   } else {
+      restore = TRUE;
+   }
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   if (self->install_pid == 0) {
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "Unexpectedly the PID of the install helper is not set");
+      return FALSE;
+   }
+
+   /* Nothing has been throttled, so there is nothing to restore */
+   if (restore && self->throttled_pid != self->install_pid)
+      return TRUE;
+
+   if (restore) {
+      g_debug("Restoring the niceness %i of the install helper with PID %i",
+              self->install_niceness, self->install_pid);
+
+      if (!_au_set_priority(self->install_pid, self->install_niceness,
+                            self->install_ioprio)) {
+         saved_errno = errno;
+         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                     "Unable to change the priority of the update helper: %s",
+                     g_strerror(saved_errno));
+         return FALSE;
+      }
+
+      _au_restore_rauc_priority(self);
+      return TRUE;
+   }
+
+   rauc_pids = _au_get_rauc_pids(&local_error);
+   if (local_error != NULL) {
+      g_propagate_error(error, g_steal_pointer(&local_error));
+      return FALSE;
+   }
+
+   if (self->throttled_pid != self->install_pid) {
+      if (!_au_get_priority(self->install_pid, &self->install_niceness,
+                            &self->install_ioprio)) {
+         saved_errno = errno;
+         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                     "Unable to get the priority of the update helper: %s",
+                     g_strerror(saved_errno));
+         return FALSE;
+      }
+
+      if (rauc_pids != NULL && !_au_save_rauc_priorities(self, rauc_pids, error))
+         return FALSE;
+
+      self->throttled_pid = self->install_pid;
+   }
+
+   g_debug("Setting niceness %i to the install helper with PID %i", niceness,
+           self->install_pid);
+
+   if (!_au_set_priority(self->install_pid, niceness, ioprio)) {
+      saved_errno = errno;
+      g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                  "Unable to change the priority of the update helper: %s",
+                  g_strerror(saved_errno));
+      return FALSE;
+   }
+
+   for (i = 0; rauc_pids != NULL && i < rauc_pids->len; i++) {
+      GPid pid = g_array_index(rauc_pids, GPid, i);
+
+      g_debug("Setting niceness %i to the RAUC process %i", niceness, pid);
+
+      /* Processes spawned after the priorities were saved inherited the
+       * throttled one, so they don't need to be tracked separately */
+      if (!_au_set_priority(pid, niceness, ioprio) && errno != ESRCH) {
+         saved_errno = errno;
+         g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+                     "Unable to change the priority of the RAUC process %i: %s", pid,
+                     g_strerror(saved_errno));
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+static gboolean
+_au_has_power_policy(AuAtomupd1Impl *self)
+{
+   return self->throttle_on_battery || self->pause_below_battery_level > 0 ||
+          self->throttle_above_temperature > 0 || self->pause_above_temperature > 0;
+}
+
+/*
+ * _au_get_power_pause_reason:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @throttled: (out) (not optional): Used to return whether the update should
+ *  run with a lower priority
+ *
+ * Returns: (nullable): The reason why, according to the configured power
+ *  policy, updates should not run with the current power and thermal
+ *  conditions, or %NULL if they can run
+ */
+static const gchar *
+_au_get_power_pause_reason(AuAtomupd1Impl *self, gboolean *throttled)
+{
+   const gchar *current_reason = au_atomupd1_get_pause_reason((AuAtomupd1 *)self);
+   const gchar *sysfs_path;
+   AuPowerState state;
+   gint margin;
+
+   *throttled = FALSE;
+
+   if (!_au_has_power_policy(self))
+      return NULL;
+
+   /* This environment variable is used for debugging and automated tests */
+   sysfs_path = g_getenv("AU_SYSFS_PATH");
+   if (sysfs_path == NULL)
+      sysfs_path = AU_SYSFS_PATH;
+
+   au_power_state_read(sysfs_path, &state);
+
+   margin = g_strcmp0(current_reason, AU_PAUSE_REASON_OVERHEATING) == 0
+               ? AU_POWER_HYSTERESIS
+               : 0;
+   if (self->pause_above_temperature > 0 &&
+       state.temperature >= self->pause_above_temperature - margin)
+      return AU_PAUSE_REASON_OVERHEATING;
+
+   margin = g_strcmp0(current_reason, AU_PAUSE_REASON_BATTERY_LOW) == 0
+               ? AU_POWER_HYSTERESIS
+               : 0;
+   if (self->pause_below_battery_level > 0 && state.on_battery &&
+       state.battery_level >= 0 &&
+       state.battery_level < self->pause_below_battery_level + margin)
+      return AU_PAUSE_REASON_BATTERY_LOW;
+
+   *throttled = (self->throttle_on_battery && state.on_battery) ||
+                (self->throttle_above_temperature > 0 &&
+                 state.temperature >= self->throttle_above_temperature);
+
+   return NULL;
+}
+
+/*
+ * _au_get_network_pause_reason:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Returns: (nullable): The reason why, according to the configured network
+ *  policy, updates should not run with the current network conditions, or
+ *  %NULL if they can run
+ */
+static const gchar *
+_au_get_network_pause_reason(AuAtomupd1Impl *self)
+{
+   g_autofree gchar *network_state = NULL;
+   gboolean offline;
+   gboolean metered;
+
+   if (!self->pause_when_offline && !self->pause_when_metered)
+      return NULL;
+
+   if (_au_read_test_network_state(&network_state)) {
+      if (network_state == NULL)
+         return NULL;
+
+      offline = g_str_equal(network_state, "offline");
+      metered = g_str_equal(network_state, "metered");
+   } else if (self->network_monitor != NULL) {
+      offline = g_network_monitor_get_connectivity(self->network_monitor) ==
+                G_NETWORK_CONNECTIVITY_LOCAL;
+      metered = g_network_monitor_get_network_metered(self->network_monitor);
+   } else {
+      return NULL;
+   }
+
+   if (self->pause_when_offline && offline)
+      return AU_PAUSE_REASON_NETWORK_OFFLINE;
+
+   if (self->pause_when_metered && metered)
+      return AU_PAUSE_REASON_NETWORK_METERED;
+
+   return NULL;
+}
+
+/*
+ * _au_apply_update_policies:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Pause the running update if the current conditions don't allow it to
+ * continue, and resume it once they do again. Updates that have been paused
+ * by the user are never resumed here. While the update runs, also lower or
+ * restore its priority according to the power and pressure policies.
+ */
+static void
+_au_apply_update_policies(AuAtomupd1Impl *self)
+{
+   AuAtomupd1 *object = (AuAtomupd1 *)self;
+   AuUpdateStatus status = au_atomupd1_get_update_status(object);
+   const gchar *current_reason = au_atomupd1_get_pause_reason(object);
+   const gchar *power_reason = NULL;
+   const gchar *reason = NULL;
+   const gchar *throttle_state;
+   gboolean throttled = FALSE;
+   g_autoptr(GError) error = NULL;
+
+   if (status != AU_UPDATE_STATUS_IN_PROGRESS && status != AU_UPDATE_STATUS_PAUSED)
+      return;
+
+   power_reason = _au_get_power_pause_reason(self, &throttled);
+   reason = _au_get_network_pause_reason(self);
+   if (reason == NULL)
+      reason = power_reason;
+
+   if (status == AU_UPDATE_STATUS_IN_PROGRESS && reason != NULL) {
+      g_info("Automatically pausing the update, reason: %s", reason);
+
+      if (!_au_send_signal_to_install_procs(self, SIGSTOP, &error)) {
+         g_warning("Failed to pause the update: %s", error->message);
+         return;
+      }
+
+      au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_PAUSED);
+      au_atomupd1_set_pause_reason(object, reason);
+      return;
+   }
+
+   if (status == AU_UPDATE_STATUS_PAUSED) {
+      if (!_au_is_automatic_pause_reason(current_reason))
+         return;
+
+      if (reason != NULL) {
+         au_atomupd1_set_pause_reason(object, reason);
+         return;
+      }
+
+      g_info("Automatically resuming the update");
+
+      if (!_au_send_signal_to_install_procs(self, SIGCONT, &error)) {
+         g_warning("Failed to resume the update: %s", error->message);
+         return;
+      }
+
+      au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_IN_PROGRESS);
+   }
+
+   throttle_state = throttled ? AU_THROTTLE_STATE_REDUCED : AU_THROTTLE_STATE_NONE;
+
+   /* The pressure policy can only slow down the update further */
+   if (self->pressure_controller != NULL) {
+      guint level = au_pressure_controller_get_state(self->pressure_controller)->level;
+
+      if (level >= 2)
+         throttle_state = AU_THROTTLE_STATE_IDLE;
+      else if (level == 1)
+         throttle_state = AU_THROTTLE_STATE_REDUCED;
+   }
+
+   if (g_strcmp0(throttle_state, au_atomupd1_get_throttle_state(object)) == 0)
+      return;
+
+   g_info("Changing the update priority to %s", throttle_state);
+
+   if (!_au_set_install_procs_throttled(self, throttle_state, &error)) {
+      g_warning("Failed to change the update priority: %s", error->message);
+      return;
+   }
+
+   au_atomupd1_set_throttle_state(object, throttle_state);
+}
+
+static gboolean
+_au_power_poll_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+
+   _au_apply_update_policies(self);
+
+   return G_SOURCE_CONTINUE;
+}
+
+static void
+_au_network_changed_cb(AuAtomupd1Impl *self)
+{
+   _au_apply_update_policies(self);
+
+   /* The cached reachability of the meta server might not be valid anymore */
+   self->reachability_expiry = 0;
+
+   if (self->recheck_when_online) {
+      /* If we are still offline, this will be set again */
+      self->recheck_when_online = FALSE;
+      g_debug("The network changed, repeating the update check skipped while offline");
+      _au_query_when_reachable(self, NULL, FALSE, FALSE, FALSE);
+   }
+}
+
+/*
+ * _au_update_power_poll:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * The power and thermal state doesn't have change notifications. Ensure that
+ * we periodically check it while there is an update that could be affected
+ * by the power policy, and only then.
+ */
+static void
+_au_update_power_poll(AuAtomupd1Impl *self)
+{
+   AuUpdateStatus status = au_atomupd1_get_update_status((AuAtomupd1 *)self);
+   const gchar *interval_str;
+   guint interval = AU_POWER_POLL_INTERVAL;
+
+   if ((status != AU_UPDATE_STATUS_IN_PROGRESS && status != AU_UPDATE_STATUS_PAUSED) ||
+       !_au_has_power_policy(self)) {
+      g_clear_handle_id(&self->power_poll_source, g_source_remove);
+      return;
+   }
+
+   if (self->power_poll_source != 0)
+      return;
+
+   /* This environment variable is used for debugging and automated tests */
+   interval_str = g_getenv("AU_POWER_POLL_INTERVAL");
+   if (interval_str != NULL && g_ascii_strtoull(interval_str, NULL, 10) > 0)
+      interval = g_ascii_strtoull(interval_str, NULL, 10);
+
+   self->power_poll_source = g_timeout_add_seconds(interval, _au_power_poll_cb, self);
+}
+
+static void
+_au_update_pressure_state(AuAtomupd1Impl *self)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sv}"));
+   const AuPressureState *state;
+   gsize i;
+
+   if (self->pressure_controller != NULL) {
+      state = au_pressure_controller_get_state(self->pressure_controller);
+
+      g_variant_builder_add(&builder, "{sv}", "level",
+                            g_variant_new_uint32(state->level));
+
+      for (i = 0; i < AU_N_PRESSURE_RESOURCES; i++)
+         g_variant_builder_add(&builder, "{sv}", au_pressure_resource_to_string(i),
+                               g_variant_new_double(state->foreground_stall[i]));
+
+      g_variant_builder_add(&builder, "{sv}", "backoffs",
+                            g_variant_new_uint64(state->backoffs));
+      g_variant_builder_add(&builder, "{sv}", "rampups",
+                            g_variant_new_uint64(state->rampups));
+   }
+
+   au_atomupd1_set_pressure_state((AuAtomupd1 *)self, g_variant_builder_end(&builder));
+}
+
+static gboolean
+_au_pressure_poll_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+   AuPressureTotals foreground;
+   const AuPressureState *state;
+
+   if (!au_pressure_totals_read(self->pressure_foreground_dir, TRUE, &foreground)) {
+      g_debug("The pressure stall information of %s is not available, the pressure "
+              "policy is ignored", self->pressure_foreground_dir);
+      self->pressure_poll_source = 0;
+      return G_SOURCE_REMOVE;
+   }
+
+   if (au_pressure_controller_sample(self->pressure_controller, g_get_monotonic_time(),
+                                     &foreground)) {
+      state = au_pressure_controller_get_state(self->pressure_controller);
+      g_info("Pressure stall of the foreground tasks: cpu %.1f%%, io %.1f%%, "
+             "memory %.1f%%, update aggressiveness reduced to level %u",
+             state->foreground_stall[AU_PRESSURE_CPU],
+             state->foreground_stall[AU_PRESSURE_IO],
+             state->foreground_stall[AU_PRESSURE_MEMORY], state->level);
+      _au_apply_update_policies(self);
+   }
+
+   _au_update_pressure_state(self);
+
+   return G_SOURCE_CONTINUE;
+}
+
+/*
+ * _au_update_pressure_poll:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Like _au_update_power_poll(), sample the pressure stall information only
+ * while an update is running and the pressure policy is enabled. When the
+ * update ends, the next one starts again at full speed.
+ */
+static void
+_au_update_pressure_poll(AuAtomupd1Impl *self)
+{
+   AuUpdateStatus status = au_atomupd1_get_update_status((AuAtomupd1 *)self);
+   const gchar *interval_str;
+   guint interval = AU_PRESSURE_POLL_INTERVAL;
+
+   if (status != AU_UPDATE_STATUS_IN_PROGRESS || self->pressure_controller == NULL) {
+      g_clear_handle_id(&self->pressure_poll_source, g_source_remove);
+
+      if (status != AU_UPDATE_STATUS_PAUSED && self->pressure_controller != NULL) {
+         au_pressure_controller_reset(self->pressure_controller);
+         _au_update_pressure_state(self);
+      }
+
+      return;
+   }
+
+   if (self->pressure_poll_source != 0)
+      return;
+
+   /* This environment variable is used for debugging and automated tests */
+   interval_str = g_getenv("AU_PRESSURE_POLL_INTERVAL");
+   if (interval_str != NULL && g_ascii_strtoull(interval_str, NULL, 10) > 0)
+      interval = g_ascii_strtoull(interval_str, NULL, 10);
+
+   /* Take the first sample right away, the following ones are compared to it */
+   if (_au_pressure_poll_cb(self) == G_SOURCE_REMOVE)
+      return;
+
+   self->pressure_poll_source =
+      g_timeout_add_seconds(interval, _au_pressure_poll_cb, self);
+}
+
+static void
+au_pause_update_authorized_cb(AuAtomupd1 *object,
+                              GDBusMethodInvocation *invocation,
+                              gpointer data_pointer)
+{
+   g_autoptr(GError) error = NULL;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   /* If the update has been automatically paused, we just need to prevent it
+    * from being automatically resumed */
+   if (au_atomupd1_get_update_status(object) == AU_UPDATE_STATUS_PAUSED &&
+       _au_is_automatic_pause_reason(au_atomupd1_get_pause_reason(object))) {
+      au_atomupd1_set_pause_reason(object, AU_PAUSE_REASON_USER);
+      au_atomupd1_complete_pause_update(object, g_steal_pointer(&invocation));
+      return;
+   }
+
+   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_IN_PROGRESS) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "There isn't an update in progress that can be paused");
+      return;
+   }
+
+   if (!_au_send_signal_to_install_procs(self, SIGSTOP, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), error->domain, error->code,
+         "An error occurred while attempting to pause the installation process: %s",
+         error->message);
+      return;
+   }
+
+   au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_PAUSED);
+   au_atomupd1_set_pause_reason(object, AU_PAUSE_REASON_USER);
+   au_atomupd1_complete_pause_update(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_pause_update(AuAtomupd1 *object,
+                                     GDBusMethodInvocation *invocation)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
+                  au_pause_update_authorized_cb, invocation, NULL, NULL);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+/*
+ * _au_reset_progress_estimation:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @update_size: Estimated download size of the update that is starting, 0 if
+ *  unknown
+ */
+static void
+_au_reset_progress_estimation(AuAtomupd1Impl *self, guint64 update_size)
+{
+   self->update_size = update_size;
+   self->progress_bytes = 0;
+   self->progress_rate = 0;
+   self->progress_timestamp = 0;
+}
+
+/*
+ * _au_update_progress_estimation:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @percentage: The completed percentage reported by the helper
+ *
+ * The helper doesn't report the downloaded bytes. Estimate them, and the
+ * download rate, from the completed percentage and the size of the update.
+ */
+static void
+_au_update_progress_estimation(AuAtomupd1Impl *self, gdouble percentage)
+{
+   gint64 now = g_get_monotonic_time();
+   guint64 bytes;
+
+   if (self->update_size == 0)
+      return;
+
+   bytes = (guint64)(self->update_size * CLAMP(percentage, 0, 100) / 100);
+
+   if (self->progress_timestamp > 0 && now > self->progress_timestamp &&
+       bytes >= self->progress_bytes) {
+      guint64 rate = (bytes - self->progress_bytes) * G_USEC_PER_SEC /
+                     (now - self->progress_timestamp);
+
+      /* Smooth the rate, the helper only reports the percentage with two decimals */
+      if (self->progress_rate == 0)
+         self->progress_rate = rate;
+      else
+         self->progress_rate = (self->progress_rate * 3 + rate) / 4;
+   }
+
+   self->progress_bytes = bytes;
+   self->progress_timestamp = now;
+}
+
+static void
+_au_client_stdout_update_cb(GObject *object_stream,
+                            GAsyncResult *result,
+                            gpointer user_data)
+{
+   GDataInputStream *stream = (GDataInputStream *)object_stream;
+   g_autoptr(AuAtomupd1) object = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   size_t len;
+   const gchar *cursor = NULL;
+   gchar *endptr = NULL;
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *line = NULL;
+   g_auto(GStrv) parts = NULL;
+   g_autoptr(GDateTime) time_estimation = g_date_time_new_now_utc();
+   gdouble percentage;
+
+   if (self->start_update_stdout_stream != stream)
+      return;
+
+   /* steamos-atomupd-client will periodically print updates regarding the
+    * upgrade process. These updates are formatted as "XX.XX% DdHhMMmSSs".
+    * The estimated remaining time may be missing if we are either using Casync
+    * or if it is currently unknown.
+    * Examples of valid values include: "15.85% 08m44s", "0.00%", "4.31% 00m56s",
+    * "47.00% 1h12m05s" and "100%". */
+
+   line = g_data_input_stream_read_line_finish(stream, result, NULL, &error);
+
+   if (error != NULL) {
+      g_debug("Unable to read the update progress: %s", error->message);
+      return;
+   }
+
+   /* If there is nothing more to read, just return */
+   if (line == NULL)
+      return;
+
+   parts = g_strsplit(g_strstrip(line), " ", 2);
+
+   len = strlen(parts[0]);
+   if (len < 2 || parts[0][len - 1] != '%') {
+      g_debug("Unable to parse the completed percentage: %s", parts[0]);
+      return;
+   }
+
+   /* Remove the percentage sign */
+   parts[0][len - 1] = '\0';
+
+   /* The percentage here is not locale dependent, we don't have to worry
+    * about comma vs period for the decimals. */
+   percentage = g_ascii_strtod(parts[0], NULL);
+   au_atomupd1_set_progress_percentage(object, percentage);
+   au_flight_record(AU_FLIGHT_EVENT_PROGRESS, (gint64)(percentage * 100), NULL);
+   _au_update_progress_estimation(self, percentage);
+
+   /* Keep the stall watchdog at bay */
+   if (percentage > self->last_progress_percentage) {
+      self->last_progress_percentage = percentage;
+      self->last_progress_time = g_get_monotonic_time();
+   }
+
+   g_data_input_stream_read_line_async(stream, G_PRIORITY_DEFAULT, NULL,
+                                       _au_client_stdout_update_cb, g_object_ref(object));
+
+   if (parts[1] == NULL) {
+      au_atomupd1_set_estimated_completion_time(object, 0);
+      g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+      return;
+   }
+
+   cursor = parts[1];
+   while (*cursor != '\0') {
+      g_autoptr(GDateTime) updated_estimation = NULL;
+      guint64 value;
+
+      endptr = NULL;
+      value = g_ascii_strtoull(cursor, &endptr, 10);
+
+      if (endptr == NULL || cursor == (const char *)endptr) {
+         g_debug("Unable to parse the expected remaining time: %s", parts[1]);
+         au_atomupd1_set_estimated_completion_time(object, 0);
+         g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+         return;
+      }
+
+      cursor = endptr + 1;
+
+      switch (endptr[0]) {
+      case 'd':
+         updated_estimation = g_date_time_add_days(time_estimation, value);
+         break;
+
+      case 'h':
+         updated_estimation = g_date_time_add_hours(time_estimation, value);
+         break;
+
+      case 'm':
+         updated_estimation = g_date_time_add_minutes(time_estimation, value);
+         break;
+
+      case 's':
+         updated_estimation = g_date_time_add_seconds(time_estimation, value);
+         break;
+
+      default:
+         g_debug("Unable to parse the expected remaining time: %s", parts[1]);
+         au_atomupd1_set_estimated_completion_time(object, 0);
+         g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+         return;
+      }
+
+      g_date_time_unref(time_estimation);
+      time_estimation = g_steal_pointer(&updated_estimation);
+   }
+
+   au_atomupd1_set_estimated_completion_time(object,
+                                             g_date_time_to_unix(time_estimation));
+   g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+}
+
+static void
+au_start_update_clear(AuAtomupd1Impl *self)
+{
+   g_clear_object(&self->start_update_stdout_stream);
+   self->install_child = NULL;
+   self->install_pid = 0;
+}
+
+static void
+child_watch_cb(AuChild *child, gint wait_status, gpointer user_data)
+{
+   AuAtomupd1 *object = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_autoptr(GError) error = NULL;
+
+   g_clear_handle_id(&self->stall_watchdog_source, g_source_remove);
+
+   if (g_spawn_check_wait_status(wait_status, &error)) {
+      g_debug("The update has been successfully applied");
+      _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_SUCCESSFUL, NULL,
+                                               NULL);
+   } else {
+      g_autofree gchar *helper_message = _au_dup_helper_message(child);
+
+      _au_add_helper_message(error, helper_message);
+      g_debug("'steamos-atomupd-client' helper returned an error: %s", error->message);
+      _au_atomupd1_set_update_status_and_error(
+         object, AU_UPDATE_STATUS_FAILED, "org.freedesktop.DBus.Error", error->message);
+   }
+
+   au_start_update_clear((AuAtomupd1Impl *)object);
+}
+
+/*
+ * @buildid: The build ID to validate
+ * @date_out: (out) (optional): Used to return the date of @buildid
+ * @inc_out: (out) (optional): Used to return the incremental number of @buildid
+ * @error: (out) (optional): Used to return an error on failure
+ *
+ * Parse @buildid and perform some sanity checks.
+ * @buildid is expected to have a "date" part that follows the ISO-8601
+ * standard, without hyphens. Optionally, after the date, there is a dot and
+ * an increment. I.e. YYYYMMDD[.N]
+ *
+ * If this standard will ever change, please keep it in sync with the
+ * BuildId class in `steamos-atomupd.git`
+ *
+ * Returns: %TRUE if the @buildid has the expected form
+ */
+gboolean
+_is_buildid_valid(const gchar *buildid, gint64 *date_out, gint64 *inc_out, GError **error)
+{
+   gint64 month = 0;
+   gint64 day = 0;
+   gint64 inc = 0;
+   gint64 date = 0;
+   char *endptr;
+   g_auto(GStrv) requested_parts = NULL;
+   const gchar *date_str;
+   gsize i;
+
+   if (buildid == NULL || g_strcmp0(buildid, "") == 0)
+      return au_throw_error(error, "The provided Buildid is either NULL or empty");
+
+   requested_parts = g_strsplit(buildid, ".", 2);
+   date_str = requested_parts[0];
+
+   /* The date is expected to be in the form of YYYYMMDD, which
+    * g_date_time_new_from_iso8601() doesn't cover because without the time part.
+    * Instead, we parse it ourselves. */
+
+   date = g_ascii_strtoll(date_str, &endptr, 10);
+   if (date < 0 || date > G_MAXINT || endptr == date_str || *endptr != '\0') {
+      return au_throw_error(
+         error, "Buildid '%s' doesn't follow the expected YYYYMMDD[.N] format", buildid);
+   }
+
+   if (strlen(date_str) != 8) {
+      return au_throw_error(
+         error, "Buildid '%s' doesn't follow the expected YYYYMMDD[.N] format", buildid);
+   }
+   for (i = 4; i < 6; i++) {
+      month = month * 10 + (date_str[i] - '0');
+   }
+   for (i = 6; i < 8; i++) {
+      day = day * 10 + (date_str[i] - '0');
+   }
+
+   if (month > 12 || day > 31)
+      return au_throw_error(error, "The date in the buildid '%s' is not valid", buildid);
+
+   if (requested_parts[1] != NULL) {
+      inc = g_ascii_strtoll(requested_parts[1], &endptr, 10);
+
+      if (inc < 0 || inc > G_MAXINT || endptr == requested_parts[1] || *endptr != '\0') {
+         return au_throw_error(
+            error, "The increment part of the buildid is unexpected: '%s'", buildid);
+      }
+   }
+
+   if (date_out != NULL)
+      *date_out = date;
+   if (inc_out != NULL)
+      *inc_out = inc;
+
+   return TRUE;
+}
+
+static gboolean
+_au_get_update_bundle_from_json(const gchar *output,
+                                const gchar *wanted_buildid,
+                                gchar **buildid_out,
+                                gchar **update_path_out);
+
+/*
+ * _au_get_update_bundle_path:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @buildid: (not nullable): The buildid of the update being installed
+ *
+ * Returns: (transfer full) (nullable): The path of the RAUC bundle of @buildid,
+ *  relative to the images URL, or %NULL if it is not in the list of updates
+ *  that we gave to the helper
+ */
+static gchar *
+_au_get_update_bundle_path(AuAtomupd1Impl *self, const gchar *buildid)
+{
+   g_autofree gchar *contents = NULL;
+   gchar *update_path = NULL;
+
+   if (self->updates_json_copy == NULL ||
+       !g_file_load_contents(self->updates_json_copy, NULL, &contents, NULL, NULL,
+                             NULL))
+      return NULL;
+
+   if (!_au_get_update_bundle_from_json(contents, buildid, NULL, &update_path))
+      return NULL;
+
+   return update_path;
+}
+
+/*
+ * _au_ensure_mirror_proxy:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @http_proxy: (nullable): The HTTP proxy to use to reach the mirrors
+ * @bundle_path: (not nullable): The path of the bundle of the update being
+ *  installed, relative to the images URL
+ * @prewarm_path: (nullable): The pre-warmed copy of the bundle, if any
+ *
+ * If the configuration lists some mirrors of the images server, some peers or a
+ * local chunk cache, or if the bundle has been pre-warmed, ensure that the
+ * mirror proxy is running. It serves the bundle and the chunks from the local
+ * copies or the peers when it can, and spreads the other requests across all
+ * the mirrors. This is an optimization, so any error here is not fatal.
+ *
+ * Returns: (transfer full) (nullable): The URL that the helper should use in
+ *  place of the images server, or %NULL if the proxy is not needed
+ */
+static gchar *
+_au_ensure_mirror_proxy(AuAtomupd1Impl *self,
+                        const gchar *http_proxy,
+                        const gchar *bundle_path,
+                        const gchar *prewarm_path)
+{
+   /* The additional targets share the chunk cache of the running system */
+   AuAtomupd1Impl *cache_owner = self->primary != NULL ? self->primary : self;
+   g_autoptr(GPtrArray) mirrors = NULL;
+   g_autoptr(GError) error = NULL;
+   gsize i;
+
+   if (self->images_mirrors == NULL && cache_owner->peer_stores == NULL &&
+       cache_owner->chunk_cache == NULL && prewarm_path == NULL) {
+      g_clear_pointer(&self->mirror_proxy, au_mirror_proxy_free);
+      return NULL;
+   }
+
+   mirrors = g_ptr_array_new();
+   g_ptr_array_add(mirrors, self->images_url);
+   for (i = 0; self->images_mirrors != NULL && self->images_mirrors[i] != NULL; i++)
+      g_ptr_array_add(mirrors, self->images_mirrors[i]);
+   g_ptr_array_add(mirrors, NULL);
+
+   if (self->mirror_proxy != NULL &&
+       !au_mirror_proxy_has_mirrors(self->mirror_proxy,
+                                    (const gchar *const *)mirrors->pdata)) {
+      g_debug("The list of mirrors changed, restarting the mirror proxy");
+      g_clear_pointer(&self->mirror_proxy, au_mirror_proxy_free);
+   }
+
+   if (self->mirror_proxy == NULL) {
+      self->mirror_proxy =
+         au_mirror_proxy_new((const gchar *const *)mirrors->pdata, &error);
+      if (self->mirror_proxy == NULL) {
+         g_warning("Failed to start the mirror proxy, only using %s: %s",
+                   self->images_url, error->message);
+         return NULL;
+      }
+   }
+
+   au_mirror_proxy_set_http_proxy(self->mirror_proxy, http_proxy);
+   au_mirror_proxy_set_peers(self->mirror_proxy,
+                             (const gchar *const *)cache_owner->peer_stores);
+   au_mirror_proxy_set_chunk_cache(self->mirror_proxy, cache_owner->chunk_cache);
+
+   if (!au_mirror_proxy_set_bundle(self->mirror_proxy, bundle_path, prewarm_path)) {
+      g_warning("Unexpected update bundle path '%s', only using %s", bundle_path,
+                self->images_url);
+      return NULL;
+   }
+
+   /* Every update gets its own URL, the previous helpers don't need it anymore */
+   if (!au_mirror_proxy_renew_secret(self->mirror_proxy, &error)) {
+      g_warning("Failed to renew the mirror proxy URL, only using %s: %s",
+                self->images_url, error->message);
+      return NULL;
+   }
+
+   return au_mirror_proxy_dup_url(self->mirror_proxy);
+}
+
+/*
+ * _au_write_update_config:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @envp: (inout) (transfer full): The environment of the update helper
+ *
+ * If the update being installed can go through the mirror proxy, write a copy
+ * of the configuration that points the helper to it, see
+ * _au_ensure_mirror_proxy(). Desync takes its chunk
+ * store from the location of the update bundle, and the helper takes that
+ * from the images server in its configuration, so this is how the chunk
+ * requests reach the proxy.
+ *
+ * Returns: (transfer full) (nullable): The path to the configuration that the
+ *  helper should use instead of ours, or %NULL to use ours
+ */
+static gchar *
+_au_write_update_config(AuAtomupd1Impl *self, gchar ***envp)
+{
+   const gchar *update_build_id = NULL;
+   const gchar *no_proxy = NULL;
+   g_autofree gchar *bundle_path = NULL;
+   g_autofree gchar *prewarm_path = NULL;
+   g_autofree gchar *http_proxy = NULL;
+   g_autofree gchar *proxy_url = NULL;
+   g_autofree gchar *update_config_path = NULL;
+   g_autoptr(GError) error = NULL;
+
+   /* For a custom update the helper doesn't use the images server */
+   update_build_id = au_atomupd1_get_update_build_id((AuAtomupd1 *)self);
+   if (update_build_id == NULL)
+      return NULL;
+
+   bundle_path = _au_get_update_bundle_path(self, update_build_id);
+   if (bundle_path == NULL)
+      return NULL;
+
+   /* If we already have the bundle, the helper can go straight to the chunks */
+   prewarm_path = _au_get_prewarm_path(self, update_build_id);
+   if (g_file_test(prewarm_path, G_FILE_TEST_IS_REGULAR))
+      g_debug("Using the pre-warmed update bundle %s", prewarm_path);
+   else
+      g_clear_pointer(&prewarm_path, g_free);
+
+   http_proxy = _au_get_http_proxy_for_host(self, AU_PROXY_HOST_IMAGES);
+   proxy_url = _au_ensure_mirror_proxy(self, http_proxy, bundle_path, prewarm_path);
+   if (proxy_url == NULL)
+      return NULL;
+
+   update_config_path =
+      _au_write_config_copy(self, AU_UPDATE_CONFIG, "ImagesUrl", proxy_url, &error);
+   if (update_config_path == NULL) {
+      g_warning("Failed to point the helper to the mirror proxy: %s", error->message);
+      return NULL;
+   }
+
+   /* The proxy is on this same machine, never reach it through the HTTP proxy */
+   no_proxy = g_environ_getenv(*envp, "no_proxy");
+   if (no_proxy != NULL && no_proxy[0] != '\0') {
+      g_autofree gchar *local_no_proxy = g_strconcat(no_proxy, ",127.0.0.1", NULL);
+
+      *envp = g_environ_setenv(*envp, "no_proxy", local_no_proxy, TRUE);
+   } else {
+      *envp = g_environ_setenv(*envp, "no_proxy", "127.0.0.1", TRUE);
+   }
+
+   return g_steal_pointer(&update_config_path);
+}
+
+static gboolean
+_au_spawn_update_helper(AuAtomupd1 *object, const GPtrArray *argv, GError **error)
+{
+   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
+   g_autofree gchar *update_config_path = NULL;
+   g_auto(GStrv) launch_environ = au_supervisor_dup_environ(au_supervisor_get_default());
+   g_autoptr(GPtrArray) launch_argv = NULL;
+   g_autoptr(GInputStream) unix_stream = NULL;
+   gint client_stdout;
+   guint i;
+
+   launch_environ = _au_environ_set_http_proxy(self, launch_environ);
+
+   /* Let the helper use the pre-warmed bundle, and download the chunks from the
+    * local network and from all the mirrors at the same time */
+   update_config_path = _au_write_update_config(self, &launch_environ);
+
+   launch_argv = g_ptr_array_new_with_free_func(g_free);
+   for (i = 0; i < argv->len; i++) {
+      const gchar *arg = g_ptr_array_index(argv, i);
+
+      if (update_config_path != NULL && i > 0 &&
+          g_strcmp0(g_ptr_array_index(argv, i - 1), "--config") == 0)
+         arg = update_config_path;
+
+      g_ptr_array_add(launch_argv, g_strdup(arg));
+   }
+
+   au_start_update_clear(self);
+   self->install_child = au_supervisor_spawn(
+      au_supervisor_get_default(), AU_HELPER_KIND_UPDATE,
+      (const gchar *const *)launch_argv->pdata, (const gchar *const *)launch_environ,
+      AU_CHILD_FLAGS_PIPE_STDOUT, 0, child_watch_cb, g_object_ref(object),
+      g_object_unref, error);
+   if (self->install_child == NULL) {
+      g_object_unref(object);
+      return FALSE;
+   }
+
+   self->install_pid = au_child_get_pid(self->install_child);
+   client_stdout = au_child_steal_stdout(self->install_child);
+   unix_stream = g_unix_input_stream_new(client_stdout, TRUE);
+   self->start_update_stdout_stream = g_data_input_stream_new(unix_stream);
+
+   g_data_input_stream_read_line_async(self->start_update_stdout_stream,
+                                       G_PRIORITY_DEFAULT, NULL,
+                                       _au_client_stdout_update_cb, g_object_ref(object));
+
+   return TRUE;
+}
+
+/*
+ * _au_get_stall_timeout:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Returns: Seconds without progress after which the update is considered
+ *  stalled, or 0 if the stall watchdog is disabled
+ */
+static guint
+_au_get_stall_timeout(AuAtomupd1Impl *self)
+{
+   const gchar *timeout_env;
+
+   /* This environment variable is used for debugging and automated tests */
+   timeout_env = g_getenv("AU_STALL_TIMEOUT");
+   if (timeout_env != NULL)
+      return g_ascii_strtoull(timeout_env, NULL, 10);
+
+   return self->stall_timeout;
+}
+
+static gboolean
+_au_stall_watchdog_cb(gpointer user_data);
+
+/*
+ * _au_arm_stall_watchdog:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Start watching the progress of the helper that has just been launched.
+ */
+static void
+_au_arm_stall_watchdog(AuAtomupd1Impl *self)
+{
+   guint timeout = _au_get_stall_timeout(self);
+
+   g_clear_handle_id(&self->stall_watchdog_source, g_source_remove);
+   self->last_progress_time = g_get_monotonic_time();
+   self->last_progress_percentage = -1;
+   self->last_io_bytes = 0;
+
+   if (timeout == 0)
+      return;
+
+   /* Check a few times per interval, to not overshoot it by too much */
+   self->stall_watchdog_source =
+      g_timeout_add_seconds(MAX(timeout / 5, 1), _au_stall_watchdog_cb, self);
+}
+
+/*
+ * _au_start_stall_watchdog:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @argv: (not nullable): The helper command line of the update that just started
+ */
+static void
+_au_start_stall_watchdog(AuAtomupd1Impl *self, GPtrArray *argv)
+{
+   g_clear_pointer(&self->update_argv, g_ptr_array_unref);
+   self->update_argv = g_ptr_array_ref(argv);
+   au_atomupd1_set_update_stalls((AuAtomupd1 *)self, 0);
+
+   _au_arm_stall_watchdog(self);
+}
+
+static void
+_au_stall_restart_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+   g_autoptr(AuAtomupd1) object = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   AuUpdateStatus status = au_atomupd1_get_update_status(object);
+   guint stalls = au_atomupd1_get_update_stalls(object);
+   g_autofree gchar *message = NULL;
+   g_autoptr(GError) error = NULL;
+
+   /* The helper is gone regardless, RAUC might just not have been running */
+   if (!g_task_propagate_boolean(G_TASK(result), &error)) {
+      g_debug("Unable to stop RAUC after the stall: %s", error->message);
+      g_clear_error(&error);
+   }
+
+   /* The update might have been cancelled in the meantime */
+   if (status != AU_UPDATE_STATUS_IN_PROGRESS && status != AU_UPDATE_STATUS_PAUSED)
+      return;
+
+   if (stalls > self->stall_retries) {
+      message = g_strdup_printf("The update made no progress for %u seconds, %u times "
+                                "in a row",
+                                _au_get_stall_timeout(self), stalls);
+      _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_FAILED,
+                                               "org.freedesktop.DBus.Error.Timeout",
+                                               message);
+      au_start_update_clear(self);
+      return;
+   }
+
+   g_info("Restarting the stalled update, attempt %u of %u", stalls,
+          self->stall_retries);
+
+   if (!_au_spawn_update_helper(object, self->update_argv, &error)) {
+      message = g_strdup_printf("Failed to restart the stalled update: %s",
+                                error->message);
+      _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_FAILED,
+                                               "org.freedesktop.DBus.Error", message);
+      au_start_update_clear(self);
+      return;
+   }
+
+   if (status == AU_UPDATE_STATUS_PAUSED &&
+       !_au_send_signal_to_install_procs(self, SIGSTOP, &error))
+      g_warning("Failed to pause the restarted update: %s", error->message);
+
+   _au_arm_stall_watchdog(self);
+}
+
+/*
+ * _au_get_install_io_bytes:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * The percentage printed by the helper can stay the same for a long time,
+ * e.g. while a big part of the image is being downloaded, so we also look at
+ * the data that the install processes are moving.
+ *
+ * Returns: The bytes read and written so far by the install helper, the RAUC
+ *  service and its children, e.g. Desync
+ */
+static guint64
+_au_get_install_io_bytes(AuAtomupd1Impl *self)
+{
+   g_autoptr(GError) error = NULL;
+   guint64 bytes;
+   gint64 rauc_pid;
+
+   bytes = _au_get_procs_io_bytes(AU_PROC_PATH, self->install_pid, FALSE);
+
+   rauc_pid = _au_get_rauc_service_pid(&error);
+   if (rauc_pid < 0)
+      g_debug("Unable to get the RAUC service PID: %s", error->message);
+   else
+      bytes += _au_get_procs_io_bytes(AU_PROC_PATH, (GPid)rauc_pid, TRUE);
+
+   return bytes;
+}
+
+static gboolean
+_au_stall_watchdog_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+   AuAtomupd1 *object = (AuAtomupd1 *)self;
+   AuUpdateStatus status = au_atomupd1_get_update_status(object);
+   guint timeout = _au_get_stall_timeout(self);
+   gint64 now = g_get_monotonic_time();
+   const gchar *throttle_state = au_atomupd1_get_throttle_state(object);
+   g_autoptr(GTask) task = NULL;
+   guint64 io_bytes;
+   guint stalls;
+
+   /* A paused update is not expected to make any progress, and a throttled one
+    * might legitimately be very slow. That time doesn't count. */
+   if (status == AU_UPDATE_STATUS_PAUSED ||
+       g_strcmp0(throttle_state != NULL ? throttle_state : AU_THROTTLE_STATE_NONE,
+                 AU_THROTTLE_STATE_NONE) != 0) {
+      self->last_progress_time = now;
+      return G_SOURCE_CONTINUE;
+   }
+
+   if (status != AU_UPDATE_STATUS_IN_PROGRESS) {
+      self->stall_watchdog_source = 0;
+      return G_SOURCE_REMOVE;
+   }
+
+   io_bytes = _au_get_install_io_bytes(self);
+   if (io_bytes != self->last_io_bytes) {
+      self->last_io_bytes = io_bytes;
+      self->last_progress_time = now;
+   }
+
+   if (now - self->last_progress_time < (gint64)timeout * G_USEC_PER_SEC)
+      return G_SOURCE_CONTINUE;
+
+   stalls = au_atomupd1_get_update_stalls(object) + 1;
+   au_atomupd1_set_update_stalls(object, stalls);
+   g_dbus_interface_skeleton_flush(G_DBUS_INTERFACE_SKELETON(object));
+
+   g_warning("The update made no progress in the last %u seconds, stopping it "
+             "(stall %u)",
+             timeout, stalls);
+
+   /* Don't report the termination of the stalled helper as a failed update */
+   if (self->install_child != NULL)
+      au_child_detach(g_steal_pointer(&self->install_child));
+
+   self->stall_watchdog_source = 0;
+
+   /* Terminate the helper and RAUC the same way as CancelUpdate() */
+   task = g_task_new(NULL, NULL, _au_stall_restart_cb, g_object_ref(object));
+   g_task_set_task_data(task, GINT_TO_POINTER(self->install_pid), NULL);
+   g_task_run_in_thread(task, _au_cancel_async);
+
+   return G_SOURCE_REMOVE;
+}
+
+static void
+au_start_update_authorized_cb(AuAtomupd1 *object,
+                              GDBusMethodInvocation *invocation,
+                              gpointer arg_id_pointer)
+{
+   const gchar *arg_id = arg_id_pointer;
+   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
+   g_autoptr(GPtrArray) argv = NULL;
+   g_autoptr(GFileIOStream) stream = NULL;
+   GVariant *updates_available = NULL; /* borrowed */
+   g_autoptr(GVariantIter) updates_iter = NULL;
+   gboolean found_buildid = FALSE;
+   guint64 update_size = 0;
+   g_autoptr(GError) error = NULL;
+   AuUpdateStatus current_status;
+
+   current_status = au_atomupd1_get_update_status(object);
+   if (current_status == AU_UPDATE_STATUS_IN_PROGRESS ||
+       current_status == AU_UPDATE_STATUS_PAUSED) {
+      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
+                                            G_DBUS_ERROR_FAILED,
+                                            "Failed to start a new update because one "
+                                            "is already in progress");
+      return;
+   }
+
+   if (!g_file_query_exists(self->updates_json_file, NULL)) {
+      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
+                                            G_DBUS_ERROR_FAILED,
+                                            "It is not possible to start an update "
+                                            "before calling \"CheckForUpdates\"");
+      return;
+   }
+
+   au_atomupd1_set_update_build_id(object, arg_id);
+
+   updates_available = au_atomupd1_get_updates_available(object);
+   if (updates_available != NULL) {
+      gchar *buildid = NULL;   /* borrowed */
+      GVariant *values = NULL; /* borrowed */
+
+      g_variant_get(updates_available, "a{?*}", &updates_iter);
+      while (g_variant_iter_loop(updates_iter, "{s@a{sv}}", &buildid, &values)) {
+         if (g_str_equal(arg_id, buildid)) {
+            g_autoptr(GVariant) version = NULL;
+
+            version = g_variant_lookup_value(values, "version", G_VARIANT_TYPE_STRING);
+            au_atomupd1_set_update_version(object, g_variant_get_string(version, NULL));
+            g_variant_lookup(values, "estimated_size", "t", &update_size);
+            found_buildid = TRUE;
+            break;
+         }
+      }
+   }
+
+   if (!found_buildid) {
+      g_warning("The chosen buildid '%s' doesn't seem to be available, the update "
+                "is expected to fail",
+                arg_id);
+
+      /* Clear any previous value we might have */
+      au_atomupd1_set_update_version(object, NULL);
+   }
+
+   /* Create a copy of the json file because we will pass that to the
+    * 'steamos-atomupd-client' helper and, if in the meantime we check again
+    * for updates, we may replace that file with a newer version. */
+
+   if (self->updates_json_copy != NULL) {
+      g_file_delete(self->updates_json_copy, NULL, NULL);
+      g_clear_object(&self->updates_json_copy);
+   }
+
+   self->updates_json_copy =
+      g_file_new_tmp("steamos-atomupd-XXXXXX.json", &stream, &error);
+   if (self->updates_json_copy == NULL) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to create a copy of the JSON update file %s", error->message);
+      return;
+   }
+   if (!g_file_copy(self->updates_json_file, self->updates_json_copy,
+                    G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to create a copy of the JSON update file %s", error->message);
+      return;
+   }
+
+   argv = g_ptr_array_new_with_free_func(g_free);
+   g_ptr_array_add(argv, g_strdup("steamos-atomupd-client"));
+   g_ptr_array_add(argv, g_strdup("--config"));
+   g_ptr_array_add(argv, g_strdup(self->config_path));
+   g_ptr_array_add(argv, g_strdup("--update-file"));
+   g_ptr_array_add(argv, g_file_get_path(self->updates_json_copy));
+   g_ptr_array_add(argv, g_strdup("--update-version"));
+   g_ptr_array_add(argv, g_strdup(arg_id));
+
+   if (g_debug_controller_get_debug_enabled(self->debug_controller))
+      g_ptr_array_add(argv, g_strdup("--debug"));
+
+   g_ptr_array_add(argv, NULL);
+
+   if (!_au_spawn_update_helper(object, argv, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to launch the \"steamos-atomupd-client\" helper: %s", error->message);
+      return;
+   }
+
+   au_atomupd1_set_progress_percentage(object, 0);
+   _au_reset_progress_estimation(self, update_size);
+   _au_start_stall_watchdog(self, argv);
+   _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_IN_PROGRESS, NULL,
+                                            NULL);
+   /* The update might need to wait for better network conditions */
+   _au_apply_update_policies(self);
+
+   au_atomupd1_complete_start_update(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_start_update(AuAtomupd1 *object,
+                                     GDBusMethodInvocation *invocation,
+                                     const gchar *arg_id)
+{
+   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
+   gint64 request_buildid_date;
+   gint64 request_buildid_increment;
+   const gchar *action_id = "com.steampowered.atomupd1.start-upgrade";
+   g_autoptr(GError) error = NULL;
+
+   if (!_is_buildid_valid(arg_id, &request_buildid_date, &request_buildid_increment,
+                          &error)) {
+      g_dbus_method_invocation_return_error_literal(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         error->message);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
+
+   if (request_buildid_date < self->buildid_date ||
+       (request_buildid_date == self->buildid_date &&
+        request_buildid_increment < self->buildid_increment)) {
+      action_id = "com.steampowered.atomupd1.start-downgrade";
+   }
+
+   _au_check_auth(object, action_id, au_start_update_authorized_cb, invocation,
+                  g_strdup(arg_id), g_free);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+au_start_custom_update_authorized_cb(AuAtomupd1 *object,
+                                     GDBusMethodInvocation *invocation,
                                      gpointer arg_options_pointer)
 {
-   GVariant *arg_options = arg_options_pointer;
-   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
-   g_autoptr(GPtrArray) argv = NULL;
+   GVariant *arg_options = arg_options_pointer;
+   AuAtomupd1Impl *self = (AuAtomupd1Impl *)object;
+   g_autoptr(GPtrArray) argv = NULL;
+   g_autoptr(GError) error = NULL;
+   AuUpdateStatus current_status;
+   const gchar *url = NULL;
+   const gchar *update_path = NULL;
+   g_autofree gchar *update_url = NULL;
+
+   current_status = au_atomupd1_get_update_status(object);
+   if (current_status == AU_UPDATE_STATUS_IN_PROGRESS ||
+       current_status == AU_UPDATE_STATUS_PAUSED) {
+      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
+                                            G_DBUS_ERROR_FAILED,
+                                            "Failed to start a new update because one "
+                                            "is already in progress");
+      return;
+   }
+
+   g_variant_lookup(arg_options, "url", "&s", &url);
+   g_variant_lookup(arg_options, "update_path", "&s", &update_path);
+
+   if ((url == NULL && update_path == NULL) || (url != NULL && update_path != NULL)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         "Exactly one of 'url' or 'update_path' must be provided");
+      return;
+   }
+
+   if (url == NULL)
+      update_url = g_build_filename(self->images_url, update_path, NULL);
+   else
+      update_url = g_strdup(url);
+
+   /* For a custom update, buildid and version are unknown */
+   au_atomupd1_set_update_build_id(object, NULL);
+   au_atomupd1_set_update_version(object, NULL);
+
+   argv = g_ptr_array_new_with_free_func(g_free);
+   g_ptr_array_add(argv, g_strdup("steamos-atomupd-client"));
+   g_ptr_array_add(argv, g_strdup("--config"));
+   g_ptr_array_add(argv, g_strdup(self->config_path));
+   g_ptr_array_add(argv, g_strdup("--update-from-url"));
+   g_ptr_array_add(argv, g_steal_pointer(&update_url));
+
+   if (g_debug_controller_get_debug_enabled(self->debug_controller))
+      g_ptr_array_add(argv, g_strdup("--debug"));
+
+   g_ptr_array_add(argv, NULL);
+
+   if (!_au_spawn_update_helper(object, argv, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to launch the \"steamos-atomupd-client\" helper: %s", error->message);
+      return;
+   }
+
+   au_atomupd1_set_progress_percentage(object, 0);
+   _au_reset_progress_estimation(self, 0);
+   _au_start_stall_watchdog(self, argv);
+   _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_IN_PROGRESS, NULL,
+                                            NULL);
+   /* The update might need to wait for better network conditions */
+   _au_apply_update_policies(self);
+
+   au_atomupd1_complete_start_custom_update(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_start_custom_update(AuAtomupd1 *object,
+                                            GDBusMethodInvocation *invocation,
+                                            GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.start-custom-upgrade",
+                  au_start_custom_update_authorized_cb, invocation,
+                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+au_resume_update_authorized_cb(AuAtomupd1 *object,
+                               GDBusMethodInvocation *invocation,
+                               gpointer data_pointer)
+{
+   g_autoptr(GError) error = NULL;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_PAUSED) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "There isn't a paused update that can be resumed");
+      return;
+   }
+
+   if (!_au_send_signal_to_install_procs(self, SIGCONT, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), error->domain, error->code,
+         "An error occurred while attempting to resume the installation process: %s",
+         error->message);
+      return;
+   }
+
+   au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_IN_PROGRESS);
+   au_atomupd1_complete_resume_update(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_resume_update(AuAtomupd1 *object,
+                                      GDBusMethodInvocation *invocation)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
+                  au_resume_update_authorized_cb, invocation, NULL, NULL);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static gboolean
+debug_controller_authorize_cb(GDebugControllerDBus *debug_controller,
+                              GDBusMethodInvocation *invocation,
+                              gpointer user_data)
+{
+   /* Do not perform any additional check before authorizing this operation.
+    * We don't print sensitive information in the debug output, so there is no
+    * need to gate this behind polkit. */
+   return TRUE;
+}
+
+static gboolean
+_au_parse_preferences(AuAtomupd1Impl *atomupd, GError **error)
+{
+   g_autofree gchar *variant = NULL;
+   g_autofree gchar *branch = NULL;
+   g_autoptr(GVariant) http_proxy = NULL;
+   const gchar *branch_file_path = _au_get_legacy_branch_file_path();
+   const gchar *user_prefs_path = _au_get_user_preferences_file_path(atomupd);
+   g_autoptr(GError) local_error = NULL;
+
+   g_return_val_if_fail(atomupd != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   /* If we still have a legacy "steamos-branch" file, we try to load it first and
+    * then convert it to the new preferences.conf. That file only ever existed for
+    * the running system. */
+   if (atomupd->target_name == NULL &&
+       !_au_load_legacy_preferences(branch_file_path, user_prefs_path, &variant, &branch,
+                                    &local_error)) {
+      g_debug("%s", local_error->message);
+      g_clear_error(&local_error);
+   }
+
+   /* Try preferences.conf if we couldn't load the legacy config */
+   if (!variant && !_au_load_user_preferences_file(user_prefs_path, &variant, &branch,
+                                                   &http_proxy, &local_error)) {
+      g_debug("%s", local_error->message);
+      g_clear_error(&local_error);
+   }
+
+   /* As our last resort we try to parse the image manifest file */
+   if (!variant) {
+      if (!_au_load_preferences_from_manifest(atomupd->manifest_path, user_prefs_path,
+                                              &variant, &branch, error)) {
+         return FALSE;
+      }
+   }
+
+   if (http_proxy == NULL)
+      http_proxy = g_variant_ref_sink(g_variant_new("(si)", "", 0));
+
+   g_debug("Tracking the variant %s and branch %s", variant, branch);
+
+   au_atomupd1_set_variant((AuAtomupd1 *)atomupd, variant);
+   au_atomupd1_set_branch((AuAtomupd1 *)atomupd, branch);
+   au_atomupd1_set_http_proxy((AuAtomupd1 *)atomupd, http_proxy);
+
+   return TRUE;
+}
+
+static gboolean
+_au_parse_manifest(AuAtomupd1Impl *atomupd, GError **error)
+{
+   const gchar *build_id = NULL;
+   const gchar *version = NULL;
+   JsonObject *json_object = NULL; /* borrowed */
+   g_autoptr(JsonParser) parser = NULL;
+
+   g_return_val_if_fail(atomupd != NULL, FALSE);
+   g_return_val_if_fail(atomupd->manifest_path != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   json_object = _au_load_manifest_object(atomupd->manifest_path, &parser, error);
+   if (json_object == NULL)
+      return FALSE;
+
+   build_id = json_object_get_string_member_with_default(json_object, "buildid", NULL);
+   version = json_object_get_string_member_with_default(json_object, "version", NULL);
+
+   if (build_id == NULL || version == NULL)
+      return au_throw_error(error,
+                            "The manifest JSON \"%s\" doesn't have the expected keys",
+                            atomupd->manifest_path);
+
+   atomupd->release =
+      g_strdup(json_object_get_string_member_with_default(json_object, "release", NULL));
+   atomupd->product =
+      g_strdup(json_object_get_string_member_with_default(json_object, "product", NULL));
+   atomupd->architecture =
+      g_strdup(json_object_get_string_member_with_default(json_object, "arch", NULL));
+
+   /* This is really unexpected, and may break the ability to check for updates. We are
+    * not failing hard to see if we can still recover */
+   if (atomupd->release == NULL || atomupd->product == NULL ||
+       atomupd->architecture == NULL)
+      g_warning("The manifest JSON \"%s\" is missing some expected keys, "
+                "trying to continue anyway...",
+                atomupd->manifest_path);
+
+   if (!_is_buildid_valid(build_id, &atomupd->buildid_date, &atomupd->buildid_increment,
+                          error))
+      return FALSE;
+
+   au_atomupd1_set_current_build_id((AuAtomupd1 *)atomupd, build_id);
+   au_atomupd1_set_current_version((AuAtomupd1 *)atomupd, version);
+
+   return TRUE;
+}
+
+/*
+ * _au_get_config_uint:
+ * @client_config: (not nullable): The client configuration
+ * @group: (not nullable): Group of the entry
+ * @key: (not nullable): Key of the entry
+ * @default_value: Value to use if the entry is missing or invalid
+ *
+ * Returns: The non-negative integer value of the @group @key entry
+ */
+static guint
+_au_get_config_uint(GKeyFile *client_config,
+                    const gchar *group,
+                    const gchar *key,
+                    guint default_value)
+{
+   g_autoptr(GError) local_error = NULL;
+   gint value;
+
+   if (!g_key_file_has_key(client_config, group, key, NULL))
+      return default_value;
+
+   value = g_key_file_get_integer(client_config, group, key, &local_error);
+   if (local_error != NULL || value < 0) {
+      g_warning("Invalid %s entry, using the default value %u", key, default_value);
+      return default_value;
+   }
+
+   return value;
+}
+
+/*
+ * _au_is_system_idle:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Check the CPU time used by the tasks with the default or a higher priority,
+ * since the previous call. Games keep at least a couple of cores busy.
+ *
+ * Returns: %TRUE if the system is idle enough for background work
+ */
+static gboolean
+_au_is_system_idle(AuAtomupd1Impl *self)
+{
+   AuCpuTimes previous = self->scrub_cpu_times;
+   const gchar *proc_stat_path;
+   guint64 total;
+
+   /* This environment variable is used for debugging and automated tests */
+   proc_stat_path = g_getenv("AU_PROC_STAT_PATH");
+   if (proc_stat_path == NULL)
+      proc_stat_path = AU_PROC_STAT_PATH;
+
+   if (!au_cpu_times_read(proc_stat_path, &self->scrub_cpu_times))
+      return FALSE;
+
+   /* We need two samples */
+   if (previous.total == 0)
+      return FALSE;
+
+   total = self->scrub_cpu_times.total - previous.total;
+   if (total == 0)
+      return TRUE;
+
+   return (self->scrub_cpu_times.busy - previous.busy) * 100 <
+          total * AU_SCRUB_MAX_BUSY_PERCENTAGE;
+}
+
+/*
+ * _au_update_scrub_stats:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Export the statistics of the chunk cache scrubber, if any.
+ */
+static void
+_au_update_scrub_stats(AuAtomupd1Impl *self)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sv}"));
+   const AuScrubStats *stats;
+   guint64 throughput = 0;
+
+   if (self->chunk_scrubber != NULL) {
+      stats = au_chunk_scrubber_get_stats(self->chunk_scrubber);
+
+      if (stats->active_time > 0)
+         throughput = stats->bytes * G_USEC_PER_SEC / stats->active_time;
+
+      g_variant_builder_add(&builder, "{sv}", "runs", g_variant_new_uint64(stats->runs));
+      g_variant_builder_add(&builder, "{sv}", "errors",
+                            g_variant_new_uint64(stats->errors));
+      g_variant_builder_add(&builder, "{sv}", "last_run",
+                            g_variant_new_uint64(stats->last_run));
+      g_variant_builder_add(&builder, "{sv}", "chunks",
+                            g_variant_new_uint64(stats->chunks));
+      g_variant_builder_add(&builder, "{sv}", "bytes",
+                            g_variant_new_uint64(stats->bytes));
+      g_variant_builder_add(&builder, "{sv}", "evicted",
+                            g_variant_new_uint64(stats->evicted));
+      g_variant_builder_add(&builder, "{sv}", "duration",
+                            g_variant_new_uint64(stats->active_time / G_USEC_PER_SEC));
+      g_variant_builder_add(&builder, "{sv}", "throughput",
+                            g_variant_new_uint64(throughput));
+   }
+
+   au_atomupd1_set_cache_scrub_stats((AuAtomupd1 *)self, g_variant_builder_end(&builder));
+}
+
+static void
+_au_chunk_scrub_done_cb(AuChunkScrubber *scrubber, gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+
+   _au_update_scrub_stats(self);
+}
+
+/*
+ * _au_apply_scrub_policy:
+ * @self: (not nullable): The AuAtomupd1Impl object of the running system
+ *
+ * Start a scrub of the chunk cache when it's due and the system is idle.
+ * Pause it while an update, or anything else that needs the CPU, is running.
+ */
+static void
+_au_apply_scrub_policy(AuAtomupd1Impl *self)
+{
+   gboolean idle;
+   gint64 last_run;
+
+   if (self->chunk_scrubber == NULL)
+      return;
+
+   idle = _au_is_system_idle(self);
+
+   /* The update needs the disk, and it might be writing to the cache */
+   if (self->install_pid != 0)
+      idle = FALSE;
+
+   if (au_chunk_scrubber_is_running(self->chunk_scrubber)) {
+      au_chunk_scrubber_set_paused(self->chunk_scrubber, !idle);
+      return;
+   }
+
+   last_run = au_chunk_scrubber_get_stats(self->chunk_scrubber)->last_run;
+   if (!idle || g_get_real_time() / G_USEC_PER_SEC - last_run < self->scrub_interval)
+      return;
+
+   g_info("Scrubbing the chunk cache %s",
+          au_chunk_scrubber_get_chunks_dir(self->chunk_scrubber));
+   au_chunk_scrubber_start(self->chunk_scrubber);
+}
+
+static gboolean
+_au_scrub_poll_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+
+   _au_apply_scrub_policy(self);
+
+   return G_SOURCE_CONTINUE;
+}
+
+/*
+ * _au_load_scrub_config:
+ * @atomupd: (not nullable): The AuAtomupd1Impl object of the running system
+ * @client_config: (not nullable): The client configuration
+ *
+ * Set up the periodic scrub of the chunk cache, unless "ScrubInterval" is 0.
+ */
+static void
+_au_load_scrub_config(AuAtomupd1Impl *atomupd, GKeyFile *client_config)
+{
+   const gchar *interval_str;
+   guint interval = AU_SCRUB_POLL_INTERVAL;
+
+   atomupd->scrub_interval = _au_get_config_uint(client_config, "PeerSharing",
+                                                 "ScrubInterval",
+                                                 AU_SCRUB_DEFAULT_INTERVAL);
+
+   if (atomupd->chunk_scrubber != NULL &&
+       (atomupd->scrub_interval == 0 ||
+        g_strcmp0(au_chunk_scrubber_get_chunks_dir(atomupd->chunk_scrubber),
+                  atomupd->chunk_cache) != 0)) {
+      g_debug("Stopping the chunk cache scrubber");
+      g_clear_pointer(&atomupd->chunk_scrubber, au_chunk_scrubber_free);
+      g_clear_handle_id(&atomupd->scrub_poll_source, g_source_remove);
+   }
+
+   if (atomupd->chunk_scrubber == NULL && atomupd->scrub_interval > 0 &&
+       atomupd->chunk_cache != NULL) {
+      atomupd->chunk_scrubber =
+         au_chunk_scrubber_new(atomupd->chunk_cache, _au_chunk_scrub_done_cb, atomupd);
+
+      /* This environment variable is used for debugging and automated tests */
+      interval_str = g_getenv("AU_SCRUB_POLL_INTERVAL");
+      if (interval_str != NULL && g_ascii_strtoull(interval_str, NULL, 10) > 0)
+         interval = g_ascii_strtoull(interval_str, NULL, 10);
+
+      atomupd->scrub_poll_source =
+         g_timeout_add_seconds(interval, _au_scrub_poll_cb, atomupd);
+   }
+
+   _au_update_scrub_stats(atomupd);
+}
+
+/*
+ * _au_load_peer_sharing_config:
+ * @atomupd: (not nullable): The AuAtomupd1Impl object
+ * @client_config: (not nullable): The client configuration
+ *
+ * Load the optional "PeerSharing" group of @client_config, and start or stop
+ * serving the local chunk cache accordingly. Peer sharing is an optimization,
+ * so any error here is not fatal.
+ */
+static void
+_au_load_peer_sharing_config(AuAtomupd1Impl *atomupd, GKeyFile *client_config)
+{
+   const gchar *group = "PeerSharing";
+   g_autoptr(GError) local_error = NULL;
+   gboolean serve;
+   gint port = AU_PEER_SERVER_DEFAULT_PORT;
+
+   g_clear_pointer(&atomupd->chunk_cache, g_free);
+   g_clear_pointer(&atomupd->peer_stores, g_strfreev);
+
+   atomupd->chunk_cache = g_key_file_get_string(client_config, group, "ChunkCache", NULL);
+   serve = g_key_file_get_boolean(client_config, group, "Serve", NULL);
+
+   if (g_key_file_has_key(client_config, group, "Port", NULL)) {
+      port = g_key_file_get_integer(client_config, group, "Port", &local_error);
+      if (local_error != NULL || port < 0 || port > G_MAXUINT16) {
+         g_warning("Invalid peer sharing port, using the default %u",
+                   AU_PEER_SERVER_DEFAULT_PORT);
+         port = AU_PEER_SERVER_DEFAULT_PORT;
+         g_clear_error(&local_error);
+      }
+   }
+
+   if (serve && atomupd->chunk_cache == NULL) {
+      g_warning("Peer sharing requires the \"ChunkCache\" entry, not serving any chunk");
+      serve = FALSE;
+   }
+
+   if (atomupd->peer_server != NULL &&
+       (!serve ||
+        g_strcmp0(au_peer_server_get_chunks_dir(atomupd->peer_server),
+                  atomupd->chunk_cache) != 0 ||
+        (port != 0 && au_peer_server_get_port(atomupd->peer_server) != port))) {
+      g_debug("Stopping the peer sharing server");
+      g_clear_pointer(&atomupd->peer_server, au_peer_server_free);
+   }
+
+   if (serve && atomupd->peer_server == NULL) {
+      atomupd->peer_server =
+         au_peer_server_new(atomupd->chunk_cache, (guint16)port, &local_error);
+      if (atomupd->peer_server == NULL) {
+         g_warning("Failed to serve the local chunk cache: %s", local_error->message);
+         g_clear_error(&local_error);
+      }
+   }
+
+   _au_load_scrub_config(atomupd, client_config);
+
+   /* The peers are tried by the mirror proxy, before the images servers */
+   atomupd->peer_stores =
+      g_key_file_get_string_list(client_config, group, "Peers", NULL, NULL);
+   if (atomupd->peer_stores != NULL && atomupd->peer_stores[0] == NULL)
+      g_clear_pointer(&atomupd->peer_stores, g_strfreev);
+}
+
+/*
+ * _au_get_config_percentage:
+ *
+ * Returns: The percentage in @key of @group, or @default_value if it is not
+ *  set or not valid
+ */
+static gdouble
+_au_get_config_percentage(GKeyFile *client_config,
+                          const gchar *group,
+                          const gchar *key,
+                          gdouble default_value)
+{
+   g_autoptr(GError) error = NULL;
+   gdouble value;
+
+   if (!g_key_file_has_key(client_config, group, key, NULL))
+      return default_value;
+
+   value = g_key_file_get_double(client_config, group, key, &error);
+   if (error != NULL || !(value >= 0 && value <= 100)) {
+      g_warning("Invalid %s, using the default value %.1f", key, default_value);
+      return default_value;
+   }
+
+   return value;
+}
+
+static void
+_au_load_pressure_policy(AuAtomupd1Impl *atomupd, GKeyFile *client_config)
+{
+   g_autofree gchar *foreground_cgroup = NULL;
+   const gchar *cgroup_root;
+   gdouble high;
+   gdouble low;
+
+   g_clear_pointer(&atomupd->pressure_controller, au_pressure_controller_free);
+   g_clear_pointer(&atomupd->pressure_foreground_dir, g_free);
+
+   if (g_key_file_get_boolean(client_config, "PressurePolicy", "AdaptToPressure",
+                              NULL)) {
+      high = _au_get_config_percentage(client_config, "PressurePolicy", "HighPressure",
+                                       AU_PRESSURE_DEFAULT_HIGH);
+      low = _au_get_config_percentage(client_config, "PressurePolicy", "LowPressure",
+                                      MIN(AU_PRESSURE_DEFAULT_LOW, high));
+
+      if (low > high) {
+         g_warning("LowPressure is higher than HighPressure, using %.1f for both", high);
+         low = high;
+      }
+
+      foreground_cgroup = g_key_file_get_string(client_config, "PressurePolicy",
+                                                "ForegroundCgroup", NULL);
+      if (foreground_cgroup == NULL)
+         foreground_cgroup = g_strdup(AU_PRESSURE_DEFAULT_FOREGROUND_CGROUP);
+
+      /* This environment variable is used for debugging and automated tests */
+      cgroup_root = g_getenv("AU_CGROUP_PATH");
+      if (cgroup_root == NULL)
+         cgroup_root = AU_CGROUP_PATH;
+
+      atomupd->pressure_foreground_dir =
+         g_build_filename(cgroup_root, foreground_cgroup, NULL);
+
+      /* Level 1 is the "reduced" ThrottleState, level 2 is "idle" */
+      atomupd->pressure_controller =
+         au_pressure_controller_new(2, high, low, AU_PRESSURE_CALM_SAMPLES);
+   }
+
+   /* The poll needs to start again with the new controller */
+   g_clear_handle_id(&atomupd->pressure_poll_source, g_source_remove);
+   _au_update_pressure_state(atomupd);
+}
+
+/*
+ * _au_load_install_config:
+ * @atomupd: (not nullable): The AuAtomupd1Impl object
+ * @client_config: (not nullable): The client configuration
+ *
+ * Load the options that only affect how the updates are installed: the
+ * pre-warming, the stall watchdog, the peer sharing and the network, power and
+ * pressure policies.
+ */
+static void
+_au_load_install_config(AuAtomupd1Impl *atomupd, GKeyFile *client_config)
+{
+   g_autoptr(GError) local_error = NULL;
+
+   atomupd->prewarm_enabled =
+      g_key_file_get_boolean(client_config, "Downloads", "PrewarmIndex", NULL);
+   atomupd->prewarm_max_size = AU_PREWARM_DEFAULT_MAX_SIZE;
+   if (g_key_file_has_key(client_config, "Downloads", "PrewarmMaxSize", NULL)) {
+      guint64 max_size;
+
+      max_size = g_key_file_get_uint64(client_config, "Downloads", "PrewarmMaxSize",
+                                       &local_error);
+      if (local_error == NULL) {
+         atomupd->prewarm_max_size = max_size;
+      } else {
+         g_warning("Failed to parse PrewarmMaxSize, using the default value: %s",
+                   local_error->message);
+         g_clear_error(&local_error);
+      }
+   }
+
+   atomupd->stall_timeout = _au_get_config_uint(client_config, "Downloads",
+                                                "StallTimeout", AU_STALL_DEFAULT_TIMEOUT);
+   atomupd->stall_retries = _au_get_config_uint(client_config, "Downloads",
+                                                "StallRetries", AU_STALL_DEFAULT_RETRIES);
+
+   _au_load_peer_sharing_config(atomupd, client_config);
+
+   atomupd->pause_when_offline =
+      g_key_file_get_boolean(client_config, "NetworkPolicy", "PauseWhenOffline", NULL);
+   atomupd->pause_when_metered =
+      g_key_file_get_boolean(client_config, "NetworkPolicy", "PauseWhenMetered", NULL);
+
+   atomupd->throttle_on_battery =
+      g_key_file_get_boolean(client_config, "PowerPolicy", "ThrottleOnBattery", NULL);
+   atomupd->pause_below_battery_level = g_key_file_get_integer(
+      client_config, "PowerPolicy", "PauseBelowBatteryLevel", NULL);
+   atomupd->throttle_above_temperature = g_key_file_get_integer(
+      client_config, "PowerPolicy", "ThrottleAboveTemperature", NULL);
+   atomupd->pause_above_temperature =
+      g_key_file_get_integer(client_config, "PowerPolicy", "PauseAboveTemperature", NULL);
+
+   _au_load_pressure_policy(atomupd, client_config);
+
+   /* The policies might have changed while an update is running */
+   _au_apply_update_policies(atomupd);
+   _au_update_power_poll(atomupd);
+   _au_update_pressure_poll(atomupd);
+}
+
+static gboolean
+_au_parse_config(AuAtomupd1Impl *atomupd, GError **error)
+{
+   const gchar *server_mandatory_key[] = { "ImagesUrl", "MetaUrl", NULL };
+   g_autofree gchar *username = NULL;
+   g_autofree gchar *password = NULL;
+   g_autofree gchar *auth_encoded = NULL;
+   g_autofree gchar *default_variant = NULL;
+   g_autofree gchar *default_branch = NULL;
+   g_auto(GStrv) known_variants = NULL;
+   g_auto(GStrv) known_branches = NULL;
+   g_auto(GStrv) known_dev_branches = NULL;
+   g_autoptr(GHashTable) url_table = NULL;
+   g_autoptr(GKeyFile) client_config = g_key_file_new();
+   g_autoptr(GKeyFile) remote_info = g_key_file_new();
+   g_autoptr(GError) local_error = NULL;
+   gsize i;
+
+   g_return_val_if_fail(atomupd != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   if (!g_key_file_load_from_file(client_config, atomupd->config_path, G_KEY_FILE_NONE,
+                                  error))
+      return FALSE;
+
+   /* Ensure that the configuration has all the mandatory fields */
+   for (i = 0; server_mandatory_key[i] != NULL; i++) {
+      if (!g_key_file_has_key(client_config, "Server", server_mandatory_key[i], NULL)) {
+         return au_throw_error(
+            error, "The config file \"%s\" doesn't have the expected \"%s\" entry",
+            atomupd->config_path, server_mandatory_key[i]);
+      }
+   }
+
+   if (!atomupd->is_using_dev_config &&
+       !g_key_file_load_from_file(remote_info, _au_get_remote_info_path(atomupd),
+                                  G_KEY_FILE_NONE, &local_error)) {
+      /* This could happen if for example the Steam Deck is in offline mode, or the server
+       * doesn't have a remote info file at all. In those cases we simply continue to use
+       * the local info */
+      g_debug("Failed to use the additional remote info: %s", local_error->message);
+      g_debug("Continuing anyway...");
+      g_clear_error(&local_error);
+   }
+
+   g_clear_pointer(&atomupd->rollouts, g_hash_table_unref);
+   if (!atomupd->is_using_dev_config)
+      atomupd->rollouts = au_rollout_load_all(remote_info);
+
+   g_debug("Getting the list of known variants and branches");
+
+   /* We don't load the remote info file when using a development configuration.
+    * We could have additional custom variants/branches, and we don't want to replace
+    * them with the ones from the server side. */
+   if (!atomupd->is_using_dev_config) {
+      known_variants = _au_get_known_variants_from_config(remote_info, NULL);
+      if (known_variants != NULL)
+         g_debug("Using the list of known variants from the remote info file");
+
+      known_branches = _au_get_known_branches_from_config(remote_info, NULL);
+      if (known_branches != NULL)
+         g_debug("Using the list of known branches from the remote info file");
+
+      known_dev_branches = _au_get_known_dev_branches_from_config(remote_info, NULL);
+      if (known_dev_branches != NULL)
+         g_debug("Using the list of known dev branches from the remote info file");
+   }
+
+   if (known_variants == NULL) {
+      known_variants = _au_get_known_variants_from_config(client_config, error);
+      if (known_variants == NULL)
+         return FALSE;
+   }
+
+   /* As a security measure against misconfigurations, we ensure that in the list of
+    * known variants there is at least the default variant */
+   default_variant = _au_get_default_variant(atomupd->manifest_path, NULL);
+   if (default_variant != NULL &&
+       !g_strv_contains((const gchar *const *)known_variants, default_variant)) {
+      gsize length = g_strv_length(known_variants);
+
+      known_variants = g_realloc(known_variants, (length + 2) * sizeof(gchar *));
+      known_variants[length] = g_steal_pointer(&default_variant);
+      known_variants[length + 1] = NULL;
+   }
+
+   au_atomupd1_set_known_variants((AuAtomupd1 *)atomupd,
+                                  (const gchar *const *)known_variants);
+
+   if (known_branches == NULL) {
+      known_branches = _au_get_known_branches_from_config(client_config, error);
+      if (known_branches == NULL)
+         return FALSE;
+   }
+
+   /* As a security measure against misconfigurations, we ensure that in the list of
+    * known branches there is at least the default branch */
+   default_branch = _au_get_default_branch(atomupd->manifest_path);
+   if (!g_strv_contains((const gchar *const *)known_branches, default_branch)) {
+      gsize length = g_strv_length(known_branches);
+
+      known_branches = g_realloc(known_branches, (length + 2) * sizeof(gchar *));
+      known_branches[length] = g_steal_pointer(&default_branch);
+      known_branches[length + 1] = NULL;
+   }
+
+   if (known_dev_branches == NULL)
+      known_dev_branches = _au_get_known_dev_branches_from_config(client_config, NULL);
+
+   au_atomupd1_set_known_branches((AuAtomupd1 *)atomupd,
+                                  (const gchar *const *)known_branches);
+   au_atomupd1_set_known_dev_branches((AuAtomupd1 *)atomupd,
+                                      (const gchar *const *)known_dev_branches);
+
+   url_table = _au_get_urls_from_config(client_config, error);
+   if (url_table == NULL) {
+      /* The config file is malformed, bail out */
+      g_warning("Failed to get the list of URLs from %s", atomupd->config_path);
+      return FALSE;
+   }
+
+   g_clear_pointer(&atomupd->images_url, g_free);
+   g_clear_pointer(&atomupd->meta_url, g_free);
+   atomupd->images_url = g_strdup(g_hash_table_lookup(url_table, "ImagesUrl"));
+   atomupd->meta_url = g_strdup(g_hash_table_lookup(url_table, "MetaUrl"));
+
+   if (atomupd->images_url == NULL || atomupd->meta_url == NULL) {
+      /* We already ensured the presence of both entries at the beginning of
+       * _au_parse_config(), but if for whatever reason they are NULL, we error out */
+      au_throw_error(
+         error, "The config file \"%s\" doesn't have the expected server URL entries",
+         atomupd->config_path);
+      return FALSE;
+   }
+
+   g_clear_pointer(&atomupd->meta_mirrors, g_strfreev);
+   atomupd->meta_mirrors =
+      g_key_file_get_string_list(client_config, "Server", "MetaMirrors", NULL, NULL);
+   if (atomupd->meta_mirrors != NULL && atomupd->meta_mirrors[0] == NULL)
+      g_clear_pointer(&atomupd->meta_mirrors, g_strfreev);
+
+   atomupd->query_timeout = _au_get_config_uint(client_config, "Server", "QueryTimeout",
+                                                AU_QUERY_DEFAULT_TIMEOUT);
+
+   g_clear_pointer(&atomupd->images_mirrors, g_strfreev);
+   atomupd->images_mirrors =
+      g_key_file_get_string_list(client_config, "Server", "ImagesMirrors", NULL, NULL);
+   if (atomupd->images_mirrors != NULL && atomupd->images_mirrors[0] == NULL)
+      g_clear_pointer(&atomupd->images_mirrors, g_strfreev);
+
+   /* If the config has an HTTP auth, we need to ensure that netrc and Desync
+    * have it too */
+   if (_au_get_http_auth_from_config(client_config, &username, &password,
+                                     &auth_encoded)) {
+      g_autoptr(GList) urls = NULL;
+      const gchar *desync_config_path;
+
+      urls = g_hash_table_get_values(url_table);
+
+      /* The mirrors are reached by the mirror proxy with libcurl, that only
+       * needs netrc */
+      for (i = 0; atomupd->images_mirrors != NULL && atomupd->images_mirrors[i] != NULL;
+           i++)
+         urls = g_list_append(urls, atomupd->images_mirrors[i]);
+      for (i = 0; atomupd->meta_mirrors != NULL && atomupd->meta_mirrors[i] != NULL; i++)
+         urls = g_list_append(urls, atomupd->meta_mirrors[i]);
+
+      if (!_au_ensure_urls_in_netrc(AU_NETRC_PATH, urls, username, password, error))
+         return FALSE;
+
+      desync_config_path = g_getenv("AU_DESYNC_CONFIG_PATH");
+      if (desync_config_path == NULL)
+         desync_config_path = AU_DESYNC_CONFIG_PATH;
+
+      if (!_au_ensure_url_in_desync_conf(desync_config_path, atomupd->images_url,
+                                         auth_encoded, error))
+         return FALSE;
+   }
+
+   /* The additional targets only check for updates, the options about installing
+    * them, and the peer sharing of the chunk cache, only apply to the running
+    * system */
+   if (atomupd->primary == NULL)
+      _au_load_install_config(atomupd, client_config);
+
+   atomupd->proxy_auto_select =
+      g_key_file_get_boolean(client_config, "ProxyPolicy", "AutoSelect", NULL);
+   atomupd->proxy_probe_interval =
+      _au_get_config_uint(client_config, "ProxyPolicy", "ProbeInterval",
+                          AU_PROXY_PROBE_DEFAULT_INTERVAL);
+   _au_update_proxy_probe(atomupd);
+
+   _au_set_trusted_dev_keys((AuAtomupd1 *)atomupd);
+
+   return TRUE;
+}
+
+static gboolean
+_au_select_and_load_configuration(AuAtomupd1Impl *atomupd, GError **error)
+{
+   g_autofree gchar *dev_config_path = NULL;
+   g_autoptr(GError) local_error = NULL;
+
+   g_return_val_if_fail(atomupd != NULL, FALSE);
+   g_return_val_if_fail(atomupd->config_directory != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   g_clear_pointer(&atomupd->config_path, g_free);
+
+   dev_config_path = g_build_filename(atomupd->config_directory, AU_DEV_CONFIG, NULL);
+   if (g_file_test(dev_config_path, G_FILE_TEST_EXISTS)) {
+      atomupd->config_path = g_steal_pointer(&dev_config_path);
+      atomupd->is_using_dev_config = TRUE;
+
+      if (_au_parse_config(atomupd, &local_error)) {
+         g_debug("Loaded the configuration file '%s'", atomupd->config_path);
+         return TRUE;
+      }
+
+      g_warning("Failed to load '%s': %s\nUsing '%s' as a fallback.", AU_DEV_CONFIG,
+                local_error->message, AU_CONFIG);
+      g_clear_error(&local_error);
+      g_clear_pointer(&atomupd->config_path, g_free);
+   }
+
+   atomupd->is_using_dev_config = FALSE;
+
+   atomupd->config_path = g_build_filename(atomupd->config_directory, AU_CONFIG, NULL);
+   if (_au_parse_config(atomupd, &local_error)) {
+      g_debug("Loaded the configuration file '%s'", atomupd->config_path);
+      return TRUE;
+   }
+
+   /* If we can't load the configuration file, as a last resort, we try the hardcoded
+    * AU_FALLBACK_CONFIG_PATH. This is a last attempt to avoid breaking the atomic
+    * updates in use cases where we have an invalid configuration file in the canonical
+    * path. */
+   g_warning(
+      "Failed to load '%s': %s\n Using the hardcoded path '%s' as a last resort attempt.",
+      atomupd->config_path, local_error->message, _au_get_fallback_config_path());
+   g_clear_error(&local_error);
+   g_clear_pointer(&atomupd->config_path, g_free);
+
+   atomupd->config_path =
+      g_build_filename(_au_get_fallback_config_path(), AU_CONFIG, NULL);
+
+   return _au_parse_config(atomupd, error);
+}
+
+static void
+au_reload_configuration_authorized_cb(AuAtomupd1 *object,
+                                      GDBusMethodInvocation *invocation,
+                                      gpointer arg_options_pointer)
+{
+   g_autoptr(GError) error = NULL;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   _au_clear_available_updates(object);
+
+   if (!_au_select_and_load_configuration(self, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "An error occurred while reloading the configuration, please fix your conf file "
+         "and retry: %s",
+         error->message);
+      return;
+   }
+
+   au_atomupd1_complete_reload_configuration(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_reload_configuration(AuAtomupd1 *object,
+                                             GDBusMethodInvocation *invocation,
+                                             GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.reload-configuration",
+                  au_reload_configuration_authorized_cb, invocation,
+                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+au_enable_http_proxy_authorized_cb(AuAtomupd1 *object,
+                                   GDBusMethodInvocation *invocation,
+                                   gpointer arg_proxy_data_pointer)
+{
+   GVariant *arg_proxy_data = arg_proxy_data_pointer;
+   const gchar *variant = au_atomupd1_get_variant(object);
+   const gchar *branch = au_atomupd1_get_branch(object);
+   const gchar *user_prefs_path =
+      _au_get_user_preferences_file_path((AuAtomupd1Impl *)object);
    g_autoptr(GError) error = NULL;
-   AuUpdateStatus current_status;
-   const gchar *url = NULL;
-   const gchar *update_path = NULL;
-   g_autofree gchar *update_url = NULL;
 
-   current_status = au_atomupd1_get_update_status(object);
-   if (current_status == AU_UPDATE_STATUS_IN_PROGRESS ||
-       current_status == AU_UPDATE_STATUS_PAUSED) {
-      g_dbus_method_invocation_return_error(g_steal_pointer(&invocation), G_DBUS_ERROR,
-                                            G_DBUS_ERROR_FAILED,
-                                            "Failed to start a new update because one "
-                                            "is already in progress");
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, arg_proxy_data,
+                                    &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "An error occurred while enabling the HTTP proxy : %s", error->message);
+      return;
+   }
+
+   au_atomupd1_set_http_proxy(object, arg_proxy_data);
+
+   au_atomupd1_complete_enable_http_proxy(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_enable_http_proxy(AuAtomupd1 *object,
+                                          GDBusMethodInvocation *invocation,
+                                          const gchar *arg_address,
+                                          gint arg_port,
+                                          GVariant *arg_options)
+{
+   g_autoptr(GVariant) proxy_data =
+      g_variant_ref_sink(g_variant_new("(si)", arg_address, arg_port));
+
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-http-proxy",
+                  au_enable_http_proxy_authorized_cb, invocation,
+                  g_steal_pointer(&proxy_data), (GDestroyNotify)g_variant_unref);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static void
+au_disable_http_proxy_authorized_cb(AuAtomupd1 *object,
+                                    GDBusMethodInvocation *invocation,
+                                    gpointer data_pointer)
+{
+   const gchar *variant = au_atomupd1_get_variant(object);
+   const gchar *branch = au_atomupd1_get_branch(object);
+   const gchar *user_prefs_path =
+      _au_get_user_preferences_file_path((AuAtomupd1Impl *)object);
+   g_autoptr(GVariant) proxy_data = g_variant_ref_sink(g_variant_new("(si)", "", 0));
+   g_autoptr(GError) error = NULL;
+
+   if (!_au_update_user_preferences(user_prefs_path, variant, branch, NULL, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "An error occurred while disabling the HTTP proxy : %s", error->message);
+      return;
+   }
+
+   au_atomupd1_set_http_proxy(object, proxy_data);
+
+   au_atomupd1_complete_disable_http_proxy(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_disable_http_proxy(AuAtomupd1 *object,
+                                           GDBusMethodInvocation *invocation)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-http-proxy",
+                  au_disable_http_proxy_authorized_cb, invocation, NULL, NULL);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static gboolean
+_au_enable_dev_keys(GError **error)
+{
+   const gchar *trusted_keys_dir = NULL;
+   const gchar *dev_keys_dir = NULL;
+   const gchar *filename;
+   g_autoptr(GDir) dir = NULL;
+   g_autoptr(GError) local_error = NULL;
+
+   /* These environment variables are used for debugging and automated tests */
+   trusted_keys_dir = g_getenv("AU_DEFAULT_TRUSTED_KEYS");
+   if (trusted_keys_dir == NULL)
+      trusted_keys_dir = AU_DEFAULT_TRUSTED_KEYS;
+
+   dev_keys_dir = g_getenv("AU_DEFAULT_DEV_KEYS");
+   if (dev_keys_dir == NULL)
+      dev_keys_dir = AU_DEFAULT_DEV_KEYS;
+
+   dir = g_dir_open(dev_keys_dir, 0, &local_error);
+   if (dir == NULL)
+      return au_throw_error(
+         error, "An error occurred while accessing the trusted dev keys directory: %s",
+         local_error->message);
+
+   while ((filename = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *pem_path = NULL;
+      g_autofree gchar *symlink_path = NULL;
+      g_autofree gchar *existing_target = NULL;
+
+      if (g_str_has_suffix(filename, ".pem"))
+         g_warning("%s doesn't follow the X509_LOOKUP_hash_dir(3) naming convention, "
+                   "RAUC may not be able to use it",
+                   filename);
+
+      pem_path = g_build_filename(dev_keys_dir, filename, NULL);
+      symlink_path = g_build_filename(trusted_keys_dir, filename, NULL);
+      existing_target = g_file_read_link(symlink_path, NULL);
+      if (g_strcmp0(existing_target, pem_path) == 0) {
+         g_debug("There is already a symlink that points to '%s'...", pem_path);
+         continue;
+      }
+
+      g_unlink(symlink_path);
+      if (symlink(pem_path, symlink_path) != 0) {
+         int saved_errno = errno;
+         return au_throw_error(
+            error, "An error occurred while enabling the trusted dev keys: %s",
+            g_strerror(saved_errno));
+      }
+   }
+   return TRUE;
+}
+
+static void
+au_enable_dev_keys_authorized_cb(AuAtomupd1 *object,
+                                 GDBusMethodInvocation *invocation,
+                                 gpointer data_pointer)
+{
+   g_autoptr(GError) error = NULL;
+
+   if (!_au_enable_dev_keys(&error)) {
+      g_dbus_method_invocation_return_error_literal(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED, error->message);
+      return;
+   }
+
+   au_atomupd1_complete_enable_dev_keys(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_enable_dev_keys(AuAtomupd1 *object,
+                                        GDBusMethodInvocation *invocation,
+                                        GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-trusted-keys",
+                  au_enable_dev_keys_authorized_cb, invocation,
+                  arg_options ? g_variant_ref(arg_options) : NULL,
+                  (GDestroyNotify)g_variant_unref);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+static gboolean
+_au_disable_dev_keys(GError **error)
+{
+   const gchar *trusted_keys_dir = NULL;
+   const gchar *dev_keys_dir = NULL;
+   const gchar *filename;
+   g_autoptr(GDir) dir = NULL;
+   g_autoptr(GError) local_error = NULL;
+
+   /* These environment variables are used for debugging and automated tests */
+   trusted_keys_dir = g_getenv("AU_DEFAULT_TRUSTED_KEYS");
+   if (trusted_keys_dir == NULL)
+      trusted_keys_dir = AU_DEFAULT_TRUSTED_KEYS;
+
+   dev_keys_dir = g_getenv("AU_DEFAULT_DEV_KEYS");
+   if (dev_keys_dir == NULL)
+      dev_keys_dir = AU_DEFAULT_DEV_KEYS;
+
+   dir = g_dir_open(trusted_keys_dir, 0, &local_error);
+   if (dir == NULL)
+      return au_throw_error(
+         error, "An error occurred while accessing the trusted dev keys directory: %s",
+         local_error->message);
+
+   while ((filename = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *symlink_path = NULL;
+      g_autofree gchar *target = NULL;
+
+      symlink_path = g_build_filename(trusted_keys_dir, filename, NULL);
+      target = g_file_read_link(symlink_path, NULL);
+      if (target == NULL)
+         continue;
+
+      /* Remove the symlink only if it points to the development keys directory */
+      if (g_str_has_prefix(target, dev_keys_dir)) {
+         if (g_unlink(symlink_path) != 0) {
+            int saved_errno = errno;
+            return au_throw_error(
+               error, "An error occurred while disabling the trusted dev keys: %s",
+               g_strerror(saved_errno));
+         }
+      }
+   }
+   return TRUE;
+}
+
+static void
+au_disable_dev_keys_authorized_cb(AuAtomupd1 *object,
+                                  GDBusMethodInvocation *invocation,
+                                  gpointer data_pointer)
+{
+   g_autoptr(GError) error = NULL;
+
+   if (!_au_disable_dev_keys(&error)) {
+      g_dbus_method_invocation_return_error_literal(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED, error->message);
       return;
    }
 
-   g_variant_lookup(arg_options, "url", "&s", &url);
-   g_variant_lookup(arg_options, "update_path", "&s", &update_path);
+   au_atomupd1_complete_disable_dev_keys(object, g_steal_pointer(&invocation));
+}
+
+static gboolean
+au_atomupd1_impl_handle_disable_dev_keys(AuAtomupd1 *object,
+                                         GDBusMethodInvocation *invocation,
+                                         GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.manage-trusted-keys",
+                  au_disable_dev_keys_authorized_cb, invocation,
+                  arg_options ? g_variant_ref(arg_options) : NULL,
+                  (GDestroyNotify)g_variant_unref);
+
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
+
+/*
+ * _au_get_builds_catalog:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @builds_data: (not nullable): The request with the variant and the builds list path
+ * @error: Used to raise an error on failure
+ *
+ * Parsing the builds list every time is wasteful, because it is usually
+ * queried multiple times while it stays unchanged. Return the cached catalog
+ * of @builds_data->variant, and parse it again only if its file was replaced.
+ *
+ * Returns: (transfer none): The catalog of builds
+ */
+static const AuBuildsCatalog *
+_au_get_builds_catalog(AuAtomupd1Impl *self,
+                       const BuildsData *builds_data,
+                       GError **error)
+{
+   AuBuildsCatalog *catalog = NULL; /* borrowed */
+   g_autoptr(AuBuildsCatalog) new_catalog = NULL;
+
+   catalog = g_hash_table_lookup(self->builds_catalogs, builds_data->variant);
 
-   if ((url == NULL && update_path == NULL) || (url != NULL && update_path != NULL)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
-         "Exactly one of 'url' or 'update_path' must be provided");
-      return;
-   }
+   if (catalog != NULL && g_strcmp0(catalog->path, builds_data->builds_path) == 0 &&
+       !au_builds_catalog_is_stale(catalog))
+      return catalog;
 
-   if (url == NULL)
-      update_url = g_build_filename(self->images_url, update_path, NULL);
-   else
-      update_url = g_strdup(url);
+   g_debug("Parsing the list of builds for %s", builds_data->variant);
 
-   /* For a custom update, buildid and version are unknown */
-   au_atomupd1_set_update_build_id(object, NULL);
-   au_atomupd1_set_update_version(object, NULL);
+   new_catalog = au_builds_catalog_new_from_file(builds_data->builds_path, error);
+   if (new_catalog == NULL)
+      return NULL;
 
-   argv = g_ptr_array_new_with_free_func(g_free);
-   g_ptr_array_add(argv, g_strdup("steamos-atomupd-client"));
-   g_ptr_array_add(argv, g_strdup("--config"));
-   g_ptr_array_add(argv, g_strdup(self->config_path));
-   g_ptr_array_add(argv, g_strdup("--update-from-url"));
-   g_ptr_array_add(argv, g_steal_pointer(&update_url));
+   catalog = new_catalog;
+   g_hash_table_replace(self->builds_catalogs, g_strdup(builds_data->variant),
+                        g_steal_pointer(&new_catalog));
 
-   if (g_debug_controller_get_debug_enabled(self->debug_controller))
-      g_ptr_array_add(argv, g_strdup("--debug"));
+   return catalog;
+}
 
-   g_ptr_array_add(argv, NULL);
+/*
+ * _au_complete_builds_request:
+ * @builds_data: (not nullable): The request to complete
+ *
+ * Reply to a GetBuilds() or QueryBuilds() request, now that its builds list
+ * is available locally.
+ */
+static void
+_au_complete_builds_request(BuildsData *builds_data)
+{
+   g_autoptr(GError) error = NULL;
+   g_autoptr(GVariant) builds = NULL;
+   const AuBuildsCatalog *catalog = NULL;
+   AuAtomupd1 *object = builds_data->req->object;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
 
-   if (!_au_spawn_update_helper(object, argv, &error)) {
+   if (builds_data->query == NULL) {
+      au_atomupd1_complete_get_builds(object,
+                                      g_steal_pointer(&builds_data->req->invocation),
+                                      builds_data->builds_path);
+      return;
+   }
+
+   catalog = _au_get_builds_catalog(self, builds_data, &error);
+   if (catalog == NULL) {
       g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to launch the \"steamos-atomupd-client\" helper: %s", error->message);
+         g_steal_pointer(&builds_data->req->invocation), G_DBUS_ERROR,
+         G_DBUS_ERROR_FAILED, "Failed to parse the builds list: %s", error->message);
       return;
    }
 
-   au_atomupd1_set_progress_percentage(object, 0);
-   _au_atomupd1_set_update_status_and_error(object, AU_UPDATE_STATUS_IN_PROGRESS, NULL,
-                                            NULL);
+   builds = au_builds_catalog_query(catalog, builds_data->query, builds_data->limit);
+   au_atomupd1_complete_query_builds(
+      object, g_steal_pointer(&builds_data->req->invocation), builds);
 
-   au_atomupd1_complete_start_custom_update(object, g_steal_pointer(&invocation));
+   _au_schedule_memory_release(self);
 }
 
-static gboolean
-au_atomupd1_impl_handle_start_custom_update(AuAtomupd1 *object,
-                                            GDBusMethodInvocation *invocation,
-                                            GVariant *arg_options)
+static gchar *
+_au_get_builds_path(AuAtomupd1Impl *self, const gchar *variant)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.start-custom-upgrade",
-                  au_start_custom_update_authorized_cb, invocation,
-                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
+   g_autofree gchar *builds_filename = NULL;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   builds_filename = g_strdup_printf("builds-%s.json", variant);
+
+   return g_build_filename(_au_get_run_path(self), builds_filename, NULL);
 }
 
 static void
-au_resume_update_authorized_cb(AuAtomupd1 *object,
-                               GDBusMethodInvocation *invocation,
-                               gpointer data_pointer)
+_au_prefetch_next_builds_list(AuAtomupd1Impl *self);
+
+static void
+_au_builds_download_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
 {
+   g_autoptr(BuildsDownloadData) builds_dl = user_data;
+   g_autoptr(GPtrArray) waiters = NULL;
+   g_autofree gchar *variant = NULL;
    g_autoptr(GError) error = NULL;
-   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   AuAtomupd1Impl *self = builds_dl->self;
+   gboolean success;
+   guint i;
 
-   if (au_atomupd1_get_update_status(object) != AU_UPDATE_STATUS_PAUSED) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "There isn't a paused update that can be resumed");
-      return;
+   success = g_task_propagate_boolean(G_TASK(result), &error);
+
+   if (success) {
+      g_debug("Builds list file of %s successfully downloaded", builds_dl->variant);
+   } else {
+      g_debug("Failed to download the builds list of %s: %s", builds_dl->variant,
+              error->message);
+      _au_proxy_download_failed(self);
    }
 
-   if (!_au_send_signal_to_install_procs(self, SIGCONT, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), error->domain, error->code,
-         "An error occurred while attempting to resume the installation process: %s",
-         error->message);
-      return;
+   if (!g_hash_table_steal_extended(self->builds_downloads, builds_dl->variant,
+                                    (gpointer *)&variant, (gpointer *)&waiters))
+      g_return_if_reached();
+
+   for (i = 0; i < waiters->len; i++) {
+      BuildsData *data = g_ptr_array_index(waiters, i);
+
+      if (success) {
+         _au_complete_builds_request(data);
+      } else {
+         g_dbus_method_invocation_return_error(
+            g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+            "Failed to download the builds list: %s", error->message);
+      }
    }
 
-   au_atomupd1_set_update_status(object, AU_UPDATE_STATUS_IN_PROGRESS);
-   au_atomupd1_complete_resume_update(object, g_steal_pointer(&invocation));
+   if (builds_dl->is_prefetch) {
+      self->n_builds_prefetches--;
+      _au_prefetch_next_builds_list(self);
+   }
 }
 
-static gboolean
-au_atomupd1_impl_handle_resume_update(AuAtomupd1 *object,
-                                      GDBusMethodInvocation *invocation)
+/*
+ * _au_download_builds_list:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @variant: (not nullable): The variant of the builds list to download
+ * @is_prefetch: %TRUE if nobody requested this builds list yet
+ *
+ * Start the download of the builds list of @variant in a separate thread.
+ * There must not be another download in progress for the same variant.
+ *
+ * Returns: (transfer none): The array of BuildsData that will be completed
+ *  when the download ends. Requests for the same variant that arrive in the
+ *  meantime are expected to be appended here, instead of starting a new
+ *  download.
+ */
+static GPtrArray *
+_au_download_builds_list(AuAtomupd1Impl *self, const gchar *variant, gboolean is_prefetch)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-pending-update",
-                  au_resume_update_authorized_cb, invocation, NULL, NULL);
+   g_autoptr(GTask) task = NULL;
+   g_autoptr(DownloadData) dl_data = g_new0(DownloadData, 1);
+   BuildsDownloadData *builds_dl = NULL;
+   GPtrArray *waiters = NULL;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   g_return_val_if_fail(!g_hash_table_contains(self->builds_downloads, variant), NULL);
+
+   dl_data->target = _au_get_builds_path(self, variant);
+   dl_data->url = g_build_filename(self->meta_url, self->release, self->product,
+                                   self->architecture, variant, AU_BUILDS_LIST, NULL);
+   dl_data->proxy = _au_get_http_proxy_for_host(self, AU_PROXY_HOST_META);
+
+   waiters = g_ptr_array_new_with_free_func((GDestroyNotify)_builds_data_free);
+   g_hash_table_insert(self->builds_downloads, g_strdup(variant), waiters);
+
+   builds_dl = g_slice_new0(BuildsDownloadData);
+   builds_dl->self = g_object_ref(self);
+   builds_dl->variant = g_strdup(variant);
+   builds_dl->is_prefetch = is_prefetch;
+
+   if (is_prefetch)
+      self->n_builds_prefetches++;
+
+   task = g_task_new(NULL, NULL, _au_builds_download_done, builds_dl);
+   g_task_set_task_data(task, g_steal_pointer(&dl_data),
+                        (GDestroyNotify)download_data_free);
+   g_task_run_in_thread(task, _au_download_thread_func);
+
+   return waiters;
 }
 
+/*
+ * _au_is_valid_variant_name:
+ * @variant: (not nullable): The name of a variant
+ *
+ * The variant is used to build the path of its builds list, both locally and on
+ * the meta server, so it must not be able to escape from their directory.
+ *
+ * Returns: %TRUE if @variant can be safely used in a path
+ */
 static gboolean
-debug_controller_authorize_cb(GDebugControllerDBus *debug_controller,
-                              GDBusMethodInvocation *invocation,
-                              gpointer user_data)
+_au_is_valid_variant_name(const gchar *variant)
 {
-   /* Do not perform any additional check before authorizing this operation.
-    * We don't print sensitive information in the debug output, so there is no
-    * need to gate this behind polkit. */
-   return TRUE;
+   return strstr(variant, "..") == NULL && strchr(variant, '/') == NULL &&
+          strchr(variant, ' ') == NULL;
 }
 
-static gboolean
-_au_parse_preferences(AuAtomupd1Impl *atomupd, GError **error)
+/*
+ * _au_prefetch_next_builds_list:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Start downloading the queued builds lists, up to AU_BUILDS_PREFETCH_MAX_JOBS
+ * at the same time.
+ */
+static void
+_au_prefetch_next_builds_list(AuAtomupd1Impl *self)
 {
-   g_autofree gchar *variant = NULL;
-   g_autofree gchar *branch = NULL;
-   g_autoptr(GVariant) http_proxy = NULL;
-   const gchar *branch_file_path = _au_get_legacy_branch_file_path();
-   const gchar *user_prefs_path = _au_get_user_preferences_file_path();
-   g_autoptr(GError) local_error = NULL;
+   while (self->n_builds_prefetches < AU_BUILDS_PREFETCH_MAX_JOBS) {
+      g_autofree gchar *variant = g_queue_pop_head(self->builds_prefetch_queue);
+      g_autofree gchar *builds_path = NULL;
 
-   g_return_val_if_fail(atomupd != NULL, FALSE);
-   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+      if (variant == NULL)
+         return;
 
-   /* If we still have a legacy "steamos-branch" file, we try to load it first and
-    * then convert it to the new preferences.conf */
-   if (!_au_load_legacy_preferences(branch_file_path, &variant, &branch, &local_error)) {
-      g_debug("%s", local_error->message);
-      g_clear_error(&local_error);
-   }
+      builds_path = _au_get_builds_path(self, variant);
 
-   /* Try preferences.conf if we couldn't load the legacy config */
-   if (!variant && !_au_load_user_preferences_file(user_prefs_path, &variant, &branch,
-                                                   &http_proxy, &local_error)) {
-      g_debug("%s", local_error->message);
-      g_clear_error(&local_error);
+      /* Skip the builds lists that we already have, or that are already being
+       * downloaded for a GetBuilds() request */
+      if (g_file_test(builds_path, G_FILE_TEST_EXISTS) ||
+          g_hash_table_contains(self->builds_downloads, variant))
+         continue;
+
+      g_debug("Prefetching the list of builds for %s", variant);
+      _au_download_builds_list(self, variant, TRUE);
    }
+}
 
-   /* As our last resort we try to parse the image manifest file */
-   if (!variant) {
-      if (!_au_load_preferences_from_manifest(atomupd->manifest_path, &variant, &branch,
-                                              error)) {
-         return FALSE;
-      }
+/*
+ * _au_prefetch_builds_lists:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Download in background the builds lists of all the known variants that we
+ * don't have yet, so that GetBuilds() and QueryBuilds() don't need to wait
+ * for the network. Nothing is prefetched when using a metered connection, or
+ * for the additional targets, that download their builds lists on request.
+ */
+static void
+_au_prefetch_builds_lists(AuAtomupd1Impl *self)
+{
+   const gchar *const *known_variants = NULL;
+   GNetworkMonitor *network_monitor = NULL; /* borrowed */
+   gsize i;
+
+   if (self->primary != NULL)
+      return;
+
+   if (self->meta_url == NULL || self->release == NULL || self->product == NULL ||
+       self->architecture == NULL)
+      return;
+
+   network_monitor = g_network_monitor_get_default();
+   if (g_network_monitor_get_network_metered(network_monitor)) {
+      g_debug("The network is metered, skipping the builds lists prefetch");
+      return;
    }
 
-   if (http_proxy == NULL)
-      http_proxy = g_variant_ref_sink(g_variant_new("(si)", "", 0));
+   known_variants = au_atomupd1_get_known_variants((AuAtomupd1 *)self);
 
-   g_debug("Tracking the variant %s and branch %s", variant, branch);
+   for (i = 0; known_variants != NULL && known_variants[i] != NULL; i++) {
+      /* The known variants can come from the remote info file */
+      if (!_au_is_valid_variant_name(known_variants[i])) {
+         g_debug("Not prefetching the builds list of the invalid variant '%s'",
+                 known_variants[i]);
+         continue;
+      }
 
-   au_atomupd1_set_variant((AuAtomupd1 *)atomupd, variant);
-   au_atomupd1_set_branch((AuAtomupd1 *)atomupd, branch);
-   au_atomupd1_set_http_proxy((AuAtomupd1 *)atomupd, http_proxy);
+      if (g_queue_find_custom(self->builds_prefetch_queue, known_variants[i],
+                              (GCompareFunc)g_strcmp0) != NULL)
+         continue;
 
-   return TRUE;
+      g_queue_push_tail(self->builds_prefetch_queue, g_strdup(known_variants[i]));
+   }
+
+   _au_prefetch_next_builds_list(self);
 }
 
+/*
+ * _au_get_update_bundle_from_json:
+ * @output: (not nullable): JSON output of the "steamos-atomupd-client" query
+ * @wanted_buildid: (nullable): The buildid of the update candidate to look for,
+ *  or %NULL for the first one, that is the only one that can be installed
+ *  right away
+ * @buildid_out: (out) (optional): Used to return the buildid of the update
+ *  candidate
+ * @update_path_out: (out) (not optional): Used to return the path of the RAUC
+ *  bundle of the update candidate, relative to the images URL
+ *
+ * Returns: %TRUE if @output has the update candidate with the expected fields
+ */
 static gboolean
-_au_parse_manifest(AuAtomupd1Impl *atomupd, GError **error)
+_au_get_update_bundle_from_json(const gchar *output,
+                                const gchar *wanted_buildid,
+                                gchar **buildid_out,
+                                gchar **update_path_out)
 {
-   const gchar *build_id = NULL;
-   const gchar *version = NULL;
+   g_autoptr(JsonNode) json_node = NULL;
    JsonObject *json_object = NULL; /* borrowed */
-   g_autoptr(JsonParser) parser = NULL;
+   JsonNode *sub_node = NULL;      /* borrowed */
+   JsonArray *array = NULL;        /* borrowed */
+   guint i;
 
-   g_return_val_if_fail(atomupd != NULL, FALSE);
-   g_return_val_if_fail(atomupd->manifest_path != NULL, FALSE);
-   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+   json_node = json_from_string(output, NULL);
+   if (json_node == NULL || !JSON_NODE_HOLDS_OBJECT(json_node))
+      return FALSE;
 
-   json_object = _au_load_manifest_object(atomupd->manifest_path, &parser, error);
-   if (json_object == NULL)
+   json_object = json_node_get_object(json_node);
+   sub_node = json_object_get_member(json_object, "minor");
+   if (sub_node == NULL || !JSON_NODE_HOLDS_OBJECT(sub_node))
       return FALSE;
 
-   build_id = json_object_get_string_member_with_default(json_object, "buildid", NULL);
-   version = json_object_get_string_member_with_default(json_object, "version", NULL);
+   sub_node = json_object_get_member(json_node_get_object(sub_node), "candidates");
+   if (sub_node == NULL || !JSON_NODE_HOLDS_ARRAY(sub_node))
+      return FALSE;
 
-   if (build_id == NULL || version == NULL)
-      return au_throw_error(error,
-                            "The manifest JSON \"%s\" doesn't have the expected keys",
-                            atomupd->manifest_path);
+   array = json_node_get_array(sub_node);
 
-   atomupd->release =
-      g_strdup(json_object_get_string_member_with_default(json_object, "release", NULL));
-   atomupd->product =
-      g_strdup(json_object_get_string_member_with_default(json_object, "product", NULL));
-   atomupd->architecture =
-      g_strdup(json_object_get_string_member_with_default(json_object, "arch", NULL));
+   for (i = 0; i < json_array_get_length(array); i++) {
+      JsonObject *candidate = NULL; /* borrowed */
+      const gchar *buildid = NULL;
+      const gchar *update_path = NULL;
 
-   /* This is really unexpected, and may break the ability to check for updates. We are
-    * not failing hard to see if we can still recover */
-   if (atomupd->release == NULL || atomupd->product == NULL ||
-       atomupd->architecture == NULL)
-      g_warning("The manifest JSON \"%s\" is missing some expected keys, "
-                "trying to continue anyway...",
-                atomupd->manifest_path);
+      if (wanted_buildid == NULL && i > 0)
+         break;
 
-   if (!_is_buildid_valid(build_id, &atomupd->buildid_date, &atomupd->buildid_increment,
-                          error))
-      return FALSE;
+      sub_node = json_array_get_element(array, i);
+      if (!JSON_NODE_HOLDS_OBJECT(sub_node))
+         continue;
 
-   au_atomupd1_set_current_build_id((AuAtomupd1 *)atomupd, build_id);
-   au_atomupd1_set_current_version((AuAtomupd1 *)atomupd, version);
+      candidate = json_node_get_object(sub_node);
+      sub_node = json_object_get_member(candidate, "image");
+      if (sub_node == NULL || !JSON_NODE_HOLDS_OBJECT(sub_node))
+         continue;
 
-   return TRUE;
+      buildid = json_object_get_string_member_with_default(
+         json_node_get_object(sub_node), "buildid", NULL);
+      if (wanted_buildid != NULL && g_strcmp0(buildid, wanted_buildid) != 0)
+         continue;
+
+      update_path =
+         json_object_get_string_member_with_default(candidate, "update_path", NULL);
+
+      /* The buildid is used to build the local file name, be strict about it */
+      if (update_path == NULL || !_is_buildid_valid(buildid, NULL, NULL, NULL))
+         return FALSE;
+
+      if (buildid_out != NULL)
+         *buildid_out = g_strdup(buildid);
+      *update_path_out = g_strdup(update_path);
+      return TRUE;
+   }
+
+   return FALSE;
 }
 
-static gboolean
-_au_parse_config(AuAtomupd1Impl *atomupd, GError **error)
+/*
+ * _au_clear_prewarmed_bundles:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Remove all the pre-warmed update bundles from the run directory.
+ */
+static void
+_au_clear_prewarmed_bundles(AuAtomupd1Impl *self)
 {
-   const gchar *server_mandatory_key[] = { "ImagesUrl", "MetaUrl", NULL };
-   g_autofree gchar *username = NULL;
-   g_autofree gchar *password = NULL;
-   g_autofree gchar *auth_encoded = NULL;
-   g_autofree gchar *default_variant = NULL;
-   g_autofree gchar *default_branch = NULL;
-   g_auto(GStrv) known_variants = NULL;
-   g_auto(GStrv) known_branches = NULL;
-   g_auto(GStrv) known_dev_branches = NULL;
-   g_autoptr(GHashTable) url_table = NULL;
-   g_autoptr(GKeyFile) client_config = g_key_file_new();
-   g_autoptr(GKeyFile) remote_info = g_key_file_new();
-   g_autoptr(GError) local_error = NULL;
-   gsize i;
+   g_autoptr(GDir) dir = NULL;
+   const gchar *filename = NULL;
+
+   dir = g_dir_open(_au_get_run_path(self), 0, NULL);
+   if (dir == NULL)
+      return;
+
+   while ((filename = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *path = NULL;
+
+      if (!g_str_has_prefix(filename, "prewarm-") ||
+          !g_str_has_suffix(filename, ".raucb"))
+         continue;
+
+      path = g_build_filename(_au_get_run_path(self), filename, NULL);
+      g_debug("Removing the old pre-warmed update bundle %s", path);
+      g_unlink(path);
+   }
+}
 
-   g_return_val_if_fail(atomupd != NULL, FALSE);
-   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+static void
+_au_prewarm_done(GObject *source, GAsyncResult *res, gpointer user_data)
+{
+   g_autoptr(AuAtomupd1) object = user_data;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_autofree gchar *buildid = g_steal_pointer(&self->prewarm_in_progress);
+   g_autoptr(GError) error = NULL;
 
-   if (!g_key_file_load_from_file(client_config, atomupd->config_path, G_KEY_FILE_NONE,
-                                  error))
-      return FALSE;
+   if (g_task_propagate_boolean(G_TASK(res), &error)) {
+      g_debug("The update bundle of %s has been pre-warmed", buildid);
+   } else {
+      g_debug("Failed to pre-warm the update bundle of %s: %s", buildid, error->message);
+      _au_proxy_download_failed(self);
+   }
+}
 
-   /* Ensure that the configuration has all the mandatory fields */
-   for (i = 0; server_mandatory_key[i] != NULL; i++) {
-      if (!g_key_file_has_key(client_config, "Server", server_mandatory_key[i], NULL)) {
-         return au_throw_error(
-            error, "The config file \"%s\" doesn't have the expected \"%s\" entry",
-            atomupd->config_path, server_mandatory_key[i]);
-      }
+/*
+ * _au_prewarm_update_bundle:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ * @output: (not nullable): JSON output of the "steamos-atomupd-client" query
+ * @available: (not nullable): Map of available updates that can be installed
+ *
+ * If enabled in the configuration, download in background the RAUC bundle of
+ * the update that can be installed right away. With Desync the bundle only
+ * carries the image chunk index and its metadata, and it is the first thing
+ * that the helper needs to download when starting an update. The bundle is
+ * skipped if it exceeds the configured maximum size, or if the network is
+ * metered.
+ */
+static void
+_au_prewarm_update_bundle(AuAtomupd1Impl *self, const gchar *output, GVariant *available)
+{
+   g_autofree gchar *buildid = NULL;
+   g_autofree gchar *update_path = NULL;
+   g_autofree gchar *prewarm_path = NULL;
+   g_autoptr(DownloadData) dl_data = NULL;
+   g_autoptr(GTask) task = NULL;
+   GNetworkMonitor *network_monitor = NULL; /* borrowed */
+
+   if (!self->prewarm_enabled || self->images_url == NULL)
+      return;
+
+   if (self->prewarm_in_progress != NULL) {
+      g_debug("The update bundle of %s is already being pre-warmed",
+              self->prewarm_in_progress);
+      return;
    }
 
-   if (!atomupd->is_using_dev_config &&
-       !g_key_file_load_from_file(remote_info, _au_get_remote_info_path(),
-                                  G_KEY_FILE_NONE, &local_error)) {
-      /* This could happen if for example the Steam Deck is in offline mode, or the server
-       * doesn't have a remote info file at all. In those cases we simply continue to use
-       * the local info */
-      g_debug("Failed to use the additional remote info: %s", local_error->message);
-      g_debug("Continuing anyway...");
-      g_clear_error(&local_error);
+   network_monitor = g_network_monitor_get_default();
+   if (g_network_monitor_get_network_metered(network_monitor)) {
+      g_debug("The network is metered, skipping the update bundle pre-warm");
+      return;
    }
 
-   g_debug("Getting the list of known variants and branches");
+   if (!_au_get_update_bundle_from_json(output, NULL, &buildid, &update_path))
+      return;
 
-   /* We don't load the remote info file when using a development configuration.
-    * We could have additional custom variants/branches, and we don't want to replace
-    * them with the ones from the server side. */
-   if (!atomupd->is_using_dev_config) {
-      known_variants = _au_get_known_variants_from_config(remote_info, NULL);
-      if (known_variants != NULL)
-         g_debug("Using the list of known variants from the remote info file");
+   /* The first candidate might have already been applied and is waiting for
+    * a reboot, in that case there is nothing to pre-warm */
+   if (!g_variant_lookup(available, buildid, "@a{sv}", NULL))
+      return;
 
-      known_branches = _au_get_known_branches_from_config(remote_info, NULL);
-      if (known_branches != NULL)
-         g_debug("Using the list of known branches from the remote info file");
+   prewarm_path = _au_get_prewarm_path(self, buildid);
+   if (g_file_test(prewarm_path, G_FILE_TEST_EXISTS))
+      return;
 
-      known_dev_branches = _au_get_known_dev_branches_from_config(remote_info, NULL);
-      if (known_dev_branches != NULL)
-         g_debug("Using the list of known dev branches from the remote info file");
-   }
+   /* We only keep the bundle of the latest available update */
+   _au_clear_prewarmed_bundles(self);
 
-   if (known_variants == NULL) {
-      known_variants = _au_get_known_variants_from_config(client_config, error);
-      if (known_variants == NULL)
-         return FALSE;
-   }
+   dl_data = g_new0(DownloadData, 1);
+   dl_data->target = g_steal_pointer(&prewarm_path);
+   dl_data->url = g_build_filename(self->images_url, update_path, NULL);
+   dl_data->proxy = _au_get_http_proxy_for_host(self, AU_PROXY_HOST_IMAGES);
+   dl_data->max_size = self->prewarm_max_size;
+   /* Up to PrewarmMaxSize might not fit in a minute on a slow connection, and
+    * nobody is waiting for this download */
+   dl_data->abort_only_if_stalled = TRUE;
 
-   /* As a security measure against misconfigurations, we ensure that in the list of
-    * known variants there is at least the default variant */
-   default_variant = _au_get_default_variant(atomupd->manifest_path, NULL);
-   if (default_variant != NULL &&
-       !g_strv_contains((const gchar *const *)known_variants, default_variant)) {
-      gsize length = g_strv_length(known_variants);
+   g_debug("Pre-warming the update bundle %s", dl_data->url);
+   self->prewarm_in_progress = g_steal_pointer(&buildid);
 
-      known_variants = g_realloc(known_variants, (length + 2) * sizeof(gchar *));
-      known_variants[length] = g_steal_pointer(&default_variant);
-      known_variants[length + 1] = NULL;
-   }
+   task = g_task_new(NULL, NULL, _au_prewarm_done, g_object_ref(self));
+   g_task_set_task_data(task, g_steal_pointer(&dl_data),
+                        (GDestroyNotify)download_data_free);
+   g_task_run_in_thread(task, _au_download_thread_func);
+}
 
-   au_atomupd1_set_known_variants((AuAtomupd1 *)atomupd,
-                                  (const gchar *const *)known_variants);
+/*
+ * _au_get_builds_list:
+ * @object: (not nullable): The AuAtomupd1 object
+ * @invocation: (transfer full): The method invocation to complete
+ * @builds_data: (transfer full): The request, without its variant and path
+ * @variant: (nullable): The variant of the builds list, or %NULL to use
+ *  the currently selected one
+ *
+ * Ensure that the builds list of @variant is available locally, downloading it
+ * if necessary, and then complete the request.
+ */
+static void
+_au_get_builds_list(AuAtomupd1 *object,
+                    GDBusMethodInvocation *invocation,
+                    BuildsData *builds_data,
+                    const gchar *variant)
+{
+   g_autoptr(BuildsData) data = builds_data;
+   GPtrArray *waiters = NULL; /* borrowed */
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
 
-   if (known_branches == NULL) {
-      known_branches = _au_get_known_branches_from_config(client_config, error);
-      if (known_branches == NULL)
-         return FALSE;
+   /* Use by default the currently selected variant */
+   if (variant == NULL || variant[0] == '\0')
+      variant = au_atomupd1_get_variant(object);
+
+   if (!_au_is_valid_variant_name(variant)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Invalid variant name: must not contain spaces, slashes, or '..'");
+      return;
    }
 
-   /* As a security measure against misconfigurations, we ensure that in the list of
-    * known branches there is at least the default branch */
-   default_branch = _au_get_default_branch(atomupd->manifest_path);
-   if (!g_strv_contains((const gchar *const *)known_branches, default_branch)) {
-      gsize length = g_strv_length(known_branches);
+   data->req->invocation = g_steal_pointer(&invocation);
+   data->req->object = g_object_ref(object);
+   data->variant = g_strdup(variant);
+   data->builds_path = _au_get_builds_path(self, variant);
 
-      known_branches = g_realloc(known_branches, (length + 2) * sizeof(gchar *));
-      known_branches[length] = g_steal_pointer(&default_branch);
-      known_branches[length + 1] = NULL;
+   if (g_file_test(data->builds_path, G_FILE_TEST_EXISTS)) {
+      g_debug("We already have the list of builds for %s", variant);
+      _au_complete_builds_request(data);
+      return;
    }
 
-   if (known_dev_branches == NULL)
-      known_dev_branches = _au_get_known_dev_branches_from_config(client_config, NULL);
+   waiters = g_hash_table_lookup(self->builds_downloads, variant);
 
-   au_atomupd1_set_known_branches((AuAtomupd1 *)atomupd,
-                                  (const gchar *const *)known_branches);
-   au_atomupd1_set_known_dev_branches((AuAtomupd1 *)atomupd,
-                                      (const gchar *const *)known_dev_branches);
+   if (waiters != NULL)
+      g_debug("The list of builds for %s is already being downloaded", variant);
+   else
+      waiters = _au_download_builds_list(self, variant, FALSE);
 
-   url_table = _au_get_urls_from_config(client_config, error);
-   if (url_table == NULL) {
-      /* The config file is malformed, bail out */
-      g_warning("Failed to get the list of URLs from %s", atomupd->config_path);
-      return FALSE;
-   }
+   g_ptr_array_add(waiters, g_steal_pointer(&data));
+}
 
-   g_clear_pointer(&atomupd->images_url, g_free);
-   g_clear_pointer(&atomupd->meta_url, g_free);
-   atomupd->images_url = g_strdup(g_hash_table_lookup(url_table, "ImagesUrl"));
-   atomupd->meta_url = g_strdup(g_hash_table_lookup(url_table, "MetaUrl"));
+static void
+au_get_builds_authorized_cb(AuAtomupd1 *object,
+                            GDBusMethodInvocation *invocation,
+                            gpointer arg_options_pointer)
+{
+   GVariant *arg_options = arg_options_pointer;
+   const gchar *key = NULL;
+   GVariant *value = NULL;
+   const gchar *variant = NULL;
+   GVariantIter iter;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
 
-   if (atomupd->images_url == NULL || atomupd->meta_url == NULL) {
-      /* We already ensured the presence of both entries at the beginning of
-       * _au_parse_config(), but if for whatever reason they are NULL, we error out */
-      au_throw_error(
-         error, "The config file \"%s\" doesn't have the expected server URL entries",
-         atomupd->config_path);
-      return FALSE;
+   g_return_if_fail(self->config_path != NULL);
+   g_return_if_fail(self->manifest_path != NULL);
+   g_return_if_fail(self->meta_url != NULL);
+
+   g_variant_iter_init(&iter, arg_options);
+
+   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
+      if (g_str_equal(key, "variant")) {
+         if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
+            variant = g_variant_get_string(value, NULL);
+         } else {
+            g_dbus_method_invocation_return_error(
+               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+               "The argument '%s' must have a string value", key);
+            return;
+         }
+         continue;
+      }
+
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "The argument '%s' is not a valid option", key);
+      return;
    }
 
-   /* If the config has an HTTP auth, we need to ensure that netrc and Desync
-    * have it too */
-   if (_au_get_http_auth_from_config(client_config, &username, &password,
-                                     &auth_encoded)) {
-      g_autoptr(GList) urls = NULL;
-      const gchar *desync_config_path;
+   _au_get_builds_list(object, g_steal_pointer(&invocation), au_builds_data_new(),
+                       variant);
+}
 
-      urls = g_hash_table_get_values(url_table);
+static gboolean
+au_atomupd1_impl_handle_get_builds(AuAtomupd1 *object,
+                                   GDBusMethodInvocation *invocation,
+                                   GVariant *arg_options)
+{
+   _au_check_auth(object, "com.steampowered.atomupd1.get-builds",
+                  au_get_builds_authorized_cb, invocation, g_variant_ref(arg_options),
+                  (GDestroyNotify)g_variant_unref);
 
-      if (!_au_ensure_urls_in_netrc(AU_NETRC_PATH, urls, username, password, error))
-         return FALSE;
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-      desync_config_path = g_getenv("AU_DESYNC_CONFIG_PATH");
-      if (desync_config_path == NULL)
-         desync_config_path = AU_DESYNC_CONFIG_PATH;
+static void
+au_query_builds_authorized_cb(AuAtomupd1 *object,
+                              GDBusMethodInvocation *invocation,
+                              gpointer arg_query_data_pointer)
+{
+   GVariant *arg_query_data = arg_query_data_pointer;
+   g_autoptr(BuildsData) builds_data = au_builds_data_new();
+   g_autoptr(GVariant) filter = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *variant = NULL;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
 
-      if (!_au_ensure_url_in_desync_conf(desync_config_path, atomupd->images_url,
-                                         auth_encoded, error))
-         return FALSE;
-   }
+   g_return_if_fail(self->meta_url != NULL);
 
-   _au_set_trusted_dev_keys((AuAtomupd1 *)atomupd);
+   g_variant_get(arg_query_data, "(&s@a{sv}u)", &variant, &filter, &builds_data->limit);
 
-   return TRUE;
+   builds_data->query = g_new0(AuBuildsQuery, 1);
+
+   if (!au_builds_query_init(builds_data->query, filter, self->buildid_date,
+                             self->buildid_increment, &error)) {
+      g_dbus_method_invocation_return_error_literal(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         error->message);
+      return;
+   }
+
+   _au_get_builds_list(object, g_steal_pointer(&invocation),
+                       g_steal_pointer(&builds_data), variant);
 }
 
 static gboolean
-_au_select_and_load_configuration(AuAtomupd1Impl *atomupd, GError **error)
+au_atomupd1_impl_handle_query_builds(AuAtomupd1 *object,
+                                     GDBusMethodInvocation *invocation,
+                                     const gchar *arg_variant,
+                                     GVariant *arg_filter,
+                                     guint arg_limit)
 {
-   g_autofree gchar *dev_config_path = NULL;
-   g_autoptr(GError) local_error = NULL;
+   g_autoptr(GVariant) query_data = g_variant_ref_sink(
+      g_variant_new("(s@a{sv}u)", arg_variant, arg_filter, arg_limit));
 
-   g_return_val_if_fail(atomupd != NULL, FALSE);
-   g_return_val_if_fail(atomupd->config_directory != NULL, FALSE);
-   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+   _au_check_auth(object, "com.steampowered.atomupd1.get-builds",
+                  au_query_builds_authorized_cb, invocation,
+                  g_steal_pointer(&query_data), (GDestroyNotify)g_variant_unref);
 
-   g_clear_pointer(&atomupd->config_path, g_free);
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-   dev_config_path = g_build_filename(atomupd->config_directory, AU_DEV_CONFIG, NULL);
-   if (g_file_test(dev_config_path, G_FILE_TEST_EXISTS)) {
-      atomupd->config_path = g_steal_pointer(&dev_config_path);
-      atomupd->is_using_dev_config = TRUE;
+/*
+ * _au_progress_subscriber_send:
+ * @subscriber: (not nullable): The subscriber that will receive the record
+ *
+ * Send a single AuProgressRecord to @subscriber.
+ *
+ * Returns: %FALSE if the subscriber went away and should be dropped
+ */
+static gboolean
+_au_progress_subscriber_send(ProgressSubscriber *subscriber)
+{
+   AuAtomupd1 *object = (AuAtomupd1 *)subscriber->self;
+   AuProgressRecord record = {
+      .version = AU_PROGRESS_RECORD_VERSION,
+      .status = au_atomupd1_get_update_status(object),
+      .percentage = au_atomupd1_get_progress_percentage(object),
+      .bytes = subscriber->self->progress_bytes,
+      .rate = subscriber->self->progress_rate,
+      .estimated_completion_time = au_atomupd1_get_estimated_completion_time(object),
+   };
 
-      if (_au_parse_config(atomupd, &local_error)) {
-         g_debug("Loaded the configuration file '%s'", atomupd->config_path);
+   /* MSG_NOSIGNAL: a subscriber that closed its end should not kill us with SIGPIPE.
+    * MSG_DONTWAIT: a subscriber that is not reading should not block the main loop. */
+   if (send(subscriber->fd, &record, sizeof(record), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+      int saved_errno = errno;
+
+      /* The subscriber is just slow, it will get the next record */
+      if (saved_errno == EAGAIN || saved_errno == EWOULDBLOCK || saved_errno == EINTR)
          return TRUE;
-      }
 
-      g_warning("Failed to load '%s': %s\nUsing '%s' as a fallback.", AU_DEV_CONFIG,
-                local_error->message, AU_CONFIG);
-      g_clear_error(&local_error);
-      g_clear_pointer(&atomupd->config_path, g_free);
+      g_debug("Dropping progress subscriber: %s", g_strerror(saved_errno));
+      return FALSE;
    }
 
-   atomupd->is_using_dev_config = FALSE;
+   return TRUE;
+}
 
-   atomupd->config_path = g_build_filename(atomupd->config_directory, AU_CONFIG, NULL);
-   if (_au_parse_config(atomupd, &local_error)) {
-      g_debug("Loaded the configuration file '%s'", atomupd->config_path);
-      return TRUE;
-   }
+static gboolean
+_au_progress_subscriber_tick_cb(gpointer user_data)
+{
+   ProgressSubscriber *subscriber = user_data;
+
+   if (_au_progress_subscriber_send(subscriber))
+      return G_SOURCE_CONTINUE;
+
+   /* Returning G_SOURCE_REMOVE already destroys the source */
+   subscriber->source_id = 0;
+   g_ptr_array_remove_fast(subscriber->self->progress_subscribers, subscriber);
+   return G_SOURCE_REMOVE;
+}
+
+/*
+ * _au_get_caller_uid:
+ * @invocation: The method invocation of the caller
+ * @uid: (out): Used to return the Unix user ID of the caller
+ * @error: Used to raise an error on failure
+ *
+ * Unlike the unique bus name, the user ID doesn't change when the caller opens a
+ * new connection, so it can be used to limit the resources of each caller.
+ *
+ * Returns: %TRUE on success
+ */
+static gboolean
+_au_get_caller_uid(GDBusMethodInvocation *invocation, guint32 *uid, GError **error)
+{
+   g_autoptr(GVariant) reply = NULL;
 
-   /* If we can't load the configuration file, as a last resort, we try the hardcoded
-    * AU_FALLBACK_CONFIG_PATH. This is a last attempt to avoid breaking the atomic
-    * updates in use cases where we have an invalid configuration file in the canonical
-    * path. */
-   g_warning(
-      "Failed to load '%s': %s\n Using the hardcoded path '%s' as a last resort attempt.",
-      atomupd->config_path, local_error->message, _au_get_fallback_config_path());
-   g_clear_error(&local_error);
-   g_clear_pointer(&atomupd->config_path, g_free);
+   reply = g_dbus_connection_call_sync(
+      g_dbus_method_invocation_get_connection(invocation), "org.freedesktop.DBus",
+      "/org/freedesktop/DBus", "org.freedesktop.DBus", "GetConnectionUnixUser",
+      g_variant_new("(s)", g_dbus_method_invocation_get_sender(invocation)),
+      G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, error);
 
-   atomupd->config_path =
-      g_build_filename(_au_get_fallback_config_path(), AU_CONFIG, NULL);
+   if (reply == NULL)
+      return FALSE;
 
-   return _au_parse_config(atomupd, error);
+   g_variant_get(reply, "(u)", uid);
+   return TRUE;
 }
 
-static void
-au_reload_configuration_authorized_cb(AuAtomupd1 *object,
-                                      GDBusMethodInvocation *invocation,
-                                      gpointer arg_options_pointer)
+static gboolean
+au_atomupd1_impl_handle_subscribe_progress(AuAtomupd1 *object,
+                                           GDBusMethodInvocation *invocation,
+                                           GUnixFDList *fd_list,
+                                           GVariant *arg_options)
 {
-   g_autoptr(GError) error = NULL;
    AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_autoptr(GUnixFDList) out_fd_list = NULL;
+   g_autoptr(GError) error = NULL;
+   ProgressSubscriber *subscriber = NULL;
+   const gchar *sender = g_dbus_method_invocation_get_sender(invocation);
+   const gchar *key = NULL;
+   GVariant *value = NULL;
+   GVariantIter iter;
+   guint32 interval = AU_PROGRESS_DEFAULT_INTERVAL;
+   guint32 uid;
+   guint n_from_user = 0;
+   guint i;
+   int fds[2];
 
-   _au_clear_available_updates(object);
+   g_variant_iter_init(&iter, arg_options);
+
+   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
+      if (g_str_equal(key, "interval")) {
+         if (!g_variant_is_of_type(value, G_VARIANT_TYPE_UINT32)) {
+            g_dbus_method_invocation_return_error(
+               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+               "The argument '%s' must have an unsigned 32-bit integer value", key);
+            return G_DBUS_METHOD_INVOCATION_HANDLED;
+         }
+         interval = g_variant_get_uint32(value);
+         continue;
+      }
 
-   if (!_au_select_and_load_configuration(self, &error)) {
       g_dbus_method_invocation_return_error(
          g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred while reloading the configuration, please fix your conf file "
-         "and retry: %s",
-         error->message);
-      return;
+         "The argument '%s' is not a valid option", key);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
    }
 
-   au_atomupd1_complete_reload_configuration(object, g_steal_pointer(&invocation));
-}
+   if (interval < AU_PROGRESS_MIN_INTERVAL || interval > AU_PROGRESS_MAX_INTERVAL) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+         "The interval must be between %u and %u milliseconds, got %u",
+         AU_PROGRESS_MIN_INTERVAL, AU_PROGRESS_MAX_INTERVAL, interval);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
 
-static gboolean
-au_atomupd1_impl_handle_reload_configuration(AuAtomupd1 *object,
-                                             GDBusMethodInvocation *invocation,
-                                             GVariant *arg_options)
-{
-   _au_check_auth(object, "com.steampowered.atomupd1.reload-configuration",
-                  au_reload_configuration_authorized_cb, invocation,
-                  g_variant_ref(arg_options), (GDestroyNotify)g_variant_unref);
+   if (self->progress_subscribers->len >= AU_PROGRESS_MAX_SUBSCRIBERS) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+         "There are already %u progress subscribers", self->progress_subscribers->len);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
-}
+   if (!_au_get_caller_uid(invocation, &uid, &error)) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to get the user of the caller: %s", error->message);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
 
-static void
-au_enable_http_proxy_authorized_cb(AuAtomupd1 *object,
-                                   GDBusMethodInvocation *invocation,
-                                   gpointer arg_proxy_data_pointer)
-{
-   GVariant *arg_proxy_data = arg_proxy_data_pointer;
-   const gchar *variant = au_atomupd1_get_variant(object);
-   const gchar *branch = au_atomupd1_get_branch(object);
-   g_autoptr(GError) error = NULL;
+   for (i = 0; i < self->progress_subscribers->len; i++) {
+      ProgressSubscriber *other = g_ptr_array_index(self->progress_subscribers, i);
+
+      if (other->uid == uid)
+         n_from_user++;
+   }
+
+   if (n_from_user >= AU_PROGRESS_MAX_SUBSCRIBERS_PER_USER) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_LIMITS_EXCEEDED,
+         "The user %u already has %u progress subscriptions", uid, n_from_user);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
+
+   /* SOCK_SEQPACKET preserves the record boundaries */
+   if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+      int saved_errno = errno;
 
-   if (!_au_update_user_preferences(variant, branch, arg_proxy_data, &error)) {
       g_dbus_method_invocation_return_error(
          g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred while enabling the HTTP proxy : %s", error->message);
-      return;
+         "Failed to create the progress socket: %s", g_strerror(saved_errno));
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
    }
 
-   au_atomupd1_set_http_proxy(object, arg_proxy_data);
+   out_fd_list = g_unix_fd_list_new();
+   /* The list duplicates the fd */
+   if (g_unix_fd_list_append(out_fd_list, fds[1], &error) < 0) {
+      g_close(fds[0], NULL);
+      g_close(fds[1], NULL);
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to pass the progress socket: %s", error->message);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
+   g_close(fds[1], NULL);
 
-   au_atomupd1_complete_enable_http_proxy(object, g_steal_pointer(&invocation));
-}
+   subscriber = g_slice_new0(ProgressSubscriber);
+   subscriber->self = self;
+   subscriber->sender = g_strdup(sender);
+   subscriber->uid = uid;
+   subscriber->fd = fds[0];
+   g_ptr_array_add(self->progress_subscribers, subscriber);
 
-static gboolean
-au_atomupd1_impl_handle_enable_http_proxy(AuAtomupd1 *object,
-                                          GDBusMethodInvocation *invocation,
-                                          const gchar *arg_address,
-                                          gint arg_port,
-                                          GVariant *arg_options)
-{
-   g_autoptr(GVariant) proxy_data =
-      g_variant_ref_sink(g_variant_new("(si)", arg_address, arg_port));
+   /* Start with the current state, without waiting for the first tick */
+   if (!_au_progress_subscriber_send(subscriber)) {
+      g_ptr_array_remove_fast(self->progress_subscribers, subscriber);
+   } else {
+      subscriber->source_id =
+         g_timeout_add(interval, _au_progress_subscriber_tick_cb, subscriber);
+   }
 
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-http-proxy",
-                  au_enable_http_proxy_authorized_cb, invocation,
-                  g_steal_pointer(&proxy_data), (GDestroyNotify)g_variant_unref);
+   g_dbus_method_invocation_return_value_with_unix_fd_list(
+      g_steal_pointer(&invocation), g_variant_new("(h)", 0), out_fd_list);
 
    return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+/*
+ * _au_name_owner_changed_cb:
+ *
+ * Drop the progress subscriptions and the pending WaitForChange() requests of
+ * a client as soon as it leaves the bus. Otherwise the subscriptions would
+ * last until the socket gets closed, which the client might have passed to
+ * another process, and the requests until their timeout.
+ */
 static void
-au_disable_http_proxy_authorized_cb(AuAtomupd1 *object,
-                                    GDBusMethodInvocation *invocation,
-                                    gpointer data_pointer)
+_au_name_owner_changed_cb(GDBusConnection *connection,
+                          const gchar *sender_name,
+                          const gchar *object_path,
+                          const gchar *interface_name,
+                          const gchar *signal_name,
+                          GVariant *parameters,
+                          gpointer user_data)
 {
-   const gchar *variant = au_atomupd1_get_variant(object);
-   const gchar *branch = au_atomupd1_get_branch(object);
-   g_autoptr(GVariant) proxy_data = g_variant_ref_sink(g_variant_new("(si)", "", 0));
-   g_autoptr(GError) error = NULL;
+   AuAtomupd1Impl *self = user_data;
+   const gchar *name;
+   const gchar *old_owner;
+   const gchar *new_owner;
+   guint i = 0;
 
-   if (!_au_update_user_preferences(variant, branch, NULL, &error)) {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "An error occurred while disabling the HTTP proxy : %s", error->message);
+   if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(sss)")))
+      return;
+
+   g_variant_get(parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+
+   /* We only care about the unique names, that go away together with the client */
+   if (name[0] != ':' || new_owner[0] != '\0')
       return;
+
+   while (i < self->progress_subscribers->len) {
+      ProgressSubscriber *subscriber = g_ptr_array_index(self->progress_subscribers, i);
+
+      if (g_strcmp0(subscriber->sender, name) == 0)
+         g_ptr_array_remove_index_fast(self->progress_subscribers, i);
+      else
+         i++;
    }
 
-   au_atomupd1_set_http_proxy(object, proxy_data);
+   i = 0;
+   while (i < self->state_waiters->len) {
+      StateWaiter *waiter = g_ptr_array_index(self->state_waiters, i);
 
-   au_atomupd1_complete_disable_http_proxy(object, g_steal_pointer(&invocation));
+      if (g_strcmp0(waiter->sender, name) == 0) {
+         /* Nobody is left to receive the reply */
+         g_clear_object(&waiter->invocation);
+         g_ptr_array_remove_index_fast(self->state_waiters, i);
+      } else {
+         i++;
+      }
+   }
 }
 
 static gboolean
-au_atomupd1_impl_handle_disable_http_proxy(AuAtomupd1 *object,
-                                           GDBusMethodInvocation *invocation)
+au_atomupd1_impl_handle_dump_flight_recorder(AuAtomupd1 *object,
+                                             GDBusMethodInvocation *invocation)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-http-proxy",
-                  au_disable_http_proxy_authorized_cb, invocation, NULL, NULL);
+   g_autofree gchar *events = au_flight_recorder_dump(au_flight_recorder_get_default());
+
+   au_atomupd1_complete_dump_flight_recorder(object, g_steal_pointer(&invocation),
+                                             events);
 
    return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
 static gboolean
-_au_enable_dev_keys(GError **error)
+au_atomupd1_impl_handle_get_memory_usage(AuAtomupd1 *object,
+                                         GDBusMethodInvocation *invocation)
 {
-   const gchar *trusted_keys_dir = NULL;
-   const gchar *dev_keys_dir = NULL;
-   const gchar *filename;
-   g_autoptr(GDir) dir = NULL;
-   g_autoptr(GError) local_error = NULL;
-
-   /* These environment variables are used for debugging and automated tests */
-   trusted_keys_dir = g_getenv("AU_DEFAULT_TRUSTED_KEYS");
-   if (trusted_keys_dir == NULL)
-      trusted_keys_dir = AU_DEFAULT_TRUSTED_KEYS;
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sv}"));
+   AuMemoryUsage usage;
+
+   au_memory_usage_read(AU_PROC_STATUS_PATH, &usage);
+
+   g_variant_builder_add(&builder, "{sv}", "rss", g_variant_new_uint64(usage.rss));
+   g_variant_builder_add(&builder, "{sv}", "peak_rss",
+                         g_variant_new_uint64(usage.peak_rss));
+   g_variant_builder_add(&builder, "{sv}", "heap_in_use",
+                         g_variant_new_uint64(usage.heap_in_use));
+   g_variant_builder_add(&builder, "{sv}", "heap_free",
+                         g_variant_new_uint64(usage.heap_free));
+   g_variant_builder_add(&builder, "{sv}", "heap_mapped",
+                         g_variant_new_uint64(usage.heap_mapped));
+   g_variant_builder_add(&builder, "{sv}", "released",
+                         g_variant_new_uint64(self->memory_released));
+
+   au_atomupd1_complete_get_memory_usage(object, g_steal_pointer(&invocation),
+                                         g_variant_builder_end(&builder));
 
-   dev_keys_dir = g_getenv("AU_DEFAULT_DEV_KEYS");
-   if (dev_keys_dir == NULL)
-      dev_keys_dir = AU_DEFAULT_DEV_KEYS;
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-   dir = g_dir_open(dev_keys_dir, 0, &local_error);
-   if (dir == NULL)
-      return au_throw_error(
-         error, "An error occurred while accessing the trusted dev keys directory: %s",
-         local_error->message);
+static gboolean
+au_atomupd1_impl_handle_get_helper_stats(AuAtomupd1 *object,
+                                         GDBusMethodInvocation *invocation)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("a{sa{sv}}"));
+   AuSupervisor *supervisor = au_supervisor_get_default();
+   AuHelperKind kind;
 
-   while ((filename = g_dir_read_name(dir)) != NULL) {
-      g_autofree gchar *pem_path = NULL;
-      g_autofree gchar *symlink_path = NULL;
-      g_autofree gchar *existing_target = NULL;
+   for (kind = 0; kind < AU_N_HELPER_KINDS; kind++) {
+      g_auto(GVariantDict) dict = G_VARIANT_DICT_INIT(NULL);
+      AuHelperStats stats;
 
-      if (g_str_has_suffix(filename, ".pem"))
-         g_warning("%s doesn't follow the X509_LOOKUP_hash_dir(3) naming convention, "
-                   "RAUC may not be able to use it",
-                   filename);
+      au_supervisor_get_stats(supervisor, kind, &stats);
 
-      pem_path = g_build_filename(dev_keys_dir, filename, NULL);
-      symlink_path = g_build_filename(trusted_keys_dir, filename, NULL);
-      existing_target = g_file_read_link(symlink_path, NULL);
-      if (g_strcmp0(existing_target, pem_path) == 0) {
-         g_debug("There is already a symlink that points to '%s'...", pem_path);
-         continue;
-      }
+      g_variant_dict_insert(&dict, "running", "u", stats.running);
+      g_variant_dict_insert(&dict, "spawned", "t", stats.spawned);
+      g_variant_dict_insert(&dict, "failed", "t", stats.failed);
+      g_variant_dict_insert(&dict, "timed_out", "t", stats.timed_out);
+      g_variant_dict_insert(&dict, "rejected", "t", stats.rejected);
+      g_variant_dict_insert(&dict, "wall_time", "t", stats.wall_time);
+      g_variant_dict_insert(&dict, "cpu_time", "t", stats.cpu_time);
+      g_variant_dict_insert(&dict, "max_rss", "t", stats.max_rss);
 
-      g_unlink(symlink_path);
-      if (symlink(pem_path, symlink_path) != 0) {
-         int saved_errno = errno;
-         return au_throw_error(
-            error, "An error occurred while enabling the trusted dev keys: %s",
-            g_strerror(saved_errno));
-      }
+      g_variant_builder_add(&builder, "{s@a{sv}}", au_helper_kind_get_name(kind),
+                            g_variant_dict_end(&dict));
    }
-   return TRUE;
-}
 
-static void
-au_enable_dev_keys_authorized_cb(AuAtomupd1 *object,
-                                 GDBusMethodInvocation *invocation,
-                                 gpointer data_pointer)
-{
-   g_autoptr(GError) error = NULL;
+   au_atomupd1_complete_get_helper_stats(object, g_steal_pointer(&invocation),
+                                         g_variant_builder_end(&builder));
 
-   if (!_au_enable_dev_keys(&error)) {
-      g_dbus_method_invocation_return_error_literal(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED, error->message);
-      return;
-   }
+   return G_DBUS_METHOD_INVOCATION_HANDLED;
+}
 
-   au_atomupd1_complete_enable_dev_keys(object, g_steal_pointer(&invocation));
+/*
+ * _au_get_state:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Returns: (transfer floating): A vardict with all the exported properties
+ */
+static GVariant *
+_au_get_state(AuAtomupd1Impl *self)
+{
+   /* Changes are dispatched from the main loop, so the properties that change
+    * together are always seen together */
+   return g_dbus_interface_skeleton_get_properties(G_DBUS_INTERFACE_SKELETON(self));
 }
 
 static gboolean
-au_atomupd1_impl_handle_enable_dev_keys(AuAtomupd1 *object,
-                                        GDBusMethodInvocation *invocation,
-                                        GVariant *arg_options)
+au_atomupd1_impl_handle_get_state(AuAtomupd1 *object, GDBusMethodInvocation *invocation)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-trusted-keys",
-                  au_enable_dev_keys_authorized_cb, invocation,
-                  arg_options ? g_variant_ref(arg_options) : NULL,
-                  (GDestroyNotify)g_variant_unref);
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+
+   au_atomupd1_complete_get_state(object, g_steal_pointer(&invocation),
+                                  self->state_generation, _au_get_state(self));
 
    return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
 
+/*
+ * _au_state_waiter_is_satisfied:
+ * @waiter: (not nullable): A WaitForChange() request
+ *
+ * Returns: %TRUE if one of the properties @waiter is interested in changed after
+ *  its known generation
+ */
 static gboolean
-_au_disable_dev_keys(GError **error)
+_au_state_waiter_is_satisfied(const StateWaiter *waiter)
 {
-   const gchar *trusted_keys_dir = NULL;
-   const gchar *dev_keys_dir = NULL;
-   const gchar *filename;
-   g_autoptr(GDir) dir = NULL;
-   g_autoptr(GError) local_error = NULL;
-
-   /* These environment variables are used for debugging and automated tests */
-   trusted_keys_dir = g_getenv("AU_DEFAULT_TRUSTED_KEYS");
-   if (trusted_keys_dir == NULL)
-      trusted_keys_dir = AU_DEFAULT_TRUSTED_KEYS;
-
-   dev_keys_dir = g_getenv("AU_DEFAULT_DEV_KEYS");
-   if (dev_keys_dir == NULL)
-      dev_keys_dir = AU_DEFAULT_DEV_KEYS;
+   AuAtomupd1Impl *self = waiter->self;
+   gsize i;
 
-   dir = g_dir_open(trusted_keys_dir, 0, &local_error);
-   if (dir == NULL)
-      return au_throw_error(
-         error, "An error occurred while accessing the trusted dev keys directory: %s",
-         local_error->message);
+   /* The caller got its generation from a previous instance of the daemon */
+   if (waiter->known_generation > self->state_generation)
+      return TRUE;
 
-   while ((filename = g_dir_read_name(dir)) != NULL) {
-      g_autofree gchar *symlink_path = NULL;
-      g_autofree gchar *target = NULL;
+   if (waiter->known_generation == self->state_generation)
+      return FALSE;
 
-      symlink_path = g_build_filename(trusted_keys_dir, filename, NULL);
-      target = g_file_read_link(symlink_path, NULL);
-      if (target == NULL)
-         continue;
+   if (waiter->properties == NULL)
+      return TRUE;
 
-      /* Remove the symlink only if it points to the development keys directory */
-      if (g_str_has_prefix(target, dev_keys_dir)) {
-         if (g_unlink(symlink_path) != 0) {
-            int saved_errno = errno;
-            return au_throw_error(
-               error, "An error occurred while disabling the trusted dev keys: %s",
-               g_strerror(saved_errno));
-         }
-      }
+   for (i = 0; waiter->properties[i] != NULL; i++) {
+      const guint64 *generation =
+         g_hash_table_lookup(self->property_generations, waiter->properties[i]);
+
+      if (generation != NULL && *generation > waiter->known_generation)
+         return TRUE;
    }
-   return TRUE;
+
+   return FALSE;
 }
 
 static void
-au_disable_dev_keys_authorized_cb(AuAtomupd1 *object,
-                                  GDBusMethodInvocation *invocation,
-                                  gpointer data_pointer)
+_au_state_waiter_reply(StateWaiter *waiter)
 {
-   g_autoptr(GError) error = NULL;
+   au_atomupd1_complete_wait_for_change((AuAtomupd1 *)waiter->self,
+                                        g_steal_pointer(&waiter->invocation),
+                                        waiter->self->state_generation,
+                                        _au_get_state(waiter->self));
+}
 
-   if (!_au_disable_dev_keys(&error)) {
-      g_dbus_method_invocation_return_error_literal(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED, error->message);
-      return;
+static gboolean
+_au_state_waiters_dispatch_cb(gpointer user_data)
+{
+   AuAtomupd1Impl *self = user_data;
+   guint i = 0;
+
+   self->state_waiters_source = 0;
+
+   while (i < self->state_waiters->len) {
+      StateWaiter *waiter = g_ptr_array_index(self->state_waiters, i);
+
+      if (_au_state_waiter_is_satisfied(waiter)) {
+         _au_state_waiter_reply(waiter);
+         g_ptr_array_remove_index_fast(self->state_waiters, i);
+      } else {
+         i++;
+      }
    }
 
-   au_atomupd1_complete_disable_dev_keys(object, g_steal_pointer(&invocation));
+   return G_SOURCE_REMOVE;
 }
 
 static gboolean
-au_atomupd1_impl_handle_disable_dev_keys(AuAtomupd1 *object,
-                                         GDBusMethodInvocation *invocation,
-                                         GVariant *arg_options)
+_au_state_waiter_timeout_cb(gpointer user_data)
 {
-   _au_check_auth(object, "com.steampowered.atomupd1.manage-trusted-keys",
-                  au_disable_dev_keys_authorized_cb, invocation,
-                  arg_options ? g_variant_ref(arg_options) : NULL,
-                  (GDestroyNotify)g_variant_unref);
+   StateWaiter *waiter = user_data;
 
-   return G_DBUS_METHOD_INVOCATION_HANDLED;
+   waiter->timeout_source = 0;
+   _au_state_waiter_reply(waiter);
+   g_ptr_array_remove_fast(waiter->self->state_waiters, waiter);
+
+   return G_SOURCE_REMOVE;
 }
 
 static void
-_au_get_builds_done(GObject *source_object, GAsyncResult *result, gpointer user_data)
+_au_state_notify_cb(AuAtomupd1Impl *self, GParamSpec *pspec, gpointer user_data)
 {
-   g_autoptr(BuildsData) data = user_data;
-   g_autoptr(GError) error = NULL;
+   /* gdbus-codegen uses the D-Bus name of the property as its nick */
+   const gchar *name = g_param_spec_get_nick(pspec);
+   guint64 *generation = g_hash_table_lookup(self->property_generations, name);
 
-   if (g_task_propagate_boolean(G_TASK(result), &error)) {
-      g_debug("Builds list file successfully downloaded");
-      au_atomupd1_complete_get_builds(
-         data->req->object, g_steal_pointer(&data->req->invocation), data->builds_path);
-   } else {
-      g_dbus_method_invocation_return_error(
-         g_steal_pointer(&data->req->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Failed to download the builds list: %s", error->message);
+   self->state_generation++;
+
+   if (generation == NULL) {
+      generation = g_new0(guint64, 1);
+      g_hash_table_insert(self->property_generations, g_strdup(name), generation);
    }
+
+   *generation = self->state_generation;
+
+   /* Wait for the end of the current main loop iteration, to also include the
+    * other properties that are changing together with this one */
+   if (self->state_waiters->len > 0 && self->state_waiters_source == 0)
+      self->state_waiters_source = g_idle_add(_au_state_waiters_dispatch_cb, self);
 }
 
-static void
-au_get_builds_authorized_cb(AuAtomupd1 *object,
-                            GDBusMethodInvocation *invocation,
-                            gpointer arg_options_pointer)
+static gboolean
+au_atomupd1_impl_handle_wait_for_change(AuAtomupd1 *object,
+                                        GDBusMethodInvocation *invocation,
+                                        guint64 arg_known_generation,
+                                        const gchar *const *arg_properties,
+                                        guint arg_timeout)
 {
-   GVariant *arg_options = arg_options_pointer;
-   g_autofree gchar *http_proxy = NULL;
-   g_autofree gchar *builds_filename = NULL;
-   g_autofree gchar *builds_path = NULL;
-   g_autofree gchar *builds_url = NULL;
-   g_autoptr(GTask) task = NULL;
-   g_autoptr(DownloadData) dl_data = g_new0(DownloadData, 1);
-   g_autoptr(BuildsData) builds_data = au_builds_data_new();
-   const gchar *key = NULL;
-   GVariant *value = NULL;
-   const gchar *variant = NULL;
-   const gchar *au_run_path = NULL;
-   GVariantIter iter;
    AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   g_autoptr(StateWaiter) waiter = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *sender = g_dbus_method_invocation_get_sender(invocation);
+   guint n_from_user = 0;
+   gsize i;
 
-   g_return_if_fail(self->config_path != NULL);
-   g_return_if_fail(self->manifest_path != NULL);
-   g_return_if_fail(self->meta_url != NULL);
+   for (i = 0; arg_properties[i] != NULL; i++) {
+      if (g_dbus_interface_info_lookup_property(
+             g_dbus_interface_skeleton_get_info(G_DBUS_INTERFACE_SKELETON(self)),
+             arg_properties[i]) == NULL) {
+         g_dbus_method_invocation_return_error(
+            g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+            "The property '%s' doesn't exist", arg_properties[i]);
+         return G_DBUS_METHOD_INVOCATION_HANDLED;
+      }
+   }
 
-   g_variant_iter_init(&iter, arg_options);
+   waiter = g_slice_new0(StateWaiter);
+   waiter->self = self;
+   waiter->sender = g_strdup(sender);
+   waiter->invocation = g_steal_pointer(&invocation);
+   waiter->known_generation = arg_known_generation;
+   if (arg_properties[0] != NULL)
+      waiter->properties = g_strdupv((gchar **)arg_properties);
 
-   while (g_variant_iter_loop(&iter, "{sv}", &key, &value)) {
-      if (g_str_equal(key, "variant")) {
-         if (g_variant_is_of_type(value, G_VARIANT_TYPE_STRING)) {
-            variant = g_variant_get_string(value, NULL);
-         } else {
-            g_dbus_method_invocation_return_error(
-               g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-               "The argument '%s' must have a string value", key);
-         }
-         continue;
-      }
+   if (arg_timeout == 0 || _au_state_waiter_is_satisfied(waiter)) {
+      _au_state_waiter_reply(waiter);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
 
+   if (self->state_waiters->len >= AU_WAIT_FOR_CHANGE_MAX_PENDING) {
       g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "The argument '%s' is not a valid option", key);
-      return;
+         g_steal_pointer(&waiter->invocation), G_DBUS_ERROR,
+         G_DBUS_ERROR_LIMITS_EXCEEDED,
+         "There are already %u pending WaitForChange requests",
+         self->state_waiters->len);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
    }
 
-   /* Use by default the currently selected variant */
-   if (variant == NULL)
-      variant = au_atomupd1_get_variant(object);
-
-   if (strstr(variant, "..") != NULL || strstr(variant, "/") != NULL ||
-       strchr(variant, ' ') != NULL) {
+   if (!_au_get_caller_uid(waiter->invocation, &waiter->uid, &error)) {
       g_dbus_method_invocation_return_error(
-         g_steal_pointer(&invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
-         "Invalid variant name: must not contain spaces, slashes, or '..'");
-      return;
+         g_steal_pointer(&waiter->invocation), G_DBUS_ERROR, G_DBUS_ERROR_FAILED,
+         "Failed to get the user of the caller: %s", error->message);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
    }
 
-   /* This environment variable is used for debugging and automated tests */
-   au_run_path = g_getenv("AU_RUN_PATH");
-   if (au_run_path == NULL)
-      au_run_path = AU_RUN_PATH;
-
-   builds_filename = g_strdup_printf("builds-%s.json", variant);
-   builds_path = g_build_filename(au_run_path, builds_filename, NULL);
+   for (i = 0; i < self->state_waiters->len; i++) {
+      StateWaiter *other = g_ptr_array_index(self->state_waiters, i);
 
-   if (g_file_test(builds_path, G_FILE_TEST_EXISTS)) {
-      g_debug("We already have the list of builds for %s", variant);
-      au_atomupd1_complete_get_builds(object, g_steal_pointer(&invocation), builds_path);
-      return;
+      if (other->uid == waiter->uid)
+         n_from_user++;
    }
 
-   builds_url = g_build_filename(self->meta_url, self->release, self->product,
-                                 self->architecture, variant, AU_BUILDS_LIST, NULL);
-
-   http_proxy = _au_get_http_proxy_address_and_port(object);
-
-   builds_data->req->invocation = g_steal_pointer(&invocation);
-   builds_data->req->object = g_object_ref(object);
-   builds_data->builds_path = g_strdup(builds_path);
-
-   dl_data->target = g_strdup(builds_path);
-   dl_data->url = g_steal_pointer(&builds_url);
-   dl_data->proxy = g_steal_pointer(&http_proxy);
-
-   task = g_task_new(NULL, NULL, _au_get_builds_done, g_steal_pointer(&builds_data));
-   g_task_set_task_data(task, g_steal_pointer(&dl_data),
-                        (GDestroyNotify)download_data_free);
-   g_task_run_in_thread(task, _au_download_thread_func);
-}
+   if (n_from_user >= AU_WAIT_FOR_CHANGE_MAX_PER_USER) {
+      g_dbus_method_invocation_return_error(
+         g_steal_pointer(&waiter->invocation), G_DBUS_ERROR,
+         G_DBUS_ERROR_LIMITS_EXCEEDED,
+         "The user %u already has %u pending WaitForChange requests", waiter->uid,
+         n_from_user);
+      return G_DBUS_METHOD_INVOCATION_HANDLED;
+   }
 
-static gboolean
-au_atomupd1_impl_handle_get_builds(AuAtomupd1 *object,
-                                   GDBusMethodInvocation *invocation,
-                                   GVariant *arg_options)
-{
-   _au_check_auth(object, "com.steampowered.atomupd1.get-builds",
-                  au_get_builds_authorized_cb, invocation, g_variant_ref(arg_options),
-                  (GDestroyNotify)g_variant_unref);
+   waiter->timeout_source =
+      g_timeout_add_seconds(MIN(arg_timeout, AU_WAIT_FOR_CHANGE_MAX_TIMEOUT),
+                            _au_state_waiter_timeout_cb, waiter);
+   g_ptr_array_add(self->state_waiters, g_steal_pointer(&waiter));
 
    return G_DBUS_METHOD_INVOCATION_HANDLED;
 }
@@ -3376,6 +7792,8 @@ init_atomupd1_iface(AuAtomupd1Iface *iface)
 {
    iface->handle_cancel_update = au_atomupd1_impl_handle_cancel_update;
    iface->handle_check_for_updates = au_atomupd1_impl_handle_check_for_updates;
+   iface->handle_check_for_updates_multi =
+      au_atomupd1_impl_handle_check_for_updates_multi;
    iface->handle_pause_update = au_atomupd1_impl_handle_pause_update;
    iface->handle_reload_configuration = au_atomupd1_impl_handle_reload_configuration;
    iface->handle_resume_update = au_atomupd1_impl_handle_resume_update;
@@ -3388,6 +7806,13 @@ init_atomupd1_iface(AuAtomupd1Iface *iface)
    iface->handle_enable_dev_keys = au_atomupd1_impl_handle_enable_dev_keys;
    iface->handle_disable_dev_keys = au_atomupd1_impl_handle_disable_dev_keys;
    iface->handle_get_builds = au_atomupd1_impl_handle_get_builds;
+   iface->handle_query_builds = au_atomupd1_impl_handle_query_builds;
+   iface->handle_subscribe_progress = au_atomupd1_impl_handle_subscribe_progress;
+   iface->handle_get_helper_stats = au_atomupd1_impl_handle_get_helper_stats;
+   iface->handle_get_memory_usage = au_atomupd1_impl_handle_get_memory_usage;
+   iface->handle_dump_flight_recorder = au_atomupd1_impl_handle_dump_flight_recorder;
+   iface->handle_get_state = au_atomupd1_impl_handle_get_state;
+   iface->handle_wait_for_change = au_atomupd1_impl_handle_wait_for_change;
 }
 
 G_DEFINE_TYPE_WITH_CODE(AuAtomupd1Impl,
@@ -3407,8 +7832,61 @@ au_atomupd1_impl_finalize(GObject *object)
    g_free(self->product);
    g_free(self->architecture);
    g_free(self->meta_url);
+   g_strfreev(self->meta_mirrors);
    g_free(self->images_url);
+   g_strfreev(self->images_mirrors);
+   g_clear_pointer(&self->mirror_proxy, au_mirror_proxy_free);
    g_clear_object(&self->authority);
+   g_clear_pointer(&self->builds_catalogs, g_hash_table_unref);
+   g_clear_pointer(&self->rollouts, g_hash_table_unref);
+   g_clear_pointer(&self->builds_downloads, g_hash_table_unref);
+   if (self->builds_prefetch_queue != NULL)
+      g_queue_free_full(g_steal_pointer(&self->builds_prefetch_queue), g_free);
+   g_free(self->prewarm_in_progress);
+   g_free(self->chunk_cache);
+   g_strfreev(self->peer_stores);
+   g_clear_pointer(&self->peer_server, au_peer_server_free);
+   g_clear_handle_id(&self->scrub_poll_source, g_source_remove);
+   g_clear_pointer(&self->chunk_scrubber, au_chunk_scrubber_free);
+   if (self->network_monitor != NULL) {
+      g_clear_signal_handler(&self->network_changed_id, self->network_monitor);
+      g_clear_signal_handler(&self->network_metered_id, self->network_monitor);
+      g_clear_signal_handler(&self->network_connectivity_id, self->network_monitor);
+      g_clear_object(&self->network_monitor);
+   }
+   if (self->network_state_monitor != NULL) {
+      g_file_monitor_cancel(self->network_state_monitor);
+      g_clear_object(&self->network_state_monitor);
+   }
+   g_clear_handle_id(&self->power_poll_source, g_source_remove);
+   g_clear_handle_id(&self->pressure_poll_source, g_source_remove);
+   g_clear_handle_id(&self->proxy_probe_source, g_source_remove);
+   g_clear_pointer(&self->pressure_foreground_dir, g_free);
+   g_clear_pointer(&self->pressure_controller, au_pressure_controller_free);
+   if (self->name_owner_changed_id != 0)
+      g_dbus_connection_signal_unsubscribe(self->bus, self->name_owner_changed_id);
+   g_clear_object(&self->bus);
+   g_clear_pointer(&self->progress_subscribers, g_ptr_array_unref);
+   g_clear_handle_id(&self->memory_release_source, g_source_remove);
+   g_clear_handle_id(&self->stall_watchdog_source, g_source_remove);
+   g_clear_pointer(&self->update_argv, g_ptr_array_unref);
+   g_clear_handle_id(&self->state_waiters_source, g_source_remove);
+   g_clear_pointer(&self->state_waiters, g_ptr_array_unref);
+   g_clear_pointer(&self->property_generations, g_hash_table_unref);
+   g_clear_pointer(&self->rauc_priorities, g_hash_table_unref);
+   if (self->targets != NULL) {
+      guint i;
+
+      /* The targets might outlive us, e.g. if they are still exported */
+      for (i = 0; i < self->targets->len; i++)
+         ((AuAtomupd1Impl *)g_ptr_array_index(self->targets, i))->primary = NULL;
+
+      g_clear_pointer(&self->targets, g_ptr_array_unref);
+   }
+   g_free(self->target_name);
+   g_free(self->target_run_path);
+   g_free(self->target_preferences_path);
+   g_free(self->target_remote_info_path);
 
    // Keep the update file, to be able to reuse it later on
    g_clear_object(&self->updates_json_file);
@@ -3426,17 +7904,227 @@ au_atomupd1_impl_finalize(GObject *object)
    G_OBJECT_CLASS(au_atomupd1_impl_parent_class)->finalize(object);
 }
 
+/* The additional targets only check for updates, so they don't export the
+ * methods and properties about installing them */
+static const gchar *const target_hidden_methods[] = {
+   "StartUpdate", "StartCustomUpdate", "SubscribeProgress",
+   "PauseUpdate", "ResumeUpdate",      "CancelUpdate",
+   NULL,
+};
+static const gchar *const target_hidden_properties[] = {
+   "UpdateStalls", "PauseReason", "ThrottleState", "PressureState", "CacheScrubStats",
+   NULL,
+};
+
+/*
+ * _au_get_target_interface_info:
+ *
+ * Returns: (transfer none): The interface info of the additional targets, that
+ *  shares the method and property infos of the full interface, without the
+ *  hidden ones
+ */
+static GDBusInterfaceInfo *
+_au_get_target_interface_info(void)
+{
+   static GDBusInterfaceInfo *target_info = NULL;
+
+   if (g_once_init_enter(&target_info)) {
+      GDBusInterfaceInfo *full_info = au_atomupd1_interface_info();
+      GDBusInterfaceInfo *info = g_new0(GDBusInterfaceInfo, 1);
+      GPtrArray *methods = g_ptr_array_new();
+      GPtrArray *properties = g_ptr_array_new();
+      gsize i;
+
+      for (i = 0; full_info->methods[i] != NULL; i++) {
+         if (!g_strv_contains(target_hidden_methods, full_info->methods[i]->name))
+            g_ptr_array_add(methods, full_info->methods[i]);
+      }
+      g_ptr_array_add(methods, NULL);
+
+      for (i = 0; full_info->properties[i] != NULL; i++) {
+         if (!g_strv_contains(target_hidden_properties, full_info->properties[i]->name))
+            g_ptr_array_add(properties, full_info->properties[i]);
+      }
+      g_ptr_array_add(properties, NULL);
+
+      /* Like the generated one, this info is never freed */
+      info->ref_count = -1;
+      info->name = full_info->name;
+      info->methods = (GDBusMethodInfo **)g_ptr_array_free(methods, FALSE);
+      info->signals = full_info->signals;
+      info->properties = (GDBusPropertyInfo **)g_ptr_array_free(properties, FALSE);
+      info->annotations = full_info->annotations;
+
+      g_once_init_leave(&target_info, info);
+   }
+
+   return target_info;
+}
+
+static GDBusInterfaceInfo *
+au_atomupd1_impl_get_info(GDBusInterfaceSkeleton *skeleton)
+{
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(skeleton);
+
+   /* The methods are dispatched, and the properties are looked up, with the info
+    * that we export, so the hidden ones are refused like unknown ones */
+   if (self->primary != NULL)
+      return _au_get_target_interface_info();
+
+   return G_DBUS_INTERFACE_SKELETON_CLASS(au_atomupd1_impl_parent_class)
+      ->get_info(skeleton);
+}
+
+static GVariant *
+au_atomupd1_impl_get_properties(GDBusInterfaceSkeleton *skeleton)
+{
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(skeleton);
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+   g_autoptr(GVariant) properties = NULL;
+   GVariantIter iter;
+   const gchar *key;
+   GVariant *value;
+
+   /* Floating, as expected by g_dbus_interface_skeleton_get_properties() */
+   if (self->primary == NULL)
+      return G_DBUS_INTERFACE_SKELETON_CLASS(au_atomupd1_impl_parent_class)
+         ->get_properties(skeleton);
+
+   /* Used by GetAll(), GetManagedObjects() and GetState() */
+   properties = g_variant_ref_sink(
+      G_DBUS_INTERFACE_SKELETON_CLASS(au_atomupd1_impl_parent_class)
+         ->get_properties(skeleton));
+
+   g_variant_iter_init(&iter, properties);
+   while (g_variant_iter_loop(&iter, "{&sv}", &key, &value)) {
+      if (!g_strv_contains(target_hidden_properties, key))
+         g_variant_builder_add(&builder, "{sv}", key, value);
+   }
+
+   return g_variant_builder_end(&builder);
+}
+
 static void
 au_atomupd1_impl_class_init(AuAtomupd1ImplClass *klass)
 {
    GObjectClass *object_class = G_OBJECT_CLASS(klass);
+   GDBusInterfaceSkeletonClass *skeleton_class = G_DBUS_INTERFACE_SKELETON_CLASS(klass);
 
    object_class->finalize = au_atomupd1_impl_finalize;
+   skeleton_class->get_info = au_atomupd1_impl_get_info;
+   skeleton_class->get_properties = au_atomupd1_impl_get_properties;
+}
+
+/*
+ * _au_flight_recorder_save:
+ * @self: (not nullable): The AuAtomupd1Impl object
+ *
+ * Write the events that led to a failure to the run directory, where they
+ * survive a restart of the daemon.
+ */
+static void
+_au_flight_recorder_save(AuAtomupd1Impl *self)
+{
+   g_autofree gchar *path = NULL;
+   g_autoptr(GError) error = NULL;
+
+   path = g_build_filename(_au_get_run_path(self), AU_FLIGHT_RECORDER_DUMP, NULL);
+
+   if (!au_flight_recorder_dump_to_file(au_flight_recorder_get_default(), path, &error))
+      g_warning("Failed to save the flight recorder: %s", error->message);
+   else
+      g_info("The events that led to the failure have been saved in %s", path);
+}
+
+/* Methods that don't change anything and that clients are expected to call
+ * often, e.g. for polling, they would quickly flush the interesting events out
+ * of the flight recorder */
+static const gchar *const unrecorded_methods[] = {
+   "GetMemoryUsage", "GetHelperStats", "GetState", "WaitForChange", "DumpFlightRecorder",
+   NULL,
+};
+
+static gboolean
+_au_authorize_method_cb(GDBusInterfaceSkeleton *skeleton,
+                        GDBusMethodInvocation *invocation,
+                        gpointer user_data)
+{
+   const gchar *method_name = g_dbus_method_invocation_get_method_name(invocation);
+
+   /* Properties are read with "Get" and "GetAll" of the properties interface */
+   if (g_strcmp0(g_dbus_method_invocation_get_interface_name(invocation),
+                 "org.freedesktop.DBus.Properties") == 0 &&
+       g_strcmp0(method_name, "Set") != 0)
+      return TRUE;
+
+   if (g_strv_contains(unrecorded_methods, method_name))
+      return TRUE;
+
+   /* Not an authorization check, the methods that need it use polkit. This is
+    * just the one place that sees every method call. */
+   au_flight_record(AU_FLIGHT_EVENT_METHOD_CALL, 0, method_name);
+
+   return TRUE;
+}
+
+static void
+_au_update_status_notify_cb(AuAtomupd1 *object, GParamSpec *pspec, gpointer user_data)
+{
+   AuAtomupd1Impl *self = AU_ATOMUPD1_IMPL(object);
+   AuAtomupd1Impl *primary;
+   AuUpdateStatus status = au_atomupd1_get_update_status(object);
+
+   au_flight_record(AU_FLIGHT_EVENT_STATUS, status, self->target_name);
+
+   if (status == AU_UPDATE_STATUS_FAILED)
+      _au_flight_recorder_save(self);
+
+   /* Leave the disk to the update right away, without waiting for the next poll */
+   primary = self->primary != NULL ? self->primary : self;
+   if (status == AU_UPDATE_STATUS_IN_PROGRESS && primary->chunk_scrubber != NULL)
+      au_chunk_scrubber_set_paused(primary->chunk_scrubber, TRUE);
+
+   /* The pause reason is only meaningful while the update is paused */
+   if (status != AU_UPDATE_STATUS_PAUSED)
+      au_atomupd1_set_pause_reason(object, "");
+
+   /* Once the update ends, the install helper is gone */
+   if (status != AU_UPDATE_STATUS_IN_PROGRESS && status != AU_UPDATE_STATUS_PAUSED) {
+      _au_restore_rauc_priority(self);
+      au_atomupd1_set_throttle_state(object, AU_THROTTLE_STATE_NONE);
+   }
+
+   _au_update_power_poll(self);
+   _au_update_pressure_poll(self);
 }
 
 static void
 au_atomupd1_impl_init(AuAtomupd1Impl *self)
 {
+   self->builds_catalogs = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                 (GDestroyNotify)au_builds_catalog_free);
+   self->builds_downloads = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                                  (GDestroyNotify)g_ptr_array_unref);
+   self->builds_prefetch_queue = g_queue_new();
+   self->progress_subscribers =
+      g_ptr_array_new_with_free_func((GDestroyNotify)_progress_subscriber_free);
+   self->property_generations =
+      g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+   self->state_waiters =
+      g_ptr_array_new_with_free_func((GDestroyNotify)_state_waiter_free);
+
+   au_atomupd1_set_pause_reason((AuAtomupd1 *)self, "");
+   au_atomupd1_set_throttle_state((AuAtomupd1 *)self, AU_THROTTLE_STATE_NONE);
+   _au_update_scrub_stats(self);
+   _au_update_pressure_state(self);
+   _au_update_proxy_routes(self);
+   g_signal_connect(self, "notify::http-proxy", G_CALLBACK(_au_http_proxy_notify_cb),
+                    NULL);
+   g_signal_connect(self, "notify::update-status",
+                    G_CALLBACK(_au_update_status_notify_cb), NULL);
+   g_signal_connect(self, "notify", G_CALLBACK(_au_state_notify_cb), NULL);
+   g_signal_connect(self, "g-authorize-method", G_CALLBACK(_au_authorize_method_cb),
+                    NULL);
 }
 
 /*
@@ -3462,8 +8150,12 @@ _str_rstrip_newline(gchar *string)
    return string;
 }
 
-/**
- * au_atomupd1_impl_new:
+/*
+ * _au_atomupd1_impl_new_full:
+ * @primary: (nullable): The object of the running system, if this is for an
+ *  additional target
+ * @target_name: (nullable): Name of the additional target, %NULL if and only if
+ *  @primary is %NULL
  * @config_preference: (transfer none) (not nullable): Path to the directory where
  *  the configuration is located.
  * @manifest_preference: (transfer none) (nullable): Path to a custom JSON manifest
@@ -3472,13 +8164,16 @@ _str_rstrip_newline(gchar *string)
  *
  * Returns: (transfer full): a new AuAtomupd1
  */
-AuAtomupd1 *
-au_atomupd1_impl_new(const gchar *config_directory,
-                     const gchar *manifest_preference,
-                     GDBusConnection *bus,
-                     GError **error)
+static AuAtomupd1 *
+_au_atomupd1_impl_new_full(AuAtomupd1Impl *primary,
+                           const gchar *target_name,
+                           const gchar *config_directory,
+                           const gchar *manifest_preference,
+                           GDBusConnection *bus,
+                           GError **error)
 {
    g_autofree gchar *reboot_content = NULL;
+   g_autofree gchar *updates_json_target_path = NULL;
    g_autoptr(GFile) updates_json_parent = NULL;
    const gchar *updates_json_path;
    const gchar *reboot_for_update;
@@ -3489,13 +8184,37 @@ au_atomupd1_impl_new(const gchar *config_directory,
    AuAtomupd1Impl *atomupd = g_object_new(AU_TYPE_ATOMUPD1_IMPL, NULL);
 
    g_return_val_if_fail(config_directory != NULL, NULL);
+   g_return_val_if_fail((primary == NULL) == (target_name == NULL), NULL);
+
+   /* The targets share the polkit authority, and with it its authorizations cache */
+   if (primary != NULL)
+      atomupd->authority = g_object_ref(primary->authority);
+   else
+      atomupd->authority = polkit_authority_get_sync(NULL, error);
 
-   atomupd->authority = polkit_authority_get_sync(NULL, error);
    if (atomupd->authority == NULL)
       return NULL;
 
    atomupd->config_directory = g_strdup(config_directory);
 
+   if (primary != NULL) {
+      /* Each target keeps its own state, separated from the running system one */
+      atomupd->primary = primary;
+      atomupd->target_name = g_strdup(target_name);
+      atomupd->target_run_path =
+         g_build_filename(_au_get_run_path(primary), "targets", target_name, NULL);
+      atomupd->target_preferences_path =
+         g_build_filename(config_directory, AU_PREFERENCES, NULL);
+      atomupd->target_remote_info_path =
+         g_build_filename(config_directory, AU_REMOTE_INFO, NULL);
+
+      if (g_mkdir_with_parents(atomupd->target_run_path, 0755) != 0) {
+         g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(errno),
+                     "Failed to create the directory '%s'", atomupd->target_run_path);
+         return NULL;
+      }
+   }
+
    if (manifest_preference == NULL)
       atomupd->manifest_path = g_strdup(AU_DEFAULT_MANIFEST);
    else
@@ -3534,10 +8253,16 @@ au_atomupd1_impl_new(const gchar *config_directory,
    if (!_au_select_and_load_configuration(atomupd, error))
       return NULL;
 
-   /* This environment variable is used for debugging and automated tests */
-   updates_json_path = g_getenv("AU_UPDATES_JSON_FILE");
-   if (updates_json_path == NULL)
-      updates_json_path = AU_DEFAULT_UPDATE_JSON;
+   if (primary != NULL) {
+      updates_json_target_path =
+         g_build_filename(atomupd->target_run_path, AU_UPDATES_JSON, NULL);
+      updates_json_path = updates_json_target_path;
+   } else {
+      /* This environment variable is used for debugging and automated tests */
+      updates_json_path = g_getenv("AU_UPDATES_JSON_FILE");
+      if (updates_json_path == NULL)
+         updates_json_path = AU_DEFAULT_UPDATE_JSON;
+   }
 
    atomupd->updates_json_file = g_file_new_for_path(updates_json_path);
 
@@ -3553,43 +8278,48 @@ au_atomupd1_impl_new(const gchar *config_directory,
 
    au_atomupd1_set_version((AuAtomupd1 *)atomupd, ATOMUPD_VERSION);
 
-   client_pid = _au_get_process_pid("steamos-atomupd-client", &local_error);
-   if (client_pid > -1) {
-      g_debug(
-         "There is already a steamos-atomupd-client process running, stopping it...");
-      _au_ensure_pid_is_killed(client_pid);
-   } else {
-      g_debug("%s", local_error->message);
-      g_clear_error(&local_error);
-   }
+   /* The processes and the reboot marker only belong to the running system, the
+    * additional targets always start from a clean state */
+   if (primary == NULL) {
+      client_pid = _au_get_process_pid("steamos-atomupd-client", &local_error);
+      if (client_pid > -1) {
+         g_debug(
+            "There is already a steamos-atomupd-client process running, stopping it...");
+         au_terminate_pid(client_pid);
+      } else {
+         g_debug("%s", local_error->message);
+         g_clear_error(&local_error);
+      }
 
-   g_debug("Stopping the RAUC service, if it's running...");
-   rauc_pid = _au_get_rauc_service_pid(NULL);
-   _au_ensure_pid_is_killed(rauc_pid);
+      g_debug("Stopping the RAUC service, if it's running...");
+      rauc_pid = _au_get_rauc_service_pid(NULL);
+      au_terminate_pid(rauc_pid);
 
-   /* This environment variable is used for debugging and automated tests */
-   reboot_for_update = g_getenv("AU_REBOOT_FOR_UPDATE");
-   if (reboot_for_update == NULL)
-      reboot_for_update = AU_REBOOT_FOR_UPDATE;
+      /* This environment variable is used for debugging and automated tests */
+      reboot_for_update = g_getenv("AU_REBOOT_FOR_UPDATE");
+      if (reboot_for_update == NULL)
+         reboot_for_update = AU_REBOOT_FOR_UPDATE;
 
-   if (g_file_get_contents(reboot_for_update, &reboot_content, NULL, NULL)) {
-      g_auto(GStrv) splitted = NULL;
+      if (g_file_get_contents(reboot_for_update, &reboot_content, NULL, NULL)) {
+         g_auto(GStrv) splitted = NULL;
 
-      g_debug("An update has already been successfully installed, it will be applied at "
-              "the next reboot");
+         g_debug("An update has already been successfully installed, it will be "
+                 "applied at the next reboot");
 
-      splitted = g_strsplit(reboot_content, "-", 2);
-      if (splitted[0] != NULL) {
-         splitted[0] = _str_rstrip_newline(g_strstrip(splitted[0]));
-         au_atomupd1_set_update_build_id((AuAtomupd1 *)atomupd, splitted[0]);
-      }
+         splitted = g_strsplit(reboot_content, "-", 2);
+         if (splitted[0] != NULL) {
+            splitted[0] = _str_rstrip_newline(g_strstrip(splitted[0]));
+            au_atomupd1_set_update_build_id((AuAtomupd1 *)atomupd, splitted[0]);
+         }
 
-      if (splitted[0] != NULL && splitted[1] != NULL) {
-         splitted[1] = _str_rstrip_newline(g_strstrip(splitted[1]));
-         au_atomupd1_set_update_version((AuAtomupd1 *)atomupd, splitted[1]);
-      }
+         if (splitted[0] != NULL && splitted[1] != NULL) {
+            splitted[1] = _str_rstrip_newline(g_strstrip(splitted[1]));
+            au_atomupd1_set_update_version((AuAtomupd1 *)atomupd, splitted[1]);
+         }
 
-      au_atomupd1_set_update_status((AuAtomupd1 *)atomupd, AU_UPDATE_STATUS_SUCCESSFUL);
+         au_atomupd1_set_update_status((AuAtomupd1 *)atomupd,
+                                       AU_UPDATE_STATUS_SUCCESSFUL);
+      }
    }
 
    if (g_file_query_exists(atomupd->updates_json_file, NULL)) {
@@ -3620,6 +8350,7 @@ au_atomupd1_impl_new(const gchar *config_directory,
                       local_error->message);
             g_clear_error(&local_error);
          } else {
+            _au_apply_rollout_gate(atomupd, &available, &available_later);
             au_atomupd1_set_updates_available((AuAtomupd1 *)atomupd, available);
             au_atomupd1_set_updates_available_later((AuAtomupd1 *)atomupd,
                                                     available_later);
@@ -3641,14 +8372,55 @@ au_atomupd1_impl_new(const gchar *config_directory,
       }
    }
 
-   atomupd->debug_controller =
-      G_DEBUG_CONTROLLER(g_debug_controller_dbus_new(bus, NULL, error));
-   if (atomupd->debug_controller == NULL)
-      return NULL;
+   atomupd->bus = g_object_ref(bus);
+   atomupd->name_owner_changed_id = g_dbus_connection_signal_subscribe(
+      bus, "org.freedesktop.DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+      "/org/freedesktop/DBus", NULL, G_DBUS_SIGNAL_FLAGS_NONE, _au_name_owner_changed_cb,
+      atomupd, NULL);
+
+   /* There can be only one debug controller on the bus, and it affects the whole
+    * daemon anyway */
+   if (primary == NULL) {
+      atomupd->debug_controller =
+         G_DEBUG_CONTROLLER(g_debug_controller_dbus_new(bus, NULL, error));
+      if (atomupd->debug_controller == NULL)
+         return NULL;
+
+      atomupd->debug_controller_id =
+         g_signal_connect(atomupd->debug_controller, "authorize",
+                          G_CALLBACK(debug_controller_authorize_cb), NULL);
+   }
 
-   atomupd->debug_controller_id =
-      g_signal_connect(atomupd->debug_controller, "authorize",
-                       G_CALLBACK(debug_controller_authorize_cb), NULL);
+   /* Follow the network conditions, to automatically pause and resume the updates
+    * according to the configured network policy, and to repeat the update checks
+    * that were skipped while offline. The additional targets never install
+    * updates, and only check for them on request. */
+   if (primary == NULL) {
+      atomupd->network_monitor = g_object_ref(g_network_monitor_get_default());
+      atomupd->network_changed_id =
+         g_signal_connect_swapped(atomupd->network_monitor, "network-changed",
+                                  G_CALLBACK(_au_network_changed_cb), atomupd);
+      atomupd->network_metered_id =
+         g_signal_connect_swapped(atomupd->network_monitor, "notify::network-metered",
+                                  G_CALLBACK(_au_apply_update_policies), atomupd);
+      atomupd->network_connectivity_id =
+         g_signal_connect_swapped(atomupd->network_monitor, "notify::connectivity",
+                                  G_CALLBACK(_au_network_changed_cb), atomupd);
+   }
+
+   /* This environment variable is used for debugging and automated tests */
+   if (primary == NULL && g_getenv("AU_NETWORK_STATE_PATH") != NULL) {
+      g_autoptr(GFile) network_state_file = NULL;
+
+      network_state_file = g_file_new_for_path(g_getenv("AU_NETWORK_STATE_PATH"));
+      atomupd->network_state_monitor =
+         g_file_monitor_file(network_state_file, G_FILE_MONITOR_NONE, NULL, error);
+      if (atomupd->network_state_monitor == NULL)
+         return NULL;
+
+      g_signal_connect_swapped(atomupd->network_state_monitor, "changed",
+                               G_CALLBACK(_au_network_changed_cb), atomupd);
+   }
 
    /* Download the remote info file at the very end, after we know we were able
     * to successfully instantiate the atomupd. This download will happen in a
@@ -3661,3 +8433,68 @@ au_atomupd1_impl_new(const gchar *config_directory,
 
    return (AuAtomupd1 *)atomupd;
 }
+
+/**
+ * au_atomupd1_impl_new:
+ * @config_preference: (transfer none) (not nullable): Path to the directory where
+ *  the configuration is located.
+ * @manifest_preference: (transfer none) (nullable): Path to a custom JSON manifest
+ *  file. If %NULL, the path will be the default manifest path.
+ * @error: Used to raise an error on failure
+ *
+ * Returns: (transfer full): a new AuAtomupd1 that manages the running system
+ */
+AuAtomupd1 *
+au_atomupd1_impl_new(const gchar *config_directory,
+                     const gchar *manifest_preference,
+                     GDBusConnection *bus,
+                     GError **error)
+{
+   return _au_atomupd1_impl_new_full(NULL, NULL, config_directory, manifest_preference,
+                                     bus, error);
+}
+
+/**
+ * au_atomupd1_impl_new_target:
+ * @primary: (not nullable): The AuAtomupd1 of the running system
+ * @target_name: (not nullable): Unique name of the additional target
+ * @config_directory: (not nullable): Path to the directory where the configuration
+ *  of the target is located
+ * @manifest_preference: (nullable): Path to the JSON manifest of the target image.
+ *  If %NULL, the path will be the default manifest path.
+ * @bus: The D-Bus connection
+ * @error: Used to raise an error on failure
+ *
+ * Create an object that manages an additional image, e.g. a container or a
+ * spare root filesystem. The target has its own configuration, preferences
+ * and update state, while sharing the polkit authority and the chunk cache of
+ * @primary.
+ *
+ * Returns: (transfer full): a new AuAtomupd1 that manages the target
+ */
+AuAtomupd1 *
+au_atomupd1_impl_new_target(AuAtomupd1 *primary,
+                            const gchar *target_name,
+                            const gchar *config_directory,
+                            const gchar *manifest_preference,
+                            GDBusConnection *bus,
+                            GError **error)
+{
+   AuAtomupd1Impl *primary_impl = AU_ATOMUPD1_IMPL(primary);
+   AuAtomupd1 *target = NULL;
+
+   g_return_val_if_fail(primary_impl->primary == NULL, NULL);
+   g_return_val_if_fail(target_name != NULL, NULL);
+
+   target = _au_atomupd1_impl_new_full(primary_impl, target_name, config_directory,
+                                       manifest_preference, bus, error);
+   if (target == NULL)
+      return NULL;
+
+   if (primary_impl->targets == NULL)
+      primary_impl->targets = g_ptr_array_new_with_free_func(g_object_unref);
+
+   g_ptr_array_add(primary_impl->targets, g_object_ref(target));
+
+   return target;
+}
@@ -44,6 +44,13 @@ AuAtomupd1 *au_atomupd1_impl_new(const gchar *config_directory,
                                  GDBusConnection *bus,
                                  GError **error);
 
+AuAtomupd1 *au_atomupd1_impl_new_target(AuAtomupd1 *primary,
+                                        const gchar *target_name,
+                                        const gchar *config_directory,
+                                        const gchar *manifest_preference,
+                                        GDBusConnection *bus,
+                                        GError **error);
+
 gboolean _au_get_http_auth_from_config(GKeyFile *client_config,
                                        gchar **username_out,
                                        gchar **password_out,
@@ -0,0 +1,415 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "au-atomupd1-impl.h"
+#include "builds-catalog.h"
+#include "utils.h"
+
+static void
+_au_build_free(AuBuild *build)
+{
+   g_free(build->buildid);
+   g_free(build->version);
+   g_free(build->branch);
+   g_free(build->update_path);
+   g_free(build);
+}
+
+/*
+ * Returns: (transfer full): A copy of the string @member of @obj, or @default_value
+ *  if it is either missing or not a string
+ */
+static gchar *
+_au_json_dup_string(JsonObject *obj, const gchar *member, const gchar *default_value)
+{
+   JsonNode *node = json_object_get_member(obj, member); /* borrowed */
+
+   if (node == NULL || !JSON_NODE_HOLDS_VALUE(node) ||
+       json_node_get_value_type(node) != G_TYPE_STRING)
+      return g_strdup(default_value);
+
+   return g_strdup(json_node_get_string(node));
+}
+
+/*
+ * Sort function for a GPtrArray of AuBuild, from the newest to the oldest
+ */
+static gint
+_au_build_compare_newest_first(gconstpointer a, gconstpointer b)
+{
+   const AuBuild *build_a = *((const AuBuild **)a);
+   const AuBuild *build_b = *((const AuBuild **)b);
+
+   if (build_a->date != build_b->date)
+      return build_a->date > build_b->date ? -1 : 1;
+
+   if (build_a->increment != build_b->increment)
+      return build_a->increment > build_b->increment ? -1 : 1;
+
+   return 0;
+}
+
+/*
+ * au_builds_catalog_new_from_file:
+ * @path: (not nullable): Path to the JSON builds list
+ * @error: Used to raise an error on failure
+ *
+ * Parse the JSON builds list in @path and index its content by branch and by
+ * build ID. Entries with a build ID that doesn't follow the expected
+ * YYYYMMDD[.N] format are skipped.
+ *
+ * Returns: (transfer full): A new catalog, free with `au_builds_catalog_free()`
+ */
+AuBuildsCatalog *
+au_builds_catalog_new_from_file(const gchar *path, GError **error)
+{
+   g_autoptr(AuBuildsCatalog) catalog = NULL;
+   g_autoptr(JsonParser) parser = NULL;
+   JsonNode *root = NULL;   /* borrowed */
+   JsonArray *array = NULL; /* borrowed */
+   GStatBuf stat_buf;
+   guint length;
+   guint i;
+
+   g_return_val_if_fail(path != NULL, NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   if (g_stat(path, &stat_buf) != 0) {
+      int saved_errno = errno;
+      return au_throw_error_null(error, "Unable to access the builds list '%s': %s",
+                                 path, g_strerror(saved_errno));
+   }
+
+   parser = json_parser_new();
+   if (!json_parser_load_from_file(parser, path, error))
+      return NULL;
+
+   root = json_parser_get_root(parser);
+   if (root == NULL || !JSON_NODE_HOLDS_ARRAY(root))
+      return au_throw_error_null(error, "Expected to find a JSON array in '%s'", path);
+
+   catalog = g_new0(AuBuildsCatalog, 1);
+   catalog->path = g_strdup(path);
+   catalog->inode = stat_buf.st_ino;
+   catalog->mtime = stat_buf.st_mtime;
+   catalog->size = stat_buf.st_size;
+   catalog->builds = g_ptr_array_new_with_free_func((GDestroyNotify)_au_build_free);
+   catalog->by_branch = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                              (GDestroyNotify)g_ptr_array_unref);
+
+   array = json_node_get_array(root);
+   length = json_array_get_length(array);
+
+   for (i = 0; i < length; i++) {
+      JsonNode *element = json_array_get_element(array, i); /* borrowed */
+      JsonObject *obj = NULL;                                /* borrowed */
+      g_autofree gchar *buildid = NULL;
+      AuBuild *build = NULL;
+      gint64 date;
+      gint64 increment;
+
+      if (!JSON_NODE_HOLDS_OBJECT(element)) {
+         g_debug("Skipping the element %u of '%s' because it is not an object", i, path);
+         continue;
+      }
+
+      obj = json_node_get_object(element);
+      buildid = _au_json_dup_string(obj, "buildid", NULL);
+
+      if (!_is_buildid_valid(buildid, &date, &increment, NULL)) {
+         g_debug("Skipping the unexpected build ID '%s' from '%s'", buildid, path);
+         continue;
+      }
+
+      build = g_new0(AuBuild, 1);
+      build->buildid = g_steal_pointer(&buildid);
+      build->version = _au_json_dup_string(obj, "version", "");
+      build->branch = _au_json_dup_string(obj, "branch", "");
+      build->update_path = _au_json_dup_string(obj, "update_path", NULL);
+      build->date = date;
+      build->increment = increment;
+
+      g_ptr_array_add(catalog->builds, build);
+   }
+
+   /* The sort is stable, builds with the same ID keep their original order */
+   g_ptr_array_sort(catalog->builds, _au_build_compare_newest_first);
+
+   for (i = 0; i < catalog->builds->len; i++) {
+      AuBuild *build = g_ptr_array_index(catalog->builds, i);
+      GPtrArray *branch_builds = g_hash_table_lookup(catalog->by_branch, build->branch);
+
+      if (branch_builds == NULL) {
+         branch_builds = g_ptr_array_new();
+         g_hash_table_insert(catalog->by_branch, g_strdup(build->branch), branch_builds);
+      }
+
+      g_ptr_array_add(branch_builds, build);
+   }
+
+   return g_steal_pointer(&catalog);
+}
+
+void
+au_builds_catalog_free(AuBuildsCatalog *self)
+{
+   if (self == NULL)
+      return;
+
+   g_free(self->path);
+   g_clear_pointer(&self->by_branch, g_hash_table_unref);
+   g_clear_pointer(&self->builds, g_ptr_array_unref);
+   g_free(self);
+}
+
+/*
+ * au_builds_catalog_is_stale:
+ * @self: (not nullable): A catalog
+ *
+ * Returns: %TRUE if the file the catalog has been parsed from has been
+ *  removed or replaced in the meantime
+ */
+gboolean
+au_builds_catalog_is_stale(const AuBuildsCatalog *self)
+{
+   GStatBuf stat_buf;
+
+   g_return_val_if_fail(self != NULL, TRUE);
+
+   if (g_stat(self->path, &stat_buf) != 0)
+      return TRUE;
+
+   return (guint64)stat_buf.st_ino != self->inode ||
+          (gint64)stat_buf.st_mtime != self->mtime ||
+          (goffset)stat_buf.st_size != self->size;
+}
+
+/*
+ * au_builds_query_init:
+ * @query: (out caller-allocates): The query to initialize
+ * @filter: (not nullable): Vardict with the filter options
+ * @current_date: Date of the build ID that is currently in use
+ * @current_increment: Increment of the build ID that is currently in use
+ * @error: Used to raise an error on failure
+ *
+ * Parse the @filter options into @query. The supported options are:
+ *  - 'branch' (s): only return builds in this branch
+ *  - 'latest_per_branch' (b): only return the newest build of each branch
+ *  - 'newer_than' (s): only return builds newer than this build ID
+ *  - 'newer_than_current' (b): only return builds newer than the current one
+ *  - 'since' (s): only return builds from this date onwards, as YYYYMMDD[.N]
+ *  - 'until' (s): only return builds up to this date, as YYYYMMDD[.N]
+ *
+ * Returns: %TRUE on success. @query must be cleared with
+ *  `au_builds_query_clear()`, regardless of the result.
+ */
+gboolean
+au_builds_query_init(AuBuildsQuery *query,
+                     GVariant *filter,
+                     gint64 current_date,
+                     gint64 current_increment,
+                     GError **error)
+{
+   const gchar *key = NULL;
+   GVariant *value = NULL;
+   GVariantIter iter;
+
+   g_return_val_if_fail(query != NULL, FALSE);
+   g_return_val_if_fail(filter != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   memset(query, 0, sizeof(*query));
+
+   g_variant_iter_init(&iter, filter);
+
+   while (g_variant_iter_next(&iter, "{&sv}", &key, &value)) {
+      g_autoptr(GVariant) owned_value = value;
+      gboolean is_string = g_variant_is_of_type(value, G_VARIANT_TYPE_STRING);
+      gboolean is_boolean = g_variant_is_of_type(value, G_VARIANT_TYPE_BOOLEAN);
+
+      if (g_str_equal(key, "branch") && is_string) {
+         g_free(query->branch);
+         query->branch = g_variant_dup_string(value, NULL);
+      } else if (g_str_equal(key, "latest_per_branch") && is_boolean) {
+         query->latest_per_branch = g_variant_get_boolean(value);
+      } else if (g_str_equal(key, "newer_than_current") && is_boolean) {
+         if (g_variant_get_boolean(value)) {
+            query->has_newer_than = TRUE;
+            query->newer_than_date = current_date;
+            query->newer_than_increment = current_increment;
+         }
+      } else if (g_str_equal(key, "newer_than") && is_string) {
+         if (!_is_buildid_valid(g_variant_get_string(value, NULL),
+                                &query->newer_than_date, &query->newer_than_increment,
+                                error))
+            return FALSE;
+
+         query->has_newer_than = TRUE;
+      } else if (g_str_equal(key, "since") && is_string) {
+         if (!_is_buildid_valid(g_variant_get_string(value, NULL), &query->since_date,
+                                NULL, error))
+            return FALSE;
+      } else if (g_str_equal(key, "until") && is_string) {
+         if (!_is_buildid_valid(g_variant_get_string(value, NULL), &query->until_date,
+                                NULL, error))
+            return FALSE;
+      } else {
+         return au_throw_error(error,
+                               "The argument '%s' is either not a valid option or it "
+                               "has an unexpected type",
+                               key);
+      }
+   }
+
+   return TRUE;
+}
+
+void
+au_builds_query_clear(AuBuildsQuery *query)
+{
+   g_clear_pointer(&query->branch, g_free);
+}
+
+/*
+ * Returns: %TRUE if @build is older than the lower bounds of @query. Given that
+ *  the builds are sorted from the newest to the oldest, this also means
+ *  that all the following builds are out of bounds too.
+ */
+static gboolean
+_au_build_is_below_bounds(const AuBuild *build, const AuBuildsQuery *query)
+{
+   if (query->since_date > 0 && build->date < query->since_date)
+      return TRUE;
+
+   if (query->has_newer_than) {
+      if (build->date < query->newer_than_date)
+         return TRUE;
+
+      if (build->date == query->newer_than_date &&
+          build->increment <= query->newer_than_increment)
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+/*
+ * Returns: The index of the first build in @builds that is not newer than
+ *  @until_date, or zero if @until_date is unbounded.
+ */
+static guint
+_au_builds_lower_bound(const GPtrArray *builds, gint64 until_date)
+{
+   guint low = 0;
+   guint high = builds->len;
+
+   if (until_date <= 0)
+      return 0;
+
+   while (low < high) {
+      guint mid = low + (high - low) / 2;
+      const AuBuild *build = g_ptr_array_index(builds, mid);
+
+      if (build->date > until_date)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return low;
+}
+
+/*
+ * au_builds_catalog_query:
+ * @self: (not nullable): A catalog
+ * @query: (not nullable): The query to run
+ * @limit: Maximum number of builds to return, zero for no limit
+ *
+ * Returns: (transfer full): An array of vardicts with the "buildid", "version",
+ *  "branch" and, if available, "update_path" of the matching builds, sorted
+ *  from the newest to the oldest.
+ */
+GVariant *
+au_builds_catalog_query(const AuBuildsCatalog *self,
+                        const AuBuildsQuery *query,
+                        guint limit)
+{
+   g_auto(GVariantBuilder) builder = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE("aa{sv}"));
+   g_autoptr(GHashTable) seen_branches = NULL;
+   const GPtrArray *builds = NULL;
+   guint n_results = 0;
+   guint i;
+
+   g_return_val_if_fail(self != NULL, NULL);
+   g_return_val_if_fail(query != NULL, NULL);
+
+   if (query->branch != NULL)
+      builds = g_hash_table_lookup(self->by_branch, query->branch);
+   else
+      builds = self->builds;
+
+   if (query->latest_per_branch)
+      seen_branches = g_hash_table_new(g_str_hash, g_str_equal);
+
+   for (i = builds == NULL ? 0 : _au_builds_lower_bound(builds, query->until_date);
+        builds != NULL && i < builds->len; i++) {
+      const AuBuild *build = g_ptr_array_index(builds, i);
+
+      if (limit > 0 && n_results >= limit)
+         break;
+
+      if (_au_build_is_below_bounds(build, query))
+         break;
+
+      if (seen_branches != NULL) {
+         if (g_hash_table_contains(seen_branches, build->branch))
+            continue;
+
+         g_hash_table_add(seen_branches, build->branch);
+      }
+
+      g_variant_builder_open(&builder, G_VARIANT_TYPE("a{sv}"));
+      g_variant_builder_add(&builder, "{sv}", "buildid",
+                            g_variant_new_string(build->buildid));
+      g_variant_builder_add(&builder, "{sv}", "version",
+                            g_variant_new_string(build->version));
+      g_variant_builder_add(&builder, "{sv}", "branch",
+                            g_variant_new_string(build->branch));
+      if (build->update_path != NULL)
+         g_variant_builder_add(&builder, "{sv}", "update_path",
+                               g_variant_new_string(build->update_path));
+      g_variant_builder_close(&builder);
+
+      n_results++;
+   }
+
+   return g_variant_ref_sink(g_variant_builder_end(&builder));
+}
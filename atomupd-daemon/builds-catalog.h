@@ -0,0 +1,86 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+typedef struct {
+   gchar *buildid;
+   gchar *version;
+   gchar *branch;
+   gchar *update_path;
+   /* Date and increment of @buildid, as parsed by `_is_buildid_valid()` */
+   gint64 date;
+   gint64 increment;
+} AuBuild;
+
+typedef struct {
+   /* Path of the JSON builds list this catalog has been parsed from */
+   gchar *path;
+   /* Identity of @path when it was parsed, used to detect when the file
+    * has been replaced */
+   guint64 inode;
+   gint64 mtime;
+   goffset size;
+   /* AuBuild, sorted from the newest to the oldest */
+   GPtrArray *builds;
+   /* Branch name -> GPtrArray of borrowed AuBuild, sorted like @builds */
+   GHashTable *by_branch;
+} AuBuildsCatalog;
+
+typedef struct {
+   /* If not %NULL, only return builds in this branch */
+   gchar *branch;
+   /* Only return the newest build of each branch */
+   gboolean latest_per_branch;
+   /* Only return builds strictly newer than this date and increment */
+   gboolean has_newer_than;
+   gint64 newer_than_date;
+   gint64 newer_than_increment;
+   /* Inclusive date range in the YYYYMMDD form, zero if unbounded */
+   gint64 since_date;
+   gint64 until_date;
+} AuBuildsQuery;
+
+AuBuildsCatalog *au_builds_catalog_new_from_file(const gchar *path, GError **error);
+void au_builds_catalog_free(AuBuildsCatalog *self);
+gboolean au_builds_catalog_is_stale(const AuBuildsCatalog *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuBuildsCatalog, au_builds_catalog_free)
+
+gboolean au_builds_query_init(AuBuildsQuery *query,
+                              GVariant *filter,
+                              gint64 current_date,
+                              gint64 current_increment,
+                              GError **error);
+void au_builds_query_clear(AuBuildsQuery *query);
+
+G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(AuBuildsQuery, au_builds_query_clear)
+
+GVariant *au_builds_catalog_query(const AuBuildsCatalog *self,
+                                  const AuBuildsQuery *query,
+                                  guint limit);
@@ -0,0 +1,478 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "chunk-scrubber.h"
+#include "peer-server.h"
+#include "supervisor.h"
+
+/* Created in the chunks directory, its modification time is the end of the
+ * last scrub. Desync ignores the files that are not chunks. */
+const gchar *AU_SCRUB_STAMP = ".atomupd-scrub";
+
+typedef struct {
+   /* %NULL once the scrubber has been freed */
+   AuChunkScrubber *scrubber;
+   /* Borrowed, owned by the supervisor */
+   AuChild *child;
+   guint64 chunks_before;
+   guint64 bytes_before;
+   gboolean failed;
+   /* Monotonic times */
+   gint64 start_time;
+   gint64 paused_since;
+   gint64 paused_time;
+} ScrubRun;
+
+struct _AuChunkScrubber {
+   gchar *chunks_dir;
+   /* The scrub in progress, or %NULL */
+   ScrubRun *run;
+   gboolean paused;
+   AuScrubStats stats;
+   AuChunkScrubberDoneFunc done_func;
+   gpointer user_data;
+};
+
+static ScrubRun *
+_scrub_run_ref(ScrubRun *run)
+{
+   return g_rc_box_acquire(run);
+}
+
+static void
+_scrub_run_unref(ScrubRun *run)
+{
+   g_rc_box_release(run);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(ScrubRun, _scrub_run_unref)
+
+/*
+ * au_chunk_cache_measure:
+ * @chunks_dir: (not nullable): Path to a Desync local chunk store
+ * @n_chunks_out: (out) (not optional): Used to return the number of chunks
+ * @bytes_out: (out) (not optional): Used to return the size of the chunks, in bytes
+ * @error: Used to raise an error on failure
+ *
+ * This walks the whole store, so it should be called from a worker thread.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+au_chunk_cache_measure(const gchar *chunks_dir,
+                       guint64 *n_chunks_out,
+                       guint64 *bytes_out,
+                       GError **error)
+{
+   g_autoptr(GDir) dir = NULL;
+   const gchar *prefix;
+
+   g_return_val_if_fail(chunks_dir != NULL, FALSE);
+   g_return_val_if_fail(n_chunks_out != NULL, FALSE);
+   g_return_val_if_fail(bytes_out != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   *n_chunks_out = 0;
+   *bytes_out = 0;
+
+   dir = g_dir_open(chunks_dir, 0, error);
+   if (dir == NULL)
+      return FALSE;
+
+   while ((prefix = g_dir_read_name(dir)) != NULL) {
+      g_autoptr(GDir) subdir = NULL;
+      g_autofree gchar *subdir_path = NULL;
+      const gchar *name;
+
+      if (strlen(prefix) != 4)
+         continue;
+
+      subdir_path = g_build_filename(chunks_dir, prefix, NULL);
+      subdir = g_dir_open(subdir_path, 0, NULL);
+      if (subdir == NULL)
+         continue;
+
+      while ((name = g_dir_read_name(subdir)) != NULL) {
+         g_autofree gchar *chunk_path = g_strdup_printf("/%s/%s", prefix, name);
+         g_autofree gchar *path = NULL;
+         GStatBuf stat_buf;
+
+         if (!au_peer_server_is_chunk_path(chunk_path))
+            continue;
+
+         path = g_build_filename(subdir_path, name, NULL);
+         if (g_lstat(path, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode))
+            continue;
+
+         *n_chunks_out += 1;
+         *bytes_out += stat_buf.st_size;
+      }
+   }
+
+   return TRUE;
+}
+
+/*
+ * au_cpu_times_read:
+ * @proc_stat_path: (not nullable): Path to the `/proc/stat` file
+ * @times: (out) (not optional): Used to return the CPU times since boot
+ *
+ * The time spent running tasks with a positive niceness is not considered
+ * busy, so that background work, like the scrub itself, doesn't count.
+ *
+ * Returns: %TRUE if the times have been read
+ */
+gboolean
+au_cpu_times_read(const gchar *proc_stat_path, AuCpuTimes *times)
+{
+   g_autofree gchar *contents = NULL;
+   guint64 values[8] = { 0 };
+   gchar *cursor;
+   gchar *endptr = NULL;
+   gsize i;
+
+   g_return_val_if_fail(proc_stat_path != NULL, FALSE);
+   g_return_val_if_fail(times != NULL, FALSE);
+
+   times->busy = 0;
+   times->total = 0;
+
+   if (!g_file_get_contents(proc_stat_path, &contents, NULL, NULL))
+      return FALSE;
+
+   if (!g_str_has_prefix(contents, "cpu "))
+      return FALSE;
+
+   /* user nice system idle iowait irq softirq steal */
+   cursor = contents + strlen("cpu ");
+   for (i = 0; i < G_N_ELEMENTS(values); i++) {
+      values[i] = g_ascii_strtoull(cursor, &endptr, 10);
+      if (endptr == cursor)
+         return FALSE;
+      cursor = endptr;
+   }
+
+   times->busy = values[0] + values[2] + values[5] + values[6];
+   for (i = 0; i < G_N_ELEMENTS(values); i++)
+      times->total += values[i];
+
+   return TRUE;
+}
+
+/*
+ * au_chunk_scrubber_new:
+ * @chunks_dir: (not nullable): Path to the Desync local chunk store
+ * @done_func: (nullable): Called every time a scrub completes
+ * @user_data: Passed to @done_func
+ *
+ * Returns: (transfer full): A new scrubber for @chunks_dir
+ */
+AuChunkScrubber *
+au_chunk_scrubber_new(const gchar *chunks_dir,
+                      AuChunkScrubberDoneFunc done_func,
+                      gpointer user_data)
+{
+   AuChunkScrubber *self = NULL;
+   g_autofree gchar *stamp_path = NULL;
+   GStatBuf stat_buf;
+
+   g_return_val_if_fail(chunks_dir != NULL, NULL);
+
+   self = g_slice_new0(AuChunkScrubber);
+   self->chunks_dir = g_strdup(chunks_dir);
+   self->done_func = done_func;
+   self->user_data = user_data;
+
+   /* Don't scrub again after every restart */
+   stamp_path = g_build_filename(chunks_dir, AU_SCRUB_STAMP, NULL);
+   if (g_stat(stamp_path, &stat_buf) == 0)
+      self->stats.last_run = stat_buf.st_mtime;
+
+   return self;
+}
+
+void
+au_chunk_scrubber_free(AuChunkScrubber *self)
+{
+   if (self->run != NULL) {
+      self->run->scrubber = NULL;
+
+      /* The helper only removes the chunks it already found to be corrupted,
+       * so it can be killed at any time */
+      if (self->run->child != NULL)
+         au_child_send_signal(self->run->child, SIGKILL, NULL);
+
+      g_clear_pointer(&self->run, _scrub_run_unref);
+   }
+
+   g_free(self->chunks_dir);
+
+   g_slice_free(AuChunkScrubber, self);
+}
+
+const gchar *
+au_chunk_scrubber_get_chunks_dir(const AuChunkScrubber *self)
+{
+   return self->chunks_dir;
+}
+
+gboolean
+au_chunk_scrubber_is_running(const AuChunkScrubber *self)
+{
+   return self->run != NULL;
+}
+
+const AuScrubStats *
+au_chunk_scrubber_get_stats(const AuChunkScrubber *self)
+{
+   return &self->stats;
+}
+
+static void
+_au_chunk_cache_measure_thread(GTask *task,
+                               G_GNUC_UNUSED gpointer source_object,
+                               gpointer task_data,
+                               G_GNUC_UNUSED GCancellable *cancellable)
+{
+   const gchar *chunks_dir = task_data;
+   g_autofree guint64 *measure = g_new0(guint64, 2);
+   GError *error = NULL;
+
+   if (!au_chunk_cache_measure(chunks_dir, &measure[0], &measure[1], &error))
+      return g_task_return_error(task, error);
+
+   g_task_return_pointer(task, g_steal_pointer(&measure), g_free);
+}
+
+static void
+_au_chunk_cache_measure_async(AuChunkScrubber *self, GAsyncReadyCallback callback)
+{
+   g_autoptr(GTask) task = NULL;
+
+   task = g_task_new(NULL, NULL, callback, _scrub_run_ref(self->run));
+   g_task_set_task_data(task, g_strdup(self->chunks_dir), g_free);
+   g_task_run_in_thread(task, _au_chunk_cache_measure_thread);
+}
+
+static void
+_au_chunk_scrubber_measured_after_cb(GObject *source_object,
+                                     GAsyncResult *result,
+                                     gpointer user_data)
+{
+   g_autoptr(ScrubRun) run = user_data;
+   g_autofree guint64 *measure = NULL;
+   g_autofree gchar *stamp_path = NULL;
+   g_autoptr(GError) error = NULL;
+   AuChunkScrubber *self = run->scrubber;
+
+   measure = g_task_propagate_pointer(G_TASK(result), &error);
+
+   if (self == NULL)
+      return;
+
+   if (measure == NULL) {
+      g_warning("Unable to measure the chunk cache: %s", error->message);
+      g_clear_error(&error);
+      run->failed = TRUE;
+   }
+
+   self->stats.runs++;
+   if (run->failed)
+      self->stats.errors++;
+   self->stats.last_run = g_get_real_time() / G_USEC_PER_SEC;
+   self->stats.chunks = run->chunks_before;
+   self->stats.bytes = run->bytes_before;
+   /* The chunks that are gone have been found to be corrupted */
+   self->stats.evicted = measure != NULL && run->chunks_before > measure[0]
+                            ? run->chunks_before - measure[0]
+                            : 0;
+
+   g_info("Scrubbed %" G_GUINT64_FORMAT " chunks in %.1f seconds, %" G_GUINT64_FORMAT
+          " of them were corrupted",
+          self->stats.chunks, (gdouble)self->stats.active_time / G_USEC_PER_SEC,
+          self->stats.evicted);
+
+   stamp_path = g_build_filename(self->chunks_dir, AU_SCRUB_STAMP, NULL);
+   if (!g_file_set_contents(stamp_path, "", 0, &error))
+      g_debug("Unable to update the scrub timestamp: %s", error->message);
+
+   g_clear_pointer(&self->run, _scrub_run_unref);
+
+   if (self->done_func != NULL)
+      self->done_func(self, self->user_data);
+}
+
+static void
+_au_chunk_scrubber_exited_cb(AuChild *child, gint wait_status, gpointer user_data)
+{
+   ScrubRun *run = user_data;
+   AuChunkScrubber *self = run->scrubber;
+   g_autoptr(GError) error = NULL;
+   gint64 now = g_get_monotonic_time();
+
+   run->child = NULL;
+
+   if (self == NULL)
+      return;
+
+   if (!g_spawn_check_wait_status(wait_status, &error)) {
+      g_warning("The scrub of the chunk cache failed: %s", error->message);
+      run->failed = TRUE;
+   }
+
+   if (run->paused_since != 0)
+      run->paused_time += now - run->paused_since;
+   self->stats.active_time = now - run->start_time - run->paused_time;
+
+   /* Whatever is missing now has been evicted by the helper */
+   _au_chunk_cache_measure_async(self, _au_chunk_scrubber_measured_after_cb);
+}
+
+static void
+_au_chunk_scrubber_measured_before_cb(GObject *source_object,
+                                      GAsyncResult *result,
+                                      gpointer user_data)
+{
+   g_autoptr(ScrubRun) run = user_data;
+   g_autofree guint64 *measure = NULL;
+   g_autoptr(GPtrArray) argv = NULL;
+   g_autoptr(GError) error = NULL;
+   AuChunkScrubber *self = run->scrubber;
+   ScrubRun *child_run = NULL;
+
+   measure = g_task_propagate_pointer(G_TASK(result), &error);
+
+   if (self == NULL)
+      return;
+
+   if (measure == NULL) {
+      g_warning("Unable to scrub the chunk cache: %s", error->message);
+      run->failed = TRUE;
+      /* Count it as a completed scrub, otherwise we would try again right away */
+      _au_chunk_cache_measure_async(self, _au_chunk_scrubber_measured_after_cb);
+      return;
+   }
+
+   run->chunks_before = measure[0];
+   run->bytes_before = measure[1];
+
+   argv = g_ptr_array_new_with_free_func(g_free);
+   g_ptr_array_add(argv, g_strdup("desync"));
+   g_ptr_array_add(argv, g_strdup("verify"));
+   g_ptr_array_add(argv, g_strdup("--store"));
+   g_ptr_array_add(argv, g_strdup(self->chunks_dir));
+   g_ptr_array_add(argv, g_strdup("--repair"));
+   /* Verifying the chunks is CPU bound, use all the cores. The helper runs with
+    * the lowest priorities, so that it only uses the time nobody else needs. */
+   g_ptr_array_add(argv, g_strdup("--concurrency"));
+   g_ptr_array_add(argv, g_strdup_printf("%u", g_get_num_processors()));
+   g_ptr_array_add(argv, NULL);
+
+   child_run = _scrub_run_ref(run);
+   run->start_time = g_get_monotonic_time();
+   run->child = au_supervisor_spawn(au_supervisor_get_default(), AU_HELPER_KIND_TOOL,
+                                    (const gchar *const *)argv->pdata, NULL,
+                                    AU_CHILD_FLAGS_LOW_PRIORITY, 0,
+                                    _au_chunk_scrubber_exited_cb, child_run,
+                                    (GDestroyNotify)_scrub_run_unref, &error);
+   if (run->child == NULL) {
+      _scrub_run_unref(child_run);
+      g_warning("Unable to launch the chunk cache scrub: %s", error->message);
+      run->failed = TRUE;
+      _au_chunk_cache_measure_async(self, _au_chunk_scrubber_measured_after_cb);
+      return;
+   }
+
+   /* We might have been asked to pause while measuring the cache */
+   if (self->paused) {
+      self->paused = FALSE;
+      au_chunk_scrubber_set_paused(self, TRUE);
+   }
+}
+
+/*
+ * au_chunk_scrubber_start:
+ * @self: (not nullable): A scrubber that is not running
+ *
+ * Verify all the chunks in the background with `desync verify`, removing the
+ * corrupted ones. The done function is called at the end, even on failure.
+ */
+void
+au_chunk_scrubber_start(AuChunkScrubber *self)
+{
+   g_return_if_fail(self->run == NULL);
+
+   self->run = g_rc_box_new0(ScrubRun);
+   self->run->scrubber = self;
+   self->paused = FALSE;
+   self->stats.active_time = 0;
+
+   /* The helper doesn't report what it removed, so we compare the content of
+    * the cache before and after */
+   _au_chunk_cache_measure_async(self, _au_chunk_scrubber_measured_before_cb);
+}
+
+/*
+ * au_chunk_scrubber_set_paused:
+ * @self: (not nullable): The scrubber
+ * @paused: %TRUE to stop the running scrub, %FALSE to let it continue
+ */
+void
+au_chunk_scrubber_set_paused(AuChunkScrubber *self, gboolean paused)
+{
+   g_autoptr(GError) error = NULL;
+
+   if (self->run == NULL || self->paused == paused)
+      return;
+
+   self->paused = paused;
+
+   /* Still measuring, the helper will be stopped as soon as it starts */
+   if (self->run->child == NULL)
+      return;
+
+   if (!au_child_send_signal(self->run->child, paused ? SIGSTOP : SIGCONT, &error)) {
+      g_warning("Failed to %s the chunk cache scrub: %s", paused ? "pause" : "resume",
+                error->message);
+      return;
+   }
+
+   if (paused) {
+      g_debug("Pausing the chunk cache scrub");
+      self->run->paused_since = g_get_monotonic_time();
+   } else {
+      g_debug("Resuming the chunk cache scrub");
+      self->run->paused_time += g_get_monotonic_time() - self->run->paused_since;
+      self->run->paused_since = 0;
+   }
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct {
+   /* Scrubs that completed, successfully or not */
+   guint64 runs;
+   /* Scrubs that could not verify the whole cache */
+   guint64 errors;
+   /* Unix time of the end of the last scrub, 0 if it never ran */
+   gint64 last_run;
+   /* Chunks, and their size in bytes, verified by the last scrub */
+   guint64 chunks;
+   guint64 bytes;
+   /* Corrupted chunks removed by the last scrub */
+   guint64 evicted;
+   /* Duration of the last scrub without the pauses, in microseconds */
+   guint64 active_time;
+} AuScrubStats;
+
+typedef struct {
+   /* Time spent running tasks with the default or higher priority */
+   guint64 busy;
+   guint64 total;
+} AuCpuTimes;
+
+typedef struct _AuChunkScrubber AuChunkScrubber;
+
+/*
+ * AuChunkScrubberDoneFunc:
+ * @scrubber: The scrubber whose scrub completed
+ * @user_data: The data passed to au_chunk_scrubber_new()
+ */
+typedef void (*AuChunkScrubberDoneFunc)(AuChunkScrubber *scrubber, gpointer user_data);
+
+AuChunkScrubber *au_chunk_scrubber_new(const gchar *chunks_dir,
+                                       AuChunkScrubberDoneFunc done_func,
+                                       gpointer user_data);
+void au_chunk_scrubber_free(AuChunkScrubber *self);
+const gchar *au_chunk_scrubber_get_chunks_dir(const AuChunkScrubber *self);
+void au_chunk_scrubber_start(AuChunkScrubber *self);
+gboolean au_chunk_scrubber_is_running(const AuChunkScrubber *self);
+void au_chunk_scrubber_set_paused(AuChunkScrubber *self, gboolean paused);
+const AuScrubStats *au_chunk_scrubber_get_stats(const AuChunkScrubber *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuChunkScrubber, au_chunk_scrubber_free)
+
+gboolean au_chunk_cache_measure(const gchar *chunks_dir,
+                                guint64 *n_chunks_out,
+                                guint64 *bytes_out,
+                                GError **error);
+gboolean au_cpu_times_read(const gchar *proc_stat_path, AuCpuTimes *times);
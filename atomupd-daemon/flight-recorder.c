@@ -0,0 +1,261 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "flight-recorder.h"
+
+/* Events kept by the default recorder, this takes about 300 KiB */
+const guint AU_FLIGHT_RECORDER_DEFAULT_EVENTS = 4096;
+
+static const gchar *const au_flight_event_names[AU_N_FLIGHT_EVENTS] = {
+   [AU_FLIGHT_EVENT_NONE] = "none",
+   [AU_FLIGHT_EVENT_METHOD_CALL] = "method",
+   [AU_FLIGHT_EVENT_STATUS] = "status",
+   [AU_FLIGHT_EVENT_PROGRESS] = "progress",
+   [AU_FLIGHT_EVENT_SPAWN] = "spawn",
+   [AU_FLIGHT_EVENT_EXIT] = "exit",
+   [AU_FLIGHT_EVENT_DOWNLOAD] = "download",
+   [AU_FLIGHT_EVENT_ERROR] = "error",
+   [AU_FLIGHT_EVENT_KILL] = "kill",
+};
+
+typedef struct {
+   /* Odd while the slot is being written, see au_flight_recorder_add() */
+   gint sequence;
+   /* Position of the event in the whole recording, to detect overwritten slots */
+   guint index;
+   AuFlightEvent event;
+} AuFlightSlot;
+
+struct _AuFlightRecorder {
+   AuFlightSlot *slots;
+   /* Always a power of two */
+   guint n_slots;
+   /* Position of the next event, only ever incremented atomically */
+   gint head;
+};
+
+/*
+ * au_flight_recorder_new:
+ * @n_events: Number of events to keep, must be a power of two
+ *
+ * Returns: (transfer full): A new recorder that keeps the last @n_events
+ */
+AuFlightRecorder *
+au_flight_recorder_new(guint n_events)
+{
+   AuFlightRecorder *self = NULL;
+
+   g_return_val_if_fail(n_events > 0 && (n_events & (n_events - 1)) == 0, NULL);
+
+   self = g_slice_new0(AuFlightRecorder);
+   self->slots = g_new0(AuFlightSlot, n_events);
+   self->n_slots = n_events;
+
+   return self;
+}
+
+void
+au_flight_recorder_free(AuFlightRecorder *self)
+{
+   g_free(self->slots);
+
+   g_slice_free(AuFlightRecorder, self);
+}
+
+/*
+ * au_flight_recorder_get_default:
+ *
+ * Returns: (transfer none): The recorder of the daemon
+ */
+AuFlightRecorder *
+au_flight_recorder_get_default(void)
+{
+   static gsize initialized = 0;
+   static AuFlightRecorder *default_recorder = NULL;
+
+   if (g_once_init_enter(&initialized)) {
+      default_recorder = au_flight_recorder_new(AU_FLIGHT_RECORDER_DEFAULT_EVENTS);
+      g_once_init_leave(&initialized, 1);
+   }
+
+   return default_recorder;
+}
+
+/*
+ * au_flight_recorder_add:
+ * @self: (not nullable): The recorder
+ * @type: Type of the event
+ * @value: Value of the event, its meaning depends on @type
+ * @detail: (nullable): Short description of the event, truncated if it's longer
+ *  than AU_FLIGHT_EVENT_DETAIL_SIZE
+ *
+ * Record an event, overwriting the oldest one. This never blocks and never
+ * allocates, so it can be called from any thread.
+ */
+void
+au_flight_recorder_add(AuFlightRecorder *self,
+                       AuFlightEventType type,
+                       gint64 value,
+                       const gchar *detail)
+{
+   guint index = (guint)g_atomic_int_add(&self->head, 1);
+   AuFlightSlot *slot = &self->slots[index & (self->n_slots - 1)];
+
+   /* This is a sequence lock with a single writer per slot, unless another
+    * thread wraps around the whole ring while we are still here. Readers skip
+    * the slots that change while they copy them. */
+   g_atomic_int_inc(&slot->sequence);
+   /* Don't let the event stores be moved before the odd sequence */
+   atomic_thread_fence(memory_order_release);
+
+   slot->index = index;
+   slot->event.time = g_get_real_time();
+   slot->event.value = value;
+   slot->event.type = type;
+   g_strlcpy(slot->event.detail, detail != NULL ? detail : "",
+             sizeof(slot->event.detail));
+
+   g_atomic_int_inc(&slot->sequence);
+}
+
+/*
+ * au_flight_recorder_get_events:
+ * @self: (not nullable): The recorder
+ *
+ * Returns: (transfer full) (element-type AuFlightEvent): The recorded events,
+ *  from the oldest to the newest one
+ */
+GArray *
+au_flight_recorder_get_events(AuFlightRecorder *self)
+{
+   g_autoptr(GArray) events = g_array_new(FALSE, FALSE, sizeof(AuFlightEvent));
+   guint head = (guint)g_atomic_int_get(&self->head);
+   guint n = MIN(head, self->n_slots);
+   guint index;
+
+   for (index = head - n; index != head; index++) {
+      AuFlightSlot *slot = &self->slots[index & (self->n_slots - 1)];
+      AuFlightEvent event;
+      guint slot_index;
+      gint sequence;
+
+      sequence = g_atomic_int_get(&slot->sequence);
+      if (sequence % 2 != 0)
+         continue;
+
+      slot_index = slot->index;
+      event = slot->event;
+
+      /* Don't let the copy be moved after the sequence re-check, otherwise a
+       * concurrent write could go unnoticed */
+      atomic_thread_fence(memory_order_acquire);
+
+      if (g_atomic_int_get(&slot->sequence) != sequence || slot_index != index ||
+          event.type == AU_FLIGHT_EVENT_NONE || event.type >= AU_N_FLIGHT_EVENTS)
+         continue;
+
+      g_array_append_val(events, event);
+   }
+
+   return g_steal_pointer(&events);
+}
+
+/*
+ * au_flight_recorder_dump:
+ * @self: (not nullable): The recorder
+ *
+ * Returns: (transfer full): The recorded events in a human readable form, one
+ *  per line
+ */
+gchar *
+au_flight_recorder_dump(AuFlightRecorder *self)
+{
+   g_autoptr(GArray) events = au_flight_recorder_get_events(self);
+   g_autoptr(GString) dump = g_string_new("");
+   guint i;
+
+   for (i = 0; i < events->len; i++) {
+      const AuFlightEvent *event = &g_array_index(events, AuFlightEvent, i);
+      g_autoptr(GDateTime) time = NULL;
+      g_autofree gchar *time_str = NULL;
+
+      time = g_date_time_new_from_unix_utc(event->time / G_USEC_PER_SEC);
+      time_str = g_date_time_format(time, "%Y-%m-%dT%H:%M:%S");
+
+      g_string_append_printf(dump, "%s.%06" G_GINT64_FORMAT "Z %s ", time_str,
+                             event->time % G_USEC_PER_SEC,
+                             au_flight_event_names[event->type]);
+
+      if (event->type == AU_FLIGHT_EVENT_PROGRESS)
+         g_string_append_printf(dump, "%.2f%%", (gdouble)event->value / 100);
+      else
+         g_string_append_printf(dump, "%" G_GINT64_FORMAT, event->value);
+
+      if (event->detail[0] != '\0')
+         g_string_append_printf(dump, " %s", event->detail);
+
+      g_string_append_c(dump, '\n');
+   }
+
+   return g_string_free(g_steal_pointer(&dump), FALSE);
+}
+
+/*
+ * au_flight_recorder_dump_to_file:
+ * @self: (not nullable): The recorder
+ * @path: (type filename): Where to write the dump, replacing the previous one
+ * @error: Used to raise an error on failure
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+au_flight_recorder_dump_to_file(AuFlightRecorder *self, const gchar *path, GError **error)
+{
+   g_autofree gchar *dump = au_flight_recorder_dump(self);
+
+   g_return_val_if_fail(path != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   return g_file_set_contents(path, dump, -1, error);
+}
+
+/*
+ * au_flight_record:
+ * @type: Type of the event
+ * @value: Value of the event, its meaning depends on @type
+ * @detail: (nullable): Short description of the event
+ *
+ * Record an event with the default recorder.
+ */
+void
+au_flight_record(AuFlightEventType type, gint64 value, const gchar *detail)
+{
+   au_flight_recorder_add(au_flight_recorder_get_default(), type, value, detail);
+}
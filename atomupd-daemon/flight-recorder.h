@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef enum {
+   AU_FLIGHT_EVENT_NONE = 0,
+   /* @value: unused, @detail: name of the D-Bus method */
+   AU_FLIGHT_EVENT_METHOD_CALL,
+   /* @value: the new AuUpdateStatus, @detail: name of the additional target */
+   AU_FLIGHT_EVENT_STATUS,
+   /* @value: hundredths of percentage points */
+   AU_FLIGHT_EVENT_PROGRESS,
+   /* @value: PID of the helper, @detail: its executable */
+   AU_FLIGHT_EVENT_SPAWN,
+   /* @value: wait status of the helper, @detail: its executable */
+   AU_FLIGHT_EVENT_EXIT,
+   /* @value: CURLcode of the transfer, @detail: last part of the URL */
+   AU_FLIGHT_EVENT_DOWNLOAD,
+   /* @value: unused, @detail: beginning of the error message */
+   AU_FLIGHT_EVENT_ERROR,
+   /* @value: PID of the helper killed after its timeout, @detail: its executable */
+   AU_FLIGHT_EVENT_KILL,
+   AU_N_FLIGHT_EVENTS,
+} AuFlightEventType;
+
+#define AU_FLIGHT_EVENT_DETAIL_SIZE 44
+
+/* 64 bytes, so that the whole recorder stays small enough to be always on */
+typedef struct {
+   /* Wall clock time, in microseconds since the Unix epoch */
+   gint64 time;
+   gint64 value;
+   guint32 type;
+   /* Always nul terminated, possibly truncated */
+   gchar detail[AU_FLIGHT_EVENT_DETAIL_SIZE];
+} AuFlightEvent;
+
+typedef struct _AuFlightRecorder AuFlightRecorder;
+
+AuFlightRecorder *au_flight_recorder_new(guint n_events);
+void au_flight_recorder_free(AuFlightRecorder *self);
+AuFlightRecorder *au_flight_recorder_get_default(void);
+void au_flight_recorder_add(AuFlightRecorder *self,
+                            AuFlightEventType type,
+                            gint64 value,
+                            const gchar *detail);
+GArray *au_flight_recorder_get_events(AuFlightRecorder *self);
+gchar *au_flight_recorder_dump(AuFlightRecorder *self);
+gboolean au_flight_recorder_dump_to_file(AuFlightRecorder *self,
+                                         const gchar *path,
+                                         GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuFlightRecorder, au_flight_recorder_free)
+
+void au_flight_record(AuFlightEventType type, gint64 value, const gchar *detail);
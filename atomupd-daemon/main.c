@@ -23,6 +23,7 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <string.h>
 #include <sysexits.h>
 
 #include <gio/gio.h>
@@ -65,6 +66,7 @@ on_sigterm(gpointer user_data)
 
 static gchar *opt_config_directory = NULL;
 static gchar *opt_manifest = NULL;
+static gchar *opt_targets_file = NULL;
 static gboolean opt_replace = FALSE;
 static gboolean opt_session = FALSE;
 static gboolean opt_verbose = FALSE;
@@ -75,6 +77,9 @@ static GOptionEntry options[] = {
      "Look for the configuration file in this directory [default: /etc/steamos-atomupd]", "PATH" },
    { "manifest-file", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &opt_manifest,
      "Use this manifest file", "PATH" },
+   { "targets-file", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &opt_targets_file,
+     "Manage the additional targets listed in this file [default: targets.conf in the "
+     "configuration directory, if present]", "PATH" },
    { "replace", '\0', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &opt_replace,
      "Replace a previous instance with the same bus name.", NULL },
    { "session", '\0', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &opt_session,
@@ -86,6 +91,99 @@ static GOptionEntry options[] = {
    { NULL }
 };
 
+static gboolean
+is_valid_target_name(const gchar *name)
+{
+   const gchar *p;
+
+   if (name[0] == '\0')
+      return FALSE;
+
+   for (p = name; *p != '\0'; p++) {
+      if (!g_ascii_isalnum(*p) && *p != '_')
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*
+ * export_targets:
+ * @bus: The D-Bus connection
+ * @atomupd: The object that manages the running system
+ * @targets_file: (not nullable): Path to the key file that lists the targets
+ * @error: Used to raise an error on failure
+ *
+ * Create an object for each "[Target NAME]" group of @targets_file, and export
+ * it at `AU_ATOMUPD1_PATH/NAME` with an object manager.
+ *
+ * Returns: (transfer full): The object manager of the targets, or %NULL on failure
+ */
+static GDBusObjectManagerServer *
+export_targets(GDBusConnection *bus,
+               AuAtomupd1 *atomupd,
+               const gchar *targets_file,
+               GError **error)
+{
+   g_autoptr(GKeyFile) targets_config = g_key_file_new();
+   g_autoptr(GDBusObjectManagerServer) manager = NULL;
+   g_auto(GStrv) groups = NULL;
+   gsize i;
+
+   if (!g_key_file_load_from_file(targets_config, targets_file, G_KEY_FILE_NONE, error))
+      return NULL;
+
+   manager = g_dbus_object_manager_server_new(AU_ATOMUPD1_PATH);
+   groups = g_key_file_get_groups(targets_config, NULL);
+
+   for (i = 0; groups[i] != NULL; i++) {
+      const gchar *name;
+      g_autofree gchar *config_directory = NULL;
+      g_autofree gchar *manifest = NULL;
+      g_autofree gchar *object_path = NULL;
+      g_autoptr(AuAtomupd1) target = NULL;
+      g_autoptr(GDBusObjectSkeleton) object = NULL;
+
+      if (!g_str_has_prefix(groups[i], "Target ")) {
+         g_warning("Ignoring the unexpected group '%s' in '%s'", groups[i],
+                   targets_file);
+         continue;
+      }
+
+      name = groups[i] + strlen("Target ");
+      if (!is_valid_target_name(name)) {
+         g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "Invalid target name '%s', only ASCII letters, digits and "
+                     "underscores are allowed",
+                     name);
+         return NULL;
+      }
+
+      config_directory =
+         g_key_file_get_string(targets_config, groups[i], "ConfigDirectory", error);
+      if (config_directory == NULL)
+         return NULL;
+
+      manifest = g_key_file_get_string(targets_config, groups[i], "Manifest", NULL);
+
+      target = au_atomupd1_impl_new_target(atomupd, name, config_directory, manifest,
+                                           bus, error);
+      if (target == NULL)
+         return NULL;
+
+      object_path = g_strdup_printf("%s/%s", AU_ATOMUPD1_PATH, name);
+      object = g_dbus_object_skeleton_new(object_path);
+      g_dbus_object_skeleton_add_interface(object, G_DBUS_INTERFACE_SKELETON(target));
+      g_dbus_object_manager_server_export(manager, object);
+
+      g_debug("Managing the target '%s' at '%s'", name, object_path);
+   }
+
+   g_dbus_object_manager_server_set_connection(manager, bus);
+
+   return g_steal_pointer(&manager);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -94,6 +192,8 @@ main(int argc, char *argv[])
    g_autoptr(GOptionContext) option_context = NULL;
    g_autoptr(GDBusConnection) bus = NULL;
    g_autoptr(AuAtomupd1) atomupd = NULL;
+   g_autoptr(GDBusObjectManagerServer) targets_manager = NULL;
+   g_autofree gchar *default_targets_file = NULL;
    GError **error = &local_error;
 
    option_context = g_option_context_new("");
@@ -146,6 +246,21 @@ main(int argc, char *argv[])
       return EXIT_FAILURE;
    }
 
+   if (opt_targets_file == NULL) {
+      default_targets_file = g_build_filename(opt_config_directory, "targets.conf", NULL);
+      if (g_file_test(default_targets_file, G_FILE_TEST_EXISTS))
+         opt_targets_file = g_steal_pointer(&default_targets_file);
+   }
+
+   if (opt_targets_file != NULL) {
+      targets_manager = export_targets(bus, atomupd, opt_targets_file, error);
+      if (targets_manager == NULL) {
+         g_warning("An error occurred while loading the targets from '%s': %s",
+                   opt_targets_file, local_error->message);
+         return EXIT_FAILURE;
+      }
+   }
+
    g_bus_own_name_on_connection(bus, AU_ATOMUPD1_BUS_NAME, flags, name_acquired_cb,
                                 name_lost_cb, NULL, NULL);
 
@@ -155,6 +270,7 @@ main(int argc, char *argv[])
 
    g_free(opt_config_directory);
    g_free(opt_manifest);
+   g_free(opt_targets_file);
 
    return EXIT_SUCCESS;
 }
@@ -0,0 +1,113 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#if defined(HAVE_MALLINFO2) || defined(HAVE_MALLOC_TRIM)
+#include <malloc.h>
+#endif
+
+#include "memory-usage.h"
+
+/*
+ * Returns: The size in bytes of the "@key:   VALUE kB" line of @status, or 0
+ *  if it is missing
+ */
+static guint64
+_au_parse_status_size(const gchar *status, const gchar *key)
+{
+   g_auto(GStrv) lines = g_strsplit(status, "\n", -1);
+   gsize key_len = strlen(key);
+   gsize i;
+
+   for (i = 0; lines[i] != NULL; i++) {
+      gchar *endptr = NULL;
+      guint64 value;
+
+      if (!g_str_has_prefix(lines[i], key) || lines[i][key_len] != ':')
+         continue;
+
+      value = g_ascii_strtoull(lines[i] + key_len + 1, &endptr, 10);
+      if (endptr == lines[i] + key_len + 1)
+         return 0;
+
+      /* The kernel always reports these sizes in kB */
+      return value * 1024;
+   }
+
+   return 0;
+}
+
+/*
+ * au_memory_usage_read:
+ * @proc_status_path: Path to the process status file, usually "/proc/self/status"
+ * @usage: (out caller-allocates): Memory usage of this process
+ */
+void
+au_memory_usage_read(const gchar *proc_status_path, AuMemoryUsage *usage)
+{
+   g_autofree gchar *status = NULL;
+
+   g_return_if_fail(proc_status_path != NULL);
+   g_return_if_fail(usage != NULL);
+
+   *usage = (AuMemoryUsage){ 0 };
+
+   if (g_file_get_contents(proc_status_path, &status, NULL, NULL)) {
+      usage->rss = _au_parse_status_size(status, "VmRSS");
+      usage->peak_rss = _au_parse_status_size(status, "VmHWM");
+   }
+
+#ifdef HAVE_MALLINFO2
+   {
+      struct mallinfo2 info = mallinfo2();
+
+      usage->heap_in_use = info.uordblks + info.hblkhd;
+      usage->heap_free = info.fordblks;
+      usage->heap_mapped = info.hblkhd;
+   }
+#endif
+}
+
+/*
+ * au_memory_release:
+ *
+ * Give the free memory held by malloc() back to the kernel. This is worth
+ * doing after large transient allocations, e.g. parsing a big JSON, because
+ * glibc rarely returns the freed arenas on its own.
+ *
+ * Returns: %TRUE if some memory was released
+ */
+gboolean
+au_memory_release(void)
+{
+#ifdef HAVE_MALLOC_TRIM
+   return malloc_trim(0) == 1;
+#else
+   return FALSE;
+#endif
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct {
+   /* Resident set size, in bytes, or 0 if unknown */
+   guint64 rss;
+   /* Peak resident set size, in bytes, or 0 if unknown */
+   guint64 peak_rss;
+   /* Bytes allocated with malloc() and still in use, or 0 if unknown */
+   guint64 heap_in_use;
+   /* Bytes held by malloc() in free chunks, or 0 if unknown */
+   guint64 heap_free;
+   /* Bytes of the malloc() allocations that have been served with mmap() */
+   guint64 heap_mapped;
+} AuMemoryUsage;
+
+void au_memory_usage_read(const gchar *proc_status_path, AuMemoryUsage *usage);
+gboolean au_memory_release(void);
@@ -0,0 +1,1261 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+
+#include <curl/curl.h>
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "mirror-proxy.h"
+#include "peer-server.h"
+#include "utils.h"
+
+/* Maximum number of requests forwarded at the same time */
+const gint AU_MIRROR_PROXY_MAX_THREADS = 16;
+/* Requests are small, anything longer than this is not something we expect */
+const gsize AU_MIRROR_PROXY_MAX_LINE_LENGTH = 2048;
+/* Desync only sends a handful of headers */
+const guint AU_MIRROR_PROXY_MAX_HEADERS = 32;
+/* Seconds of inactivity after which a connection gets dropped */
+const guint AU_MIRROR_PROXY_TIMEOUT = 60;
+/* Weight of the last transfer in the moving average of a mirror throughput */
+const gdouble AU_MIRROR_THROUGHPUT_SMOOTHING = 0.2;
+/* Consecutive failures after which a mirror share stops decreasing */
+const guint AU_MIRROR_MAX_FAILURES = 10;
+/* Seconds to wait for a peer connection, they are expected to be in the same network */
+const glong AU_MIRROR_PEER_CONNECT_TIMEOUT = 2;
+/* Seconds to wait for a mirror connection */
+const glong AU_MIRROR_CONNECT_TIMEOUT = 10;
+/* Seconds during which a peer that could not be reached is not tried again */
+const gint64 AU_MIRROR_PEER_BACKOFF = 60;
+/* Chunks bigger than this are not added to the local chunk cache. Desync
+ * chunks are usually a lot smaller, this only bounds the memory usage. */
+const gsize AU_MIRROR_MAX_CACHED_CHUNK_SIZE = 4 * 1024 * 1024;
+/* Random bytes in the secret that the requests must start with */
+#define AU_MIRROR_SECRET_SIZE 16
+
+/* Key of the mirrors in the GSocketService object data. They are kept there,
+ * instead of only in AuMirrorProxy, because the service outlives the
+ * AuMirrorProxy if there are requests still being forwarded. */
+#define AU_MIRROR_SET_KEY "au-mirror-set"
+
+typedef struct {
+   /* Base URL of the mirror, always with a trailing slash */
+   gchar *url;
+   /* Moving average of the transfer rate, in bytes per second, or 0 if the
+    * mirror has not been measured yet */
+   gdouble throughput;
+   /* Number of consecutive failed requests */
+   guint failures;
+} AuMirror;
+
+typedef struct {
+   /* Base URL of the peer chunk store, always with a trailing slash */
+   gchar *url;
+   /* Monotonic time before which the peer is not tried, because the last
+    * connection attempt failed */
+   gint64 retry_after;
+} AuMirrorPeer;
+
+/* Atomically reference counted with g_atomic_rc_box_acquire() */
+typedef struct {
+   GMutex lock;
+   AuMirror *mirrors;
+   gsize n_mirrors;
+   AuMirrorPeer *peers;
+   gsize n_peers;
+   /* Desync local chunk store, or %NULL */
+   gchar *chunk_cache;
+   gchar *http_proxy;
+   /* The first segment of every accepted request path. Anyone on this machine
+    * can connect to the proxy, but only who we gave its URL to knows this. */
+   gchar *secret;
+   /* Path of the update bundle, relative to the mirrors and with a leading
+    * slash, that can be fetched besides the chunks, or %NULL */
+   gchar *bundle_path;
+   /* Local copy of the update bundle, or %NULL */
+   gchar *bundle_file;
+} AuMirrorSet;
+
+typedef struct {
+   /* The transfer from the mirror */
+   CURL *curl;
+   /* The client connection, borrowed */
+   GOutputStream *output;
+   /* TRUE once the response headers have been sent to the client */
+   gboolean started;
+   /* Bytes of the body that have been forwarded to the client */
+   gsize sent;
+   /* Copy of the body to store in the local chunk cache, borrowed. It is set
+    * to %NULL if the body turns out to be too big. */
+   GByteArray *cache_body;
+   /* Set if writing to the client failed */
+   GError *error;
+} AuMirrorForward;
+
+struct _AuMirrorProxy {
+   GSocketService *service;
+   AuMirrorSet *set;
+   guint16 port;
+};
+
+static void
+_au_mirror_set_clear(AuMirrorSet *set)
+{
+   gsize i;
+
+   for (i = 0; i < set->n_mirrors; i++)
+      g_free(set->mirrors[i].url);
+
+   for (i = 0; i < set->n_peers; i++)
+      g_free(set->peers[i].url);
+
+   g_free(set->mirrors);
+   g_free(set->peers);
+   g_free(set->chunk_cache);
+   g_free(set->http_proxy);
+   g_free(set->secret);
+   g_free(set->bundle_path);
+   g_free(set->bundle_file);
+   g_mutex_clear(&set->lock);
+}
+
+static void
+_au_mirror_set_release(AuMirrorSet *set)
+{
+   g_atomic_rc_box_release_full(set, (GDestroyNotify)_au_mirror_set_clear);
+}
+
+static gchar *
+_au_mirror_normalize_url(const gchar *url)
+{
+   return g_strdup_printf("%s%s", url, g_str_has_suffix(url, "/") ? "" : "/");
+}
+
+/*
+ * au_mirror_proxy_is_valid_path:
+ * @path: (not nullable): The path of an HTTP request
+ *
+ * Check if @path can be safely appended to the base URL of a mirror. We only
+ * accept plain absolute paths, without queries, escapes or dot segments.
+ *
+ * Returns: %TRUE if @path is a valid store path
+ */
+gboolean
+au_mirror_proxy_is_valid_path(const gchar *path)
+{
+   g_auto(GStrv) segments = NULL;
+   gsize i;
+
+   g_return_val_if_fail(path != NULL, FALSE);
+
+   if (path[0] != '/' || path[1] == '\0')
+      return FALSE;
+
+   for (i = 0; path[i] != '\0'; i++) {
+      if (!g_ascii_isalnum(path[i]) && strchr("/-._~+", path[i]) == NULL)
+         return FALSE;
+   }
+
+   segments = g_strsplit(path + 1, "/", -1);
+   for (i = 0; segments[i] != NULL; i++) {
+      if (g_str_equal(segments[i], "") || g_str_equal(segments[i], ".") ||
+          g_str_equal(segments[i], ".."))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*
+ * _au_mirror_proxy_get_chunk_location:
+ * @path: (not nullable): The path of an HTTP request, without the secret
+ *
+ * Returns: (nullable): The end of @path with the location of the chunk in a
+ *  Desync local store, e.g. `/0123/0123....cacnk`, or %NULL if @path is not a
+ *  chunk path
+ */
+static const gchar *
+_au_mirror_proxy_get_chunk_location(const gchar *path)
+{
+   /* Same length as the paths accepted by au_peer_server_is_chunk_path() */
+   const gsize chunk_path_length = strlen("/0123/") + 64 + strlen(".cacnk");
+   gsize length;
+
+   if (!au_mirror_proxy_is_valid_path(path))
+      return NULL;
+
+   length = strlen(path);
+   if (length < chunk_path_length ||
+       !au_peer_server_is_chunk_path(path + length - chunk_path_length))
+      return NULL;
+
+   return path + length - chunk_path_length;
+}
+
+/*
+ * au_mirror_proxy_is_chunk_path:
+ * @path: (not nullable): The path of an HTTP request, without the secret
+ *
+ * Check if @path is the location of a chunk in a Desync store, i.e. a valid
+ * path that ends with `/<first 4 chars of the ID>/<ID>.cacnk`. The requests are
+ * sent with our netrc credentials, so nothing else can be fetched through
+ * the proxy.
+ *
+ * Returns: %TRUE if @path is a valid chunk path
+ */
+gboolean
+au_mirror_proxy_is_chunk_path(const gchar *path)
+{
+   g_return_val_if_fail(path != NULL, FALSE);
+
+   return _au_mirror_proxy_get_chunk_location(path) != NULL;
+}
+
+/*
+ * _au_mirror_proxy_new_secret:
+ * @error: Used to raise an error on failure
+ *
+ * Returns: (transfer full): A new random secret, in hex form, or %NULL on failure
+ */
+static gchar *
+_au_mirror_proxy_new_secret(GError **error)
+{
+   guint8 bytes[AU_MIRROR_SECRET_SIZE];
+   g_autoptr(GString) secret = g_string_sized_new(2 * AU_MIRROR_SECRET_SIZE);
+   gsize i;
+
+   if (getrandom(bytes, sizeof(bytes), 0) != sizeof(bytes)) {
+      int saved_errno = errno;
+
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                  "Unable to generate the mirror proxy secret: %s",
+                  g_strerror(saved_errno));
+      return NULL;
+   }
+
+   for (i = 0; i < sizeof(bytes); i++)
+      g_string_append_printf(secret, "%02x", bytes[i]);
+
+   return g_string_free(g_steal_pointer(&secret), FALSE);
+}
+
+/*
+ * _au_mirror_proxy_strip_secret:
+ * @path: (not nullable): The path of an HTTP request
+ * @secret: (not nullable): The secret that @path is expected to start with
+ *
+ * Returns: (nullable): The rest of @path, starting with a slash, or %NULL if
+ *  @path doesn't start with @secret
+ */
+static const gchar *
+_au_mirror_proxy_strip_secret(const gchar *path, const gchar *secret)
+{
+   gsize secret_length = strlen(secret);
+   guint8 difference = 0;
+   gsize i;
+
+   if (path[0] != '/' || strlen(path) < secret_length + 2 ||
+       path[secret_length + 1] != '/')
+      return NULL;
+
+   /* Compare the whole secret even after the first mismatch, to not tell
+    * how much of it has been guessed right */
+   for (i = 0; i < secret_length; i++)
+      difference |= path[i + 1] ^ secret[i];
+
+   if (difference != 0)
+      return NULL;
+
+   return path + secret_length + 1;
+}
+
+/*
+ * au_mirror_proxy_choose:
+ * @weights: (array length=n_mirrors): Share of the requests that each mirror
+ *  should receive, usually its measured throughput
+ * @excluded: (array length=n_mirrors): %TRUE for the mirrors that must not be
+ *  chosen, e.g. because they already failed this request
+ * @n_mirrors: Number of mirrors
+ * @random_value: A random number in the range [0, 1)
+ *
+ * Choose a mirror with a probability proportional to its weight.
+ *
+ * Returns: The index of the chosen mirror, or -1 if they are all excluded
+ */
+gint
+au_mirror_proxy_choose(const gdouble *weights,
+                       const gboolean *excluded,
+                       gsize n_mirrors,
+                       gdouble random_value)
+{
+   gdouble total = 0;
+   gdouble cumulative = 0;
+   gint last = -1;
+   gsize i;
+
+   g_return_val_if_fail(weights != NULL, -1);
+   g_return_val_if_fail(excluded != NULL, -1);
+
+   for (i = 0; i < n_mirrors; i++) {
+      if (excluded[i])
+         continue;
+
+      total += MAX(weights[i], 0);
+      last = i;
+   }
+
+   if (last < 0 || total <= 0)
+      return last;
+
+   for (i = 0; i < n_mirrors; i++) {
+      if (excluded[i])
+         continue;
+
+      cumulative += MAX(weights[i], 0);
+      if (random_value * total < cumulative)
+         return i;
+   }
+
+   /* Rounding errors, the random value was very close to 1 */
+   return last;
+}
+
+/*
+ * _au_mirror_set_get_weights:
+ * @set: (not nullable): The mirrors, with their lock held
+ * @weights: (out caller-allocates) (array length=set->n_mirrors): The current
+ *  weight of each mirror
+ */
+static void
+_au_mirror_set_get_weights(const AuMirrorSet *set, gdouble *weights)
+{
+   gdouble measured_sum = 0;
+   gsize measured = 0;
+   gdouble unmeasured_weight;
+   gsize i;
+
+   for (i = 0; i < set->n_mirrors; i++) {
+      if (set->mirrors[i].throughput > 0) {
+         measured_sum += set->mirrors[i].throughput;
+         measured++;
+      }
+   }
+
+   /* Give the mirrors that have not been measured yet the average share, so
+    * that they quickly get their own measure */
+   unmeasured_weight = measured > 0 ? measured_sum / measured : 1;
+
+   for (i = 0; i < set->n_mirrors; i++) {
+      const AuMirror *mirror = &set->mirrors[i];
+      gdouble weight = mirror->throughput > 0 ? mirror->throughput : unmeasured_weight;
+
+      /* Halve the share of a failing mirror for each consecutive failure */
+      weights[i] = weight / (1 << MIN(mirror->failures, AU_MIRROR_MAX_FAILURES));
+   }
+}
+
+/*
+ * _au_mirror_set_record:
+ * @set: (not nullable): The mirrors
+ * @index: Index of the mirror that served the request
+ * @success: %TRUE if the request succeeded
+ * @bytes: Bytes received
+ * @elapsed: Duration of the request, in microseconds
+ */
+static void
+_au_mirror_set_record(AuMirrorSet *set,
+                      gsize index,
+                      gboolean success,
+                      gsize bytes,
+                      gint64 elapsed)
+{
+   AuMirror *mirror = NULL;
+   g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&set->lock);
+
+   mirror = &set->mirrors[index];
+
+   if (!success) {
+      mirror->failures = MIN(mirror->failures + 1, AU_MIRROR_MAX_FAILURES);
+      return;
+   }
+
+   mirror->failures = 0;
+
+   if (bytes > 0 && elapsed > 0) {
+      gdouble rate = (gdouble)bytes * G_USEC_PER_SEC / elapsed;
+
+      if (mirror->throughput == 0)
+         mirror->throughput = rate;
+      else
+         mirror->throughput = (1 - AU_MIRROR_THROUGHPUT_SMOOTHING) * mirror->throughput +
+                              AU_MIRROR_THROUGHPUT_SMOOTHING * rate;
+   }
+}
+
+/*
+ * _au_mirror_proxy_send_ok:
+ * @output: (not nullable): The client connection
+ * @length: Length of the body, or -1 if it is not known, in which case the
+ *  client reads until the connection gets closed
+ * @error: Used to raise an error on failure
+ *
+ * Send the headers of a successful response to the client.
+ *
+ * Returns: %TRUE on success
+ */
+static gboolean
+_au_mirror_proxy_send_ok(GOutputStream *output, gint64 length, GError **error)
+{
+   g_autofree gchar *content_length = NULL;
+   g_autofree gchar *headers = NULL;
+
+   if (length >= 0)
+      content_length =
+         g_strdup_printf("Content-Length: %" G_GINT64_FORMAT "\r\n", length);
+
+   headers = g_strdup_printf("HTTP/1.1 200 OK\r\n"
+                             "Content-Type: application/octet-stream\r\n"
+                             "%s"
+                             "Connection: close\r\n"
+                             "\r\n",
+                             content_length != NULL ? content_length : "");
+
+   return g_output_stream_write_all(output, headers, strlen(headers), NULL, NULL, error);
+}
+
+/*
+ * _au_mirror_forward_start:
+ * @forward: (not nullable): The response being forwarded
+ *
+ * Send the response headers to the client, with the length of the body
+ * announced by the mirror, if any.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE with @forward->error set
+ */
+static gboolean
+_au_mirror_forward_start(AuMirrorForward *forward)
+{
+   curl_off_t length = -1;
+
+   forward->started = TRUE;
+
+   curl_easy_getinfo(forward->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+
+   return _au_mirror_proxy_send_ok(forward->output, (gint64)length, &forward->error);
+}
+
+static size_t
+_au_mirror_write_cb(char *ptr, size_t size, size_t nmemb, void *user_data)
+{
+   AuMirrorForward *forward = user_data;
+   gsize length = size * nmemb;
+   long status = 0;
+
+   /* Error pages are not forwarded, the request gets retried on another mirror */
+   curl_easy_getinfo(forward->curl, CURLINFO_RESPONSE_CODE, &status);
+   if (status < 200 || status >= 300)
+      return length;
+
+   /* Returning a different length makes libcurl abort the transfer */
+   if (!forward->started && !_au_mirror_forward_start(forward))
+      return 0;
+
+   if (!g_output_stream_write_all(forward->output, ptr, length, NULL, NULL,
+                                  &forward->error))
+      return 0;
+
+   forward->sent += length;
+
+   if (forward->cache_body != NULL) {
+      if (forward->cache_body->len + length > AU_MIRROR_MAX_CACHED_CHUNK_SIZE)
+         forward->cache_body = NULL;
+      else
+         g_byte_array_append(forward->cache_body, (const guint8 *)ptr, length);
+   }
+
+   return length;
+}
+
+/*
+ * _au_mirror_fetch:
+ * @url: (not nullable): The URL to fetch
+ * @http_proxy: (nullable): The HTTP proxy to use
+ * @use_netrc: %TRUE to authenticate with the credentials from netrc, if any
+ * @connect_timeout: Seconds to wait for the connection
+ * @is_head: %TRUE to only fetch the headers
+ * @forward: (not nullable): Where to forward a successful response
+ * @error: Used to raise an error on failure
+ *
+ * Successful responses are streamed to the client while they are being
+ * received, instead of being kept in memory. If @forward->started is %TRUE
+ * after this call, the response has been, at least partially, sent.
+ *
+ * Returns: The HTTP status of the response, or 0 if the mirror could not be
+ *  reached
+ */
+static glong
+_au_mirror_fetch(const gchar *url,
+                 const gchar *http_proxy,
+                 gboolean use_netrc,
+                 glong connect_timeout,
+                 gboolean is_head,
+                 AuMirrorForward *forward,
+                 GError **error)
+{
+   g_autoptr(CURL) curl = NULL;
+   CURLcode r;
+   long status = 0;
+
+   curl = curl_easy_init();
+   if (curl == NULL) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Libcurl failed to initialize");
+      return 0;
+   }
+
+   curl_easy_setopt(curl, CURLOPT_URL, url);
+   curl_easy_setopt(curl, CURLOPT_NETRC,
+                    use_netrc ? CURL_NETRC_OPTIONAL : CURL_NETRC_IGNORED);
+   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+   curl_easy_setopt(curl, CURLOPT_NOBODY, is_head ? 1L : 0L);
+   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _au_mirror_write_cb);
+   curl_easy_setopt(curl, CURLOPT_WRITEDATA, forward);
+   curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, connect_timeout);
+   /* Give up on a mirror that stalls, so that the chunk can be retried elsewhere */
+   curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+   curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+
+   if (http_proxy != NULL)
+      curl_easy_setopt(curl, CURLOPT_PROXY, http_proxy);
+
+   forward->curl = curl;
+   r = curl_easy_perform(curl);
+   if (r != CURLE_OK) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s", curl_easy_strerror(r));
+      return 0;
+   }
+
+   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+
+   /* HEAD requests, and empty bodies, never reach the write callback */
+   if (status >= 200 && status < 300 && !forward->started &&
+       !_au_mirror_forward_start(forward)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s", forward->error->message);
+      return 0;
+   }
+
+   return status;
+}
+
+static gboolean
+_au_mirror_proxy_send_status(GOutputStream *output,
+                             guint status,
+                             const gchar *reason,
+                             GError **error)
+{
+   g_autofree gchar *response = NULL;
+
+   response = g_strdup_printf("HTTP/1.1 %u %s\r\n"
+                              "Content-Length: 0\r\n"
+                              "Connection: close\r\n"
+                              "\r\n",
+                              status, reason);
+
+   return g_output_stream_write_all(output, response, strlen(response), NULL, NULL,
+                                    error);
+}
+
+/*
+ * _au_mirror_proxy_send_file:
+ * @path: (not nullable): The local file to send
+ * @is_head: %TRUE to only send the headers
+ * @output: (not nullable): The client connection
+ * @found: (out): Set to %TRUE if @path is a regular file and a response has
+ *  been, at least partially, sent
+ * @error: Used to raise an error on failure
+ *
+ * Returns: %TRUE on success, including when @path doesn't exist
+ */
+static gboolean
+_au_mirror_proxy_send_file(const gchar *path,
+                           gboolean is_head,
+                           GOutputStream *output,
+                           gboolean *found,
+                           GError **error)
+{
+   g_autoptr(GInputStream) file_stream = NULL;
+   struct stat stat_buf;
+   int fd;
+
+   *found = FALSE;
+
+   fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd < 0)
+      return TRUE;
+
+   file_stream = g_unix_input_stream_new(fd, TRUE);
+
+   if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode))
+      return TRUE;
+
+   *found = TRUE;
+
+   if (!_au_mirror_proxy_send_ok(output, stat_buf.st_size, error))
+      return FALSE;
+
+   if (is_head)
+      return TRUE;
+
+   return g_output_stream_splice(output, file_stream, G_OUTPUT_STREAM_SPLICE_NONE,
+                                 NULL, error) >= 0;
+}
+
+/*
+ * _au_mirror_proxy_store_cached_chunk:
+ * @chunk_cache: (not nullable): The Desync local chunk store
+ * @location: (not nullable): The location of the chunk in @chunk_cache
+ * @body: (not nullable): The chunk, as received from the images server
+ *
+ * Add the chunk to @chunk_cache, so that it can be served to the peers. The
+ * chunk cache is an optimization, so any error here is not fatal.
+ */
+static void
+_au_mirror_proxy_store_cached_chunk(const gchar *chunk_cache,
+                                    const gchar *location,
+                                    const GByteArray *body)
+{
+   g_autofree gchar *chunk_path = NULL;
+   g_autofree gchar *chunk_dir = NULL;
+   g_autoptr(GError) error = NULL;
+
+   chunk_path = g_build_filename(chunk_cache, location, NULL);
+   chunk_dir = g_path_get_dirname(chunk_path);
+
+   if (g_mkdir_with_parents(chunk_dir, 0755) != 0) {
+      g_debug("Unable to create the chunk cache directory %s: %s", chunk_dir,
+              g_strerror(errno));
+      return;
+   }
+
+   if (!g_file_set_contents_full(chunk_path, (const gchar *)body->data, body->len,
+                                 G_FILE_SET_CONTENTS_CONSISTENT, 0644, &error))
+      g_debug("Failed to add %s to the chunk cache: %s", location, error->message);
+}
+
+/*
+ * _au_mirror_proxy_try_peers:
+ * @set: (not nullable): The mirrors
+ * @location: (not nullable): The location of the chunk in a Desync local store
+ * @is_head: %TRUE to only fetch the headers
+ * @output: (not nullable): The client connection
+ * @sent: (out): Set to %TRUE if one of the peers had the chunk, and a
+ *  response has been, at least partially, sent
+ * @error: Used to raise an error on failure
+ *
+ * Try to fetch the chunk from the peers, in order. A peer that doesn't have
+ * the chunk is not a problem, but one that can't be reached is skipped for
+ * the next %AU_MIRROR_PEER_BACKOFF seconds. The peers are in the local
+ * network, so they are never reached through the HTTP proxy, and never with
+ * our credentials.
+ *
+ * Returns: %TRUE on success, including when no peer has the chunk
+ */
+static gboolean
+_au_mirror_proxy_try_peers(AuMirrorSet *set,
+                           const gchar *location,
+                           gboolean is_head,
+                           GOutputStream *output,
+                           gboolean *sent,
+                           GError **error)
+{
+   g_autoptr(GPtrArray) peers = g_ptr_array_new_with_free_func(g_free);
+   gint64 now = g_get_monotonic_time();
+   gsize i;
+
+   *sent = FALSE;
+
+   /* The peers can be replaced while we wait for them, so take a copy */
+   g_mutex_lock(&set->lock);
+   for (i = 0; i < set->n_peers; i++) {
+      if (set->peers[i].retry_after <= now)
+         g_ptr_array_add(peers, g_strdup(set->peers[i].url));
+   }
+   g_mutex_unlock(&set->lock);
+
+   for (i = 0; i < peers->len; i++) {
+      const gchar *peer = g_ptr_array_index(peers, i);
+      g_autofree gchar *url = g_strconcat(peer, location + 1, NULL);
+      g_autoptr(GError) fetch_error = NULL;
+      AuMirrorForward forward = { .output = output };
+      glong status;
+      gsize j;
+
+      status = _au_mirror_fetch(url, NULL, FALSE, AU_MIRROR_PEER_CONNECT_TIMEOUT,
+                                is_head, &forward, &fetch_error);
+
+      if (forward.error != NULL) {
+         g_propagate_error(error, g_steal_pointer(&forward.error));
+         return FALSE;
+      }
+
+      if (forward.started) {
+         *sent = TRUE;
+
+         if (fetch_error != NULL) {
+            g_propagate_error(error, g_steal_pointer(&fetch_error));
+            return FALSE;
+         }
+
+         return TRUE;
+      }
+
+      if (status != 0)
+         continue;
+
+      g_debug("Unable to reach the peer for %s: %s", url, fetch_error->message);
+
+      g_mutex_lock(&set->lock);
+      for (j = 0; j < set->n_peers; j++) {
+         if (g_str_equal(peer, set->peers[j].url))
+            set->peers[j].retry_after =
+               g_get_monotonic_time() + AU_MIRROR_PEER_BACKOFF * G_USEC_PER_SEC;
+      }
+      g_mutex_unlock(&set->lock);
+   }
+
+   return TRUE;
+}
+
+/*
+ * _au_mirror_proxy_handle_request:
+ * @set: (not nullable): The mirrors
+ * @connection: (not nullable): The client connection
+ * @error: Used to raise an error on failure
+ *
+ * Forward a single HTTP request to one of the mirrors, chosen proportionally
+ * to their measured throughput. If the mirror fails before sending a
+ * successful response, the request is retried on the mirrors that have not
+ * been tried yet. Only the requests that start with the current secret, for a
+ * chunk or for the current update bundle, are forwarded. Like in the peer
+ * server, we only support GET and HEAD, and the connection is always closed
+ * after the response.
+ *
+ * The chunks are first looked up in the local chunk cache, then in the peers,
+ * and only then requested to the mirrors. The chunks received from the mirrors
+ * are added to the local chunk cache, the ones received from the peers are
+ * not, to avoid spreading the corrupted chunks of a peer. Likewise, the update
+ * bundle is served from its local copy, if we have one.
+ *
+ * Returns: %TRUE if a response has been sent
+ */
+static gboolean
+_au_mirror_proxy_handle_request(AuMirrorSet *set,
+                                GSocketConnection *connection,
+                                GError **error)
+{
+   GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+   GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+   g_autoptr(GError) local_error = NULL;
+   g_autofree gchar *request_line = NULL;
+   g_autofree gboolean *tried = NULL;
+   g_autofree gdouble *weights = NULL;
+   g_auto(GStrv) request = NULL;
+   gboolean is_head;
+   gboolean not_found = FALSE;
+   g_autofree gchar *secret = NULL;
+   g_autofree gchar *bundle_path = NULL;
+   g_autofree gchar *bundle_file = NULL;
+   g_autofree gchar *chunk_cache = NULL;
+   const gchar *path;
+   const gchar *location;
+   gsize attempt;
+
+   /* Skip the request headers. The authentication, if any, comes from netrc. */
+   request_line = _au_http_read_request_line(input, AU_MIRROR_PROXY_MAX_LINE_LENGTH,
+                                             AU_MIRROR_PROXY_MAX_HEADERS, &local_error);
+   if (request_line == NULL) {
+      if (g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE))
+         return _au_mirror_proxy_send_status(output, 400, "Bad Request", error);
+
+      g_propagate_error(error, g_steal_pointer(&local_error));
+      return FALSE;
+   }
+
+   request = g_strsplit(request_line, " ", 0);
+   if (g_strv_length(request) != 3 || !g_str_has_prefix(request[2], "HTTP/1."))
+      return _au_mirror_proxy_send_status(output, 400, "Bad Request", error);
+
+   is_head = g_str_equal(request[0], "HEAD");
+   if (!is_head && !g_str_equal(request[0], "GET"))
+      return _au_mirror_proxy_send_status(output, 405, "Method Not Allowed", error);
+
+   g_mutex_lock(&set->lock);
+   secret = g_strdup(set->secret);
+   bundle_path = g_strdup(set->bundle_path);
+   bundle_file = g_strdup(set->bundle_file);
+   chunk_cache = g_strdup(set->chunk_cache);
+   g_mutex_unlock(&set->lock);
+
+   path = _au_mirror_proxy_strip_secret(request[1], secret);
+   if (path == NULL)
+      return _au_mirror_proxy_send_status(output, 403, "Forbidden", error);
+
+   if (!au_mirror_proxy_is_valid_path(path))
+      return _au_mirror_proxy_send_status(output, 400, "Bad Request", error);
+
+   location = _au_mirror_proxy_get_chunk_location(path);
+   if (location == NULL && g_strcmp0(path, bundle_path) != 0)
+      return _au_mirror_proxy_send_status(output, 404, "Not Found", error);
+
+   if (location == NULL && bundle_file != NULL) {
+      gboolean sent = FALSE;
+
+      if (!_au_mirror_proxy_send_file(bundle_file, is_head, output, &sent, error))
+         return FALSE;
+
+      if (sent)
+         return TRUE;
+   }
+
+   if (location != NULL) {
+      g_autofree gchar *cached_chunk = NULL;
+      gboolean sent = FALSE;
+
+      if (chunk_cache != NULL) {
+         cached_chunk = g_build_filename(chunk_cache, location, NULL);
+         if (!_au_mirror_proxy_send_file(cached_chunk, is_head, output, &sent, error))
+            return FALSE;
+      }
+
+      if (!sent && !_au_mirror_proxy_try_peers(set, location, is_head, output, &sent,
+                                               error))
+         return FALSE;
+
+      if (sent)
+         return TRUE;
+   }
+
+   tried = g_new0(gboolean, set->n_mirrors);
+   weights = g_new0(gdouble, set->n_mirrors);
+
+   for (attempt = 0; attempt < set->n_mirrors; attempt++) {
+      g_autofree gchar *url = NULL;
+      g_autofree gchar *http_proxy = NULL;
+      g_autoptr(GError) fetch_error = NULL;
+      g_autoptr(GByteArray) cache_body = NULL;
+      AuMirrorForward forward = { .output = output };
+      gint64 start;
+      glong status;
+      gint chosen;
+
+      g_mutex_lock(&set->lock);
+      _au_mirror_set_get_weights(set, weights);
+      chosen = au_mirror_proxy_choose(weights, tried, set->n_mirrors, g_random_double());
+      /* Skip the leading slash, the base URL already has a trailing one */
+      url = g_strconcat(set->mirrors[chosen].url, path + 1, NULL);
+      http_proxy = g_strdup(set->http_proxy);
+      g_mutex_unlock(&set->lock);
+
+      tried[chosen] = TRUE;
+
+      if (location != NULL && chunk_cache != NULL && !is_head) {
+         cache_body = g_byte_array_new();
+         forward.cache_body = cache_body;
+      }
+
+      start = g_get_monotonic_time();
+      status = _au_mirror_fetch(url, http_proxy, TRUE, AU_MIRROR_CONNECT_TIMEOUT, is_head,
+                                &forward, &fetch_error);
+
+      if (forward.error != NULL) {
+         /* The client went away, it's not the mirror's fault */
+         g_propagate_error(error, g_steal_pointer(&forward.error));
+         return FALSE;
+      }
+
+      if (forward.started) {
+         /* The response is already on its way to the client, it's too late to
+          * retry on another mirror */
+         _au_mirror_set_record(set, chosen, fetch_error == NULL, forward.sent,
+                               g_get_monotonic_time() - start);
+
+         if (fetch_error != NULL) {
+            g_propagate_error(error, g_steal_pointer(&fetch_error));
+            return FALSE;
+         }
+
+         if (forward.cache_body != NULL && forward.cache_body->len > 0)
+            _au_mirror_proxy_store_cached_chunk(chunk_cache, location,
+                                                forward.cache_body);
+
+         return TRUE;
+      }
+
+      if (status == 404) {
+         /* The mirror might not be fully synchronized yet, it's not its fault */
+         g_debug("%s is not available", url);
+         not_found = TRUE;
+         continue;
+      }
+
+      _au_mirror_set_record(set, chosen, FALSE, 0, 0);
+
+      if (fetch_error != NULL)
+         g_debug("Failed to fetch %s: %s", url, fetch_error->message);
+      else
+         g_debug("Failed to fetch %s: HTTP status %ld", url, status);
+   }
+
+   if (not_found)
+      return _au_mirror_proxy_send_status(output, 404, "Not Found", error);
+
+   return _au_mirror_proxy_send_status(output, 502, "Bad Gateway", error);
+}
+
+static gboolean
+_au_mirror_proxy_run_cb(GThreadedSocketService *service,
+                        GSocketConnection *connection,
+                        GObject *source_object,
+                        gpointer user_data)
+{
+   AuMirrorSet *set = g_object_get_data(G_OBJECT(service), AU_MIRROR_SET_KEY);
+   g_autoptr(GError) error = NULL;
+
+   g_socket_set_timeout(g_socket_connection_get_socket(connection),
+                        AU_MIRROR_PROXY_TIMEOUT);
+
+   if (!_au_mirror_proxy_handle_request(set, connection, &error))
+      g_debug("Failed to forward a chunk request: %s", error->message);
+
+   g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+
+   return TRUE;
+}
+
+/*
+ * au_mirror_proxy_new:
+ * @mirrors: (array zero-terminated=1) (not nullable): Base URLs of servers
+ *  that have the same content
+ * @error: Used to raise an error on failure
+ *
+ * Start a local HTTP proxy that spreads the requests it receives across
+ * @mirrors, in proportion to their measured throughput, and retries the
+ * failed requests on the other mirrors. Pointing Desync to this proxy lets
+ * it download the chunks from all the mirrors at once, instead of being
+ * capped by the speed of a single server. The proxy only listens on the
+ * loopback interface, only serves chunks and the bundle set with
+ * au_mirror_proxy_set_bundle(), and only to the clients that know its URL,
+ * see au_mirror_proxy_dup_url(). The chunks are first looked up in the
+ * sources set with au_mirror_proxy_set_chunk_cache() and
+ * au_mirror_proxy_set_peers(). Its incoming connections are accepted from the
+ * thread-default main context.
+ *
+ * Returns: (transfer full): A new AuMirrorProxy, or %NULL on failure
+ */
+AuMirrorProxy *
+au_mirror_proxy_new(const gchar *const *mirrors, GError **error)
+{
+   g_autoptr(AuMirrorProxy) self = NULL;
+   g_autoptr(GInetAddress) loopback = NULL;
+   g_autoptr(GSocketAddress) address = NULL;
+   g_autoptr(GSocketAddress) effective_address = NULL;
+   gsize n_mirrors;
+   gsize i;
+
+   g_return_val_if_fail(mirrors != NULL, NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   n_mirrors = g_strv_length((gchar **)mirrors);
+   if (n_mirrors == 0) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "At least one mirror is required");
+      return NULL;
+   }
+
+   self = g_new0(AuMirrorProxy, 1);
+   self->set = g_atomic_rc_box_new0(AuMirrorSet);
+   g_mutex_init(&self->set->lock);
+   self->set->secret = _au_mirror_proxy_new_secret(error);
+   if (self->set->secret == NULL)
+      return NULL;
+
+   self->set->n_mirrors = n_mirrors;
+   self->set->mirrors = g_new0(AuMirror, n_mirrors);
+   for (i = 0; i < n_mirrors; i++)
+      self->set->mirrors[i].url = _au_mirror_normalize_url(mirrors[i]);
+
+   self->service = g_threaded_socket_service_new(AU_MIRROR_PROXY_MAX_THREADS);
+   g_object_set_data_full(G_OBJECT(self->service), AU_MIRROR_SET_KEY,
+                          g_atomic_rc_box_acquire(self->set),
+                          (GDestroyNotify)_au_mirror_set_release);
+
+   /* Only the update helper, on this same machine, is expected to connect */
+   loopback = g_inet_address_new_loopback(G_SOCKET_FAMILY_IPV4);
+   address = g_inet_socket_address_new(loopback, 0);
+   if (!g_socket_listener_add_address(G_SOCKET_LISTENER(self->service), address,
+                                      G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP, NULL,
+                                      &effective_address, error))
+      return NULL;
+
+   self->port =
+      g_inet_socket_address_get_port(G_INET_SOCKET_ADDRESS(effective_address));
+
+   g_signal_connect(self->service, "run", G_CALLBACK(_au_mirror_proxy_run_cb), NULL);
+   g_socket_service_start(self->service);
+
+   g_debug("Spreading the chunk requests across %" G_GSIZE_FORMAT
+           " mirrors, from port %u",
+           n_mirrors, self->port);
+
+   return g_steal_pointer(&self);
+}
+
+void
+au_mirror_proxy_free(AuMirrorProxy *self)
+{
+   if (self == NULL)
+      return;
+
+   if (self->service != NULL) {
+      g_socket_service_stop(self->service);
+      g_socket_listener_close(G_SOCKET_LISTENER(self->service));
+      g_object_unref(self->service);
+   }
+
+   if (self->set != NULL)
+      _au_mirror_set_release(self->set);
+
+   g_free(self);
+}
+
+/*
+ * au_mirror_proxy_has_mirrors:
+ * @self: (not nullable): The AuMirrorProxy
+ * @mirrors: (array zero-terminated=1) (not nullable): Base URLs of servers
+ *
+ * Returns: %TRUE if @self spreads the requests across exactly @mirrors
+ */
+gboolean
+au_mirror_proxy_has_mirrors(const AuMirrorProxy *self, const gchar *const *mirrors)
+{
+   gsize i;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(mirrors != NULL, FALSE);
+
+   if (g_strv_length((gchar **)mirrors) != self->set->n_mirrors)
+      return FALSE;
+
+   for (i = 0; mirrors[i] != NULL; i++) {
+      g_autofree gchar *url = _au_mirror_normalize_url(mirrors[i]);
+
+      if (!g_str_equal(url, self->set->mirrors[i].url))
+         return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*
+ * au_mirror_proxy_set_http_proxy:
+ * @self: (not nullable): The AuMirrorProxy
+ * @http_proxy: (nullable): The HTTP proxy to use to reach the mirrors
+ */
+void
+au_mirror_proxy_set_http_proxy(AuMirrorProxy *self, const gchar *http_proxy)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+
+   g_return_if_fail(self != NULL);
+
+   locker = g_mutex_locker_new(&self->set->lock);
+   g_free(self->set->http_proxy);
+   self->set->http_proxy = g_strdup(http_proxy);
+}
+
+/*
+ * au_mirror_proxy_set_peers:
+ * @self: (not nullable): The AuMirrorProxy
+ * @peers: (array zero-terminated=1) (nullable): Base URLs of the chunk stores
+ *  of the other devices in the local network, see AuPeerServer
+ *
+ * Let the proxy try @peers, in order, before the mirrors for every chunk.
+ */
+void
+au_mirror_proxy_set_peers(AuMirrorProxy *self, const gchar *const *peers)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+   gsize n_peers;
+   gsize i;
+
+   g_return_if_fail(self != NULL);
+
+   n_peers = peers == NULL ? 0 : g_strv_length((gchar **)peers);
+
+   locker = g_mutex_locker_new(&self->set->lock);
+
+   /* Keep the backoff of the peers that we already know */
+   if (n_peers == self->set->n_peers) {
+      for (i = 0; i < n_peers; i++) {
+         g_autofree gchar *url = _au_mirror_normalize_url(peers[i]);
+
+         if (!g_str_equal(url, self->set->peers[i].url))
+            break;
+      }
+
+      if (i == n_peers)
+         return;
+   }
+
+   for (i = 0; i < self->set->n_peers; i++)
+      g_free(self->set->peers[i].url);
+   g_free(self->set->peers);
+
+   self->set->n_peers = n_peers;
+   self->set->peers = g_new0(AuMirrorPeer, n_peers);
+   for (i = 0; i < n_peers; i++)
+      self->set->peers[i].url = _au_mirror_normalize_url(peers[i]);
+}
+
+/*
+ * au_mirror_proxy_set_chunk_cache:
+ * @self: (not nullable): The AuMirrorProxy
+ * @chunk_cache: (nullable): The Desync local chunk store, or %NULL
+ *
+ * Serve the chunks that are in @chunk_cache without forwarding the request,
+ * and add the chunks received from the mirrors to it.
+ */
+void
+au_mirror_proxy_set_chunk_cache(AuMirrorProxy *self, const gchar *chunk_cache)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+
+   g_return_if_fail(self != NULL);
+
+   locker = g_mutex_locker_new(&self->set->lock);
+   g_free(self->set->chunk_cache);
+   self->set->chunk_cache = g_strdup(chunk_cache);
+}
+
+/*
+ * au_mirror_proxy_set_bundle:
+ * @self: (not nullable): The AuMirrorProxy
+ * @bundle_path: (nullable): Path of the bundle of the update being installed,
+ *  relative to the mirrors, or %NULL
+ * @bundle_file: (nullable): Local copy of the bundle, e.g. downloaded in
+ *  advance, or %NULL to fetch it from the mirrors
+ *
+ * Desync takes its chunk store from the location of the update bundle, so the
+ * helper needs to fetch the bundle from the proxy too. Let it fetch
+ * @bundle_path, and only that, besides the chunks.
+ *
+ * Returns: %TRUE on success, %FALSE if @bundle_path is not a valid path
+ */
+gboolean
+au_mirror_proxy_set_bundle(AuMirrorProxy *self,
+                           const gchar *bundle_path,
+                           const gchar *bundle_file)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+   g_autofree gchar *path = NULL;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+
+   if (bundle_path != NULL) {
+      while (bundle_path[0] == '/')
+         bundle_path++;
+
+      path = g_strconcat("/", bundle_path, NULL);
+      if (!au_mirror_proxy_is_valid_path(path))
+         return FALSE;
+   }
+
+   locker = g_mutex_locker_new(&self->set->lock);
+   g_free(self->set->bundle_path);
+   self->set->bundle_path = g_steal_pointer(&path);
+   g_free(self->set->bundle_file);
+   self->set->bundle_file = bundle_path != NULL ? g_strdup(bundle_file) : NULL;
+
+   return TRUE;
+}
+
+/*
+ * au_mirror_proxy_renew_secret:
+ * @self: (not nullable): The AuMirrorProxy
+ * @error: Used to raise an error on failure
+ *
+ * Replace the secret part of the proxy URL, so that the URLs returned until
+ * now stop working. This is expected to be called before every update.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+au_mirror_proxy_renew_secret(AuMirrorProxy *self, GError **error)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+   gchar *secret = NULL;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   secret = _au_mirror_proxy_new_secret(error);
+   if (secret == NULL)
+      return FALSE;
+
+   locker = g_mutex_locker_new(&self->set->lock);
+   g_free(self->set->secret);
+   self->set->secret = secret;
+
+   return TRUE;
+}
+
+/*
+ * au_mirror_proxy_dup_url:
+ * @self: (not nullable): The AuMirrorProxy
+ *
+ * The URL includes the current secret, so it must only be given to the
+ * update helper, e.g. in a file that only root can read.
+ *
+ * Returns: (transfer full): The base URL to use in place of the mirrors
+ */
+gchar *
+au_mirror_proxy_dup_url(AuMirrorProxy *self)
+{
+   g_autoptr(GMutexLocker) locker = NULL;
+
+   g_return_val_if_fail(self != NULL, NULL);
+
+   locker = g_mutex_locker_new(&self->set->lock);
+
+   return g_strdup_printf("http://127.0.0.1:%u/%s/", self->port, self->set->secret);
+}
@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+#include <glib.h>
+
+typedef struct _AuMirrorProxy AuMirrorProxy;
+
+AuMirrorProxy *au_mirror_proxy_new(const gchar *const *mirrors, GError **error);
+void au_mirror_proxy_free(AuMirrorProxy *self);
+gboolean au_mirror_proxy_has_mirrors(const AuMirrorProxy *self,
+                                     const gchar *const *mirrors);
+void au_mirror_proxy_set_http_proxy(AuMirrorProxy *self, const gchar *http_proxy);
+void au_mirror_proxy_set_peers(AuMirrorProxy *self, const gchar *const *peers);
+void au_mirror_proxy_set_chunk_cache(AuMirrorProxy *self, const gchar *chunk_cache);
+gboolean au_mirror_proxy_set_bundle(AuMirrorProxy *self,
+                                    const gchar *bundle_path,
+                                    const gchar *bundle_file);
+gboolean au_mirror_proxy_renew_secret(AuMirrorProxy *self, GError **error);
+gchar *au_mirror_proxy_dup_url(AuMirrorProxy *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuMirrorProxy, au_mirror_proxy_free)
+
+gboolean au_mirror_proxy_is_valid_path(const gchar *path);
+gboolean au_mirror_proxy_is_chunk_path(const gchar *path);
+gint au_mirror_proxy_choose(const gdouble *weights,
+                            const gboolean *excluded,
+                            gsize n_mirrors,
+                            gdouble random_value);
@@ -0,0 +1,298 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+#include <glib.h>
+
+#include "peer-server.h"
+#include "utils.h"
+
+/* Maximum number of requests served at the same time */
+const gint AU_PEER_SERVER_MAX_THREADS = 8;
+/* Requests are small, anything longer than this is not something we expect */
+const gsize AU_PEER_SERVER_MAX_LINE_LENGTH = 1024;
+/* Desync only sends a handful of headers */
+const guint AU_PEER_SERVER_MAX_HEADERS = 32;
+/* Seconds of inactivity after which a connection gets dropped */
+const guint AU_PEER_SERVER_TIMEOUT = 10;
+
+/* Key of the chunks directory in the GSocketService object data. It is kept there,
+ * instead of in AuPeerServer, because the service outlives the AuPeerServer
+ * if there are requests still being served. */
+#define AU_CHUNKS_DIR_KEY "au-chunks-dir"
+
+/* Desync chunk IDs are SHA512/256 hashes, in hex form */
+#define AU_CHUNK_ID_LENGTH 64
+#define AU_CHUNK_SUFFIX ".cacnk"
+
+struct _AuPeerServer {
+   GSocketService *service;
+   gchar *chunks_dir;
+   guint16 port;
+};
+
+/*
+ * au_peer_server_is_chunk_path:
+ * @path: (not nullable): The path of an HTTP request
+ *
+ * Check if @path is the location of a chunk in a Desync local store, i.e.
+ * `/<first 4 chars of the ID>/<ID>.cacnk`. Because we only accept lowercase
+ * hex digits, there is no way for @path to point outside of the store.
+ *
+ * Returns: %TRUE if @path is a valid chunk path
+ */
+gboolean
+au_peer_server_is_chunk_path(const gchar *path)
+{
+   const gchar *id;
+   gsize i;
+
+   g_return_val_if_fail(path != NULL, FALSE);
+
+   if (strlen(path) != 1 + 4 + 1 + AU_CHUNK_ID_LENGTH + strlen(AU_CHUNK_SUFFIX))
+      return FALSE;
+
+   if (path[0] != '/' || path[5] != '/')
+      return FALSE;
+
+   id = path + 6;
+
+   if (strncmp(path + 1, id, 4) != 0)
+      return FALSE;
+
+   for (i = 0; i < AU_CHUNK_ID_LENGTH; i++) {
+      if (!g_ascii_isxdigit(id[i]) || g_ascii_isupper(id[i]))
+         return FALSE;
+   }
+
+   return g_str_equal(id + AU_CHUNK_ID_LENGTH, AU_CHUNK_SUFFIX);
+}
+
+static gboolean
+_au_peer_server_send_status(GOutputStream *output,
+                            guint status,
+                            const gchar *reason,
+                            GError **error)
+{
+   g_autofree gchar *response = NULL;
+
+   response = g_strdup_printf("HTTP/1.1 %u %s\r\n"
+                              "Content-Length: 0\r\n"
+                              "Connection: close\r\n"
+                              "\r\n",
+                              status, reason);
+
+   return g_output_stream_write_all(output, response, strlen(response), NULL, NULL,
+                                    error);
+}
+
+/*
+ * _au_peer_server_handle_request:
+ * @chunks_dir: (not nullable): Path to the Desync local chunk store
+ * @connection: (not nullable): The client connection
+ * @error: Used to raise an error on failure
+ *
+ * Serve a single HTTP request. We only support GET and HEAD of chunks,
+ * everything else is rejected. The connection is always closed after
+ * the response, to keep the implementation as simple as possible.
+ *
+ * Returns: %TRUE if a response has been sent
+ */
+static gboolean
+_au_peer_server_handle_request(const gchar *chunks_dir,
+                               GSocketConnection *connection,
+                               GError **error)
+{
+   GInputStream *input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+   GOutputStream *output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+   g_autoptr(GInputStream) chunk_stream = NULL;
+   g_autoptr(GError) local_error = NULL;
+   g_autofree gchar *request_line = NULL;
+   g_autofree gchar *chunk_path = NULL;
+   g_autofree gchar *headers = NULL;
+   g_auto(GStrv) request = NULL;
+   gboolean is_head;
+   struct stat stat_buf;
+   int fd;
+
+   /* We don't need any of the request headers, they are just skipped */
+   request_line = _au_http_read_request_line(input, AU_PEER_SERVER_MAX_LINE_LENGTH,
+                                             AU_PEER_SERVER_MAX_HEADERS, &local_error);
+   if (request_line == NULL) {
+      if (g_error_matches(local_error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE))
+         return _au_peer_server_send_status(output, 400, "Bad Request", error);
+
+      g_propagate_error(error, g_steal_pointer(&local_error));
+      return FALSE;
+   }
+
+   request = g_strsplit(request_line, " ", 0);
+   if (g_strv_length(request) != 3 || !g_str_has_prefix(request[2], "HTTP/1."))
+      return _au_peer_server_send_status(output, 400, "Bad Request", error);
+
+   is_head = g_str_equal(request[0], "HEAD");
+   if (!is_head && !g_str_equal(request[0], "GET"))
+      return _au_peer_server_send_status(output, 405, "Method Not Allowed", error);
+
+   if (!au_peer_server_is_chunk_path(request[1]))
+      return _au_peer_server_send_status(output, 404, "Not Found", error);
+
+   chunk_path = g_build_filename(chunks_dir, request[1], NULL);
+
+   fd = open(chunk_path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+   if (fd < 0)
+      return _au_peer_server_send_status(output, 404, "Not Found", error);
+
+   chunk_stream = g_unix_input_stream_new(fd, TRUE);
+
+   if (fstat(fd, &stat_buf) != 0 || !S_ISREG(stat_buf.st_mode))
+      return _au_peer_server_send_status(output, 404, "Not Found", error);
+
+   headers = g_strdup_printf("HTTP/1.1 200 OK\r\n"
+                             "Content-Type: application/octet-stream\r\n"
+                             "Content-Length: %" G_GINT64_FORMAT "\r\n"
+                             "Connection: close\r\n"
+                             "\r\n",
+                             (gint64)stat_buf.st_size);
+
+   if (!g_output_stream_write_all(output, headers, strlen(headers), NULL, NULL, error))
+      return FALSE;
+
+   if (is_head)
+      return TRUE;
+
+   return g_output_stream_splice(output, chunk_stream,
+                                 G_OUTPUT_STREAM_SPLICE_CLOSE_SOURCE, NULL, error) >= 0;
+}
+
+static gboolean
+_au_peer_server_run_cb(GThreadedSocketService *service,
+                       GSocketConnection *connection,
+                       GObject *source_object,
+                       gpointer user_data)
+{
+   const gchar *chunks_dir = g_object_get_data(G_OBJECT(service), AU_CHUNKS_DIR_KEY);
+   g_autoptr(GError) error = NULL;
+
+   g_socket_set_timeout(g_socket_connection_get_socket(connection),
+                        AU_PEER_SERVER_TIMEOUT);
+
+   if (!_au_peer_server_handle_request(chunks_dir, connection, &error))
+      g_debug("Failed to serve a peer request: %s", error->message);
+
+   g_io_stream_close(G_IO_STREAM(connection), NULL, NULL);
+
+   return TRUE;
+}
+
+/*
+ * au_peer_server_new:
+ * @chunks_dir: (not nullable): Path to a Desync local chunk store
+ * @port: TCP port to listen to, or 0 to choose a random one
+ * @error: Used to raise an error on failure
+ *
+ * Start serving, read-only, the chunks in @chunks_dir to the other machines in
+ * the network. Chunks are content-addressed, the clients are expected to
+ * verify them against their ID, so we don't need any kind of authentication.
+ * The incoming connections are accepted from the thread-default main context.
+ *
+ * Returns: (transfer full): A new AuPeerServer, or %NULL on failure
+ */
+AuPeerServer *
+au_peer_server_new(const gchar *chunks_dir, guint16 port, GError **error)
+{
+   g_autoptr(AuPeerServer) self = NULL;
+
+   g_return_val_if_fail(chunks_dir != NULL, NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   if (!g_file_test(chunks_dir, G_FILE_TEST_IS_DIR)) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                  "The chunks directory '%s' does not exist", chunks_dir);
+      return NULL;
+   }
+
+   self = g_new0(AuPeerServer, 1);
+   self->chunks_dir = g_strdup(chunks_dir);
+   self->service = g_threaded_socket_service_new(AU_PEER_SERVER_MAX_THREADS);
+   g_object_set_data_full(G_OBJECT(self->service), AU_CHUNKS_DIR_KEY,
+                          g_strdup(chunks_dir), g_free);
+
+   if (port == 0) {
+      port = g_socket_listener_add_any_inet_port(G_SOCKET_LISTENER(self->service), NULL,
+                                                 error);
+      if (port == 0)
+         return NULL;
+   } else if (!g_socket_listener_add_inet_port(G_SOCKET_LISTENER(self->service), port,
+                                               NULL, error)) {
+      return NULL;
+   }
+
+   self->port = port;
+
+   g_signal_connect(self->service, "run", G_CALLBACK(_au_peer_server_run_cb), NULL);
+   g_socket_service_start(self->service);
+
+   g_debug("Serving the chunks in '%s' on port %u", self->chunks_dir, self->port);
+
+   return g_steal_pointer(&self);
+}
+
+void
+au_peer_server_free(AuPeerServer *self)
+{
+   if (self == NULL)
+      return;
+
+   if (self->service != NULL) {
+      g_socket_service_stop(self->service);
+      g_socket_listener_close(G_SOCKET_LISTENER(self->service));
+      g_object_unref(self->service);
+   }
+
+   g_free(self->chunks_dir);
+   g_free(self);
+}
+
+const gchar *
+au_peer_server_get_chunks_dir(const AuPeerServer *self)
+{
+   g_return_val_if_fail(self != NULL, NULL);
+
+   return self->chunks_dir;
+}
+
+guint16
+au_peer_server_get_port(const AuPeerServer *self)
+{
+   g_return_val_if_fail(self != NULL, 0);
+
+   return self->port;
+}
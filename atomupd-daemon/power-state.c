@@ -0,0 +1,155 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+
+#include "power-state.h"
+
+/*
+ * Returns: The integer in the sysfs attribute @name of @dir, or @default_value
+ *  if it can't be read
+ */
+static gint64
+_au_read_sysfs_int(const gchar *dir, const gchar *name, gint64 default_value)
+{
+   g_autofree gchar *path = g_build_filename(dir, name, NULL);
+   g_autofree gchar *content = NULL;
+   gchar *endptr = NULL;
+   gint64 value;
+
+   if (!g_file_get_contents(path, &content, NULL, NULL))
+      return default_value;
+
+   value = g_ascii_strtoll(content, &endptr, 10);
+   if (endptr == content)
+      return default_value;
+
+   return value;
+}
+
+/*
+ * Returns: (transfer full) (nullable): The content of the sysfs attribute
+ *  @name of @dir, without the trailing newline
+ */
+static gchar *
+_au_read_sysfs_string(const gchar *dir, const gchar *name)
+{
+   g_autofree gchar *path = g_build_filename(dir, name, NULL);
+   g_autofree gchar *content = NULL;
+
+   if (!g_file_get_contents(path, &content, NULL, NULL))
+      return NULL;
+
+   return g_strdup(g_strstrip(content));
+}
+
+static void
+_au_read_power_supplies(const gchar *sysfs_path, AuPowerState *state)
+{
+   g_autofree gchar *class_path = NULL;
+   g_autoptr(GDir) dir = NULL;
+   const gchar *name;
+   gboolean has_battery = FALSE;
+   gboolean external_online = FALSE;
+
+   class_path = g_build_filename(sysfs_path, "class", "power_supply", NULL);
+   dir = g_dir_open(class_path, 0, NULL);
+   if (dir == NULL)
+      return;
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *supply_path = g_build_filename(class_path, name, NULL);
+      g_autofree gchar *type = _au_read_sysfs_string(supply_path, "type");
+      g_autofree gchar *scope = _au_read_sysfs_string(supply_path, "scope");
+
+      /* Skip the batteries of peripherals, like wireless controllers */
+      if (g_strcmp0(scope, "Device") == 0)
+         continue;
+
+      if (g_strcmp0(type, "Battery") == 0) {
+         gint64 capacity = _au_read_sysfs_int(supply_path, "capacity", -1);
+
+         has_battery = TRUE;
+         /* With more than one battery, the lowest charge is the one that matters */
+         if (capacity >= 0 &&
+             (state->battery_level < 0 || capacity < state->battery_level))
+            state->battery_level = (gint)MIN(capacity, 100);
+      } else if (_au_read_sysfs_int(supply_path, "online", 0) == 1) {
+         external_online = TRUE;
+      }
+   }
+
+   state->on_battery = has_battery && !external_online;
+}
+
+static void
+_au_read_thermal_zones(const gchar *sysfs_path, AuPowerState *state)
+{
+   g_autofree gchar *class_path = NULL;
+   g_autoptr(GDir) dir = NULL;
+   const gchar *name;
+
+   class_path = g_build_filename(sysfs_path, "class", "thermal", NULL);
+   dir = g_dir_open(class_path, 0, NULL);
+   if (dir == NULL)
+      return;
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *zone_path = NULL;
+      gint64 millicelsius;
+
+      if (!g_str_has_prefix(name, "thermal_zone"))
+         continue;
+
+      zone_path = g_build_filename(class_path, name, NULL);
+      millicelsius = _au_read_sysfs_int(zone_path, "temp", G_MININT64);
+      if (millicelsius == G_MININT64)
+         continue;
+
+      state->temperature = MAX(state->temperature, (gint)(millicelsius / 1000));
+   }
+}
+
+/*
+ * au_power_state_read:
+ * @sysfs_path: (not nullable): Path where sysfs is mounted, usually "/sys"
+ * @state: (out caller-allocates): Used to return the power state
+ *
+ * Read the power supplies and thermal zones state from sysfs. Missing or
+ * unreadable attributes are reported as unknown values.
+ */
+void
+au_power_state_read(const gchar *sysfs_path, AuPowerState *state)
+{
+   g_return_if_fail(sysfs_path != NULL);
+   g_return_if_fail(state != NULL);
+
+   state->on_battery = FALSE;
+   state->battery_level = -1;
+   state->temperature = G_MININT;
+
+   _au_read_power_supplies(sysfs_path, state);
+   _au_read_thermal_zones(sysfs_path, state);
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "pressure.h"
+
+struct _AuPressureController {
+   AuPressureState state;
+   guint max_level;
+   /* Foreground stall, in percent, above which the update is slowed down, and
+    * below which it is considered calm */
+   gdouble high_threshold;
+   gdouble low_threshold;
+   /* Consecutive calm samples required before speeding up the update again */
+   guint calm_samples;
+   guint n_calm;
+   /* The previous sample, valid if previous_time is not zero */
+   gint64 previous_time;
+   AuPressureTotals previous_foreground;
+};
+
+static const gchar *const resource_names[AU_N_PRESSURE_RESOURCES] = {
+   [AU_PRESSURE_CPU] = "cpu",
+   [AU_PRESSURE_IO] = "io",
+   [AU_PRESSURE_MEMORY] = "memory",
+};
+
+const gchar *
+au_pressure_resource_to_string(AuPressureResource resource)
+{
+   g_return_val_if_fail(resource < AU_N_PRESSURE_RESOURCES, NULL);
+
+   return resource_names[resource];
+}
+
+/*
+ * _au_pressure_read_some_total:
+ * @path: (not nullable): A PSI file, e.g. /proc/pressure/io
+ * @total: (out) (not optional): Used to return the "total" of its "some" line
+ *
+ * The PSI files look like this:
+ *
+ * |[
+ * some avg10=0.00 avg60=0.00 avg300=0.00 total=12345
+ * full avg10=0.00 avg60=0.00 avg300=0.00 total=6789
+ * ]|
+ *
+ * Returns: %TRUE if @path could be parsed
+ */
+static gboolean
+_au_pressure_read_some_total(const gchar *path, guint64 *total)
+{
+   g_autofree gchar *content = NULL;
+   const gchar *field;
+   gchar *endptr = NULL;
+
+   if (!g_file_get_contents(path, &content, NULL, NULL))
+      return FALSE;
+
+   if (!g_str_has_prefix(content, "some "))
+      return FALSE;
+
+   field = strstr(content, " total=");
+   if (field == NULL)
+      return FALSE;
+
+   field += strlen(" total=");
+   *total = g_ascii_strtoull(field, &endptr, 10);
+
+   return endptr != field;
+}
+
+/*
+ * au_pressure_totals_read:
+ * @dir: (not nullable): /proc/pressure, or the directory of a cgroup
+ * @is_cgroup: %TRUE if @dir is a cgroup, where the files are called
+ *  e.g. "io.pressure" instead of "io"
+ * @totals: (out caller-allocates) (not optional): Used to return the stall times
+ *
+ * The resources that can't be read, e.g. because the kernel has been built
+ * without CONFIG_PSI, are set to zero.
+ *
+ * Returns: %TRUE if at least one resource could be read
+ */
+gboolean
+au_pressure_totals_read(const gchar *dir, gboolean is_cgroup, AuPressureTotals *totals)
+{
+   gboolean found = FALSE;
+   gsize i;
+
+   g_return_val_if_fail(dir != NULL, FALSE);
+   g_return_val_if_fail(totals != NULL, FALSE);
+
+   for (i = 0; i < AU_N_PRESSURE_RESOURCES; i++) {
+      g_autofree gchar *name = NULL;
+      g_autofree gchar *path = NULL;
+
+      name = is_cgroup ? g_strdup_printf("%s.pressure", resource_names[i])
+                       : g_strdup(resource_names[i]);
+      path = g_build_filename(dir, name, NULL);
+
+      totals->stall[i] = 0;
+      if (_au_pressure_read_some_total(path, &totals->stall[i]))
+         found = TRUE;
+   }
+
+   return found;
+}
+
+/*
+ * au_pressure_controller_new:
+ * @max_level: The highest level the update can be slowed down to
+ * @high_threshold: Share of time, in percent, in which the foreground tasks
+ *  can be stalled before the update is slowed down by one level
+ * @low_threshold: Share of time, in percent, below which the foreground
+ *  tasks are considered not affected by the update
+ * @calm_samples: Number of consecutive samples below @low_threshold required
+ *  before speeding up the update by one level
+ *
+ * Returns: (transfer full): A new controller, starting at level 0
+ */
+AuPressureController *
+au_pressure_controller_new(guint max_level,
+                           gdouble high_threshold,
+                           gdouble low_threshold,
+                           guint calm_samples)
+{
+   AuPressureController *self = NULL;
+
+   g_return_val_if_fail(low_threshold <= high_threshold, NULL);
+
+   self = g_slice_new0(AuPressureController);
+   self->max_level = max_level;
+   self->high_threshold = high_threshold;
+   self->low_threshold = low_threshold;
+   self->calm_samples = MAX(calm_samples, 1);
+
+   return self;
+}
+
+void
+au_pressure_controller_free(AuPressureController *self)
+{
+   g_slice_free(AuPressureController, self);
+}
+
+/*
+ * au_pressure_controller_reset:
+ * @self: (not nullable): The controller
+ *
+ * Go back to level 0 and forget the previous sample, e.g. because a new update
+ * is starting. The statistics are preserved.
+ */
+void
+au_pressure_controller_reset(AuPressureController *self)
+{
+   gsize i;
+
+   g_return_if_fail(self != NULL);
+
+   self->state.level = 0;
+   for (i = 0; i < AU_N_PRESSURE_RESOURCES; i++)
+      self->state.foreground_stall[i] = 0;
+
+   self->n_calm = 0;
+   self->previous_time = 0;
+}
+
+/*
+ * au_pressure_controller_sample:
+ * @self: (not nullable): The controller
+ * @now: Monotonic time, in microseconds
+ * @foreground: (not nullable): The stall times of the foreground tasks, e.g.
+ *  the ones in the cgroup of the user sessions
+ *
+ * Compare the new stall times with the previous sample. The foreground tasks
+ * need to be measured on their own, in a cgroup that doesn't include the
+ * update: the "some" stall times of different groups of tasks overlap, so the
+ * ones of the update can't be subtracted from the system wide ones. If the
+ * foreground tasks spent too much time stalled, the update backs off by one
+ * level right away. It speeds up
+ * again one level at a time, only after the system has been calm for a while,
+ * so that it doesn't keep oscillating while a game is loading.
+ *
+ * Returns: %TRUE if the level changed
+ */
+gboolean
+au_pressure_controller_sample(AuPressureController *self,
+                              gint64 now,
+                              const AuPressureTotals *foreground)
+{
+   gdouble worst = 0;
+   gint64 elapsed;
+   gboolean changed = FALSE;
+   gsize i;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(foreground != NULL, FALSE);
+
+   elapsed = now - self->previous_time;
+
+   if (self->previous_time == 0 || elapsed <= 0)
+      goto out;
+
+   for (i = 0; i < AU_N_PRESSURE_RESOURCES; i++) {
+      guint64 foreground_delta = 0;
+
+      /* The counters only go backwards if they can't be read anymore */
+      if (foreground->stall[i] > self->previous_foreground.stall[i])
+         foreground_delta = foreground->stall[i] - self->previous_foreground.stall[i];
+
+      self->state.foreground_stall[i] = MIN(100.0 * foreground_delta / elapsed, 100);
+      worst = MAX(worst, self->state.foreground_stall[i]);
+   }
+
+   if (worst >= self->high_threshold) {
+      self->n_calm = 0;
+
+      if (self->state.level < self->max_level) {
+         self->state.level++;
+         self->state.backoffs++;
+         changed = TRUE;
+      }
+   } else if (worst < self->low_threshold) {
+      self->n_calm++;
+
+      if (self->n_calm >= self->calm_samples && self->state.level > 0) {
+         self->state.level--;
+         self->state.rampups++;
+         self->n_calm = 0;
+         changed = TRUE;
+      }
+   } else {
+      /* Somewhere in between, keep the current level */
+      self->n_calm = 0;
+   }
+
+out:
+   self->previous_time = now;
+   self->previous_foreground = *foreground;
+
+   return changed;
+}
+
+const AuPressureState *
+au_pressure_controller_get_state(AuPressureController *self)
+{
+   g_return_val_if_fail(self != NULL, NULL);
+
+   return &self->state;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef enum {
+   AU_PRESSURE_CPU,
+   AU_PRESSURE_IO,
+   AU_PRESSURE_MEMORY,
+   AU_N_PRESSURE_RESOURCES,
+} AuPressureResource;
+
+typedef struct {
+   /* Cumulative time, in microseconds, in which at least one task was stalled
+    * waiting for each resource, as in the "some" line of the PSI files */
+   guint64 stall[AU_N_PRESSURE_RESOURCES];
+} AuPressureTotals;
+
+typedef struct {
+   /* How much the update has been slowed down, from 0 to the maximum level */
+   guint level;
+   /* Share of the last interval, in percent, in which the foreground tasks
+    * were stalled waiting for each resource */
+   gdouble foreground_stall[AU_N_PRESSURE_RESOURCES];
+   /* Number of times the level has been raised and lowered */
+   guint64 backoffs;
+   guint64 rampups;
+} AuPressureState;
+
+typedef struct _AuPressureController AuPressureController;
+
+const gchar *au_pressure_resource_to_string(AuPressureResource resource);
+gboolean au_pressure_totals_read(const gchar *dir,
+                                 gboolean is_cgroup,
+                                 AuPressureTotals *totals);
+
+AuPressureController *au_pressure_controller_new(guint max_level,
+                                                 gdouble high_threshold,
+                                                 gdouble low_threshold,
+                                                 guint calm_samples);
+void au_pressure_controller_free(AuPressureController *self);
+void au_pressure_controller_reset(AuPressureController *self);
+gboolean au_pressure_controller_sample(AuPressureController *self,
+                                       gint64 now,
+                                       const AuPressureTotals *foreground);
+const AuPressureState *au_pressure_controller_get_state(AuPressureController *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuPressureController, au_pressure_controller_free)
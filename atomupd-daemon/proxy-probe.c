@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <curl/curl.h>
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "proxy-probe.h"
+#include "utils.h"
+
+/* Seconds after which a path is considered broken. The probe is a single HEAD
+ * request, any working path is expected to answer much sooner than that. */
+const glong AU_PROXY_PROBE_TIMEOUT = 10;
+/* The other path needs to be at least this much faster than the current one
+ * before switching, to avoid flipping between two paths that are about equal */
+const gdouble AU_PROXY_SWITCH_RATIO = 0.75;
+
+const gchar *
+au_proxy_route_to_string(AuProxyRoute route)
+{
+   switch (route) {
+   case AU_PROXY_ROUTE_PROXY:
+      return "proxy";
+   case AU_PROXY_ROUTE_DIRECT:
+      return "direct";
+   default:
+      g_return_val_if_reached(NULL);
+   }
+}
+
+/*
+ * au_proxy_probe:
+ * @url: (not nullable): The server to probe
+ * @http_proxy: (nullable): The HTTP proxy to go through, or %NULL to reach
+ *  @url directly, ignoring the proxy environment variables
+ * @error: Used to raise an error on failure
+ *
+ * Send a HEAD request to @url and measure how long it takes to get an answer.
+ * Any answer is fine, except the errors that come from the proxy itself
+ * instead of the server, e.g. 502 Bad Gateway. This blocks, so it is expected
+ * to be called from a separate thread.
+ *
+ * Returns: The latency in microseconds, or -1 if @url could not be reached
+ */
+gint64
+au_proxy_probe(const gchar *url, const gchar *http_proxy, GError **error)
+{
+   g_autoptr(CURL) curl = NULL;
+   curl_off_t total_time = 0;
+   long status = 0;
+   CURLcode r;
+
+   g_return_val_if_fail(url != NULL, -1);
+   g_return_val_if_fail(error == NULL || *error == NULL, -1);
+
+   curl = curl_easy_init();
+   if (curl == NULL) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "Libcurl failed to initialize");
+      return -1;
+   }
+
+   curl_easy_setopt(curl, CURLOPT_URL, url);
+   curl_easy_setopt(curl, CURLOPT_NETRC, CURL_NETRC_OPTIONAL);
+   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+   curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+   curl_easy_setopt(curl, CURLOPT_TIMEOUT, AU_PROXY_PROBE_TIMEOUT);
+   /* An empty string disables the proxies set in the environment too */
+   curl_easy_setopt(curl, CURLOPT_PROXY, http_proxy != NULL ? http_proxy : "");
+
+   r = curl_easy_perform(curl);
+   if (r != CURLE_OK) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "%s", curl_easy_strerror(r));
+      return -1;
+   }
+
+   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+   if (status >= 500 || status == 407) {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED, "HTTP status %li", status);
+      return -1;
+   }
+
+   curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_time);
+
+   return total_time;
+}
+
+/*
+ * au_proxy_route_choose:
+ * @current: The route currently in use
+ * @proxy_latency: Latency through the proxy, in microseconds, or -1 if the
+ *  proxy path is broken
+ * @direct_latency: Same as @proxy_latency, for the direct path
+ *
+ * Choose the faster working route. A route that works is never abandoned
+ * for one that is only marginally faster.
+ *
+ * Returns: The route to use from now on
+ */
+AuProxyRoute
+au_proxy_route_choose(AuProxyRoute current, gint64 proxy_latency, gint64 direct_latency)
+{
+   gint64 current_latency;
+   gint64 other_latency;
+
+   if (current == AU_PROXY_ROUTE_PROXY) {
+      current_latency = proxy_latency;
+      other_latency = direct_latency;
+   } else {
+      current_latency = direct_latency;
+      other_latency = proxy_latency;
+   }
+
+   /* If neither works, there is nothing better to switch to */
+   if (other_latency < 0)
+      return current;
+
+   if (current_latency < 0 || other_latency < current_latency * AU_PROXY_SWITCH_RATIO)
+      return current == AU_PROXY_ROUTE_PROXY ? AU_PROXY_ROUTE_DIRECT
+                                             : AU_PROXY_ROUTE_PROXY;
+
+   return current;
+}
@@ -0,0 +1,304 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "rollout.h"
+
+/* Prefix of the remote info groups with the rollout of a build, followed by
+ * its build ID */
+#define AU_ROLLOUT_GROUP_PREFIX "Rollout "
+
+typedef struct {
+   /* Unix time */
+   gint64 time;
+   gdouble percentage;
+} AuRolloutStep;
+
+struct _AuRollout {
+   gdouble percentage;
+   /* AuRolloutStep, sorted by time, or %NULL if the percentage is fixed */
+   GArray *schedule;
+};
+
+static gboolean
+_au_rollout_parse_percentage(const gchar *string, gdouble *percentage, GError **error)
+{
+   gchar *endptr = NULL;
+
+   *percentage = g_ascii_strtod(string, &endptr);
+
+   /* Written in this way to also reject NaN */
+   if (endptr == string || *endptr != '\0' || !(*percentage >= 0 && *percentage <= 100)) {
+      g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                  "Invalid rollout percentage \"%s\"", string);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*
+ * au_rollout_new_from_key_file:
+ * @key_file: (not nullable): The remote info
+ * @group: (not nullable): Group with the rollout of a build
+ * @error: Used to raise an error on failure
+ *
+ * Parse a group like this one:
+ *
+ * |[
+ * [Rollout 20240115.1]
+ * Percentage = 10
+ * Schedule = 2024-01-16T00:00:00Z 10;2024-01-18T00:00:00Z 100
+ * ]|
+ *
+ * "Percentage" is the share of devices the build is offered to. With
+ * "Schedule" instead, the share is zero until the first step, then grows
+ * linearly from one step to the next and stays at the value of the last one.
+ *
+ * Returns: (transfer full) (nullable): The rollout, or %NULL on failure
+ */
+AuRollout *
+au_rollout_new_from_key_file(GKeyFile *key_file, const gchar *group, GError **error)
+{
+   g_autoptr(AuRollout) self = NULL;
+   g_autoptr(GTimeZone) utc = g_time_zone_new_utc();
+   g_auto(GStrv) schedule = NULL;
+   g_autofree gchar *percentage = NULL;
+   gsize i;
+
+   g_return_val_if_fail(key_file != NULL, NULL);
+   g_return_val_if_fail(group != NULL, NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   self = g_slice_new0(AuRollout);
+
+   schedule = g_key_file_get_string_list(key_file, group, "Schedule", NULL, NULL);
+   if (schedule == NULL || schedule[0] == NULL) {
+      percentage = g_key_file_get_string(key_file, group, "Percentage", error);
+      if (percentage == NULL)
+         return NULL;
+
+      if (!_au_rollout_parse_percentage(g_strstrip(percentage), &self->percentage,
+                                        error))
+         return NULL;
+
+      return g_steal_pointer(&self);
+   }
+
+   self->schedule = g_array_new(FALSE, FALSE, sizeof(AuRolloutStep));
+
+   for (i = 0; schedule[i] != NULL; i++) {
+      g_auto(GStrv) parts = g_strsplit(g_strstrip(schedule[i]), " ", 2);
+      g_autoptr(GDateTime) time = NULL;
+      AuRolloutStep step;
+
+      if (g_strv_length(parts) != 2) {
+         g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "Invalid rollout step \"%s\", expected \"<time> <percentage>\"",
+                     schedule[i]);
+         return NULL;
+      }
+
+      time = g_date_time_new_from_iso8601(parts[0], utc);
+      if (time == NULL) {
+         g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "Invalid rollout step time \"%s\"", parts[0]);
+         return NULL;
+      }
+
+      step.time = g_date_time_to_unix(time);
+
+      if (!_au_rollout_parse_percentage(g_strstrip(parts[1]), &step.percentage, error))
+         return NULL;
+
+      if (self->schedule->len > 0 &&
+          step.time <= g_array_index(self->schedule, AuRolloutStep,
+                                     self->schedule->len - 1).time) {
+         g_set_error(error, G_KEY_FILE_ERROR, G_KEY_FILE_ERROR_INVALID_VALUE,
+                     "The rollout steps are not in chronological order");
+         return NULL;
+      }
+
+      g_array_append_val(self->schedule, step);
+   }
+
+   return g_steal_pointer(&self);
+}
+
+void
+au_rollout_free(AuRollout *self)
+{
+   g_clear_pointer(&self->schedule, g_array_unref);
+
+   g_slice_free(AuRollout, self);
+}
+
+/*
+ * au_rollout_get_percentage:
+ * @self: (not nullable): The rollout of a build
+ * @now: Unix time
+ *
+ * Returns: Share of the devices the build is offered to at @now, from 0 to 100
+ */
+gdouble
+au_rollout_get_percentage(const AuRollout *self, gint64 now)
+{
+   const AuRolloutStep *previous = NULL;
+   guint i;
+
+   if (self->schedule == NULL)
+      return self->percentage;
+
+   for (i = 0; i < self->schedule->len; i++) {
+      const AuRolloutStep *step = &g_array_index(self->schedule, AuRolloutStep, i);
+
+      if (now < step->time) {
+         if (previous == NULL)
+            return 0;
+
+         return previous->percentage + (step->percentage - previous->percentage) *
+                                          (now - previous->time) /
+                                          (step->time - previous->time);
+      }
+
+      previous = step;
+   }
+
+   return previous->percentage;
+}
+
+/*
+ * au_rollout_get_bucket:
+ * @machine_id: (not nullable): Stable identifier of the device
+ * @build_id: (not nullable): The build being rolled out
+ *
+ * Hash the device and the build, so that each device always gets the same
+ * position for a given build, but not always the first or the last one.
+ *
+ * Returns: Position of the device in the rollout of @build_id, from 0 included
+ *  to 100 excluded
+ */
+gdouble
+au_rollout_get_bucket(const gchar *machine_id, const gchar *build_id)
+{
+   g_autoptr(GChecksum) checksum = g_checksum_new(G_CHECKSUM_SHA256);
+   guint8 digest[32];
+   gsize digest_len = sizeof(digest);
+   guint64 value = 0;
+   gsize i;
+
+   g_checksum_update(checksum, (const guchar *)machine_id, -1);
+   g_checksum_update(checksum, (const guchar *)":", 1);
+   g_checksum_update(checksum, (const guchar *)build_id, -1);
+   g_checksum_get_digest(checksum, digest, &digest_len);
+
+   for (i = 0; i < sizeof(value); i++)
+      value = (value << 8) | digest[i];
+
+   return (gdouble)(value % 10000) / 100;
+}
+
+/*
+ * au_rollout_is_exposed:
+ * @self: (not nullable): The rollout of @build_id
+ * @machine_id: (not nullable): Stable identifier of the device
+ * @build_id: (not nullable): The build being rolled out
+ * @now: Unix time
+ *
+ * Returns: %TRUE if @build_id should be offered to this device at @now
+ */
+gboolean
+au_rollout_is_exposed(const AuRollout *self,
+                      const gchar *machine_id,
+                      const gchar *build_id,
+                      gint64 now)
+{
+   return au_rollout_get_bucket(machine_id, build_id) <
+          au_rollout_get_percentage(self, now);
+}
+
+/*
+ * au_rollout_load_all:
+ * @key_file: (not nullable): The remote info
+ *
+ * Returns: (transfer full): Map of build IDs to their AuRollout. Invalid
+ *  rollouts are skipped, so that their build is offered to everybody.
+ */
+GHashTable *
+au_rollout_load_all(GKeyFile *key_file)
+{
+   g_autoptr(GHashTable) rollouts = NULL;
+   g_auto(GStrv) groups = NULL;
+   gsize i;
+
+   rollouts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                    (GDestroyNotify)au_rollout_free);
+   groups = g_key_file_get_groups(key_file, NULL);
+
+   for (i = 0; groups[i] != NULL; i++) {
+      g_autoptr(GError) error = NULL;
+      AuRollout *rollout = NULL;
+      const gchar *build_id;
+
+      if (!g_str_has_prefix(groups[i], AU_ROLLOUT_GROUP_PREFIX))
+         continue;
+
+      build_id = groups[i] + strlen(AU_ROLLOUT_GROUP_PREFIX);
+      rollout = au_rollout_new_from_key_file(key_file, groups[i], &error);
+      if (rollout == NULL) {
+         g_warning("Ignoring the rollout of %s: %s", build_id, error->message);
+         continue;
+      }
+
+      g_hash_table_replace(rollouts, g_strdup(build_id), rollout);
+   }
+
+   return g_steal_pointer(&rollouts);
+}
+
+/*
+ * au_rollout_read_machine_id:
+ * @path: (not nullable): Path to the machine-id(5) file
+ *
+ * Returns: (transfer full) (nullable): The machine ID, or %NULL if it is not
+ *  available
+ */
+gchar *
+au_rollout_read_machine_id(const gchar *path)
+{
+   g_autofree gchar *contents = NULL;
+
+   if (!g_file_get_contents(path, &contents, NULL, NULL))
+      return NULL;
+
+   g_strstrip(contents);
+   if (contents[0] == '\0')
+      return NULL;
+
+   return g_steal_pointer(&contents);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef struct _AuRollout AuRollout;
+
+AuRollout *au_rollout_new_from_key_file(GKeyFile *key_file,
+                                        const gchar *group,
+                                        GError **error);
+void au_rollout_free(AuRollout *self);
+gdouble au_rollout_get_percentage(const AuRollout *self, gint64 now);
+gboolean au_rollout_is_exposed(const AuRollout *self,
+                               const gchar *machine_id,
+                               const gchar *build_id,
+                               gint64 now);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuRollout, au_rollout_free)
+
+GHashTable *au_rollout_load_all(GKeyFile *key_file);
+gdouble au_rollout_get_bucket(const gchar *machine_id, const gchar *build_id);
+gchar *au_rollout_read_machine_id(const gchar *path);
@@ -0,0 +1,842 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <glib.h>
+
+#include "flight-recorder.h"
+#include "supervisor.h"
+#include "utils.h"
+
+/* The query helper prints a JSON with the available updates, which is never
+ * expected to be anywhere close to this size */
+const gsize AU_CHILD_STDOUT_MAX_SIZE = 16 * 1024 * 1024;
+
+/* Bytes of the standard error that are kept for each helper, the most recent ones */
+#define AU_CHILD_STDERR_TAIL_SIZE 4096
+
+static const gchar *const au_helper_kind_names[AU_N_HELPER_KINDS] = {
+   [AU_HELPER_KIND_QUERY] = "query",
+   [AU_HELPER_KIND_UPDATE] = "update",
+   [AU_HELPER_KIND_TOOL] = "tool",
+};
+
+/* Helpers of each kind that can run at the same time, 0 means unlimited */
+static const guint au_helper_max_running[AU_N_HELPER_KINDS] = {
+   [AU_HELPER_KIND_QUERY] = 16,
+   [AU_HELPER_KIND_UPDATE] = 1,
+   [AU_HELPER_KIND_TOOL] = 0,
+};
+
+struct _AuSupervisor {
+   /* Protects the counters, au_supervisor_run_sync() can be called from
+    * worker threads */
+   GMutex lock;
+   /* Environment of the helpers, taken when the supervisor is created */
+   GStrv base_environ;
+   AuHelperStats stats[AU_N_HELPER_KINDS];
+};
+
+struct _AuChild {
+   AuSupervisor *supervisor; /* borrowed */
+   AuHelperKind kind;
+   GPid pid;
+   /* Basename of the executable, for the flight recorder */
+   gchar *executable;
+   /* -1 if pidfds are not supported, then the exit is tracked with a child watch */
+   gint pidfd;
+   guint exit_source;
+   guint timeout_source;
+   gboolean timed_out;
+   gint64 start_time;
+   gint standard_output;
+   guint stdout_source;
+   /* %NULL if the standard output is not captured */
+   GByteArray *stdout_buffer;
+   gboolean stdout_overflow;
+   gint standard_error;
+   guint stderr_source;
+   gchar stderr_tail[AU_CHILD_STDERR_TAIL_SIZE + 1];
+   gsize stderr_tail_len;
+   AuChildExitFunc exit_func;
+   gpointer user_data;
+   GDestroyNotify user_data_free;
+};
+
+static void
+_au_child_free(AuChild *child)
+{
+   g_clear_handle_id(&child->exit_source, g_source_remove);
+   g_clear_handle_id(&child->timeout_source, g_source_remove);
+   g_clear_handle_id(&child->stdout_source, g_source_remove);
+   g_clear_handle_id(&child->stderr_source, g_source_remove);
+
+   if (child->pidfd > -1)
+      g_close(child->pidfd, NULL);
+   if (child->standard_output > -1)
+      g_close(child->standard_output, NULL);
+   if (child->standard_error > -1)
+      g_close(child->standard_error, NULL);
+
+   g_clear_pointer(&child->stdout_buffer, g_byte_array_unref);
+   g_free(child->executable);
+
+   if (child->user_data_free != NULL)
+      child->user_data_free(child->user_data);
+
+   g_slice_free(AuChild, child);
+}
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuChild, _au_child_free)
+
+AuSupervisor *
+au_supervisor_new(void)
+{
+   AuSupervisor *self = g_slice_new0(AuSupervisor);
+
+   g_mutex_init(&self->lock);
+   /* Building the environment once avoids copying it for every helper, and
+    * gives all of them the same view, whatever happens to ours later */
+   self->base_environ = g_get_environ();
+
+   return self;
+}
+
+void
+au_supervisor_free(AuSupervisor *self)
+{
+   g_strfreev(self->base_environ);
+   g_mutex_clear(&self->lock);
+
+   g_slice_free(AuSupervisor, self);
+}
+
+/*
+ * au_supervisor_get_default:
+ *
+ * Returns: (transfer none): The supervisor of the daemon helpers
+ */
+AuSupervisor *
+au_supervisor_get_default(void)
+{
+   static gsize initialized = 0;
+   static AuSupervisor *default_supervisor = NULL;
+
+   if (g_once_init_enter(&initialized)) {
+      default_supervisor = au_supervisor_new();
+      g_once_init_leave(&initialized, 1);
+   }
+
+   return default_supervisor;
+}
+
+/*
+ * au_helper_kind_get_name:
+ * @kind: Kind of helpers
+ *
+ * Returns: (transfer none): The name of @kind, as used in the logs and in
+ *  the helpers statistics
+ */
+const gchar *
+au_helper_kind_get_name(AuHelperKind kind)
+{
+   g_return_val_if_fail(kind < AU_N_HELPER_KINDS, NULL);
+
+   return au_helper_kind_names[kind];
+}
+
+/*
+ * au_supervisor_dup_environ:
+ * @self: (not nullable): The supervisor
+ *
+ * Returns: (transfer full): A copy of the environment that is used by default
+ *  for the helpers, to extend it before calling au_supervisor_spawn()
+ */
+GStrv
+au_supervisor_dup_environ(AuSupervisor *self)
+{
+   return g_strdupv(self->base_environ);
+}
+
+/*
+ * au_supervisor_get_stats:
+ * @self: (not nullable): The supervisor
+ * @kind: Kind of helpers
+ * @stats: (out caller-allocates): Used to return the resource usage of the
+ *  helpers of @kind
+ */
+void
+au_supervisor_get_stats(AuSupervisor *self, AuHelperKind kind, AuHelperStats *stats)
+{
+   g_return_if_fail(kind < AU_N_HELPER_KINDS);
+   g_return_if_fail(stats != NULL);
+
+   g_mutex_lock(&self->lock);
+   *stats = self->stats[kind];
+   g_mutex_unlock(&self->lock);
+}
+
+/*
+ * _au_supervisor_reserve:
+ * @self: (not nullable): The supervisor
+ * @kind: Kind of the helper that is about to be launched
+ * @error: Used to raise an error on failure
+ *
+ * Returns: %TRUE if another helper of @kind can be launched, and it has been
+ *  counted as running
+ */
+static gboolean
+_au_supervisor_reserve(AuSupervisor *self, AuHelperKind kind, GError **error)
+{
+   AuHelperStats *stats = &self->stats[kind];
+   g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&self->lock);
+
+   if (au_helper_max_running[kind] > 0 && stats->running >= au_helper_max_running[kind]) {
+      stats->rejected++;
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                  "There are already %u %s helpers running", stats->running,
+                  au_helper_kind_names[kind]);
+      return FALSE;
+   }
+
+   stats->running++;
+   stats->spawned++;
+
+   return TRUE;
+}
+
+static void
+_au_supervisor_release(AuSupervisor *self,
+                       AuHelperKind kind,
+                       gint64 start_time,
+                       gboolean failed,
+                       const struct rusage *usage)
+{
+   AuHelperStats *stats = &self->stats[kind];
+   g_autoptr(GMutexLocker) locker = g_mutex_locker_new(&self->lock);
+
+   stats->running--;
+   stats->wall_time += g_get_monotonic_time() - start_time;
+
+   if (failed)
+      stats->failed++;
+
+   if (usage != NULL) {
+      stats->cpu_time +=
+         (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * G_USEC_PER_SEC +
+         usage->ru_utime.tv_usec + usage->ru_stime.tv_usec;
+      stats->max_rss = MAX(stats->max_rss, (guint64)usage->ru_maxrss);
+   }
+}
+
+static gint
+_au_pidfd_open(GPid pid)
+{
+#ifdef SYS_pidfd_open
+   return syscall(SYS_pidfd_open, pid, 0);
+#else
+   errno = ENOSYS;
+   return -1;
+#endif
+}
+
+static void
+_au_child_append_stdout(AuChild *child, const gchar *buffer, gsize len)
+{
+   if (child->stdout_overflow)
+      return;
+
+   if (child->stdout_buffer->len + len > AU_CHILD_STDOUT_MAX_SIZE) {
+      g_warning("The %s helper %d printed more than %" G_GSIZE_FORMAT
+                " bytes, killing it",
+                au_helper_kind_names[child->kind], child->pid,
+                AU_CHILD_STDOUT_MAX_SIZE);
+      child->stdout_overflow = TRUE;
+      au_child_send_signal(child, SIGKILL, NULL);
+      return;
+   }
+
+   g_byte_array_append(child->stdout_buffer, (const guint8 *)buffer, len);
+}
+
+static void
+_au_child_append_stderr(AuChild *child, const gchar *buffer, gsize len)
+{
+   gsize drop;
+
+   /* Keep the helpers messages in our log, like when they inherited our stderr */
+   fwrite(buffer, 1, len, stderr);
+
+   if (len >= AU_CHILD_STDERR_TAIL_SIZE) {
+      memcpy(child->stderr_tail, buffer + len - AU_CHILD_STDERR_TAIL_SIZE,
+             AU_CHILD_STDERR_TAIL_SIZE);
+      child->stderr_tail_len = AU_CHILD_STDERR_TAIL_SIZE;
+   } else {
+      if (child->stderr_tail_len + len > AU_CHILD_STDERR_TAIL_SIZE) {
+         drop = child->stderr_tail_len + len - AU_CHILD_STDERR_TAIL_SIZE;
+         memmove(child->stderr_tail, child->stderr_tail + drop,
+                 child->stderr_tail_len - drop);
+         child->stderr_tail_len -= drop;
+      }
+
+      memcpy(child->stderr_tail + child->stderr_tail_len, buffer, len);
+      child->stderr_tail_len += len;
+   }
+
+   child->stderr_tail[child->stderr_tail_len] = '\0';
+}
+
+/*
+ * _au_child_read:
+ * @child: (not nullable): The helper
+ * @fd: Non-blocking pipe with the helper standard output or error
+ *
+ * Read everything that is currently available from @fd.
+ *
+ * Returns: %FALSE if @fd reached the end of file, or it can't be read anymore
+ */
+static gboolean
+_au_child_read(AuChild *child, gint fd)
+{
+   gchar buffer[4096];
+   gssize n;
+
+   while (TRUE) {
+      n = read(fd, buffer, sizeof(buffer));
+
+      if (n < 0 && errno == EINTR)
+         continue;
+
+      if (n < 0)
+         return errno == EAGAIN;
+
+      if (n == 0)
+         return FALSE;
+
+      if (fd == child->standard_output)
+         _au_child_append_stdout(child, buffer, n);
+      else
+         _au_child_append_stderr(child, buffer, n);
+   }
+}
+
+static gboolean
+_au_child_stdout_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+   AuChild *child = user_data;
+
+   if (_au_child_read(child, fd))
+      return G_SOURCE_CONTINUE;
+
+   child->stdout_source = 0;
+   return G_SOURCE_REMOVE;
+}
+
+static gboolean
+_au_child_stderr_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+   AuChild *child = user_data;
+
+   if (_au_child_read(child, fd))
+      return G_SOURCE_CONTINUE;
+
+   child->stderr_source = 0;
+   return G_SOURCE_REMOVE;
+}
+
+static void
+_au_child_exited(AuChild *child, gint wait_status, const struct rusage *usage)
+{
+   g_autoptr(AuChild) owned_child = child;
+   gboolean succeeded = g_spawn_check_wait_status(wait_status, NULL);
+
+   g_clear_handle_id(&child->timeout_source, g_source_remove);
+
+   /* Collect whatever the helper printed right before exiting */
+   if (child->stdout_source != 0) {
+      g_clear_handle_id(&child->stdout_source, g_source_remove);
+      _au_child_read(child, child->standard_output);
+   }
+
+   if (child->stderr_source != 0) {
+      g_clear_handle_id(&child->stderr_source, g_source_remove);
+      _au_child_read(child, child->standard_error);
+   }
+
+   _au_supervisor_release(child->supervisor, child->kind, child->start_time,
+                          !succeeded, usage);
+
+   if (child->timed_out) {
+      g_mutex_lock(&child->supervisor->lock);
+      child->supervisor->stats[child->kind].timed_out++;
+      g_mutex_unlock(&child->supervisor->lock);
+   }
+
+   g_debug("The %s helper %d exited after %.1f seconds",
+           au_helper_kind_names[child->kind], child->pid,
+           (gdouble)(g_get_monotonic_time() - child->start_time) / G_USEC_PER_SEC);
+   au_flight_record(AU_FLIGHT_EVENT_EXIT, wait_status, child->executable);
+
+   if (child->exit_func != NULL)
+      child->exit_func(child, wait_status, child->user_data);
+}
+
+static gboolean
+_au_child_pidfd_cb(gint fd, GIOCondition condition, gpointer user_data)
+{
+   AuChild *child = user_data;
+   struct rusage usage = { 0 };
+   gint wait_status = 0;
+   pid_t ret;
+
+   do {
+      ret = wait4(child->pid, &wait_status, WNOHANG, &usage);
+   } while (ret < 0 && errno == EINTR);
+
+   /* The helper is still running, this should not happen with a pidfd */
+   if (ret == 0)
+      return G_SOURCE_CONTINUE;
+
+   child->exit_source = 0;
+
+   if (ret < 0) {
+      int saved_errno = errno;
+
+      g_warning("Unable to reap the %s helper %d: %s", au_helper_kind_names[child->kind],
+                child->pid, g_strerror(saved_errno));
+      _au_child_exited(child, W_EXITCODE(255, 0), NULL);
+   } else {
+      _au_child_exited(child, wait_status, &usage);
+   }
+
+   return G_SOURCE_REMOVE;
+}
+
+static void
+_au_child_watch_cb(GPid pid, gint wait_status, gpointer user_data)
+{
+   AuChild *child = user_data;
+
+   child->exit_source = 0;
+   _au_child_exited(child, wait_status, NULL);
+}
+
+static gboolean
+_au_child_timeout_cb(gpointer user_data)
+{
+   AuChild *child = user_data;
+
+   g_debug("The %s helper %d timed out, killing it", au_helper_kind_names[child->kind],
+           child->pid);
+   au_flight_record(AU_FLIGHT_EVENT_KILL, child->pid, child->executable);
+
+   child->timeout_source = 0;
+   child->timed_out = TRUE;
+   au_child_send_signal(child, SIGKILL, NULL);
+
+   return G_SOURCE_REMOVE;
+}
+
+/*
+ * _au_child_lower_priority:
+ *
+ * Called in the helper right before executing it, so that all its threads
+ * inherit the priority. Errors are ignored, the helper works anyway.
+ */
+static void
+_au_child_lower_priority(G_GNUC_UNUSED gpointer user_data)
+{
+   /* 19 is the highest niceness */
+   setpriority(PRIO_PROCESS, 0, 19);
+   syscall(SYS_ioprio_set, AU_IOPRIO_WHO_PROCESS, 0,
+           AU_IOPRIO_PRIO_VALUE(AU_IOPRIO_CLASS_IDLE, 0));
+}
+
+/*
+ * au_supervisor_spawn:
+ * @self: (not nullable): The supervisor
+ * @kind: Kind of the helper, to apply the limit of helpers running at the same time
+ * @argv: (not nullable): Command line of the helper, searched in `PATH`
+ * @envp: (nullable): Environment of the helper, or %NULL to use the default one
+ * @flags: What to do with the helper standard output, and its priority
+ * @timeout: Seconds after which the helper is killed, or 0 for no timeout
+ * @exit_func: (nullable): Called when the helper exits
+ * @user_data: Passed to @exit_func
+ * @user_data_free: (nullable): Used to free @user_data together with the helper,
+ *  only if the helper has been launched
+ * @error: Used to raise an error on failure
+ *
+ * Launch a helper and reap it when it exits. Its standard error is forwarded to
+ * ours, keeping the last part of it in memory for au_child_get_stderr().
+ * The file descriptors that are not explicitly redirected are never inherited.
+ *
+ * Returns: (transfer none) (nullable): The helper, which stays valid until
+ *  @exit_func returns or au_child_detach() is called, or %NULL on failure
+ */
+AuChild *
+au_supervisor_spawn(AuSupervisor *self,
+                    AuHelperKind kind,
+                    const gchar *const *argv,
+                    const gchar *const *envp,
+                    AuChildFlags flags,
+                    guint timeout,
+                    AuChildExitFunc exit_func,
+                    gpointer user_data,
+                    GDestroyNotify user_data_free,
+                    GError **error)
+{
+   g_autoptr(AuChild) child = NULL;
+   gboolean want_stdout =
+      (flags & (AU_CHILD_FLAGS_CAPTURE_STDOUT | AU_CHILD_FLAGS_PIPE_STDOUT)) != 0;
+
+   g_return_val_if_fail(self != NULL, NULL);
+   g_return_val_if_fail(kind < AU_N_HELPER_KINDS, NULL);
+   g_return_val_if_fail(argv != NULL && argv[0] != NULL, NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   if (!_au_supervisor_reserve(self, kind, error))
+      return NULL;
+
+   child = g_slice_new0(AuChild);
+   child->supervisor = self;
+   child->kind = kind;
+   child->pidfd = -1;
+   child->standard_output = -1;
+   child->standard_error = -1;
+   child->start_time = g_get_monotonic_time();
+   child->exit_func = exit_func;
+   child->user_data = user_data;
+   child->user_data_free = user_data_free;
+   child->executable = g_path_get_basename(argv[0]);
+
+   if (envp == NULL)
+      envp = (const gchar *const *)self->base_environ;
+
+   if (!g_spawn_async_with_pipes(NULL, /* working directory */
+                                 (gchar **)argv, (gchar **)envp,
+                                 G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+                                 (flags & AU_CHILD_FLAGS_LOW_PRIORITY)
+                                    ? _au_child_lower_priority
+                                    : NULL,
+                                 NULL, /* user data */
+                                 &child->pid, NULL, /* standard input */
+                                 want_stdout ? &child->standard_output : NULL,
+                                 &child->standard_error, error)) {
+      /* On failure @user_data still belongs to the caller */
+      child->user_data_free = NULL;
+      _au_supervisor_release(self, kind, child->start_time, TRUE, NULL);
+      return NULL;
+   }
+
+   g_debug("Launched the %s helper %s with PID %d", au_helper_kind_names[kind], argv[0],
+           child->pid);
+   au_flight_record(AU_FLIGHT_EVENT_SPAWN, child->pid, child->executable);
+
+   if (flags & AU_CHILD_FLAGS_CAPTURE_STDOUT) {
+      child->stdout_buffer = g_byte_array_new();
+      g_unix_set_fd_nonblocking(child->standard_output, TRUE, NULL);
+      child->stdout_source =
+         g_unix_fd_add(child->standard_output, G_IO_IN | G_IO_HUP | G_IO_ERR,
+                       _au_child_stdout_cb, child);
+   }
+
+   g_unix_set_fd_nonblocking(child->standard_error, TRUE, NULL);
+   child->stderr_source = g_unix_fd_add(child->standard_error,
+                                        G_IO_IN | G_IO_HUP | G_IO_ERR,
+                                        _au_child_stderr_cb, child);
+
+   /* With a pidfd we can reap the helper ourselves, which gives us its resource
+    * usage, and signal it without any risk of hitting a recycled PID */
+   child->pidfd = _au_pidfd_open(child->pid);
+   if (child->pidfd > -1)
+      child->exit_source =
+         g_unix_fd_add(child->pidfd, G_IO_IN, _au_child_pidfd_cb, child);
+   else
+      child->exit_source = g_child_watch_add(child->pid, _au_child_watch_cb, child);
+
+   if (timeout > 0)
+      child->timeout_source = g_timeout_add_seconds(timeout, _au_child_timeout_cb, child);
+
+   return g_steal_pointer(&child);
+}
+
+/*
+ * au_supervisor_run_sync:
+ * @self: (not nullable): The supervisor
+ * @kind: Kind of the helper, to apply the limit of helpers running at the same time
+ * @argv: (not nullable): Command line of the helper, searched in `PATH`
+ * @stdout_out: (out) (optional): Used to return the standard output of the helper
+ * @wait_status_out: (out) (not optional): Used to return the status of the helper
+ * @error: Used to raise an error on failure
+ *
+ * Launch a short lived helper and wait for it to exit. Unlike
+ * au_supervisor_spawn(), this can be used from any thread.
+ *
+ * Returns: %TRUE if the helper has been launched
+ */
+gboolean
+au_supervisor_run_sync(AuSupervisor *self,
+                       AuHelperKind kind,
+                       const gchar *const *argv,
+                       gchar **stdout_out,
+                       gint *wait_status_out,
+                       GError **error)
+{
+   g_autofree gchar *executable = NULL;
+   gint64 start_time = g_get_monotonic_time();
+   gboolean launched;
+
+   g_return_val_if_fail(self != NULL, FALSE);
+   g_return_val_if_fail(kind < AU_N_HELPER_KINDS, FALSE);
+   g_return_val_if_fail(argv != NULL && argv[0] != NULL, FALSE);
+   g_return_val_if_fail(wait_status_out != NULL, FALSE);
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+   if (!_au_supervisor_reserve(self, kind, error))
+      return FALSE;
+
+   /* The PID is not known with g_spawn_sync() */
+   executable = g_path_get_basename(argv[0]);
+   au_flight_record(AU_FLIGHT_EVENT_SPAWN, 0, executable);
+
+   launched = g_spawn_sync(NULL, /* working directory */
+                           (gchar **)argv, self->base_environ, G_SPAWN_SEARCH_PATH,
+                           NULL,             /* child setup */
+                           NULL,             /* user data */
+                           stdout_out, NULL, /* standard error */
+                           wait_status_out, error);
+
+   if (launched)
+      au_flight_record(AU_FLIGHT_EVENT_EXIT, *wait_status_out, executable);
+
+   _au_supervisor_release(self, kind, start_time,
+                          !launched || !g_spawn_check_wait_status(*wait_status_out, NULL),
+                          NULL);
+
+   return launched;
+}
+
+/*
+ * au_child_get_pid:
+ * @child: (not nullable): A running helper
+ *
+ * Returns: The PID of @child, which is not reaped before its exit function is
+ *  called, so it can't be recycled while @child is valid
+ */
+GPid
+au_child_get_pid(const AuChild *child)
+{
+   return child->pid;
+}
+
+/*
+ * au_child_steal_stdout:
+ * @child: (not nullable): A helper launched with %AU_CHILD_FLAGS_PIPE_STDOUT
+ *
+ * Returns: (transfer full): A pipe with the standard output of @child
+ */
+gint
+au_child_steal_stdout(AuChild *child)
+{
+   g_return_val_if_fail(child->stdout_buffer == NULL, -1);
+
+   return g_steal_fd(&child->standard_output);
+}
+
+/*
+ * au_child_get_stdout:
+ * @child: (not nullable): A helper launched with %AU_CHILD_FLAGS_CAPTURE_STDOUT
+ *
+ * Returns: (transfer full): What @child printed on its standard output so far
+ */
+GBytes *
+au_child_get_stdout(const AuChild *child)
+{
+   g_return_val_if_fail(child->stdout_buffer != NULL, NULL);
+
+   return g_bytes_new(child->stdout_buffer->data, child->stdout_buffer->len);
+}
+
+/*
+ * au_child_get_stderr:
+ * @child: (not nullable): A helper
+ *
+ * Returns: (transfer none): The last messages that @child printed on its standard
+ *  error, at most AU_CHILD_STDERR_TAIL_SIZE bytes
+ */
+const gchar *
+au_child_get_stderr(const AuChild *child)
+{
+   return child->stderr_tail;
+}
+
+/*
+ * au_child_get_timed_out:
+ * @child: (not nullable): A helper
+ *
+ * Returns: %TRUE if @child has been killed because it exceeded its timeout
+ */
+gboolean
+au_child_get_timed_out(const AuChild *child)
+{
+   return child->timed_out;
+}
+
+/*
+ * au_child_send_signal:
+ * @child: (not nullable): A helper that has not been reaped yet
+ * @sig: The signal to send
+ * @error: Used to raise an error on failure
+ *
+ * Returns: %TRUE if @sig has been sent
+ */
+gboolean
+au_child_send_signal(AuChild *child, gint sig, GError **error)
+{
+   int ret = -1;
+   int saved_errno;
+
+   g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+
+#ifdef SYS_pidfd_send_signal
+   if (child->pidfd > -1)
+      ret = syscall(SYS_pidfd_send_signal, child->pidfd, sig, NULL, 0);
+   else
+#endif
+      /* The helper is not reaped until its child watch runs, so its PID can't
+       * have been recycled yet */
+      ret = kill(child->pid, sig);
+
+   if (ret < 0) {
+      saved_errno = errno;
+      g_set_error(error, G_IO_ERROR, g_io_error_from_errno(saved_errno),
+                  "Unable to send signal %i to the %s helper %d: %s", sig,
+                  au_helper_kind_names[child->kind], child->pid,
+                  g_strerror(saved_errno));
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+/*
+ * au_child_detach:
+ * @child: (transfer full) (not nullable): A helper that has not been reaped yet
+ *
+ * Stop supervising @child, without calling its exit function. The caller
+ * becomes responsible for terminating and reaping it, e.g. with
+ * au_terminate_pid(). @child is freed.
+ */
+void
+au_child_detach(AuChild *child)
+{
+   g_debug("Detaching the %s helper %d", au_helper_kind_names[child->kind], child->pid);
+
+   _au_supervisor_release(child->supervisor, child->kind, child->start_time, TRUE,
+                          NULL);
+   _au_child_free(child);
+}
+
+/*
+ * au_terminate_pid:
+ * @pid: The process to stop, it doesn't need to be one of our children
+ *
+ * Send SIGTERM to @pid and, if it is still running after a couple of seconds,
+ * SIGKILL. This blocks, so it should be called from a worker thread.
+ */
+void
+au_terminate_pid(GPid pid)
+{
+   gsize i;
+   int status;
+   int pgid = getpgid(pid);
+
+   if (pid < 1)
+      return;
+
+   g_debug("Sending SIGTERM to PID %i", pid);
+
+   if (kill(pid, SIGTERM) == 0) {
+      /* The PIDs we are trying to stop usually do it in less than a second.
+       * We wait up to 2s and, if they are still running, we will send a
+       * SIGKILL. */
+      for (i = 0; i < 4; i++) {
+         if (waitpid(pid, &status, WNOHANG | WUNTRACED) > 0) {
+            if (WIFEXITED(status))
+               goto success;
+
+            if (WIFSTOPPED(status)) {
+               g_debug("PID %i is currently paused, sending SIGCONT to the group %i", pid,
+                       pgid);
+               killpg(pgid, SIGCONT);
+            }
+         } else {
+            int saved_errno = errno;
+
+            if (saved_errno == ESRCH)
+               goto success;
+
+            if (saved_errno == ECHILD) {
+               /* The PID may not be our child, i.e. the rauc service.
+                * It is still safe to kill it, because it is the process
+                * responsible for applying an update and will gracefully
+                * handle the kill(). When we'll try to apply another update
+                * this service will be automatically executed again. */
+               if (kill(pid, 0) != 0)
+                  goto success;
+
+               /* If this process is not our child, we can't use waitpid() and
+                * WIFSTOPPED(). Instead we send a SIGCONT regardless of the status of the
+                * process. */
+               g_debug("Sending SIGCONT to the group %i to ensure that the PIDs are not "
+                       "paused",
+                       pgid);
+               killpg(pgid, SIGCONT);
+            }
+         }
+
+         g_debug("PID %i is still running", pid);
+         g_usleep(0.5 * G_USEC_PER_SEC);
+      }
+   }
+
+   g_debug("Sending SIGKILL to PID %i", pid);
+   kill(pid, SIGKILL);
+   waitpid(pid, NULL, 0);
+
+success:
+   g_debug("PID %i terminated successfully", pid);
+}
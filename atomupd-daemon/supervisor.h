@@ -0,0 +1,109 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+typedef enum {
+   AU_HELPER_KIND_QUERY = 0,
+   AU_HELPER_KIND_UPDATE,
+   AU_HELPER_KIND_TOOL,
+   AU_N_HELPER_KINDS,
+} AuHelperKind;
+
+typedef enum {
+   AU_CHILD_FLAGS_NONE = 0,
+   /* Collect the standard output, see au_child_get_stdout() */
+   AU_CHILD_FLAGS_CAPTURE_STDOUT = (1 << 0),
+   /* Let the caller read the standard output, see au_child_steal_stdout() */
+   AU_CHILD_FLAGS_PIPE_STDOUT = (1 << 1),
+   /* Run with the lowest CPU priority and in the idle I/O scheduling class */
+   AU_CHILD_FLAGS_LOW_PRIORITY = (1 << 2),
+} AuChildFlags;
+
+typedef struct {
+   /* Helpers that are currently running */
+   guint running;
+   guint64 spawned;
+   /* Helpers that exited with an error, or have been killed */
+   guint64 failed;
+   guint64 timed_out;
+   /* Helpers that have not been launched because too many were already running */
+   guint64 rejected;
+   /* Total time the helpers have been running, in microseconds */
+   guint64 wall_time;
+   /* Total user and system CPU time of the reaped helpers, in microseconds */
+   guint64 cpu_time;
+   /* Highest resident set size of a reaped helper, in KiB */
+   guint64 max_rss;
+} AuHelperStats;
+
+typedef struct _AuSupervisor AuSupervisor;
+typedef struct _AuChild AuChild;
+
+/*
+ * AuChildExitFunc:
+ * @child: The helper that exited, it is freed when this function returns
+ * @wait_status: Status of the helper, as for g_spawn_check_wait_status()
+ * @user_data: The data passed to au_supervisor_spawn()
+ */
+typedef void (*AuChildExitFunc)(AuChild *child, gint wait_status, gpointer user_data);
+
+const gchar *au_helper_kind_get_name(AuHelperKind kind);
+
+AuSupervisor *au_supervisor_get_default(void);
+AuSupervisor *au_supervisor_new(void);
+void au_supervisor_free(AuSupervisor *self);
+GStrv au_supervisor_dup_environ(AuSupervisor *self);
+AuChild *au_supervisor_spawn(AuSupervisor *self,
+                             AuHelperKind kind,
+                             const gchar *const *argv,
+                             const gchar *const *envp,
+                             AuChildFlags flags,
+                             guint timeout,
+                             AuChildExitFunc exit_func,
+                             gpointer user_data,
+                             GDestroyNotify user_data_free,
+                             GError **error);
+gboolean au_supervisor_run_sync(AuSupervisor *self,
+                                AuHelperKind kind,
+                                const gchar *const *argv,
+                                gchar **stdout_out,
+                                gint *wait_status_out,
+                                GError **error);
+void au_supervisor_get_stats(AuSupervisor *self, AuHelperKind kind, AuHelperStats *stats);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(AuSupervisor, au_supervisor_free)
+
+GPid au_child_get_pid(const AuChild *child);
+gint au_child_steal_stdout(AuChild *child);
+GBytes *au_child_get_stdout(const AuChild *child);
+const gchar *au_child_get_stderr(const AuChild *child);
+gboolean au_child_get_timed_out(const AuChild *child);
+gboolean au_child_send_signal(AuChild *child, gint sig, GError **error);
+void au_child_detach(AuChild *child);
+
+void au_terminate_pid(GPid pid);
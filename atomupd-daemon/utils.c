@@ -23,11 +23,15 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include <curl/curl.h>
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <json-glib/json-glib.h>
 
+#include "flight-recorder.h"
 #include "utils.h"
 
 /*
@@ -330,7 +334,10 @@ download_data_free(DownloadData *data)
  *
  * Downloads the @task_data->url to the provided @task_data->target. If @task_data->target
  * already exists, it will be replaced. During the download, the temporary file is stored
- * at @task_data->target with the `.part` suffix.
+ * at @task_data->target with the `.part` suffix. If @task_data->max_size is set,
+ * files bigger than that are not downloaded. Unless
+ * @task_data->abort_only_if_stalled is set, the download fails if it takes more
+ * than a minute.
  */
 void
 _au_download_thread_func(GTask *task,
@@ -344,6 +351,7 @@ _au_download_thread_func(GTask *task,
    FILE *fp = NULL;
    g_autoptr(GError) error = NULL;
    const DownloadData *data = task_data;
+   const gchar *url_basename = NULL;
 
    g_return_if_fail(data != NULL);
    g_return_if_fail(data->target != NULL);
@@ -370,16 +378,28 @@ _au_download_thread_func(GTask *task,
    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
    curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-   /* We don't have to be too aggressive with the timeout because the download
-    * is done out of band and we are not blocking anything in the meantime. */
-   curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+   if (data->abort_only_if_stalled) {
+      curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+      curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+   } else {
+      /* We don't have to be too aggressive with the timeout because the download
+       * is done out of band and we are not blocking anything in the meantime. */
+      curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+   }
 
    if (data->proxy != NULL)
       curl_easy_setopt(curl, CURLOPT_PROXY, data->proxy);
 
+   if (data->max_size > 0)
+      curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE, (curl_off_t)data->max_size);
+
    r = curl_easy_perform(curl);
    fclose(fp);
 
+   url_basename = strrchr(data->url, '/');
+   au_flight_record(AU_FLIGHT_EVENT_DOWNLOAD, r,
+                    url_basename != NULL ? url_basename + 1 : data->url);
+
    if (r != CURLE_OK) {
       g_unlink(tmp_file);
       g_set_error(&error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
@@ -396,3 +416,247 @@ _au_download_thread_func(GTask *task,
 
    g_task_return_boolean(task, TRUE);
 }
+
+/*
+ * _au_http_read_request_line:
+ * @input: (not nullable): The input stream of an HTTP client connection
+ * @max_line_length: Maximum length, in bytes, of the request line and of every header
+ * @max_headers: Maximum number of headers that the request can have
+ * @error: Used to raise an error on failure
+ *
+ * Read the head of an HTTP request, up to the empty line that terminates it,
+ * and return its request line. The headers are skipped. The lines are collected
+ * one byte at a time, so that a client can't make us buffer more than
+ * @max_line_length bytes, regardless of what it sends.
+ *
+ * Returns: (transfer full): The request line, without the line terminator, or
+ *  %NULL on failure. If the request exceeds the given limits, @error is set to
+ *  %G_IO_ERROR_MESSAGE_TOO_LARGE.
+ */
+gchar *
+_au_http_read_request_line(GInputStream *input,
+                           gsize max_line_length,
+                           guint max_headers,
+                           GError **error)
+{
+   g_autoptr(GBufferedInputStream) buffered = NULL;
+   g_autoptr(GString) line = NULL;
+   g_autofree gchar *request_line = NULL;
+   guint n_headers = 0;
+
+   g_return_val_if_fail(G_IS_INPUT_STREAM(input), NULL);
+   g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+
+   buffered = G_BUFFERED_INPUT_STREAM(g_buffered_input_stream_new(input));
+   g_filter_input_stream_set_close_base_stream(G_FILTER_INPUT_STREAM(buffered), FALSE);
+   line = g_string_sized_new(128);
+
+   while (TRUE) {
+      g_autoptr(GError) local_error = NULL;
+      int c;
+
+      c = g_buffered_input_stream_read_byte(buffered, NULL, &local_error);
+      if (c < 0) {
+         if (local_error != NULL) {
+            g_propagate_error(error, g_steal_pointer(&local_error));
+            return NULL;
+         }
+
+         g_set_error(error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
+                     "The connection was closed before the end of the request");
+         return NULL;
+      }
+
+      if (c != '\n') {
+         /* Leave room for the carriage return that precedes the newline */
+         if (line->len > max_line_length) {
+            g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                        "The request has a line longer than %" G_GSIZE_FORMAT " bytes",
+                        max_line_length);
+            return NULL;
+         }
+
+         g_string_append_c(line, (gchar)c);
+         continue;
+      }
+
+      if (line->len > 0 && line->str[line->len - 1] == '\r')
+         g_string_truncate(line, line->len - 1);
+
+      if (request_line == NULL) {
+         request_line = g_strdup(line->str);
+      } else if (line->len == 0) {
+         return g_steal_pointer(&request_line);
+      } else if (++n_headers > max_headers) {
+         g_set_error(error, G_IO_ERROR, G_IO_ERROR_MESSAGE_TOO_LARGE,
+                     "The request has more than %u headers", max_headers);
+         return NULL;
+      }
+
+      g_string_truncate(line, 0);
+   }
+}
+
+/*
+ * _au_get_proc_io_bytes:
+ * @proc_pid_path: (not nullable): The proc directory of a process, e.g. `/proc/1234`
+ * @bytes: (out) (not optional): Used to return the bytes that the process read
+ *  and wrote so far
+ *
+ * This counts every read and write, from files, pipes and sockets alike.
+ *
+ * Returns: %TRUE on success
+ */
+static gboolean
+_au_get_proc_io_bytes(const gchar *proc_pid_path, guint64 *bytes)
+{
+   g_autofree gchar *io_path = g_build_filename(proc_pid_path, "io", NULL);
+   g_autofree gchar *contents = NULL;
+   g_auto(GStrv) lines = NULL;
+   gboolean found = FALSE;
+   gsize i;
+
+   *bytes = 0;
+
+   if (!g_file_get_contents(io_path, &contents, NULL, NULL))
+      return FALSE;
+
+   lines = g_strsplit(contents, "\n", -1);
+   for (i = 0; lines[i] != NULL; i++) {
+      if (g_str_has_prefix(lines[i], "rchar:") || g_str_has_prefix(lines[i], "wchar:")) {
+         *bytes += g_ascii_strtoull(strchr(lines[i], ':') + 1, NULL, 10);
+         found = TRUE;
+      }
+   }
+
+   return found;
+}
+
+/*
+ * _au_get_proc_stat_ids:
+ * @proc_pid_path: (not nullable): The proc directory of a process, e.g. `/proc/1234`
+ * @ppid: (out) (optional): Used to return the parent PID of the process
+ * @pgrp: (out) (optional): Used to return the process group ID of the process
+ *
+ * Returns: %TRUE if the IDs of the process are known
+ */
+static gboolean
+_au_get_proc_stat_ids(const gchar *proc_pid_path, GPid *ppid, GPid *pgrp)
+{
+   g_autofree gchar *stat_path = g_build_filename(proc_pid_path, "stat", NULL);
+   g_autofree gchar *contents = NULL;
+   const gchar *comm_end;
+   gint parent = 0;
+   gint group = 0;
+
+   if (!g_file_get_contents(stat_path, &contents, NULL, NULL))
+      return FALSE;
+
+   /* The command name, between parentheses, can contain spaces and parentheses,
+    * the state, the parent PID and the process group come after its closing
+    * parenthesis */
+   comm_end = strrchr(contents, ')');
+   if (comm_end == NULL || sscanf(comm_end + 1, " %*c %d %d", &parent, &group) != 2)
+      return FALSE;
+
+   if (ppid != NULL)
+      *ppid = parent;
+   if (pgrp != NULL)
+      *pgrp = group;
+
+   return TRUE;
+}
+
+/*
+ * _au_get_procs_io_bytes:
+ * @proc_path: (not nullable): Path to the proc filesystem, usually `/proc`
+ * @pid: The process ID
+ * @with_children: If %TRUE, count also the direct children of @pid, e.g. the
+ *  Desync process launched by RAUC
+ *
+ * Returns: The bytes that @pid, and optionally its children, read and wrote
+ *  so far. The processes that can't be inspected are skipped.
+ */
+guint64
+_au_get_procs_io_bytes(const gchar *proc_path, GPid pid, gboolean with_children)
+{
+   g_autofree gchar *pid_str = g_strdup_printf("%i", pid);
+   g_autofree gchar *proc_pid_path = g_build_filename(proc_path, pid_str, NULL);
+   g_autoptr(GDir) dir = NULL;
+   const gchar *name;
+   guint64 total = 0;
+   guint64 bytes;
+   GPid ppid;
+
+   g_return_val_if_fail(proc_path != NULL, 0);
+
+   if (pid <= 0)
+      return 0;
+
+   if (_au_get_proc_io_bytes(proc_pid_path, &bytes))
+      total += bytes;
+
+   if (!with_children)
+      return total;
+
+   dir = g_dir_open(proc_path, 0, NULL);
+   if (dir == NULL)
+      return total;
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *child_path = NULL;
+
+      if (!g_ascii_isdigit(name[0]))
+         continue;
+
+      child_path = g_build_filename(proc_path, name, NULL);
+      if (_au_get_proc_stat_ids(child_path, &ppid, NULL) && ppid == pid &&
+          _au_get_proc_io_bytes(child_path, &bytes))
+         total += bytes;
+   }
+
+   return total;
+}
+
+/*
+ * _au_get_pgrp_pids:
+ * @proc_path: (not nullable): Path to the proc filesystem, usually `/proc`
+ * @pgid: The process group ID
+ *
+ * Returns: (transfer full) (element-type GPid): The processes that are in the
+ *  @pgid group, in no particular order
+ */
+GArray *
+_au_get_pgrp_pids(const gchar *proc_path, GPid pgid)
+{
+   g_autoptr(GArray) pids = g_array_new(FALSE, FALSE, sizeof(GPid));
+   g_autoptr(GDir) dir = NULL;
+   const gchar *name;
+
+   g_return_val_if_fail(proc_path != NULL, NULL);
+
+   if (pgid <= 0)
+      return g_steal_pointer(&pids);
+
+   dir = g_dir_open(proc_path, 0, NULL);
+   if (dir == NULL)
+      return g_steal_pointer(&pids);
+
+   while ((name = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *proc_pid_path = NULL;
+      GPid pgrp;
+      GPid pid;
+
+      if (!g_ascii_isdigit(name[0]))
+         continue;
+
+      proc_pid_path = g_build_filename(proc_path, name, NULL);
+      if (!_au_get_proc_stat_ids(proc_pid_path, NULL, &pgrp) || pgrp != pgid)
+         continue;
+
+      pid = (GPid)g_ascii_strtoll(name, NULL, 10);
+      g_array_append_val(pids, pid);
+   }
+
+   return g_steal_pointer(&pids);
+}
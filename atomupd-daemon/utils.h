@@ -49,6 +49,42 @@ typedef enum {
    AU_UPDATE_STATUS_CANCELLED = 5,
 } AuUpdateStatus;
 
+/* From linux/ioprio.h, glibc doesn't have a wrapper for ioprio_set() */
+#define AU_IOPRIO_CLASS_SHIFT 13
+#define AU_IOPRIO_CLASS_NONE 0
+#define AU_IOPRIO_CLASS_BE 2
+#define AU_IOPRIO_CLASS_IDLE 3
+#define AU_IOPRIO_WHO_PROCESS 1
+#define AU_IOPRIO_PRIO_VALUE(_class, _data)                                             \
+   (((_class) << AU_IOPRIO_CLASS_SHIFT) | (_data))
+
+/* Version of the AuProgressRecord layout */
+#define AU_PROGRESS_RECORD_VERSION 1
+
+/**
+ * AuProgressRecord:
+ * @version: Always %AU_PROGRESS_RECORD_VERSION
+ * @status: The current #AuUpdateStatus
+ * @percentage: Completed percentage of the update, from 0 to 100
+ * @bytes: Estimated number of bytes downloaded so far, 0 if unknown
+ * @rate: Estimated download rate in bytes per second, 0 if unknown
+ * @estimated_completion_time: Unix timestamp of the expected completion, 0 if
+ *  unknown
+ *
+ * Fixed-size record, in host byte order, that is written to the file descriptors
+ * returned by SubscribeProgress().
+ */
+typedef struct {
+   guint32 version;
+   guint32 status;
+   gdouble percentage;
+   guint64 bytes;
+   guint64 rate;
+   guint64 estimated_completion_time;
+} AuProgressRecord;
+
+G_STATIC_ASSERT(sizeof(AuProgressRecord) == 40);
+
 typedef struct {
    /* Path where to store the downloaded file */
    gchar *target;
@@ -56,6 +92,11 @@ typedef struct {
    gchar *url;
    /* Eventual HTTP/HTTPS proxy to use */
    gchar *proxy;
+   /* Maximum size of the file, in bytes, or 0 for no limit */
+   guint64 max_size;
+   /* If %TRUE, the download is not limited in time, and it is only aborted if
+    * it stalls */
+   gboolean abort_only_if_stalled;
 } DownloadData;
 
 extern guint ATOMUPD_VERSION;
@@ -92,6 +133,14 @@ void _au_download_thread_func(GTask *task,
                               gpointer task_data,
                               GCancellable *cancellable);
 
+gchar *_au_http_read_request_line(GInputStream *input,
+                                  gsize max_line_length,
+                                  guint max_headers,
+                                  GError **error);
+
+guint64 _au_get_procs_io_bytes(const gchar *proc_path, GPid pid, gboolean with_children);
+GArray *_au_get_pgrp_pids(const gchar *proc_path, GPid pgid);
+
 gboolean au_throw_error(GError **error,
                         const char *format, ...) G_GNUC_PRINTF(2, 3);
 
@@ -0,0 +1,226 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/builds-catalog.h"
+
+typedef struct {
+   int unused;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+}
+
+/* Intentionally not sorted, and with an entry that has an invalid buildid */
+static const gchar *builds_list_json =
+   "["
+   "{\"buildid\": \"20240107.1\", \"version\": \"3.5.10\", \"branch\": \"rc\"},"
+   "{\"buildid\": \"20240115.1\", \"version\": \"3.5.11\", \"branch\": \"stable\"},"
+   "{\"buildid\": \"not-a-buildid\", \"version\": \"1\", \"branch\": \"stable\"},"
+   "{\"buildid\": \"20240104.1\", \"version\": \"3.5.9\", \"branch\": \"stable\"},"
+   "{\"buildid\": \"20240115.2\", \"version\": \"3.5.12\", \"branch\": \"stable\","
+   " \"update_path\": \"steamos/amd64/3.5.12/steamdeck/20240115.2.json\"},"
+   "{\"buildid\": \"20240101.1\", \"version\": \"3.6.0\", \"branch\": \"main\"}"
+   "]";
+
+typedef struct {
+   const gchar *description;
+   const gchar *filter;
+   guint limit;
+   const gchar *expected[7]; /* buildid of the expected results, in order */
+   const gchar *error;       /* The expected error message, or NULL */
+} QueryTest;
+
+static const QueryTest query_tests[] = {
+   {
+      .description = "No filter",
+      .filter = "@a{sv} {}",
+      .expected = { "20240115.2", "20240115.1", "20240107.1", "20240104.1", "20240101.1",
+                    NULL },
+   },
+   {
+      .description = "Limit",
+      .filter = "@a{sv} {}",
+      .limit = 2,
+      .expected = { "20240115.2", "20240115.1", NULL },
+   },
+   {
+      .description = "Single branch",
+      .filter = "{'branch': <'stable'>}",
+      .expected = { "20240115.2", "20240115.1", "20240104.1", NULL },
+   },
+   {
+      .description = "Unknown branch",
+      .filter = "{'branch': <'beta'>}",
+      .expected = { NULL },
+   },
+   {
+      .description = "Latest per branch",
+      .filter = "{'latest_per_branch': <true>}",
+      .expected = { "20240115.2", "20240107.1", "20240101.1", NULL },
+   },
+   {
+      .description = "Newer than a given build",
+      .filter = "{'newer_than': <'20240107.1'>}",
+      .expected = { "20240115.2", "20240115.1", NULL },
+   },
+   {
+      .description = "Newer than the current build",
+      .filter = "{'newer_than_current': <true>, 'branch': <'stable'>}",
+      .expected = { "20240115.2", "20240115.1", NULL },
+   },
+   {
+      .description = "Date range",
+      .filter = "{'since': <'20240104'>, 'until': <'20240107'>}",
+      .expected = { "20240107.1", "20240104.1", NULL },
+   },
+   {
+      .description = "Latest per branch up to a date",
+      .filter = "{'until': <'20240110'>, 'latest_per_branch': <true>}",
+      .expected = { "20240107.1", "20240104.1", "20240101.1", NULL },
+   },
+   {
+      .description = "Unknown option",
+      .filter = "{'foo': <'bar'>}",
+      .error = "The argument 'foo' is either not a valid option or it has an "
+               "unexpected type",
+   },
+   {
+      .description = "Unexpected type",
+      .filter = "{'branch': <true>}",
+      .error = "The argument 'branch' is either not a valid option or it has an "
+               "unexpected type",
+   },
+   {
+      .description = "Invalid date",
+      .filter = "{'since': <'2024-01-04'>}",
+      .error = "Buildid '2024-01-04' doesn't follow the expected YYYYMMDD[.N] format",
+   },
+};
+
+static void
+test_query(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *tmp_file = NULL;
+   g_autoptr(AuBuildsCatalog) catalog = NULL;
+   g_autoptr(GError) error = NULL;
+   int fd;
+
+   fd = g_file_open_tmp("builds-XXXXXX.json", &tmp_file, &error);
+   g_assert_no_error(error);
+   g_assert_cmpint(fd, !=, -1);
+   close(fd);
+
+   g_file_set_contents(tmp_file, builds_list_json, -1, &error);
+   g_assert_no_error(error);
+
+   catalog = au_builds_catalog_new_from_file(tmp_file, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(catalog);
+   g_assert_cmpuint(catalog->builds->len, ==, 5);
+   g_assert_false(au_builds_catalog_is_stale(catalog));
+
+   for (gsize i = 0; i < G_N_ELEMENTS(query_tests); i++) {
+      const QueryTest *test = &query_tests[i];
+      g_auto(AuBuildsQuery) query = { 0 };
+      g_autoptr(GVariant) filter = NULL;
+      g_autoptr(GVariant) builds = NULL;
+      gboolean result;
+      gsize j;
+
+      g_test_message("%s", test->description);
+
+      filter = g_variant_ref_sink(g_variant_new_parsed(test->filter));
+
+      result = au_builds_query_init(&query, filter, 20240107, 1, &error);
+
+      if (test->error != NULL) {
+         g_assert_false(result);
+         g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+         g_assert_cmpstr(error->message, ==, test->error);
+         g_clear_error(&error);
+         continue;
+      }
+
+      g_assert_no_error(error);
+      g_assert_true(result);
+
+      builds = au_builds_catalog_query(catalog, &query, test->limit);
+
+      for (j = 0; test->expected[j] != NULL; j++) {
+         g_autoptr(GVariant) build = NULL;
+         const gchar *buildid = NULL;
+
+         g_assert_cmpuint(j, <, g_variant_n_children(builds));
+         build = g_variant_get_child_value(builds, j);
+         g_assert_true(g_variant_lookup(build, "buildid", "&s", &buildid));
+         g_assert_cmpstr(buildid, ==, test->expected[j]);
+         g_assert_true(g_variant_lookup(build, "version", "&s", NULL));
+         g_assert_true(g_variant_lookup(build, "branch", "&s", NULL));
+      }
+
+      g_assert_cmpuint(j, ==, g_variant_n_children(builds));
+   }
+
+   /* Replacing the file must invalidate the catalog */
+   g_unlink(tmp_file);
+   g_file_set_contents(tmp_file, "[]", -1, &error);
+   g_assert_no_error(error);
+   g_assert_true(au_builds_catalog_is_stale(catalog));
+
+   g_unlink(tmp_file);
+   g_assert_true(au_builds_catalog_is_stale(catalog));
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/builds_catalog/query", test_query);
+
+   return g_test_run();
+}
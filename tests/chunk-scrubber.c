@@ -0,0 +1,255 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/chunk-scrubber.h"
+#include "tests-utils.h"
+
+#define GOOD_CHUNK_ID "6c87f68371b28954707ebb92afee7ccffb74c6f71ec8fea8a98cf6104289585b"
+#define BAD_CHUNK_ID "6c87a0e5d9b04f36a4a4d0cc51ffd9e5c00c0bbd2e8e2b2cb0c4b0b0fdbf2e3a"
+
+typedef struct {
+   gchar *chunks_dir;
+   gchar *good_chunk_path;
+   gchar *bad_chunk_path;
+   GMainLoop *loop;
+   guint n_done;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autofree gchar *prefix_dir = NULL;
+   g_autoptr(GError) error = NULL;
+
+   f->chunks_dir = g_dir_make_tmp("atomupd-scrub-XXXXXX", &error);
+   g_assert_no_error(error);
+
+   prefix_dir = g_build_filename(f->chunks_dir, "6c87", NULL);
+   g_assert_cmpint(g_mkdir(prefix_dir, 0755), ==, 0);
+
+   f->good_chunk_path = g_build_filename(prefix_dir, GOOD_CHUNK_ID ".cacnk", NULL);
+   g_file_set_contents(f->good_chunk_path, "compressed chunk", -1, &error);
+   g_assert_no_error(error);
+
+   f->bad_chunk_path = g_build_filename(prefix_dir, BAD_CHUNK_ID ".cacnk", NULL);
+   g_file_set_contents(f->bad_chunk_path, "corrupted chunk", -1, &error);
+   g_assert_no_error(error);
+
+   f->loop = g_main_loop_new(NULL, FALSE);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->chunks_dir))
+      g_debug("Unable to remove temp directory: %s", f->chunks_dir);
+
+   g_free(f->chunks_dir);
+   g_free(f->good_chunk_path);
+   g_free(f->bad_chunk_path);
+   g_main_loop_unref(f->loop);
+}
+
+static void
+test_measure(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *unrelated_path = NULL;
+   g_autofree gchar *misplaced_path = NULL;
+   g_autoptr(GError) error = NULL;
+   guint64 n_chunks;
+   guint64 bytes;
+
+   /* Files that are not chunks are ignored */
+   unrelated_path = g_build_filename(f->chunks_dir, "6c87", "notes.txt", NULL);
+   g_file_set_contents(unrelated_path, "not a chunk", -1, &error);
+   g_assert_no_error(error);
+   misplaced_path = g_build_filename(f->chunks_dir, GOOD_CHUNK_ID ".cacnk", NULL);
+   g_file_set_contents(misplaced_path, "not in its prefix directory", -1, &error);
+   g_assert_no_error(error);
+
+   au_chunk_cache_measure(f->chunks_dir, &n_chunks, &bytes, &error);
+   g_assert_no_error(error);
+   g_assert_cmpuint(n_chunks, ==, 2);
+   g_assert_cmpuint(bytes, ==, strlen("compressed chunk") + strlen("corrupted chunk"));
+
+   g_assert_false(au_chunk_cache_measure("/nonexistent", &n_chunks, &bytes, &error));
+   g_assert_error(error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+}
+
+typedef struct {
+   const gchar *description;
+   const gchar *stat;
+   gboolean valid;
+   guint64 busy;
+   guint64 total;
+} CpuTimesTest;
+
+static const CpuTimesTest cpu_times_tests[] = {
+   {
+      .description = "Regular stat file",
+      .stat = "cpu  100 50 20 1000 5 1 2 0 0 0\n"
+              "cpu0 50 25 10 500 2 1 1 0 0 0\n"
+              "intr 12345\n",
+      .valid = TRUE,
+      .busy = 100 + 20 + 1 + 2,
+      .total = 100 + 50 + 20 + 1000 + 5 + 1 + 2 + 0,
+   },
+
+   {
+      .description = "Truncated stat file",
+      .stat = "cpu  100 50 20\n",
+      .valid = FALSE,
+   },
+
+   {
+      .description = "Missing aggregate line",
+      .stat = "cpu0 50 25 10 500 2 1 1 0 0 0\n",
+      .valid = FALSE,
+   },
+};
+
+static void
+test_cpu_times(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *stat_path = g_build_filename(f->chunks_dir, "stat", NULL);
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(cpu_times_tests); i++) {
+      const CpuTimesTest *test = &cpu_times_tests[i];
+      g_autoptr(GError) error = NULL;
+      AuCpuTimes times;
+
+      g_test_message("%s", test->description);
+
+      g_file_set_contents(stat_path, test->stat, -1, &error);
+      g_assert_no_error(error);
+
+      g_assert_cmpint(au_cpu_times_read(stat_path, &times), ==, test->valid);
+
+      if (test->valid) {
+         g_assert_cmpuint(times.busy, ==, test->busy);
+         g_assert_cmpuint(times.total, ==, test->total);
+      }
+   }
+}
+
+static void
+_scrub_done_cb(AuChunkScrubber *scrubber, gpointer user_data)
+{
+   Fixture *f = user_data;
+
+   f->n_done++;
+   g_main_loop_quit(f->loop);
+}
+
+static gboolean
+_quit_loop_cb(gpointer user_data)
+{
+   Fixture *f = user_data;
+
+   g_main_loop_quit(f->loop);
+
+   return G_SOURCE_REMOVE;
+}
+
+static void
+test_scrub(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuChunkScrubber) scrubber = NULL;
+   g_autoptr(AuChunkScrubber) restarted = NULL;
+   const AuScrubStats *stats;
+
+   scrubber = au_chunk_scrubber_new(f->chunks_dir, _scrub_done_cb, f);
+   stats = au_chunk_scrubber_get_stats(scrubber);
+   g_assert_cmpint(stats->last_run, ==, 0);
+
+   au_chunk_scrubber_start(scrubber);
+   g_assert_true(au_chunk_scrubber_is_running(scrubber));
+
+   /* Pausing and resuming doesn't prevent the scrub from completing */
+   au_chunk_scrubber_set_paused(scrubber, TRUE);
+   au_chunk_scrubber_set_paused(scrubber, FALSE);
+
+   g_main_loop_run(f->loop);
+
+   g_assert_false(au_chunk_scrubber_is_running(scrubber));
+   g_assert_cmpuint(f->n_done, ==, 1);
+   g_assert_cmpuint(stats->runs, ==, 1);
+   g_assert_cmpuint(stats->errors, ==, 0);
+   g_assert_cmpuint(stats->chunks, ==, 2);
+   g_assert_cmpuint(stats->evicted, ==, 1);
+   g_assert_cmpint(stats->last_run, >, 0);
+
+   g_assert_true(g_file_test(f->good_chunk_path, G_FILE_TEST_EXISTS));
+   g_assert_false(g_file_test(f->bad_chunk_path, G_FILE_TEST_EXISTS));
+
+   /* The time of the last scrub is preserved across restarts */
+   restarted = au_chunk_scrubber_new(f->chunks_dir, NULL, NULL);
+   g_assert_cmpint(au_chunk_scrubber_get_stats(restarted)->last_run, ==, stats->last_run);
+}
+
+static void
+test_scrub_cancel(Fixture *f, gconstpointer context)
+{
+   AuChunkScrubber *scrubber = NULL;
+
+   /* Freeing a running scrubber must not call the done function afterwards */
+   scrubber = au_chunk_scrubber_new(f->chunks_dir, _scrub_done_cb, f);
+   au_chunk_scrubber_start(scrubber);
+   au_chunk_scrubber_free(scrubber);
+
+   g_timeout_add_seconds(1, _quit_loop_cb, f);
+   g_main_loop_run(f->loop);
+
+   g_assert_cmpuint(f->n_done, ==, 0);
+   /* The scrub stopped before the helper got to remove anything */
+   g_assert_true(g_file_test(f->bad_chunk_path, G_FILE_TEST_EXISTS));
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/chunk_scrubber/measure", test_measure);
+   test_add("/chunk_scrubber/cpu_times", test_cpu_times);
+   test_add("/chunk_scrubber/scrub", test_scrub);
+   test_add("/chunk_scrubber/scrub_cancel", test_scrub_cancel);
+
+   return g_test_run();
+}
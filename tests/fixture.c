@@ -121,6 +121,7 @@ au_tests_setup(Fixture *f, gconstpointer context)
    int fd;
    const char *argv0 = context;
    g_autoptr(GDBusConnection) system_bus = NULL;
+   g_autofree gchar *network_state_path = NULL;
    g_autoptr(GError) error = NULL;
 
    const gchar *polkit_allow_all[] = {
@@ -201,6 +202,10 @@ au_tests_setup(Fixture *f, gconstpointer context)
    f->test_envp = g_environ_setenv(f->test_envp, "AU_DEFAULT_TRUSTED_KEYS", f->trusted_keys_dir, TRUE);
    f->test_envp =g_environ_setenv(f->test_envp, "AU_DEFAULT_DEV_KEYS", f->dev_keys_dir, TRUE);
    f->test_envp = g_environ_setenv(f->test_envp, "AU_RUN_PATH", f->run_dir, TRUE);
+   /* Assume to be online, regardless of the network of the test machine */
+   network_state_path = g_build_filename(f->run_dir, "network-state", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "AU_NETWORK_STATE_PATH", network_state_path, TRUE);
 
    system_bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
    g_assert_no_error(error);
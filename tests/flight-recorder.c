@@ -0,0 +1,203 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/flight-recorder.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *tmp_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmp_dir = g_dir_make_tmp("atomupd-flight-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmp_dir))
+      g_debug("Unable to remove temp directory: %s", f->tmp_dir);
+
+   g_free(f->tmp_dir);
+}
+
+static void
+test_record(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuFlightRecorder) recorder = au_flight_recorder_new(8);
+   g_autoptr(GArray) events = NULL;
+   const AuFlightEvent *event = NULL;
+   gint64 before = g_get_real_time();
+
+   events = au_flight_recorder_get_events(recorder);
+   g_assert_cmpuint(events->len, ==, 0);
+   g_clear_pointer(&events, g_array_unref);
+
+   au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_METHOD_CALL, 0, "StartUpdate");
+   au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_PROGRESS, 4250, NULL);
+   au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_ERROR, 0,
+                          "This message is longer than what an event can hold");
+
+   events = au_flight_recorder_get_events(recorder);
+   g_assert_cmpuint(events->len, ==, 3);
+
+   event = &g_array_index(events, AuFlightEvent, 0);
+   g_assert_cmpuint(event->type, ==, AU_FLIGHT_EVENT_METHOD_CALL);
+   g_assert_cmpstr(event->detail, ==, "StartUpdate");
+   g_assert_cmpint(event->time, >=, before);
+
+   event = &g_array_index(events, AuFlightEvent, 1);
+   g_assert_cmpuint(event->type, ==, AU_FLIGHT_EVENT_PROGRESS);
+   g_assert_cmpint(event->value, ==, 4250);
+   g_assert_cmpstr(event->detail, ==, "");
+
+   event = &g_array_index(events, AuFlightEvent, 2);
+   g_assert_cmpuint(event->type, ==, AU_FLIGHT_EVENT_ERROR);
+   g_assert_cmpuint(strlen(event->detail), ==, AU_FLIGHT_EVENT_DETAIL_SIZE - 1);
+   g_assert_true(g_str_has_prefix(event->detail, "This message is longer"));
+}
+
+static void
+test_wrap_around(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuFlightRecorder) recorder = au_flight_recorder_new(4);
+   g_autoptr(GArray) events = NULL;
+   gint64 i;
+
+   for (i = 0; i < 10; i++)
+      au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_SPAWN, i, "helper");
+
+   /* Only the newest events are kept, still from the oldest one */
+   events = au_flight_recorder_get_events(recorder);
+   g_assert_cmpuint(events->len, ==, 4);
+
+   for (i = 0; i < 4; i++)
+      g_assert_cmpint(g_array_index(events, AuFlightEvent, i).value, ==, 6 + i);
+}
+
+static gpointer
+_record_thread_func(gpointer user_data)
+{
+   AuFlightRecorder *recorder = user_data;
+   gint64 i;
+
+   for (i = 0; i < 10000; i++)
+      au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_PROGRESS, i, NULL);
+
+   return NULL;
+}
+
+static void
+test_threads(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuFlightRecorder) recorder = au_flight_recorder_new(64);
+   GThread *threads[4];
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(threads); i++)
+      threads[i] = g_thread_new("recorder", _record_thread_func, recorder);
+
+   /* Reading while the events are being written never returns torn events */
+   while (TRUE) {
+      g_autoptr(GArray) events = au_flight_recorder_get_events(recorder);
+      gsize j;
+
+      g_assert_cmpuint(events->len, <=, 64);
+
+      for (j = 0; j < events->len; j++) {
+         const AuFlightEvent *event = &g_array_index(events, AuFlightEvent, j);
+
+         g_assert_cmpuint(event->type, ==, AU_FLIGHT_EVENT_PROGRESS);
+         g_assert_cmpint(event->value, <, 10000);
+      }
+
+      if (events->len == 64)
+         break;
+   }
+
+   for (i = 0; i < G_N_ELEMENTS(threads); i++)
+      g_thread_join(threads[i]);
+}
+
+static void
+test_dump(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuFlightRecorder) recorder = au_flight_recorder_new(8);
+   g_autofree gchar *dump = NULL;
+   g_autofree gchar *dump_path = NULL;
+   g_autofree gchar *saved = NULL;
+   g_auto(GStrv) lines = NULL;
+   g_autoptr(GError) error = NULL;
+
+   au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_PROGRESS, 4250, NULL);
+   au_flight_recorder_add(recorder, AU_FLIGHT_EVENT_EXIT, 256, "steamos-atomupd-client");
+
+   dump = au_flight_recorder_dump(recorder);
+   lines = g_strsplit(dump, "\n", -1);
+   g_assert_cmpuint(g_strv_length(lines), ==, 3);
+   g_assert_true(g_str_has_suffix(lines[0], "Z progress 42.50%"));
+   g_assert_true(g_str_has_suffix(lines[1], "Z exit 256 steamos-atomupd-client"));
+   g_assert_cmpstr(lines[2], ==, "");
+
+   dump_path = g_build_filename(f->tmp_dir, "flight-recorder.log", NULL);
+   au_flight_recorder_dump_to_file(recorder, dump_path, &error);
+   g_assert_no_error(error);
+
+   g_file_get_contents(dump_path, &saved, NULL, &error);
+   g_assert_no_error(error);
+   g_assert_cmpstr(saved, ==, dump);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/flight_recorder/record", test_record);
+   test_add("/flight_recorder/wrap_around", test_wrap_around);
+   test_add("/flight_recorder/threads", test_threads);
+   test_add("/flight_recorder/dump", test_dump);
+
+   return g_test_run();
+}
@@ -29,6 +29,7 @@
 #include <unistd.h>
 
 #include <gio/gio.h>
+#include <gio/gunixfdlist.h>
 #include <glib-unix.h>
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -708,6 +709,8 @@ _check_default_properties(Fixture *f, GDBusConnection *bus, const PropertiesTest
    g_assert_cmpstr(atomupd_properties->variant, ==, "steamdeck");
    g_assert_cmpstr(atomupd_properties->failure_code, ==, "");
    g_assert_cmpstr(atomupd_properties->failure_message, ==, "");
+   _check_string_property(bus, "PauseReason", "");
+   _check_string_property(bus, "ThrottleState", "none");
    g_assert_cmpuint(atomupd_properties->updates_available_n, ==, 0);
    g_assert_cmpuint(atomupd_properties->updates_available_later_n, ==, 0);
    /* Version buildid parsed from "manifest.json" */
@@ -1047,8 +1050,10 @@ test_remote_config(Fixture *f, gconstpointer context)
    const gchar *client_remote_variants[] = { "steamdeck", "vanilla", NULL };
    const gchar *client_remote_branches[] = { "stable",  "rc", "beta", "bc",
                                              "preview", "pc", "main", NULL };
+   g_autofree gchar *builds_path = NULL;
    g_autoptr(AtomupdProperties) atomupd_properties = NULL;
    g_autoptr(GError) error = NULL;
+   gsize i;
 
    bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
 
@@ -1095,6 +1100,13 @@ test_remote_config(Fixture *f, gconstpointer context)
    g_assert_cmpstrv(atomupd_properties->known_variants, client_remote_variants);
    g_assert_cmpstrv(atomupd_properties->known_branches, client_remote_branches);
 
+   /* After loading the remote info, the builds lists of the known variants
+    * are expected to be prefetched off band */
+   builds_path = g_build_filename(f->run_dir, "builds-steamdeck.json", NULL);
+   for (i = 0; i < 10 && !g_file_test(builds_path, G_FILE_TEST_EXISTS); i++)
+      g_usleep(default_wait);
+   g_assert_true(g_file_test(builds_path, G_FILE_TEST_EXISTS));
+
    g_file_set_contents(f->remote_info_path, "pre-existing file", -1, &error);
    g_assert_no_error(error);
    _send_atomupd_message_with_null_reply(bus, "ReloadConfiguration", "(a{sv})", NULL);
@@ -1255,6 +1267,7 @@ test_start_pause_stop_update(Fixture *f, gconstpointer context)
    atomupd_properties = _get_atomupd_properties(bus);
    g_assert_true(atomupd_properties->progress_percentage == 16.08);
    g_assert_cmpuint(atomupd_properties->status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "user");
    /* Assert that the mock rauc service has not been killed.
     * Because it is not our own child, we can't check for "WIFSTOPPED". */
    g_assert_cmpint(
@@ -2308,6 +2321,83 @@ static const CheckUpdates4xxTest check_updates_4xx_test[] = {
    },
 };
 
+static void
+test_query_updates_multi(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(AtomupdProperties) atomupd_properties = NULL;
+   g_autoptr(GVariant) variant_reply = NULL;
+   g_autoptr(GVariant) branch_reply = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *tracked_key = NULL;
+   g_autofree gchar *variant = NULL;
+   g_autofree gchar *branch = NULL;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   update_file_path = g_build_filename(f->srcdir, "data", "update_one_minor.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   variant_reply = _get_atomupd_property(bus, "Variant");
+   variant = g_variant_dup_string(variant_reply, NULL);
+   branch_reply = _get_atomupd_property(bus, "Branch");
+   branch = g_variant_dup_string(branch_reply, NULL);
+   tracked_key = g_strdup_printf("%s/%s", variant, branch);
+
+   g_debug("Query the tracked target, another branch and a duplicated target");
+   {
+      g_autoptr(GVariant) reply = NULL;
+      g_autoptr(GVariant) results = NULL;
+      g_autoptr(GVariant) tracked_result = NULL;
+      g_autoptr(GVariant) other_result = NULL;
+      g_autoptr(GVariant) available = NULL;
+      GVariant *targets = NULL; /* floating */
+
+      targets = g_variant_new_parsed("[(%s, %s), ('steamdeck', 'beta'), (%s, %s)]",
+                                     variant, branch, variant, branch);
+      reply = _send_atomupd_message(bus, "CheckForUpdatesMulti", "(@a(ss)a{sv})",
+                                    targets, NULL);
+      results = g_variant_get_child_value(reply, 0);
+      g_assert_cmpuint(g_variant_n_children(results), ==, 2);
+
+      g_assert_true(g_variant_lookup(results, tracked_key, "@a{sv}", &tracked_result));
+      available = g_variant_lookup_value(tracked_result, "available", NULL);
+      g_assert_nonnull(available);
+      g_assert_true(g_variant_lookup(available, "20220227.3", "@a{sv}", NULL));
+
+      g_assert_true(g_variant_lookup(results, "steamdeck/beta", "@a{sv}", &other_result));
+      g_assert_false(g_variant_lookup(other_result, "error", "&s", NULL));
+   }
+
+   /* The tracked variant and branch must not change, but the result of the
+    * tracked target is shared with the UpdatesAvailable property */
+   _check_string_property(bus, "Variant", variant);
+   _check_string_property(bus, "Branch", branch);
+   atomupd_properties = _get_atomupd_properties(bus);
+   g_assert_cmpuint(atomupd_properties->updates_available_n, ==, 1);
+
+   g_debug("Request an invalid target");
+   {
+      g_autoptr(GVariant) reply = NULL;
+      const gchar *reply_str = NULL;
+
+      reply = _send_atomupd_message(bus, "CheckForUpdatesMulti", "(@a(ss)a{sv})",
+                                    g_variant_new_parsed("[('../steamdeck', 'stable')]"),
+                                    NULL);
+      g_variant_get(reply, "(&s)", &reply_str);
+      g_assert_true(g_str_has_prefix(reply_str, "Invalid target '../steamdeck'"));
+   }
+
+   au_tests_stop_process(daemon_proc);
+}
+
 static void
 test_query_updates_4xx(Fixture *f, gconstpointer context)
 {
@@ -2842,6 +2932,35 @@ test_builds_list(Fixture *f, gconstpointer context)
       g_assert_cmpstr(local_content, ==, server_content);
    }
 
+   g_debug("Query the builds list with a filter");
+   {
+      g_autoptr(GVariant) reply = NULL;
+      g_autoptr(GVariant) builds = NULL;
+      g_autoptr(GVariant) build = NULL;
+      const gchar *buildid = NULL;
+
+      reply = _send_atomupd_message(bus, "QueryBuilds", "(s@a{sv}u)", "",
+                                    g_variant_new_parsed("{'branch': <'stable'>}"), 2);
+      builds = g_variant_get_child_value(reply, 0);
+      g_assert_cmpuint(g_variant_n_children(builds), ==, 2);
+
+      build = g_variant_get_child_value(builds, 0);
+      g_assert_true(g_variant_lookup(build, "buildid", "&s", &buildid));
+      g_assert_cmpstr(buildid, ==, "20240115.2");
+   }
+
+   g_debug("Query the builds list with an invalid filter");
+   {
+      g_autoptr(GVariant) reply = NULL;
+      const gchar *reply_str = NULL;
+
+      reply = _send_atomupd_message(bus, "QueryBuilds", "(s@a{sv}u)", "steamdeck",
+                                    g_variant_new_parsed("{'since': <'yesterday'>}"), 0);
+      g_variant_get(reply, "(&s)", &reply_str);
+      g_assert_cmpstr(reply_str, ==,
+                      "Buildid 'yesterday' doesn't follow the expected YYYYMMDD[.N] format");
+   }
+
    g_debug("Check that the existing JSON list doesn't get re-downloaded each time");
    {
       g_autofree gchar *reply = NULL;
@@ -2864,8 +2983,1573 @@ test_builds_list(Fixture *f, gconstpointer context)
       g_assert_cmpstr(old_local_content, ==, new_local_content);
    }
 
+   g_debug("Check that the cached builds catalog follows the changes to the JSON list");
+   {
+      g_autoptr(GVariant) reply = NULL;
+      g_autoptr(GVariant) builds = NULL;
+      g_autoptr(GVariant) build = NULL;
+      const gchar *buildid = NULL;
+
+      reply = _send_atomupd_message(bus, "QueryBuilds", "(s@a{sv}u)", "steamdeck",
+                                    g_variant_new_parsed("@a{sv} {}"), 0);
+      builds = g_variant_get_child_value(reply, 0);
+      g_assert_cmpuint(g_variant_n_children(builds), ==, 1);
+
+      build = g_variant_get_child_value(builds, 0);
+      g_assert_true(g_variant_lookup(build, "buildid", "&s", &buildid));
+      g_assert_cmpstr(buildid, ==, "20260115.2");
+   }
+
+   au_tests_stop_process(daemon_proc);
+   au_tests_stop_process(http_server_proc);
+}
+
+static void
+test_prewarm_update_bundle(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) http_server_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *local_server_dir = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *prewarm_path = NULL;
+   g_autofree gchar *server_bundle = NULL;
+   g_autofree gchar *server_content = NULL;
+   g_autofree gchar *local_content = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *config_template = "[Server]\n"
+                                  "ImagesUrl = http://localhost:12312/images/\n"
+                                  "MetaUrl = http://localhost:12312/meta\n"
+                                  "Variants = steamdeck\n"
+                                  "Branches = stable;rc;beta;bc;main\n"
+                                  "[Downloads]\n"
+                                  "PrewarmIndex = true\n"
+                                  "%s";
+   gsize i;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-prewarm-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+
+   {
+      g_autofree gchar *config = g_strdup_printf(config_template, "");
+
+      g_file_set_contents(config_path, config, -1, &error);
+      g_assert_no_error(error);
+   }
+
+   update_file_path = g_build_filename(f->srcdir, "data", "update_one_minor.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   local_server_dir = g_build_filename(f->srcdir, "data", "client_meta", NULL);
+   http_server_proc = au_tests_start_local_http_server(local_server_dir);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   prewarm_path = g_build_filename(f->run_dir, "prewarm-20220227.3.raucb", NULL);
+   g_assert_false(g_file_test(prewarm_path, G_FILE_TEST_EXISTS));
+
+   g_debug("The update bundle is expected to be downloaded after checking for updates");
+   _call_check_for_updates(bus, NULL, NULL);
+
+   for (i = 0; i < 10 && !g_file_test(prewarm_path, G_FILE_TEST_EXISTS); i++)
+      g_usleep(default_wait);
+
+   server_bundle = g_build_filename(local_server_dir, "images", "steamdeck", "20220227.3",
+                                    "steamdeck-20220227.3-snapshot.raucb", NULL);
+   g_file_get_contents(server_bundle, &server_content, NULL, &error);
+   g_assert_no_error(error);
+   g_file_get_contents(prewarm_path, &local_content, NULL, &error);
+   g_assert_no_error(error);
+   g_assert_cmpstr(local_content, ==, server_content);
+
+   g_debug("Bundles bigger than the configured maximum size are not downloaded");
+   g_unlink(prewarm_path);
+   {
+      g_autofree gchar *config = g_strdup_printf(config_template, "PrewarmMaxSize = 4\n");
+
+      g_file_set_contents(config_path, config, -1, &error);
+      g_assert_no_error(error);
+   }
+   _send_atomupd_message_with_null_reply(bus, "ReloadConfiguration", "(a{sv})", NULL);
+   _call_check_for_updates(bus, NULL, NULL);
+
+   g_usleep(2 * default_wait);
+   g_assert_false(g_file_test(prewarm_path, G_FILE_TEST_EXISTS));
+
+   au_tests_stop_process(daemon_proc);
+   au_tests_stop_process(http_server_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+_set_network_state(const gchar *network_state_path, const gchar *state)
+{
+   g_autoptr(GError) error = NULL;
+
+   g_file_set_contents(network_state_path, state, -1, &error);
+   g_assert_no_error(error);
+
+   /* Give the daemon the time to notice the change */
+   g_usleep(2 * default_wait);
+}
+
+static void
+test_network_policy(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *network_state_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n"
+                         "[NetworkPolicy]\n"
+                         "PauseWhenOffline = true\n"
+                         "PauseWhenMetered = true\n";
+   AuUpdateStatus status;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-network-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   network_state_path = g_build_filename(tmp_config_dir, "network-state", NULL);
+   g_file_set_contents(network_state_path, "online", -1, &error);
+   g_assert_no_error(error);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "AU_NETWORK_STATE_PATH", network_state_path, TRUE);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, NULL, NULL);
+
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+   g_usleep(2 * default_wait);
+
+   g_debug("Losing the network connection is expected to pause the update");
+   _set_network_state(network_state_path, "offline");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "network-offline");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("A metered connection is not enough to resume the update");
+   _set_network_state(network_state_path, "metered");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "network-metered");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("The update is expected to resume when the network is back");
+   _set_network_state(network_state_path, "online");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_IN_PROGRESS);
+   _check_string_property(bus, "PauseReason", "");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("Pausing an automatically paused update prevents it from resuming");
+   _set_network_state(network_state_path, "offline");
+   _send_atomupd_message_with_null_reply(bus, "PauseUpdate", NULL, NULL);
+   _check_string_property(bus, "PauseReason", "user");
+   _set_network_state(network_state_path, "online");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "user");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   _send_atomupd_message_with_null_reply(bus, "ResumeUpdate", NULL, NULL);
+   _check_string_property(bus, "PauseReason", "");
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+_set_battery_capacity(const gchar *capacity_path, const gchar *capacity)
+{
+   g_autoptr(GError) error = NULL;
+
+   g_file_set_contents(capacity_path, capacity, -1, &error);
+   g_assert_no_error(error);
+
+   /* The power state is polled every second */
+   g_usleep(G_USEC_PER_SEC + 2 * default_wait);
+}
+
+/*
+ * _get_proxy_route:
+ *
+ * Returns: (transfer full) (nullable): The "route" of @host in the
+ *  "HttpProxyRoutes" property, or %NULL if it is not there
+ */
+static gchar *
+_get_proxy_route(GDBusConnection *bus, const gchar *host)
+{
+   g_autoptr(GVariant) routes = NULL;
+   g_autoptr(GVariant) host_route = NULL;
+   const gchar *route = NULL;
+
+   routes = _get_atomupd_property(bus, "HttpProxyRoutes");
+   if (!g_variant_lookup(routes, host, "@a{sv}", &host_route))
+      return NULL;
+
+   g_assert_true(g_variant_lookup(host_route, "route", "&s", &route));
+
+   return g_strdup(route);
+}
+
+static void
+test_proxy_policy(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) http_server_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *local_server_dir = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = http://localhost:12312/images/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n"
+                         "[ProxyPolicy]\n"
+                         "AutoSelect = true\n";
+   const gchar *hosts[] = { "meta", "images" };
+   gsize i;
+   gsize j;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-proxy-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   local_server_dir = g_build_filename(f->srcdir, "data", "client_meta", NULL);
+   http_server_proc = au_tests_start_local_http_server(local_server_dir);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("Without a proxy there is nothing to choose");
+   for (i = 0; i < G_N_ELEMENTS(hosts); i++)
+      g_assert_null(_get_proxy_route(bus, hosts[i]));
+
+   g_debug("Nothing is expected to listen on port 1, the servers must be reached "
+           "directly");
+   _send_atomupd_message_with_null_reply(bus, "EnableHttpProxy", "(sia{sv})",
+                                         "127.0.0.1", 1, NULL);
+
+   for (i = 0; i < G_N_ELEMENTS(hosts); i++) {
+      g_autofree gchar *route = NULL;
+
+      for (j = 0; j < 20; j++) {
+         g_clear_pointer(&route, g_free);
+         route = _get_proxy_route(bus, hosts[i]);
+         g_assert_nonnull(route);
+
+         if (g_str_equal(route, "direct"))
+            break;
+
+         g_usleep(default_wait);
+      }
+
+      g_assert_cmpstr(route, ==, "direct");
+   }
+
+   _send_atomupd_message_with_null_reply(bus, "DisableHttpProxy", NULL, NULL);
+   for (i = 0; i < G_N_ELEMENTS(hosts); i++)
+      g_assert_null(_get_proxy_route(bus, hosts[i]));
+
    au_tests_stop_process(daemon_proc);
    au_tests_stop_process(http_server_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+test_power_policy(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *sysfs_path = NULL;
+   g_autofree gchar *battery_path = NULL;
+   g_autofree gchar *attribute_path = NULL;
+   g_autofree gchar *capacity_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n"
+                         "[PowerPolicy]\n"
+                         "ThrottleOnBattery = true\n"
+                         "PauseBelowBatteryLevel = 20\n";
+   AuUpdateStatus status;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-power-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   sysfs_path = g_build_filename(tmp_config_dir, "sys", NULL);
+   battery_path = g_build_filename(sysfs_path, "class", "power_supply", "BAT1", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(battery_path, 0755), ==, 0);
+   attribute_path = g_build_filename(battery_path, "type", NULL);
+   g_file_set_contents(attribute_path, "Battery\n", -1, &error);
+   g_assert_no_error(error);
+   capacity_path = g_build_filename(battery_path, "capacity", NULL);
+   g_file_set_contents(capacity_path, "10\n", -1, &error);
+   g_assert_no_error(error);
+
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_SYSFS_PATH", sysfs_path, TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_POWER_POLL_INTERVAL", "1", TRUE);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, NULL, NULL);
+
+   g_debug("Starting an update with an almost empty battery is expected to pause it");
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+   g_usleep(2 * default_wait);
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "battery-low");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("A charge just above the threshold is not enough to resume the update");
+   _set_battery_capacity(capacity_path, "22\n");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_PAUSED);
+   _check_string_property(bus, "PauseReason", "battery-low");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("The update is expected to resume, slowed down, while on battery");
+   _set_battery_capacity(capacity_path, "50\n");
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_IN_PROGRESS);
+   _check_string_property(bus, "PauseReason", "");
+   _check_string_property(bus, "ThrottleState", "reduced");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+   _check_string_property(bus, "ThrottleState", "none");
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+_set_io_pressure_total(const gchar *io_path, guint64 total)
+{
+   g_autofree gchar *content = NULL;
+   g_autoptr(GError) error = NULL;
+
+   content = g_strdup_printf("some avg10=0.00 avg60=0.00 avg300=0.00 "
+                             "total=%" G_GUINT64_FORMAT "\n"
+                             "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n",
+                             total);
+   g_file_set_contents(io_path, content, -1, &error);
+   g_assert_no_error(error);
+}
+
+static void
+test_pressure_policy(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *cgroup_path = NULL;
+   g_autofree gchar *foreground_path = NULL;
+   g_autofree gchar *io_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n"
+                         "[PressurePolicy]\n"
+                         "AdaptToPressure = true\n"
+                         "ForegroundCgroup = user.slice/user-1000.slice\n";
+   guint level = 0;
+   guint64 backoffs = 0;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-pressure-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   cgroup_path = g_build_filename(tmp_config_dir, "cgroup", NULL);
+   foreground_path = g_build_filename(cgroup_path, "user.slice", "user-1000.slice", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(foreground_path, 0755), ==, 0);
+   io_path = g_build_filename(foreground_path, "io.pressure", NULL);
+   _set_io_pressure_total(io_path, 0);
+
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_CGROUP_PATH", cgroup_path, TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_PRESSURE_POLL_INTERVAL", "1", TRUE);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, NULL, NULL);
+
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+   g_usleep(2 * default_wait);
+   _check_string_property(bus, "ThrottleState", "none");
+
+   g_debug("The update is expected to back off while the foreground tasks are stalled");
+   /* More stall time than the seconds elapsed, i.e. 100% of the time */
+   _set_io_pressure_total(io_path, 100 * G_USEC_PER_SEC);
+   g_usleep(G_USEC_PER_SEC + 2 * default_wait);
+   _check_string_property(bus, "ThrottleState", "reduced");
+
+   g_debug("If the pressure remains high, the update only uses the idle time");
+   _set_io_pressure_total(io_path, 200 * G_USEC_PER_SEC);
+   g_usleep(G_USEC_PER_SEC + 2 * default_wait);
+   _check_string_property(bus, "ThrottleState", "idle");
+
+   reply = _get_atomupd_property(bus, "PressureState");
+   g_assert_true(g_variant_lookup(reply, "level", "u", &level));
+   g_assert_cmpuint(level, ==, 2);
+   g_assert_true(g_variant_lookup(reply, "backoffs", "t", &backoffs));
+   g_assert_cmpuint(backoffs, ==, 2);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+   _check_string_property(bus, "ThrottleState", "none");
+
+   reply = _get_atomupd_property(bus, "PressureState");
+   g_assert_true(g_variant_lookup(reply, "level", "u", &level));
+   g_assert_cmpuint(level, ==, 0);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+test_multiple_targets(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) value = NULL;
+   g_autoptr(GVariant) interfaces = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *target_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *targets_path = NULL;
+   g_autofree gchar *targets_config = NULL;
+   g_autofree gchar *target_manifest = NULL;
+   g_autofree gchar *target_preferences = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *reply_str = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *target_path = AU_ATOMUPD1_PATH "/spare";
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck;steamtest\n"
+                         "Branches = stable;rc;beta;bc;main\n";
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-targets-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   target_config_dir = g_build_filename(tmp_config_dir, "spare", NULL);
+   g_assert_cmpint(g_mkdir(target_config_dir, 0755), ==, 0);
+   g_clear_pointer(&config_path, g_free);
+   config_path = g_build_filename(target_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   target_manifest = g_build_filename(f->srcdir, "data", "manifest_steamtest.json", NULL);
+   targets_config = g_strdup_printf("[Target spare]\n"
+                                    "ConfigDirectory = %s\n"
+                                    "Manifest = %s\n",
+                                    target_config_dir, target_manifest);
+   targets_path = g_build_filename(tmp_config_dir, "targets.conf", NULL);
+   g_file_set_contents(targets_path, targets_config, -1, &error);
+   g_assert_no_error(error);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("The target is expected to be listed by the object manager");
+   reply = send_atomupd_message(bus, AU_ATOMUPD1_PATH,
+                                "org.freedesktop.DBus.ObjectManager", "GetManagedObjects",
+                                NULL, NULL);
+   g_variant_get(reply, "(@a{oa{sa{sv}}})", &value);
+   interfaces = g_variant_lookup_value(value, target_path, G_VARIANT_TYPE("a{sa{sv}}"));
+   g_assert_nonnull(interfaces);
+   g_assert_true(g_variant_lookup(interfaces, AU_ATOMUPD1_INTERFACE, "@a{sv}", NULL));
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&value, g_variant_unref);
+
+   g_debug("The target is expected to follow its own manifest and preferences");
+   reply = send_atomupd_message(bus, target_path, "org.freedesktop.DBus.Properties",
+                                "Get", "(ss)", AU_ATOMUPD1_INTERFACE, "Variant");
+   g_variant_get(reply, "(v)", &value);
+   g_assert_cmpstr(g_variant_get_string(value, NULL), ==, "steamtest");
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&value, g_variant_unref);
+   _check_string_property(bus, "Variant", "steamdeck");
+
+   target_preferences = g_build_filename(target_config_dir, "preferences.conf", NULL);
+   g_assert_true(g_file_test(target_preferences, G_FILE_TEST_EXISTS));
+
+   g_debug("Checking for updates can happen concurrently on the targets");
+   _call_check_for_updates(bus, NULL, NULL);
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+   reply = send_atomupd_message(bus, target_path, AU_ATOMUPD1_INTERFACE,
+                                "CheckForUpdates", "(a{sv})", NULL);
+   g_assert_nonnull(reply);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("The targets can't be updated with the RAUC service of the running system");
+   reply = send_atomupd_message(bus, target_path, AU_ATOMUPD1_INTERFACE, "StartUpdate",
+                                "(s)", MOCK_INFINITE);
+   g_variant_get(reply, "(s)", &reply_str);
+   g_assert_true(g_str_has_prefix(reply_str, "No such method"));
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&reply_str, g_free);
+
+   reply = send_atomupd_message(bus, target_path, AU_ATOMUPD1_INTERFACE, "CancelUpdate",
+                                NULL, NULL);
+   g_variant_get(reply, "(s)", &reply_str);
+   g_assert_true(g_str_has_prefix(reply_str, "No such method"));
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&reply_str, g_free);
+
+   g_debug("The targets are not expected to have the install properties");
+   reply = send_atomupd_message(bus, target_path, "org.freedesktop.DBus.Properties",
+                                "Get", "(ss)", AU_ATOMUPD1_INTERFACE, "PauseReason");
+   g_variant_get(reply, "(s)", &reply_str);
+   g_assert_true(g_str_has_prefix(reply_str, "No such property"));
+   g_clear_pointer(&reply, g_variant_unref);
+
+   reply = send_atomupd_message(bus, target_path, "org.freedesktop.DBus.Properties",
+                                "GetAll", "(s)", AU_ATOMUPD1_INTERFACE);
+   g_variant_get(reply, "(@a{sv})", &value);
+   g_assert_true(g_variant_lookup(value, "Variant", "&s", NULL));
+   g_assert_false(g_variant_lookup(value, "ThrottleState", "&s", NULL));
+   g_clear_pointer(&value, g_variant_unref);
+
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+/*
+ * _subscribe_progress:
+ * @bus: The D-Bus connection
+ * @interval: The requested interval in milliseconds
+ *
+ * Returns: The progress file descriptor, or -1 if the daemon refused the subscription
+ */
+static gint
+_subscribe_progress(GDBusConnection *bus, guint32 interval)
+{
+   g_autoptr(GDBusMessage) message = NULL;
+   g_autoptr(GDBusMessage) reply = NULL;
+   g_autoptr(GVariantDict) options = g_variant_dict_new(NULL);
+   GUnixFDList *fd_list = NULL; /* borrowed */
+   g_autoptr(GError) error = NULL;
+   gint32 handle;
+   gint fd;
+
+   g_variant_dict_insert(options, "interval", "u", interval);
+
+   message = g_dbus_message_new_method_call(AU_ATOMUPD1_BUS_NAME, AU_ATOMUPD1_PATH,
+                                            AU_ATOMUPD1_INTERFACE, "SubscribeProgress");
+   g_dbus_message_set_body(message,
+                           g_variant_new("(@a{sv})", g_variant_dict_end(options)));
+
+   reply = g_dbus_connection_send_message_with_reply_sync(
+      bus, message, G_DBUS_SEND_MESSAGE_FLAGS_NONE, 3000, NULL, NULL, &error);
+   g_assert_no_error(error);
+
+   if (g_dbus_message_get_message_type(reply) == G_DBUS_MESSAGE_TYPE_ERROR) {
+      g_debug("SubscribeProgress failed: %s", g_dbus_message_get_error_name(reply));
+      return -1;
+   }
+
+   g_variant_get(g_dbus_message_get_body(reply), "(h)", &handle);
+   fd_list = g_dbus_message_get_unix_fd_list(reply);
+   g_assert_nonnull(fd_list);
+   fd = g_unix_fd_list_get(fd_list, handle, &error);
+   g_assert_no_error(error);
+
+   return fd;
+}
+
+/*
+ * _read_progress_record:
+ * @fd: The progress file descriptor
+ * @record: (out): The received record
+ *
+ * Wait up to five seconds for the next progress record.
+ */
+static void
+_read_progress_record(gint fd, AuProgressRecord *record)
+{
+   GPollFD poll_fd = { .fd = fd, .events = G_IO_IN };
+   gssize len;
+
+   g_assert_cmpint(g_poll(&poll_fd, 1, 5000), ==, 1);
+
+   len = read(fd, record, sizeof(*record));
+   g_assert_cmpint(len, ==, sizeof(*record));
+   g_assert_cmpuint(record->version, ==, AU_PROGRESS_RECORD_VERSION);
+}
+
+static void
+test_subscribe_progress(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *error_message = NULL;
+   g_auto(GVariantBuilder) wrong_type = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+   g_auto(GVariantBuilder) unknown = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+   AuProgressRecord record = { 0 };
+   AuUpdateStatus status;
+   gint fd;
+   gsize i;
+
+   g_variant_builder_add(&wrong_type, "{sv}", "interval", g_variant_new_int32(100));
+   g_variant_builder_add(&unknown, "{sv}", "rate", g_variant_new_uint32(100));
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("Intervals out of range are expected to be rejected");
+   g_assert_cmpint(_subscribe_progress(bus, 0), ==, -1);
+   g_assert_cmpint(_subscribe_progress(bus, G_MAXUINT32), ==, -1);
+
+   g_debug("Options with the wrong type, or unknown, are expected to be rejected");
+   reply = _send_atomupd_message(bus, "SubscribeProgress", "(a{sv})", &wrong_type);
+   g_variant_get(reply, "(s)", &error_message);
+   g_assert_cmpstr(error_message, ==,
+                   "The argument 'interval' must have an unsigned 32-bit integer value");
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&error_message, g_free);
+
+   reply = _send_atomupd_message(bus, "SubscribeProgress", "(a{sv})", &unknown);
+   g_variant_get(reply, "(s)", &error_message);
+   g_assert_cmpstr(error_message, ==, "The argument 'rate' is not a valid option");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   fd = _subscribe_progress(bus, 100);
+   g_assert_cmpint(fd, >, -1);
+
+   g_debug("The first record is expected to be sent right away");
+   _read_progress_record(fd, &record);
+   g_assert_cmpuint(record.status, ==, AU_UPDATE_STATUS_IDLE);
+   g_assert_cmpfloat(record.percentage, ==, 0);
+   g_assert_cmpuint(record.bytes, ==, 0);
+
+   _call_check_for_updates(bus, NULL, NULL);
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+
+   for (i = 0; i < 50; i++) {
+      _read_progress_record(fd, &record);
+      if (record.status == AU_UPDATE_STATUS_IN_PROGRESS && record.percentage > 0)
+         break;
+   }
+   g_assert_cmpuint(record.status, ==, AU_UPDATE_STATUS_IN_PROGRESS);
+   g_assert_cmpfloat_with_epsilon(record.percentage, 16.08, 0.001);
+   /* 16.08% of the "estimated_size" in "update_mock_infinite.json" */
+   g_assert_cmpuint(record.bytes, >=, 9666046);
+   g_assert_cmpuint(record.bytes, <=, 9666048);
+   g_assert_cmpuint(record.estimated_completion_time, >, 0);
+
+   g_debug("Closing the socket is expected to silently drop the subscriber");
+   g_close(fd, NULL);
+   g_usleep(default_wait);
+   reply = _get_atomupd_property(bus, "UpdateStatus");
+   g_variant_get(reply, "u", &status);
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_IN_PROGRESS);
+
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+/*
+ * _new_bus_client:
+ *
+ * Returns: (transfer full): A new connection to the session bus, that can be
+ *  closed without affecting the shared one
+ */
+static GDBusConnection *
+_new_bus_client(void)
+{
+   g_autoptr(GDBusConnection) client = NULL;
+   g_autofree gchar *address = NULL;
+   g_autoptr(GError) error = NULL;
+
+   address = g_dbus_address_get_for_bus_sync(G_BUS_TYPE_SESSION, NULL, &error);
+   g_assert_no_error(error);
+
+   client = g_dbus_connection_new_for_address_sync(
+      address,
+      G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+         G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+      NULL, NULL, &error);
+   g_assert_no_error(error);
+
+   return g_steal_pointer(&client);
+}
+
+static void
+test_subscribe_progress_per_user(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GDBusConnection) client = NULL;
+   g_autoptr(GError) error = NULL;
+   AuProgressRecord record = { 0 };
+   gint fds[4];
+   gint fd;
+   gsize i;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   client = _new_bus_client();
+
+   g_debug("Each user is expected to have a limited number of subscriptions");
+   for (i = 0; i < G_N_ELEMENTS(fds); i++) {
+      fds[i] = _subscribe_progress(client, 60000);
+      g_assert_cmpint(fds[i], >, -1);
+      _read_progress_record(fds[i], &record);
+   }
+   g_assert_cmpint(_subscribe_progress(client, 60000), ==, -1);
+
+   g_debug("Opening another connection is not expected to raise the limit");
+   g_assert_cmpint(_subscribe_progress(bus, 60000), ==, -1);
+
+   g_debug("Leaving the bus is expected to drop all the subscriptions of the client");
+   g_dbus_connection_close_sync(client, NULL, &error);
+   g_assert_no_error(error);
+
+   for (i = 0; i < G_N_ELEMENTS(fds); i++) {
+      GPollFD poll_fd = { .fd = fds[i], .events = G_IO_IN };
+
+      /* The daemon closes its end of the socket */
+      g_assert_cmpint(g_poll(&poll_fd, 1, 5000), ==, 1);
+      g_assert_cmpint(read(fds[i], &record, sizeof(record)), ==, 0);
+      g_close(fds[i], NULL);
+   }
+
+   g_debug("The freed subscriptions are expected to be available again");
+   fd = _subscribe_progress(bus, 60000);
+   g_assert_cmpint(fd, >, -1);
+   g_close(fd, NULL);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+test_memory_usage(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) usage = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   const gchar *keys[] = { "rss", "peak_rss", "heap_in_use", "heap_free", "heap_mapped",
+                           "released" };
+   guint64 rss = 0;
+   guint64 peak_rss = 0;
+   gsize i;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, NULL, NULL);
+
+   g_debug("Wait for the memory to be released after parsing the updates");
+   g_usleep(3 * G_USEC_PER_SEC);
+
+   reply = _send_atomupd_message(bus, "GetMemoryUsage", NULL, NULL);
+   g_assert_nonnull(reply);
+   usage = g_variant_get_child_value(reply, 0);
+
+   for (i = 0; i < G_N_ELEMENTS(keys); i++) {
+      guint64 value;
+
+      g_assert_true(g_variant_lookup(usage, keys[i], "t", &value));
+   }
+
+   /* The daemon runs on Linux, so it can always read its RSS */
+   g_assert_true(g_variant_lookup(usage, "rss", "t", &rss));
+   g_assert_true(g_variant_lookup(usage, "peak_rss", "t", &peak_rss));
+   g_assert_cmpuint(rss, >, 0);
+   g_assert_cmpuint(peak_rss, >=, rss);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+test_helper_stats(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) stats = NULL;
+   g_autoptr(GVariant) query_stats = NULL;
+   g_autofree gchar *missing_update_file = NULL;
+   g_autofree gchar *reply_str = NULL;
+   guint64 spawned = 0;
+   guint64 failed = 0;
+   guint32 running = 0;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   /* The mock helper fails, and tells why on its stderr, when the update
+    * file is missing */
+   missing_update_file = g_build_filename(f->run_dir, "missing.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", missing_update_file, TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("The error is expected to include the last message of the helper");
+   reply = _send_atomupd_message(bus, "CheckForUpdates", "(a{sv})", NULL);
+   g_variant_get(reply, "(s)", &reply_str);
+   g_assert_nonnull(strstr(reply_str, "Failed to parse the update json file"));
+   g_clear_pointer(&reply, g_variant_unref);
+
+   reply = _send_atomupd_message(bus, "GetHelperStats", NULL, NULL);
+   g_assert_nonnull(reply);
+   stats = g_variant_get_child_value(reply, 0);
+
+   g_assert_true(g_variant_lookup(stats, "update", "@a{sv}", NULL));
+   g_assert_true(g_variant_lookup(stats, "tool", "@a{sv}", NULL));
+   g_assert_true(g_variant_lookup(stats, "query", "@a{sv}", &query_stats));
+   g_assert_true(g_variant_lookup(query_stats, "running", "u", &running));
+   g_assert_true(g_variant_lookup(query_stats, "spawned", "t", &spawned));
+   g_assert_true(g_variant_lookup(query_stats, "failed", "t", &failed));
+   g_assert_cmpuint(running, ==, 0);
+   g_assert_cmpuint(spawned, >=, 1);
+   g_assert_cmpuint(failed, >=, 1);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+test_hedged_query(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *hedge_config_path = NULL;
+   g_autoptr(GError) error = NULL;
+   GStatBuf stat_buf;
+   gint64 start_time;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://slow.example.com/meta\n"
+                         "MetaMirrors = http://fast.example.com/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n";
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-hedge-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_QUERY_HEDGE_DELAY", "500", TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "G_TEST_CLIENT_QUERY_SLOW_META",
+                                   "http://slow.example.com/meta", TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("The hedged query against the mirror is expected to answer first");
+   start_time = g_get_monotonic_time();
+   _call_check_for_updates(bus, NULL, NULL);
+   g_assert_cmpint(g_get_monotonic_time() - start_time, <, 3 * G_USEC_PER_SEC);
+
+   g_debug("The copy of the configuration might have credentials, it must be private");
+   hedge_config_path = g_build_filename(f->run_dir, "client-hedge.conf", NULL);
+   g_assert_cmpint(g_stat(hedge_config_path, &stat_buf), ==, 0);
+   g_assert_cmpint(stat_buf.st_mode & 0777, ==, 0600);
+
+   au_tests_stop_process(daemon_proc);
+   g_clear_object(&daemon_proc);
+
+   g_debug("When both servers are slow the query is expected to time out");
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_CLIENT_QUERY_SLOW_META",
+                       "http://slow.example.com/meta;http://fast.example.com/meta", TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_QUERY_TIMEOUT", "1", TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   _check_message_reply_prefix(bus, "CheckForUpdates", "(a{sv})", NULL,
+                               "The update query did not complete");
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+typedef struct {
+   const gchar *images_mirrors;
+   gboolean prewarmed;
+} MirrorProxyTest;
+
+static const MirrorProxyTest mirror_proxy_tests[] = {
+   { .images_mirrors = "ImagesMirrors = https://mirror.example.com/\n" },
+   /* The pre-warmed bundle is served by the proxy, even without mirrors */
+   { .images_mirrors = "", .prewarmed = TRUE },
+};
+
+static void
+test_mirror_proxy_config(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   gsize i;
+   gsize j;
+   const gchar *config_template = "[Server]\n"
+                                  "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                                  "%s"
+                                  "MetaUrl = http://localhost:12312/meta\n"
+                                  "Variants = steamdeck\n"
+                                  "Branches = stable;rc;beta;bc;main\n";
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", "update_mock_infinite.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   for (i = 0; i < G_N_ELEMENTS(mirror_proxy_tests); i++) {
+      const MirrorProxyTest *test = &mirror_proxy_tests[i];
+      g_autoptr(GSubprocess) daemon_proc = NULL;
+      g_autoptr(GSubprocess) rauc_proc = NULL;
+      g_autofree gchar *tmp_config_dir = NULL;
+      g_autofree gchar *config_path = NULL;
+      g_autofree gchar *config = NULL;
+      g_autofree gchar *update_config_path = NULL;
+      g_autofree gchar *images_url_path = NULL;
+      g_autofree gchar *images_url = NULL;
+      g_autofree gchar *prewarm_path = NULL;
+      GStatBuf stat_buf;
+
+      tmp_config_dir = g_dir_make_tmp("atomupd-daemon-mirrors-XXXXXX", &error);
+      g_assert_no_error(error);
+      config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+      config = g_strdup_printf(config_template, test->images_mirrors);
+      g_file_set_contents(config_path, config, -1, &error);
+      g_assert_no_error(error);
+
+      images_url_path = g_build_filename(tmp_config_dir, "images-url", NULL);
+      f->test_envp = g_environ_setenv(f->test_envp, "G_TEST_CLIENT_IMAGES_URL_PATH",
+                                      images_url_path, TRUE);
+
+      rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+      daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                                  f->test_envp, FALSE);
+
+      _call_check_for_updates(bus, NULL, NULL);
+
+      prewarm_path =
+         g_build_filename(f->run_dir, "prewarm-" MOCK_INFINITE ".raucb", NULL);
+      if (test->prewarmed) {
+         g_file_set_contents(prewarm_path, "bundle", -1, &error);
+         g_assert_no_error(error);
+      }
+
+      _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+
+      for (j = 0; j < 10 && !g_file_test(images_url_path, G_FILE_TEST_EXISTS); j++)
+         g_usleep(default_wait);
+
+      g_debug("The helper is expected to reach the images through the mirror proxy");
+      g_file_get_contents(images_url_path, &images_url, NULL, &error);
+      g_assert_no_error(error);
+      g_assert_true(g_str_has_prefix(images_url, "http://127.0.0.1:"));
+
+      g_debug("The proxy URL has a secret, its configuration must be private");
+      update_config_path = g_build_filename(f->run_dir, "client-update.conf", NULL);
+      g_assert_cmpint(g_stat(update_config_path, &stat_buf), ==, 0);
+      g_assert_cmpint(stat_buf.st_mode & 0777, ==, 0600);
+
+      _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+
+      au_tests_stop_process(daemon_proc);
+      g_unlink(prewarm_path);
+      g_unlink(update_config_path);
+
+      if (!rm_rf(tmp_config_dir))
+         g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+   }
+}
+
+static void
+_copy_test_data(Fixture *f, const gchar *name, const gchar *dest_path)
+{
+   g_autofree gchar *source_path = NULL;
+   g_autoptr(GFile) source_file = NULL;
+   g_autoptr(GFile) dest_file = NULL;
+   g_autoptr(GError) error = NULL;
+
+   source_path = g_build_filename(f->srcdir, "data", name, NULL);
+   source_file = g_file_new_for_path(source_path);
+   dest_file = g_file_new_for_path(dest_path);
+
+   g_file_copy(source_file, dest_file, G_FILE_COPY_OVERWRITE, NULL, NULL, NULL, &error);
+   g_assert_no_error(error);
+}
+
+static void
+test_offline_check(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariantIter) available_iter = NULL;
+   g_autoptr(GVariantIter) available_later_iter = NULL;
+   g_auto(GVariantBuilder) options = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+   g_autofree gchar *network_state_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   gint64 start_time;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   /* The same file that the fixture set in AU_NETWORK_STATE_PATH */
+   network_state_path = g_build_filename(f->run_dir, "network-state", NULL);
+
+   /* Use a copy of the update JSON, to change the available updates later */
+   update_file_path = g_build_filename(f->run_dir, "update.json", NULL);
+   _copy_test_data(f, "update_mock_infinite.json", update_file_path);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, mock_infinite_update, NULL);
+
+   g_debug("While offline, the check is expected to fail without launching the helper");
+   _set_network_state(network_state_path, "offline");
+   start_time = g_get_monotonic_time();
+   _check_message_reply_prefix(bus, "CheckForUpdates", "(a{sv})", NULL,
+                               "The meta server is not reachable");
+   g_assert_cmpint(g_get_monotonic_time() - start_time, <, G_USEC_PER_SEC / 2);
+
+   g_debug("The result of the previous check is expected when it is allowed");
+   g_variant_builder_add(&options, "{sv}", "allow_cached", g_variant_new_boolean(TRUE));
+   reply = _send_atomupd_message(bus, "CheckForUpdates", "(a{sv})", &options);
+   g_assert_nonnull(reply);
+   g_variant_get(reply, "(a{?*}a{?*})", &available_iter, &available_later_iter);
+   _check_available_updates(available_iter, mock_infinite_update);
+
+   g_debug("Once back online, the skipped check is expected to be repeated");
+   _copy_test_data(f, "update_one_minor.json", update_file_path);
+   _set_network_state(network_state_path, "online");
+   g_usleep(2 * default_wait);
+   _check_updates_property(bus, "UpdatesAvailable", updates_test[0].updates_available);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+test_stalled_update(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) rauc_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *tmp_config_dir = NULL;
+   g_autofree gchar *config_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *flight_recorder_path = NULL;
+   g_autofree gchar *saved_events = NULL;
+   const gchar *events = NULL;
+   const gchar *config = "[Server]\n"
+                         "ImagesUrl = https://steamdeck-images.steamos.cloud/\n"
+                         "MetaUrl = http://localhost:12312/meta\n"
+                         "Variants = steamdeck\n"
+                         "Branches = stable;rc;beta;bc;main\n"
+                         "[Downloads]\n"
+                         "StallRetries = 1\n";
+   AuUpdateStatus status = AU_UPDATE_STATUS_IN_PROGRESS;
+   guint stalls;
+   gsize i;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   tmp_config_dir = g_dir_make_tmp("atomupd-daemon-stall-XXXXXX", &error);
+   g_assert_no_error(error);
+   config_path = g_build_filename(tmp_config_dir, "client.conf", NULL);
+   g_file_set_contents(config_path, config, -1, &error);
+   g_assert_no_error(error);
+
+   update_file_path = g_build_filename(f->srcdir, "data", "update_one_minor.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+   f->test_envp = g_environ_setenv(f->test_envp, "AU_STALL_TIMEOUT", "1", TRUE);
+
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, tmp_config_dir,
+                                               f->test_envp, FALSE);
+
+   _call_check_for_updates(bus, NULL, NULL);
+
+   g_debug("An update that keeps printing the same percentage is still transferring "
+           "data, it is not expected to be restarted");
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_INFINITE);
+   g_usleep(3 * G_USEC_PER_SEC);
+   reply = _get_atomupd_property(bus, "UpdateStalls");
+   g_variant_get(reply, "u", &stalls);
+   g_assert_cmpuint(stalls, ==, 0);
+   g_clear_pointer(&reply, g_variant_unref);
+   _send_atomupd_message_with_null_reply(bus, "CancelUpdate", NULL, NULL);
+   g_usleep(2 * default_wait);
+
+   /* CancelUpdate also stopped the RAUC service */
+   g_clear_object(&rauc_proc);
+   rauc_proc = au_tests_launch_rauc_service(f->rauc_pid_path);
+
+   g_debug("An update that never makes progress is expected to be restarted once, "
+           "and then to fail");
+   _send_atomupd_message_with_null_reply(bus, "StartUpdate", "(s)", MOCK_STUCK);
+
+   for (i = 0; i < 20 && status == AU_UPDATE_STATUS_IN_PROGRESS; i++) {
+      g_usleep(default_wait);
+      reply = _get_atomupd_property(bus, "UpdateStatus");
+      g_variant_get(reply, "u", &status);
+      g_clear_pointer(&reply, g_variant_unref);
+   }
+
+   g_assert_cmpuint(status, ==, AU_UPDATE_STATUS_FAILED);
+   _check_string_property(bus, "FailureCode", "org.freedesktop.DBus.Error.Timeout");
+
+   reply = _get_atomupd_property(bus, "UpdateStalls");
+   g_variant_get(reply, "u", &stalls);
+   g_assert_cmpuint(stalls, ==, 2);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("The events that led to the failure are expected to be saved");
+   flight_recorder_path = g_build_filename(f->run_dir, "flight-recorder.log", NULL);
+   g_file_get_contents(flight_recorder_path, &saved_events, NULL, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(strstr(saved_events, " method 0 StartUpdate\n"));
+   g_assert_nonnull(strstr(saved_events, " spawn "));
+   g_assert_nonnull(strstr(saved_events, " error 0 "));
+   /* The status polling is not expected to be recorded */
+   g_assert_null(strstr(saved_events, " method 0 Get\n"));
+
+   reply = _send_atomupd_message(bus, "DumpFlightRecorder", NULL, NULL);
+   g_assert_nonnull(reply);
+   g_variant_get(reply, "(&s)", &events);
+   g_assert_true(g_str_has_prefix(events, saved_events));
+
+   au_tests_stop_process(daemon_proc);
+
+   if (!rm_rf(tmp_config_dir))
+      g_debug("Unable to remove temp directory: %s", tmp_config_dir);
+}
+
+static void
+_wait_for_change_cb(GObject *source_object, GAsyncResult *result, gpointer user_data)
+{
+   GVariant **reply_out = user_data;
+   g_autoptr(GError) error = NULL;
+
+   *reply_out =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), result, &error);
+   g_assert_no_error(error);
+}
+
+static void
+test_state_snapshot(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariant) state = NULL;
+   g_autoptr(GVariant) pending_reply = NULL;
+   g_autofree gchar *initial_branch = NULL;
+   g_autofree gchar *branch = NULL;
+   g_autofree gchar *error_message = NULL;
+   const gchar *no_properties[] = { NULL };
+   const gchar *branch_property[] = { "Branch", NULL };
+   const gchar *unknown_property[] = { "NotAProperty", NULL };
+   const gchar *new_branch = NULL;
+   guint64 generation = 0;
+   guint64 new_generation = 0;
+   guint32 version = 0;
+   gint64 start_time;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   reply = _send_atomupd_message(bus, "GetState", NULL, NULL);
+   g_variant_get(reply, "(t@a{sv})", &generation, &state);
+   g_assert_cmpuint(generation, >, 0);
+   g_assert_true(g_variant_lookup(state, "Version", "u", &version));
+   g_assert_cmpuint(version, ==, ATOMUPD_VERSION);
+   g_assert_true(g_variant_lookup(state, "Branch", "s", &initial_branch));
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&state, g_variant_unref);
+
+   g_debug("Without a timeout the current state is returned right away");
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", generation,
+                                 no_properties, 0);
+   g_variant_get(reply, "(t@a{sv})", &new_generation, NULL);
+   g_assert_cmpuint(new_generation, ==, generation);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("A generation from a previous daemon instance returns right away");
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", G_MAXUINT64,
+                                 no_properties, 30);
+   g_variant_get(reply, "(t@a{sv})", &new_generation, NULL);
+   g_assert_cmpuint(new_generation, ==, generation);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", generation,
+                                 unknown_property, 30);
+   g_variant_get(reply, "(s)", &error_message);
+   g_assert_cmpstr(error_message, ==, "The property 'NotAProperty' doesn't exist");
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("Wait for the branch to change");
+   g_dbus_connection_call(bus, AU_ATOMUPD1_BUS_NAME, AU_ATOMUPD1_PATH,
+                          AU_ATOMUPD1_INTERFACE, "WaitForChange",
+                          g_variant_new("(t^asu)", generation, branch_property, 60),
+                          G_VARIANT_TYPE("(ta{sv})"), G_DBUS_CALL_FLAGS_NONE, 90000,
+                          NULL, _wait_for_change_cb, &pending_reply);
+
+   new_branch = g_strcmp0(initial_branch, "beta") == 0 ? "rc" : "beta";
+   _send_atomupd_message_with_null_reply(bus, "SwitchToBranch", "(s)", new_branch);
+
+   while (pending_reply == NULL)
+      g_main_context_iteration(NULL, TRUE);
+
+   g_variant_get(pending_reply, "(t@a{sv})", &new_generation, &state);
+   g_assert_cmpuint(new_generation, >, generation);
+   g_assert_true(g_variant_lookup(state, "Branch", "s", &branch));
+   g_assert_cmpstr(branch, ==, new_branch);
+   g_clear_pointer(&state, g_variant_unref);
+
+   g_debug("Nothing else changes, the request times out");
+   generation = new_generation;
+   start_time = g_get_monotonic_time();
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", generation,
+                                 branch_property, 1);
+   g_variant_get(reply, "(t@a{sv})", &new_generation, NULL);
+   g_assert_cmpint(g_get_monotonic_time() - start_time, >=, G_USEC_PER_SEC);
+   g_assert_cmpuint(new_generation, >=, generation);
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+_wait_for_change_closed_cb(GObject *source_object,
+                           GAsyncResult *result,
+                           gpointer user_data)
+{
+   guint *n_closed = user_data;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GError) error = NULL;
+
+   reply =
+      g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), result, &error);
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+   (*n_closed)++;
+}
+
+static void
+test_wait_for_change_per_user(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GDBusConnection) client = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autofree gchar *error_message = NULL;
+   g_autofree gchar *expected_message = NULL;
+   g_autoptr(GError) error = NULL;
+   const gchar *no_properties[] = { NULL };
+   guint64 generation = 0;
+   guint n_closed = 0;
+   gsize i;
+
+   expected_message = g_strdup_printf(
+      "The user %u already has 8 pending WaitForChange requests", getuid());
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   reply = _send_atomupd_message(bus, "GetState", NULL, NULL);
+   g_variant_get(reply, "(t@a{sv})", &generation, NULL);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   client = _new_bus_client();
+
+   g_debug("Each user is expected to have a limited number of pending requests");
+   for (i = 0; i < 8; i++)
+      g_dbus_connection_call(client, AU_ATOMUPD1_BUS_NAME, AU_ATOMUPD1_PATH,
+                             AU_ATOMUPD1_INTERFACE, "WaitForChange",
+                             g_variant_new("(t^asu)", generation, no_properties, 60),
+                             G_VARIANT_TYPE("(ta{sv})"), G_DBUS_CALL_FLAGS_NONE, 90000,
+                             NULL, _wait_for_change_closed_cb, &n_closed);
+
+   reply = _send_atomupd_message(client, "WaitForChange", "(t^asu)", generation,
+                                 no_properties, 60);
+   g_variant_get(reply, "(s)", &error_message);
+   g_assert_cmpstr(error_message, ==, expected_message);
+   g_clear_pointer(&reply, g_variant_unref);
+   g_clear_pointer(&error_message, g_free);
+
+   g_debug("Opening another connection is not expected to raise the limit");
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", generation,
+                                 no_properties, 1);
+   g_variant_get(reply, "(s)", &error_message);
+   g_assert_cmpstr(error_message, ==, expected_message);
+   g_clear_pointer(&reply, g_variant_unref);
+
+   g_debug("Leaving the bus is expected to drop the pending requests of the client");
+   g_dbus_connection_close_sync(client, NULL, &error);
+   g_assert_no_error(error);
+
+   while (n_closed < 8)
+      g_main_context_iteration(NULL, TRUE);
+
+   g_debug("The dropped requests are expected to leave room for new ones");
+   reply = _send_atomupd_message(bus, "WaitForChange", "(t^asu)", generation,
+                                 no_properties, 1);
+   g_assert_true(g_variant_is_of_type(reply, G_VARIANT_TYPE("(ta{sv})")));
+
+   au_tests_stop_process(daemon_proc);
+}
+
+static void
+test_rollout_gate(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(GVariant) reply = NULL;
+   g_autoptr(GVariantIter) available_iter = NULL;
+   g_autoptr(GVariantIter) available_later_iter = NULL;
+   g_auto(GVariantBuilder) options = G_VARIANT_BUILDER_INIT(G_VARIANT_TYPE_VARDICT);
+   g_autofree gchar *machine_id_path = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autoptr(GError) error = NULL;
+   const CheckUpdatesTest *three_minors = &updates_test[2];
+   const UpdatesTest no_update[] = { {} };
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   machine_id_path = g_build_filename(f->run_dir, "machine-id", NULL);
+   g_file_set_contents(machine_id_path, "0123456789abcdef0123456789abcdef\n", -1,
+                       &error);
+   g_assert_no_error(error);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "AU_MACHINE_ID_PATH", machine_id_path, TRUE);
+
+   update_file_path =
+      g_build_filename(f->srcdir, "data", three_minors->update_json, NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   /* The second update is not offered to anybody yet, the first one is fully
+    * rolled out */
+   g_file_set_contents(f->remote_info_path,
+                       "[Rollout 20211225.1]\n"
+                       "Percentage = 100\n"
+                       "[Rollout 20220101.1]\n"
+                       "Percentage = 0\n",
+                       -1, &error);
+   g_assert_no_error(error);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   g_debug("The update that is not rolled out, and the ones after it, are expected "
+           "to be hidden");
+   _call_check_for_updates(bus, three_minors->updates_available, no_update);
+   _check_updates_property(bus, "UpdatesAvailable", three_minors->updates_available);
+   _check_updates_property(bus, "UpdatesAvailableLater", no_update);
+
+   g_debug("The rollout can be ignored on request");
+   g_variant_builder_add(&options, "{sv}", "ignore_rollout", g_variant_new_boolean(TRUE));
+   reply = _send_atomupd_message(bus, "CheckForUpdates", "(a{sv})", &options);
+   g_assert_nonnull(reply);
+   g_variant_get(reply, "(a{?*}a{?*})", &available_iter, &available_later_iter);
+   _check_available_updates(available_iter, three_minors->updates_available);
+   _check_available_updates(available_later_iter, three_minors->updates_available_later);
+
+   au_tests_stop_process(daemon_proc);
 }
 
 int
@@ -2884,6 +4568,7 @@ main(int argc, char **argv)
 
    test_add("/daemon/query_updates", test_query_updates);
    test_add("/daemon/query_updates_4xx", test_query_updates_4xx);
+   test_add("/daemon/query_updates_multi", test_query_updates_multi);
    test_add("/daemon/default_properties", test_default_properties);
    test_add("/daemon/dev_config", test_dev_config);
    test_add("/daemon/fallback_config", test_fallback_config);
@@ -2901,6 +4586,23 @@ main(int argc, char **argv)
    test_add("/daemon/manage_trusted_keys", test_manage_trusted_keys);
    test_add("/daemon/branch_dev_keys", test_branch_dev_keys);
    test_add("/daemon/builds_list", test_builds_list);
+   test_add("/daemon/prewarm_update_bundle", test_prewarm_update_bundle);
+   test_add("/daemon/network_policy", test_network_policy);
+   test_add("/daemon/power_policy", test_power_policy);
+   test_add("/daemon/pressure_policy", test_pressure_policy);
+   test_add("/daemon/proxy_policy", test_proxy_policy);
+   test_add("/daemon/multiple_targets", test_multiple_targets);
+   test_add("/daemon/subscribe_progress", test_subscribe_progress);
+   test_add("/daemon/subscribe_progress_per_user", test_subscribe_progress_per_user);
+   test_add("/daemon/memory_usage", test_memory_usage);
+   test_add("/daemon/helper_stats", test_helper_stats);
+   test_add("/daemon/hedged_query", test_hedged_query);
+   test_add("/daemon/mirror_proxy_config", test_mirror_proxy_config);
+   test_add("/daemon/offline_check", test_offline_check);
+   test_add("/daemon/stalled_update", test_stalled_update);
+   test_add("/daemon/state_snapshot", test_state_snapshot);
+   test_add("/daemon/wait_for_change_per_user", test_wait_for_change_per_user);
+   test_add("/daemon/rollout_gate", test_rollout_gate);
 
    ret = g_test_run();
    return ret;
@@ -32,6 +32,7 @@
 #include <glib-unix.h>
 #include <glib.h>
 #include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
 
 #include "atomupd-daemon/utils.h"
 #include "fixture.h"
@@ -878,6 +879,80 @@ test_list_builds(Fixture *f, gconstpointer context)
    au_tests_stop_process(http_server_proc);
 }
 
+static void
+test_bench(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GSubprocess) daemon_proc = NULL;
+   g_autoptr(GSubprocess) http_server_proc = NULL;
+   g_autoptr(GDBusConnection) bus = NULL;
+   g_autoptr(JsonParser) parser = json_parser_new();
+   g_autofree gchar *local_server_dir = NULL;
+   g_autofree gchar *update_file_path = NULL;
+   g_autofree gchar *output = NULL;
+   g_autofree gchar *json_output = NULL;
+   g_autoptr(GError) error = NULL;
+   JsonObject *root = NULL;    /* borrowed */
+   JsonObject *results = NULL; /* borrowed */
+   JsonObject *result = NULL;  /* borrowed */
+   const gchar *measured[] = {
+      "get-all-properties", "check-for-updates",  "updates-available",
+      "get-builds",         "switch-branch-noop", NULL,
+   };
+   gsize i;
+
+   bus = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+   _skip_if_daemon_is_running(bus, NULL);
+
+   update_file_path = g_build_filename(f->srcdir, "data", "update_one_minor.json", NULL);
+   f->test_envp =
+      g_environ_setenv(f->test_envp, "G_TEST_UPDATE_JSON", update_file_path, TRUE);
+
+   local_server_dir = g_build_filename(f->srcdir, "data", "client_meta", NULL);
+   http_server_proc = au_tests_start_local_http_server(local_server_dir);
+
+   daemon_proc = au_tests_start_daemon_service(bus, f->manifest_path, f->conf_dir,
+                                               f->test_envp, FALSE);
+
+   output = _au_execute_manager("bench", "--iterations=2", FALSE, f->test_envp, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(strstr(output, "get-all-properties   min "));
+   g_assert_nonnull(strstr(output, "pause-resume         skipped"));
+
+   json_output = _au_execute_manager("bench", "--json", FALSE, f->test_envp, &error);
+   g_assert_no_error(error);
+
+   json_parser_load_from_data(parser, json_output, -1, &error);
+   g_assert_no_error(error);
+
+   root = json_node_get_object(json_parser_get_root(parser));
+   g_assert_cmpint(json_object_get_int_member(root, "iterations"), ==, 10);
+   results = json_object_get_object_member(root, "results");
+
+   for (i = 0; measured[i] != NULL; i++) {
+      g_debug("Checking the results of %s", measured[i]);
+
+      result = json_object_get_object_member(results, measured[i]);
+      g_assert_nonnull(result);
+      g_assert_false(json_object_has_member(result, "error"));
+      g_assert_cmpfloat(json_object_get_double_member(result, "min_ms"), >, 0);
+      g_assert_cmpfloat(json_object_get_double_member(result, "min_ms"), <=,
+                        json_object_get_double_member(result, "p50_ms"));
+      g_assert_cmpfloat(json_object_get_double_member(result, "p50_ms"), <=,
+                        json_object_get_double_member(result, "p99_ms"));
+      g_assert_cmpfloat(json_object_get_double_member(result, "first_ms"), <=,
+                        json_object_get_double_member(result, "p99_ms"));
+   }
+
+   /* There is no update to pause */
+   result = json_object_get_object_member(results, "pause-resume");
+   g_assert_cmpstr(json_object_get_string_member(result, "skipped"), ==,
+                   "no update in progress");
+
+   au_tests_stop_process(daemon_proc);
+   au_tests_stop_process(http_server_proc);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -894,6 +969,7 @@ main(int argc, char **argv)
    test_add("/manager/verbose", test_verbose);
    test_add("/manager/dev_config", test_dev_config);
    test_add("/manager/list_builds", test_list_builds);
+   test_add("/manager/bench", test_bench);
 
    ret = g_test_run();
    return ret;
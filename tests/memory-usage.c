@@ -0,0 +1,168 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/memory-usage.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *tmp_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmp_dir = g_dir_make_tmp("atomupd-memory-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmp_dir))
+      g_debug("Unable to remove temp directory: %s", f->tmp_dir);
+
+   g_free(f->tmp_dir);
+}
+
+typedef struct {
+   const gchar *description;
+   const gchar *status;
+   guint64 rss;
+   guint64 peak_rss;
+} MemoryUsageTest;
+
+static const MemoryUsageTest memory_usage_tests[] = {
+   {
+      .description = "Regular status file",
+      .status = "Name:\tatomupd-daemon\n"
+                "VmPeak:\t  312420 kB\n"
+                "VmSize:\t  312416 kB\n"
+                "VmHWM:\t   24576 kB\n"
+                "VmRSS:\t   12288 kB\n"
+                "RssAnon:\t    4096 kB\n"
+                "Threads:\t3\n",
+      .rss = 12288 * 1024,
+      .peak_rss = 24576 * 1024,
+   },
+
+   {
+      .description = "Keys that share a prefix are not confused",
+      .status = "VmRSSFoo:\t   1 kB\n"
+                "VmRSS:\t   2 kB\n",
+      .rss = 2 * 1024,
+      .peak_rss = 0,
+   },
+
+   {
+      .description = "Invalid values",
+      .status = "VmHWM:\tinvalid\n"
+                "VmRSS:\n",
+      .rss = 0,
+      .peak_rss = 0,
+   },
+
+   {
+      .description = "Missing status file",
+      .status = NULL,
+      .rss = 0,
+      .peak_rss = 0,
+   },
+};
+
+static void
+test_memory_usage(Fixture *f, gconstpointer context)
+{
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(memory_usage_tests); i++) {
+      const MemoryUsageTest *test = &memory_usage_tests[i];
+      g_autofree gchar *status_path = NULL;
+      g_autoptr(GError) error = NULL;
+      AuMemoryUsage usage;
+
+      g_test_message("%s", test->description);
+
+      status_path = g_build_filename(f->tmp_dir, "status", NULL);
+      g_unlink(status_path);
+
+      if (test->status != NULL) {
+         g_file_set_contents(status_path, test->status, -1, &error);
+         g_assert_no_error(error);
+      }
+
+      au_memory_usage_read(status_path, &usage);
+
+      g_assert_cmpuint(usage.rss, ==, test->rss);
+      g_assert_cmpuint(usage.peak_rss, ==, test->peak_rss);
+   }
+}
+
+static void
+test_memory_release(Fixture *f, gconstpointer context)
+{
+   AuMemoryUsage usage;
+   GPtrArray *allocations = g_ptr_array_new_with_free_func(g_free);
+   gsize i;
+
+   au_memory_usage_read("/proc/self/status", &usage);
+   g_assert_cmpuint(usage.rss, >, 0);
+   g_assert_cmpuint(usage.peak_rss, >=, usage.rss);
+
+   /* Simulate a large transient parse, then check that releasing the memory
+    * is safe. Whether something is actually given back depends on the allocator. */
+   for (i = 0; i < 4096; i++)
+      g_ptr_array_add(allocations, g_malloc0(1024));
+   g_ptr_array_unref(allocations);
+
+   g_test_message("Memory released: %s", au_memory_release() ? "yes" : "no");
+
+   au_memory_usage_read("/proc/self/status", &usage);
+   g_assert_cmpuint(usage.rss, >, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/memory_usage/read", test_memory_usage);
+   test_add("/memory_usage/release", test_memory_release);
+
+   return g_test_run();
+}
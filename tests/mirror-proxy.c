@@ -0,0 +1,446 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+
+#include <curl/curl.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/mirror-proxy.h"
+#include "atomupd-daemon/peer-server.h"
+#include "atomupd-daemon/utils.h"
+#include "tests-utils.h"
+
+#define CHUNK_ID "abcd0123456789abcdef0123456789abcdef0123456789abcdef0123456789ab"
+#define CHUNK_PATH "/abcd/" CHUNK_ID ".cacnk"
+#define MISSING_CHUNK_ID "abce0123456789abcdef0123456789abcdef0123456789abcdef0123456789ab"
+#define MISSING_CHUNK_PATH "/abce/" MISSING_CHUNK_ID ".cacnk"
+
+typedef struct {
+   gchar *tmp_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmp_dir = g_dir_make_tmp("atomupd-mirror-proxy-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmp_dir))
+      g_debug("Unable to remove temp directory: %s", f->tmp_dir);
+
+   g_free(f->tmp_dir);
+}
+
+typedef struct {
+   const gchar *path;
+   gboolean valid;
+} PathTest;
+
+static const PathTest path_tests[] = {
+   { CHUNK_PATH, TRUE },
+   { "/steamdeck/20240101.1/steamdeck-20240101.1.castr/0a1b/0a1b.cacnk", TRUE },
+   { "/", FALSE },
+   { "", FALSE },
+   { "relative/path", FALSE },
+   { "/a//b", FALSE },
+   { "/a/../b", FALSE },
+   { "/a/./b", FALSE },
+   { "/a/b/", FALSE },
+   { "/a/b?query=1", FALSE },
+   { "/a/%2e%2e/b", FALSE },
+   { "/a\\b", FALSE },
+};
+
+static void
+test_valid_path(Fixture *f, gconstpointer context)
+{
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(path_tests); i++) {
+      g_test_message("%s", path_tests[i].path);
+      g_assert_cmpint(au_mirror_proxy_is_valid_path(path_tests[i].path), ==,
+                      path_tests[i].valid);
+   }
+}
+
+static const PathTest chunk_path_tests[] = {
+   { CHUNK_PATH, TRUE },
+   { "/steamdeck/20240101.1/steamdeck-20240101.1.castr" CHUNK_PATH, TRUE },
+   { "/steamdeck/20240101.1/steamdeck-20240101.1.raucb", FALSE },
+   { "/steamdeck/20240101.1/steamdeck-20240101.1.castr/0a1b/0a1b.cacnk", FALSE },
+   { "/steamdeck/abcd" CHUNK_ID ".cacnk", FALSE },
+   { "/steamdeck/../abcd/" CHUNK_ID ".cacnk", FALSE },
+   { "/", FALSE },
+   { "", FALSE },
+};
+
+static void
+test_chunk_path(Fixture *f, gconstpointer context)
+{
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(chunk_path_tests); i++) {
+      g_test_message("%s", chunk_path_tests[i].path);
+      g_assert_cmpint(au_mirror_proxy_is_chunk_path(chunk_path_tests[i].path), ==,
+                      chunk_path_tests[i].valid);
+   }
+}
+
+static void
+test_choose(Fixture *f, gconstpointer context)
+{
+   const gdouble weights[] = { 1, 3, 0 };
+   const gdouble no_weights[] = { 0, 0, 0 };
+   const gboolean none_excluded[] = { FALSE, FALSE, FALSE };
+   const gboolean first_excluded[] = { TRUE, FALSE, FALSE };
+   const gboolean all_excluded[] = { TRUE, TRUE, TRUE };
+
+   /* The first mirror gets a quarter of the requests, the second the rest */
+   g_assert_cmpint(au_mirror_proxy_choose(weights, none_excluded, 3, 0), ==, 0);
+   g_assert_cmpint(au_mirror_proxy_choose(weights, none_excluded, 3, 0.2), ==, 0);
+   g_assert_cmpint(au_mirror_proxy_choose(weights, none_excluded, 3, 0.3), ==, 1);
+   g_assert_cmpint(au_mirror_proxy_choose(weights, none_excluded, 3, 0.99), ==, 1);
+
+   /* A mirror that already failed is never chosen again */
+   g_assert_cmpint(au_mirror_proxy_choose(weights, first_excluded, 3, 0), ==, 1);
+   g_assert_cmpint(au_mirror_proxy_choose(weights, all_excluded, 3, 0.5), ==, -1);
+
+   /* Without any weight we still need to try something */
+   g_assert_cmpint(au_mirror_proxy_choose(no_weights, none_excluded, 3, 0.5), ==, 2);
+}
+
+typedef struct {
+   const gchar *url;
+   GByteArray *body;
+   long status;
+   gint done;
+} FetchRequest;
+
+static size_t
+_write_cb(char *ptr, size_t size, size_t nmemb, void *user_data)
+{
+   GByteArray *body = user_data;
+
+   g_byte_array_append(body, (const guint8 *)ptr, size * nmemb);
+   return size * nmemb;
+}
+
+static gpointer
+_fetch_thread(gpointer user_data)
+{
+   FetchRequest *request = user_data;
+   g_autoptr(CURL) curl = curl_easy_init();
+
+   g_assert_nonnull(curl);
+
+   curl_easy_setopt(curl, CURLOPT_URL, request->url);
+   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, _write_cb);
+   curl_easy_setopt(curl, CURLOPT_WRITEDATA, request->body);
+   curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+
+   if (curl_easy_perform(curl) == CURLE_OK)
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &request->status);
+
+   g_atomic_int_set(&request->done, TRUE);
+   g_main_context_wakeup(NULL);
+
+   return NULL;
+}
+
+/*
+ * The proxy and the peer servers accept their connections from the main
+ * context, so fetch from a separate thread while iterating it.
+ */
+static long
+_fetch(const gchar *url, GByteArray *body)
+{
+   FetchRequest request = { .url = url, .body = body };
+   GThread *thread = g_thread_new("fetch", _fetch_thread, &request);
+
+   while (!g_atomic_int_get(&request.done))
+      g_main_context_iteration(NULL, TRUE);
+
+   g_thread_join(thread);
+
+   return request.status;
+}
+
+static void
+test_forward(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) empty_mirror = NULL;
+   g_autoptr(AuPeerServer) full_mirror = NULL;
+   g_autoptr(AuMirrorProxy) proxy = NULL;
+   g_autoptr(GByteArray) body = g_byte_array_new();
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *empty_dir = NULL;
+   g_autofree gchar *full_dir = NULL;
+   g_autofree gchar *chunk_dir = NULL;
+   g_autofree gchar *chunk_file = NULL;
+   g_autofree gchar *proxy_url = NULL;
+   g_autofree gchar *url = NULL;
+   g_autofree gchar *empty_url = NULL;
+   g_autofree gchar *full_url = NULL;
+   g_autofree gchar *base_url = NULL;
+   g_autofree gchar *bundle_file = NULL;
+   const gchar *chunk_content = "chunk content";
+   const gchar *bundle_content = "bundle content";
+   const gchar *path_start = NULL;
+   const gchar *mirrors[4] = { NULL };
+
+   empty_dir = g_build_filename(f->tmp_dir, "empty", NULL);
+   g_assert_cmpint(g_mkdir(empty_dir, 0755), ==, 0);
+   full_dir = g_build_filename(f->tmp_dir, "full", NULL);
+   chunk_dir = g_build_filename(full_dir, "abcd", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(chunk_dir, 0755), ==, 0);
+   chunk_file = g_build_filename(full_dir, CHUNK_PATH, NULL);
+   g_file_set_contents(chunk_file, chunk_content, -1, &error);
+   g_assert_no_error(error);
+
+   empty_mirror = au_peer_server_new(empty_dir, 0, &error);
+   g_assert_no_error(error);
+   full_mirror = au_peer_server_new(full_dir, 0, &error);
+   g_assert_no_error(error);
+
+   /* With and without the trailing slash, both are expected to work */
+   empty_url =
+      g_strdup_printf("http://127.0.0.1:%u", au_peer_server_get_port(empty_mirror));
+   full_url =
+      g_strdup_printf("http://127.0.0.1:%u/", au_peer_server_get_port(full_mirror));
+
+   /* Nothing is expected to listen on port 1, the proxy must move on */
+   mirrors[0] = "http://127.0.0.1:1/";
+   mirrors[1] = empty_url;
+   mirrors[2] = full_url;
+
+   g_assert_null(au_mirror_proxy_new(&mirrors[3], &error));
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+   g_clear_error(&error);
+
+   proxy = au_mirror_proxy_new(mirrors, &error);
+   g_assert_no_error(error);
+   g_assert_true(au_mirror_proxy_has_mirrors(proxy, mirrors));
+   g_assert_false(au_mirror_proxy_has_mirrors(proxy, &mirrors[1]));
+
+   proxy_url = au_mirror_proxy_dup_url(proxy);
+
+   g_test_message("A chunk that is only in one mirror is always found");
+   url = g_strconcat(proxy_url, CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, chunk_content, strlen(chunk_content));
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("A chunk that is in no mirror is not found");
+   url = g_strconcat(proxy_url, MISSING_CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 404);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("Invalid paths are rejected");
+   url = g_strconcat(proxy_url, "abcd//chunk", NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 400);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("Only chunks can be fetched");
+   url = g_strconcat(proxy_url, "steamdeck/20240101.1/steamdeck.raucb", NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 404);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_assert_false(
+      au_mirror_proxy_set_bundle(proxy, "steamdeck/../steamdeck.raucb", NULL));
+   g_assert_true(au_mirror_proxy_set_bundle(proxy, "steamdeck/20240101.1/x.raucb", NULL));
+
+   g_test_message("The local copy of the bundle is used, if there is one");
+   bundle_file = g_build_filename(f->tmp_dir, "x.raucb", NULL);
+   g_file_set_contents(bundle_file, bundle_content, -1, &error);
+   g_assert_no_error(error);
+   g_assert_true(
+      au_mirror_proxy_set_bundle(proxy, "/steamdeck/20240101.1/x.raucb", bundle_file));
+   url = g_strconcat(proxy_url, "steamdeck/20240101.1/x.raucb", NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, bundle_content, strlen(bundle_content));
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_assert_true(au_mirror_proxy_set_bundle(proxy, NULL, NULL));
+
+   g_test_message("The requests without the secret are rejected");
+   path_start = strchr(proxy_url + strlen("http://"), '/');
+   g_assert_nonnull(path_start);
+   base_url = g_strndup(proxy_url, path_start + 1 - proxy_url);
+   url = g_strconcat(base_url, CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 403);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   url = g_strconcat(base_url, "0123456789abcdef0123456789abcdef", CHUNK_PATH, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 403);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("The previous URLs stop working after renewing the secret");
+   au_mirror_proxy_renew_secret(proxy, &error);
+   g_assert_no_error(error);
+   url = g_strconcat(proxy_url, CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 403);
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_clear_pointer(&proxy_url, g_free);
+   proxy_url = au_mirror_proxy_dup_url(proxy);
+   url = g_strconcat(proxy_url, CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, chunk_content, strlen(chunk_content));
+}
+
+static void
+test_peers_and_cache(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) mirror = NULL;
+   g_autoptr(AuPeerServer) peer = NULL;
+   g_autoptr(AuMirrorProxy) proxy = NULL;
+   g_autoptr(GByteArray) body = g_byte_array_new();
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *mirror_dir = NULL;
+   g_autofree gchar *peer_dir = NULL;
+   g_autofree gchar *cache_dir = NULL;
+   g_autofree gchar *chunk_dir = NULL;
+   g_autofree gchar *chunk_file = NULL;
+   g_autofree gchar *cached_file = NULL;
+   g_autofree gchar *cached_content = NULL;
+   g_autofree gchar *mirror_url = NULL;
+   g_autofree gchar *peer_url = NULL;
+   g_autofree gchar *proxy_url = NULL;
+   g_autofree gchar *url = NULL;
+   const gchar *mirrors[2] = { NULL };
+   const gchar *peers[3] = { NULL };
+
+   mirror_dir = g_build_filename(f->tmp_dir, "mirror", NULL);
+   peer_dir = g_build_filename(f->tmp_dir, "peer", NULL);
+   cache_dir = g_build_filename(f->tmp_dir, "cache", NULL);
+
+   chunk_dir = g_build_filename(peer_dir, "abcd", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(chunk_dir, 0755), ==, 0);
+   chunk_file = g_build_filename(peer_dir, CHUNK_PATH, NULL);
+   g_file_set_contents(chunk_file, "from the peer", -1, &error);
+   g_assert_no_error(error);
+   g_clear_pointer(&chunk_dir, g_free);
+   g_clear_pointer(&chunk_file, g_free);
+
+   chunk_dir = g_build_filename(mirror_dir, "abce", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(chunk_dir, 0755), ==, 0);
+   chunk_file = g_build_filename(mirror_dir, MISSING_CHUNK_PATH, NULL);
+   g_file_set_contents(chunk_file, "from the mirror", -1, &error);
+   g_assert_no_error(error);
+   g_clear_pointer(&chunk_dir, g_free);
+   g_clear_pointer(&chunk_file, g_free);
+   chunk_dir = g_build_filename(mirror_dir, "abcd", NULL);
+   g_assert_cmpint(g_mkdir_with_parents(chunk_dir, 0755), ==, 0);
+   chunk_file = g_build_filename(mirror_dir, CHUNK_PATH, NULL);
+   g_file_set_contents(chunk_file, "from the mirror", -1, &error);
+   g_assert_no_error(error);
+
+   mirror = au_peer_server_new(mirror_dir, 0, &error);
+   g_assert_no_error(error);
+   peer = au_peer_server_new(peer_dir, 0, &error);
+   g_assert_no_error(error);
+
+   mirror_url = g_strdup_printf("http://127.0.0.1:%u/", au_peer_server_get_port(mirror));
+   peer_url = g_strdup_printf("http://127.0.0.1:%u", au_peer_server_get_port(peer));
+   mirrors[0] = mirror_url;
+   /* Nothing is expected to listen on port 1, the proxy must move on */
+   peers[0] = "http://127.0.0.1:1";
+   peers[1] = peer_url;
+
+   proxy = au_mirror_proxy_new(mirrors, &error);
+   g_assert_no_error(error);
+   au_mirror_proxy_set_peers(proxy, peers);
+   au_mirror_proxy_set_chunk_cache(proxy, cache_dir);
+   proxy_url = au_mirror_proxy_dup_url(proxy);
+
+   g_test_message("The peers are preferred over the mirrors");
+   url = g_strconcat(proxy_url, CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, "from the peer", strlen("from the peer"));
+   g_clear_pointer(&url, g_free);
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("The chunks from the peers are not cached");
+   cached_file = g_build_filename(cache_dir, CHUNK_PATH, NULL);
+   g_assert_false(g_file_test(cached_file, G_FILE_TEST_EXISTS));
+   g_clear_pointer(&cached_file, g_free);
+
+   g_test_message("The chunks that the peers don't have come from the mirrors");
+   url = g_strconcat(proxy_url, MISSING_CHUNK_PATH + 1, NULL);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, "from the mirror", strlen("from the mirror"));
+   g_byte_array_set_size(body, 0);
+
+   g_test_message("The chunks from the mirrors are cached");
+   cached_file = g_build_filename(cache_dir, MISSING_CHUNK_PATH, NULL);
+   g_file_get_contents(cached_file, &cached_content, NULL, &error);
+   g_assert_no_error(error);
+   g_assert_cmpstr(cached_content, ==, "from the mirror");
+
+   g_test_message("The cached chunks are served even without the mirrors");
+   g_clear_pointer(&mirror, au_peer_server_free);
+   g_assert_cmpint(_fetch(url, body), ==, 200);
+   g_assert_cmpmem(body->data, body->len, "from the mirror", strlen("from the mirror"));
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/mirror_proxy/valid_path", test_valid_path);
+   test_add("/mirror_proxy/chunk_path", test_chunk_path);
+   test_add("/mirror_proxy/choose", test_choose);
+   test_add("/mirror_proxy/forward", test_forward);
+   test_add("/mirror_proxy/peers_and_cache", test_peers_and_cache);
+
+   return g_test_run();
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+int
+main(int argc, char **argv)
+{
+   /* Mock implementation for "desync verify --store STORE [--repair]". The
+    * chunks whose content starts with "corrupted" are considered invalid. */
+
+   const gchar *store = NULL;
+   gboolean repair = FALSE;
+   g_autoptr(GDir) dir = NULL;
+   const gchar *prefix;
+   int i;
+
+   if (argc < 2 || g_strcmp0(argv[1], "verify") != 0)
+      return EXIT_FAILURE;
+
+   for (i = 2; i < argc; i++) {
+      if (g_str_equal(argv[i], "--store") && i + 1 < argc)
+         store = argv[++i];
+      else if (g_str_equal(argv[i], "--repair"))
+         repair = TRUE;
+   }
+
+   if (store == NULL)
+      return EXIT_FAILURE;
+
+   dir = g_dir_open(store, 0, NULL);
+   if (dir == NULL)
+      return EXIT_FAILURE;
+
+   while ((prefix = g_dir_read_name(dir)) != NULL) {
+      g_autofree gchar *subdir_path = g_build_filename(store, prefix, NULL);
+      g_autoptr(GDir) subdir = NULL;
+      const gchar *name;
+
+      subdir = g_dir_open(subdir_path, 0, NULL);
+      if (subdir == NULL)
+         continue;
+
+      while ((name = g_dir_read_name(subdir)) != NULL) {
+         g_autofree gchar *path = g_build_filename(subdir_path, name, NULL);
+         g_autofree gchar *content = NULL;
+
+         if (!g_str_has_suffix(name, ".cacnk"))
+            continue;
+
+         if (!g_file_get_contents(path, &content, NULL, NULL) ||
+             !g_str_has_prefix(content, "corrupted"))
+            continue;
+
+         fprintf(stderr, "chunk %s is invalid\n", name);
+
+         if (repair)
+            g_unlink(path);
+      }
+   }
+
+   return EXIT_SUCCESS;
+}
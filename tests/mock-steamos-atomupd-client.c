@@ -98,6 +98,24 @@ main(int argc, char **argv)
       if (g_getenv("G_TEST_CLIENT_QUERY_4xx"))
          return 2;
 
+      if (g_getenv("G_TEST_CLIENT_QUERY_SLOW_META") != NULL && opt_config != NULL) {
+         g_auto(GStrv) slow_urls =
+            g_strsplit(g_getenv("G_TEST_CLIENT_QUERY_SLOW_META"), ";", -1);
+         g_autoptr(GKeyFile) client_config = g_key_file_new();
+         g_autofree gchar *meta_url = NULL;
+         guint i;
+
+         if (g_key_file_load_from_file(client_config, opt_config, G_KEY_FILE_NONE, NULL))
+            meta_url = g_key_file_get_string(client_config, "Server", "MetaUrl", NULL);
+
+         /* Simulates a meta server that takes a minute to reply */
+         if (meta_url != NULL &&
+             g_strv_contains((const gchar *const *)slow_urls, meta_url)) {
+            for (i = 0; i < 600 && !stopped; i++)
+               g_usleep(0.1 * G_USEC_PER_SEC);
+         }
+      }
+
       if (opt_penultimate)
          update_json_path = g_getenv("G_TEST_UPDATE_JSON_PENULTIMATE");
       else
@@ -122,6 +140,19 @@ main(int argc, char **argv)
    if (opt_update_version == NULL && opt_update_from_url == NULL)
       return EXIT_FAILURE;
 
+   if (g_getenv("G_TEST_CLIENT_IMAGES_URL_PATH") != NULL && opt_config != NULL) {
+      g_autoptr(GKeyFile) client_config = g_key_file_new();
+      g_autofree gchar *images_url = NULL;
+
+      /* Let the test know which images server we have been told to use */
+      if (g_key_file_load_from_file(client_config, opt_config, G_KEY_FILE_NONE, NULL))
+         images_url = g_key_file_get_string(client_config, "Server", "ImagesUrl", NULL);
+
+      if (images_url != NULL)
+         g_file_set_contents(g_getenv("G_TEST_CLIENT_IMAGES_URL_PATH"), images_url, -1,
+                             NULL);
+   }
+
    setbuf(stdout, NULL);
 
    if (g_strcmp0(opt_update_version, MOCK_SUCCESS) == 0) {
@@ -0,0 +1,284 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/peer-server.h"
+#include "tests-utils.h"
+
+#define CHUNK_ID "6c87f68371b28954707ebb92afee7ccffb74c6f71ec8fea8a98cf6104289585b"
+#define CHUNK_CONTENT "compressed chunk content"
+
+typedef struct {
+   gchar *chunks_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autofree gchar *prefix_dir = NULL;
+   g_autofree gchar *chunk_path = NULL;
+   g_autoptr(GError) error = NULL;
+
+   f->chunks_dir = g_dir_make_tmp("atomupd-chunks-XXXXXX", &error);
+   g_assert_no_error(error);
+
+   prefix_dir = g_build_filename(f->chunks_dir, "6c87", NULL);
+   g_assert_cmpint(g_mkdir(prefix_dir, 0755), ==, 0);
+
+   chunk_path = g_build_filename(prefix_dir, CHUNK_ID ".cacnk", NULL);
+   g_file_set_contents(chunk_path, CHUNK_CONTENT, -1, &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->chunks_dir))
+      g_debug("Unable to remove temp directory: %s", f->chunks_dir);
+
+   g_free(f->chunks_dir);
+}
+
+typedef struct {
+   guint16 port;
+   const gchar *request;
+   gchar *response;
+   gint done;
+} RequestData;
+
+static gpointer
+_send_request_thread(gpointer user_data)
+{
+   RequestData *data = user_data;
+   g_autoptr(GSocketClient) client = g_socket_client_new();
+   g_autoptr(GSocketConnection) connection = NULL;
+   g_autoptr(GString) response = g_string_new(NULL);
+   g_autoptr(GError) error = NULL;
+   GInputStream *input = NULL;  /* borrowed */
+   GOutputStream *output = NULL; /* borrowed */
+   gchar buffer[1024];
+   gssize n_read;
+
+   connection = g_socket_client_connect_to_host(client, "127.0.0.1", data->port, NULL,
+                                                &error);
+   g_assert_no_error(error);
+
+   output = g_io_stream_get_output_stream(G_IO_STREAM(connection));
+   g_output_stream_write_all(output, data->request, strlen(data->request), NULL, NULL,
+                             &error);
+   g_assert_no_error(error);
+
+   input = g_io_stream_get_input_stream(G_IO_STREAM(connection));
+   while ((n_read = g_input_stream_read(input, buffer, sizeof(buffer), NULL, &error)) > 0)
+      g_string_append_len(response, buffer, n_read);
+   g_assert_no_error(error);
+
+   data->response = g_string_free(g_steal_pointer(&response), FALSE);
+
+   g_atomic_int_set(&data->done, TRUE);
+   g_main_context_wakeup(NULL);
+
+   return NULL;
+}
+
+/*
+ * Send @request to the server on @port, while iterating the default main
+ * context to let the server accept the connection.
+ *
+ * Returns: (transfer full): The raw response
+ */
+static gchar *
+_send_request(guint16 port, const gchar *request)
+{
+   RequestData data = { .port = port, .request = request };
+   g_autoptr(GThread) thread = NULL;
+
+   thread = g_thread_new("peer-client", _send_request_thread, &data);
+
+   while (!g_atomic_int_get(&data.done))
+      g_main_context_iteration(NULL, TRUE);
+
+   g_thread_join(g_steal_pointer(&thread));
+
+   return data.response;
+}
+
+typedef struct {
+   const gchar *description;
+   const gchar *request;
+   const gchar *status_line;
+   const gchar *body; /* The expected body, or NULL if we don't expect any */
+} PeerRequestTest;
+
+static const PeerRequestTest peer_request_tests[] = {
+   {
+      .description = "Get a chunk",
+      .request = "GET /6c87/" CHUNK_ID ".cacnk HTTP/1.1\r\n"
+                 "Host: localhost\r\n"
+                 "\r\n",
+      .status_line = "HTTP/1.1 200 OK",
+      .body = CHUNK_CONTENT,
+   },
+   {
+      .description = "Check the existence of a chunk",
+      .request = "HEAD /6c87/" CHUNK_ID ".cacnk HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 200 OK",
+   },
+   {
+      .description = "Chunk that we don't have",
+      .request = "GET /0000/0000f68371b28954707ebb92afee7ccf"
+                 "fb74c6f71ec8fea8a98cf6104289585b.cacnk HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 404 Not Found",
+   },
+   {
+      .description = "Chunk ID that doesn't match its directory",
+      .request = "GET /0000/" CHUNK_ID ".cacnk HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 404 Not Found",
+   },
+   {
+      .description = "Uppercase chunk ID",
+      .request = "GET /6C87/6C87F68371B28954707EBB92AFEE7CCF"
+                 "FB74C6F71EC8FEA8A98CF6104289585B.cacnk HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 404 Not Found",
+   },
+   {
+      .description = "Path outside of the chunk store",
+      .request = "GET /../../etc/passwd HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 404 Not Found",
+   },
+   {
+      .description = "Unsupported method",
+      .request = "PUT /6c87/" CHUNK_ID ".cacnk HTTP/1.1\r\n\r\n",
+      .status_line = "HTTP/1.1 405 Method Not Allowed",
+   },
+   {
+      .description = "Not an HTTP request",
+      .request = "hello\r\n\r\n",
+      .status_line = "HTTP/1.1 400 Bad Request",
+   },
+};
+
+static void
+test_serve_chunks(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) server = NULL;
+   g_autoptr(GError) error = NULL;
+   gsize i;
+
+   server = au_peer_server_new(f->chunks_dir, 0, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(server);
+   g_assert_cmpuint(au_peer_server_get_port(server), !=, 0);
+   g_assert_cmpstr(au_peer_server_get_chunks_dir(server), ==, f->chunks_dir);
+
+   for (i = 0; i < G_N_ELEMENTS(peer_request_tests); i++) {
+      const PeerRequestTest *test = &peer_request_tests[i];
+      g_autofree gchar *response = NULL;
+      const gchar *body = NULL;
+
+      g_test_message("%s", test->description);
+
+      response = _send_request(au_peer_server_get_port(server), test->request);
+
+      g_assert_true(g_str_has_prefix(response, test->status_line));
+
+      body = strstr(response, "\r\n\r\n");
+      g_assert_nonnull(body);
+      body += strlen("\r\n\r\n");
+
+      g_assert_cmpstr(body, ==, test->body == NULL ? "" : test->body);
+   }
+}
+
+static void
+test_oversized_requests(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) server = NULL;
+   g_autoptr(GString) long_line = g_string_new("GET /");
+   g_autoptr(GString) many_headers = NULL;
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *response = NULL;
+   gsize i;
+
+   server = au_peer_server_new(f->chunks_dir, 0, &error);
+   g_assert_no_error(error);
+
+   for (i = 0; i < 2000; i++)
+      g_string_append_c(long_line, 'a');
+   g_string_append(long_line, " HTTP/1.1\r\n\r\n");
+
+   response = _send_request(au_peer_server_get_port(server), long_line->str);
+   g_assert_true(g_str_has_prefix(response, "HTTP/1.1 400 Bad Request"));
+   g_clear_pointer(&response, g_free);
+
+   many_headers = g_string_new("GET /6c87/" CHUNK_ID ".cacnk HTTP/1.1\r\n");
+   for (i = 0; i < 100; i++)
+      g_string_append_printf(many_headers, "X-Header-%" G_GSIZE_FORMAT ": a\r\n", i);
+   g_string_append(many_headers, "\r\n");
+
+   response = _send_request(au_peer_server_get_port(server), many_headers->str);
+   g_assert_true(g_str_has_prefix(response, "HTTP/1.1 400 Bad Request"));
+}
+
+static void
+test_missing_chunks_dir(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) server = NULL;
+   g_autofree gchar *missing_dir = NULL;
+   g_autoptr(GError) error = NULL;
+
+   missing_dir = g_build_filename(f->chunks_dir, "missing", NULL);
+
+   server = au_peer_server_new(missing_dir, 0, &error);
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND);
+   g_assert_null(server);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/peer_server/serve_chunks", test_serve_chunks);
+   test_add("/peer_server/oversized_requests", test_oversized_requests);
+   test_add("/peer_server/missing_chunks_dir", test_missing_chunks_dir);
+
+   return g_test_run();
+}
@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/power-state.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *sysfs_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->sysfs_dir = g_dir_make_tmp("atomupd-sysfs-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->sysfs_dir))
+      g_debug("Unable to remove temp directory: %s", f->sysfs_dir);
+
+   g_free(f->sysfs_dir);
+}
+
+/* Attribute of the fake sysfs, relative to its root, and its content */
+typedef struct {
+   const gchar *path;
+   const gchar *content;
+} SysfsAttribute;
+
+typedef struct {
+   const gchar *description;
+   SysfsAttribute attributes[8];
+   gboolean on_battery;
+   gint battery_level;
+   gint temperature;
+} PowerStateTest;
+
+static const PowerStateTest power_state_tests[] = {
+   {
+      .description = "Empty sysfs",
+      .on_battery = FALSE,
+      .battery_level = -1,
+      .temperature = G_MININT,
+   },
+
+   {
+      .description = "Discharging battery",
+      .attributes = {
+         { "class/power_supply/BAT1/type", "Battery\n" },
+         { "class/power_supply/BAT1/scope", "System\n" },
+         { "class/power_supply/BAT1/capacity", "42\n" },
+         { "class/power_supply/ACAD/type", "Mains\n" },
+         { "class/power_supply/ACAD/online", "0\n" },
+      },
+      .on_battery = TRUE,
+      .battery_level = 42,
+      .temperature = G_MININT,
+   },
+
+   {
+      .description = "Battery with the external power supply online",
+      .attributes = {
+         { "class/power_supply/BAT1/type", "Battery\n" },
+         { "class/power_supply/BAT1/capacity", "15\n" },
+         { "class/power_supply/ACAD/type", "Mains\n" },
+         { "class/power_supply/ACAD/online", "1\n" },
+      },
+      .on_battery = FALSE,
+      .battery_level = 15,
+      .temperature = G_MININT,
+   },
+
+   {
+      .description = "The battery of a peripheral is ignored",
+      .attributes = {
+         { "class/power_supply/BAT1/type", "Battery\n" },
+         { "class/power_supply/BAT1/capacity", "80\n" },
+         { "class/power_supply/controller/type", "Battery\n" },
+         { "class/power_supply/controller/scope", "Device\n" },
+         { "class/power_supply/controller/capacity", "5\n" },
+      },
+      .on_battery = TRUE,
+      .battery_level = 80,
+      .temperature = G_MININT,
+   },
+
+   {
+      .description = "The hottest thermal zone is used",
+      .attributes = {
+         { "class/thermal/thermal_zone0/temp", "45000\n" },
+         { "class/thermal/thermal_zone1/temp", "81500\n" },
+         { "class/thermal/thermal_zone2/temp", "invalid\n" },
+         { "class/thermal/cooling_device0/temp", "99000\n" },
+      },
+      .on_battery = FALSE,
+      .battery_level = -1,
+      .temperature = 81,
+   },
+};
+
+static void
+test_power_state(Fixture *f, gconstpointer context)
+{
+   gsize i;
+   gsize j;
+
+   for (i = 0; i < G_N_ELEMENTS(power_state_tests); i++) {
+      const PowerStateTest *test = &power_state_tests[i];
+      AuPowerState state;
+      g_autoptr(GError) error = NULL;
+
+      g_test_message("%s", test->description);
+
+      for (j = 0; j < G_N_ELEMENTS(test->attributes) && test->attributes[j].path != NULL;
+           j++) {
+         g_autofree gchar *path =
+            g_build_filename(f->sysfs_dir, test->attributes[j].path, NULL);
+         g_autofree gchar *dir = g_path_get_dirname(path);
+
+         g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+         g_file_set_contents(path, test->attributes[j].content, -1, &error);
+         g_assert_no_error(error);
+      }
+
+      au_power_state_read(f->sysfs_dir, &state);
+
+      g_assert_cmpint(state.on_battery, ==, test->on_battery);
+      g_assert_cmpint(state.battery_level, ==, test->battery_level);
+      g_assert_cmpint(state.temperature, ==, test->temperature);
+
+      /* Start the next test with an empty sysfs */
+      g_assert_true(rm_rf(f->sysfs_dir));
+      g_assert_cmpint(g_mkdir(f->sysfs_dir, 0755), ==, 0);
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/power_state/read", test_power_state);
+
+   return g_test_run();
+}
@@ -0,0 +1,258 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/pressure.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *tmpdir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmpdir = g_dir_make_tmp("atomupd-pressure-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmpdir))
+      g_debug("Unable to remove temp directory: %s", f->tmpdir);
+
+   g_free(f->tmpdir);
+}
+
+static void
+write_file(const gchar *dir, const gchar *name, const gchar *content)
+{
+   g_autofree gchar *path = g_build_filename(dir, name, NULL);
+   g_autoptr(GError) error = NULL;
+
+   g_file_set_contents(path, content, -1, &error);
+   g_assert_no_error(error);
+}
+
+static void
+test_totals_read(Fixture *f, gconstpointer context)
+{
+   AuPressureTotals totals;
+
+   /* No PSI files at all, e.g. a kernel without CONFIG_PSI */
+   g_assert_false(au_pressure_totals_read(f->tmpdir, FALSE, &totals));
+
+   write_file(f->tmpdir, "cpu",
+              "some avg10=1.00 avg60=0.50 avg300=0.10 total=123456\n"
+              "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n");
+   write_file(f->tmpdir, "io",
+              "some avg10=0.00 avg60=0.00 avg300=0.00 total=42\n"
+              "full avg10=0.00 avg60=0.00 avg300=0.00 total=7\n");
+   write_file(f->tmpdir, "memory", "garbage\n");
+
+   g_assert_true(au_pressure_totals_read(f->tmpdir, FALSE, &totals));
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_CPU], ==, 123456);
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_IO], ==, 42);
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_MEMORY], ==, 0);
+
+   /* In a cgroup the files have a ".pressure" suffix */
+   g_assert_false(au_pressure_totals_read(f->tmpdir, TRUE, &totals));
+
+   write_file(f->tmpdir, "memory.pressure",
+              "some avg10=0.00 avg60=0.00 avg300=0.00 total=999\n"
+              "full avg10=0.00 avg60=0.00 avg300=0.00 total=1\n");
+
+   g_assert_true(au_pressure_totals_read(f->tmpdir, TRUE, &totals));
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_CPU], ==, 0);
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_IO], ==, 0);
+   g_assert_cmpuint(totals.stall[AU_PRESSURE_MEMORY], ==, 999);
+}
+
+/* One second, in microseconds */
+#define SECOND G_USEC_PER_SEC
+
+/*
+ * sample:
+ * @stall: How long the foreground tasks were stalled on I/O in the last second,
+ *  in microseconds
+ *
+ * Simulate one more second of stalls on I/O.
+ *
+ * Returns: %TRUE if the level changed
+ */
+static gboolean
+sample(AuPressureController *controller,
+       gint64 *now,
+       AuPressureTotals *foreground,
+       guint64 stall)
+{
+   *now += SECOND;
+   foreground->stall[AU_PRESSURE_IO] += stall;
+
+   return au_pressure_controller_sample(controller, *now, foreground);
+}
+
+static void
+test_controller(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPressureController) controller = NULL;
+   const AuPressureState *state;
+   AuPressureTotals foreground = { { 0 } };
+   gint64 now = 1;
+   gsize i;
+
+   controller = au_pressure_controller_new(2, 10, 2, 3);
+   state = au_pressure_controller_get_state(controller);
+
+   /* The first sample is only a baseline */
+   g_assert_false(au_pressure_controller_sample(controller, now, &foreground));
+   g_assert_cmpuint(state->level, ==, 0);
+
+   g_assert_false(sample(controller, &now, &foreground, 0));
+   g_assert_cmpuint(state->level, ==, 0);
+   g_assert_cmpfloat(state->foreground_stall[AU_PRESSURE_IO], ==, 0);
+
+   /* The foreground tasks are stalled 20% of the time, back off one level at a time */
+   g_assert_true(sample(controller, &now, &foreground, SECOND / 5));
+   g_assert_cmpuint(state->level, ==, 1);
+   g_assert_cmpfloat_with_epsilon(state->foreground_stall[AU_PRESSURE_IO], 20, 0.01);
+   g_assert_true(sample(controller, &now, &foreground, SECOND / 5));
+   g_assert_cmpuint(state->level, ==, 2);
+
+   /* Already at the maximum level */
+   g_assert_false(sample(controller, &now, &foreground, SECOND));
+   g_assert_cmpuint(state->level, ==, 2);
+   g_assert_cmpuint(state->backoffs, ==, 2);
+   g_assert_cmpfloat(state->foreground_stall[AU_PRESSURE_IO], ==, 100);
+
+   /* Between the thresholds the level is kept, and the calm samples restart */
+   g_assert_false(sample(controller, &now, &foreground, 0));
+   g_assert_false(sample(controller, &now, &foreground, 0));
+   g_assert_false(sample(controller, &now, &foreground, SECOND / 20));
+   g_assert_cmpuint(state->level, ==, 2);
+
+   /* Ramp up one level after each 3 calm samples */
+   for (i = 0; i < 2; i++) {
+      g_assert_false(sample(controller, &now, &foreground, 0));
+      g_assert_false(sample(controller, &now, &foreground, SECOND / 100));
+      g_assert_true(sample(controller, &now, &foreground, 0));
+      g_assert_cmpuint(state->level, ==, 1 - i);
+   }
+
+   g_assert_cmpuint(state->rampups, ==, 2);
+
+   /* Already at full speed */
+   for (i = 0; i < 5; i++)
+      g_assert_false(sample(controller, &now, &foreground, 0));
+
+   /* A reset forgets the baseline and the level, but keeps the statistics */
+   g_assert_true(sample(controller, &now, &foreground, SECOND));
+   g_assert_cmpuint(state->level, ==, 1);
+   au_pressure_controller_reset(controller);
+   g_assert_cmpuint(state->level, ==, 0);
+   g_assert_cmpuint(state->backoffs, ==, 3);
+   g_assert_false(sample(controller, &now, &foreground, SECOND));
+   g_assert_cmpuint(state->level, ==, 0);
+}
+
+static void
+write_io_pressure(const gchar *dir, guint64 total)
+{
+   g_autofree gchar *content = NULL;
+
+   g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+
+   content = g_strdup_printf("some avg10=0.00 avg60=0.00 avg300=0.00 "
+                             "total=%" G_GUINT64_FORMAT "\n"
+                             "full avg10=0.00 avg60=0.00 avg300=0.00 total=0\n",
+                             total);
+   write_file(dir, "io.pressure", content);
+}
+
+static void
+test_overlapping_stalls(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPressureController) controller = NULL;
+   g_autofree gchar *user_slice = g_build_filename(f->tmpdir, "user.slice", NULL);
+   g_autofree gchar *rauc = NULL;
+   const AuPressureState *state;
+   AuPressureTotals foreground;
+   gint64 now = 1;
+
+   rauc = g_build_filename(f->tmpdir, "system.slice", "rauc.service", NULL);
+
+   controller = au_pressure_controller_new(2, 10, 2, 3);
+   state = au_pressure_controller_get_state(controller);
+
+   write_io_pressure(user_slice, 0);
+   write_io_pressure(rauc, 0);
+   g_assert_true(au_pressure_totals_read(user_slice, TRUE, &foreground));
+   g_assert_false(au_pressure_controller_sample(controller, now, &foreground));
+
+   /* The game and the update are stalled on I/O during the same half second.
+    * The system wide "some" only grows by half a second, exactly like the
+    * update one, so subtracting them would hide the stall of the game. */
+   write_io_pressure(user_slice, SECOND / 2);
+   write_io_pressure(rauc, SECOND / 2);
+   now += SECOND;
+   g_assert_true(au_pressure_totals_read(user_slice, TRUE, &foreground));
+   g_assert_true(au_pressure_controller_sample(controller, now, &foreground));
+   g_assert_cmpfloat_with_epsilon(state->foreground_stall[AU_PRESSURE_IO], 50, 0.01);
+   g_assert_cmpuint(state->level, ==, 1);
+
+   /* Only the update is stalled, the foreground tasks are not affected */
+   write_io_pressure(rauc, SECOND * 3 / 2);
+   now += SECOND;
+   g_assert_true(au_pressure_totals_read(user_slice, TRUE, &foreground));
+   g_assert_false(au_pressure_controller_sample(controller, now, &foreground));
+   g_assert_cmpfloat(state->foreground_stall[AU_PRESSURE_IO], ==, 0);
+   g_assert_cmpuint(state->level, ==, 1);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/pressure/totals_read", test_totals_read);
+   test_add("/pressure/controller", test_controller);
+   test_add("/pressure/overlapping_stalls", test_overlapping_stalls);
+
+   return g_test_run();
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/peer-server.h"
+#include "atomupd-daemon/proxy-probe.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *tmp_dir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmp_dir = g_dir_make_tmp("atomupd-proxy-probe-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmp_dir))
+      g_debug("Unable to remove temp directory: %s", f->tmp_dir);
+
+   g_free(f->tmp_dir);
+}
+
+typedef struct {
+   AuProxyRoute current;
+   gint64 proxy_latency;
+   gint64 direct_latency;
+   AuProxyRoute expected;
+} ChooseTest;
+
+static const ChooseTest choose_tests[] = {
+   /* The current path is kept while it is about as fast as the other */
+   { AU_PROXY_ROUTE_PROXY, 1000, 900, AU_PROXY_ROUTE_PROXY },
+   { AU_PROXY_ROUTE_DIRECT, 900, 1000, AU_PROXY_ROUTE_DIRECT },
+   /* The other path is much faster */
+   { AU_PROXY_ROUTE_PROXY, 1000, 500, AU_PROXY_ROUTE_DIRECT },
+   { AU_PROXY_ROUTE_DIRECT, 200, 1000, AU_PROXY_ROUTE_PROXY },
+   /* The current path is broken */
+   { AU_PROXY_ROUTE_PROXY, -1, 5000, AU_PROXY_ROUTE_DIRECT },
+   { AU_PROXY_ROUTE_DIRECT, 5000, -1, AU_PROXY_ROUTE_PROXY },
+   /* The other path is broken, even if the current one is slow */
+   { AU_PROXY_ROUTE_PROXY, 9000, -1, AU_PROXY_ROUTE_PROXY },
+   /* Nothing works, there is no reason to move */
+   { AU_PROXY_ROUTE_PROXY, -1, -1, AU_PROXY_ROUTE_PROXY },
+   { AU_PROXY_ROUTE_DIRECT, -1, -1, AU_PROXY_ROUTE_DIRECT },
+};
+
+static void
+test_choose(Fixture *f, gconstpointer context)
+{
+   gsize i;
+
+   for (i = 0; i < G_N_ELEMENTS(choose_tests); i++) {
+      const ChooseTest *test = &choose_tests[i];
+
+      g_assert_cmpint(au_proxy_route_choose(test->current, test->proxy_latency,
+                                            test->direct_latency),
+                      ==, test->expected);
+   }
+
+   g_assert_cmpstr(au_proxy_route_to_string(AU_PROXY_ROUTE_PROXY), ==, "proxy");
+   g_assert_cmpstr(au_proxy_route_to_string(AU_PROXY_ROUTE_DIRECT), ==, "direct");
+}
+
+typedef struct {
+   const gchar *url;
+   const gchar *http_proxy;
+   gint64 latency;
+   GError *error;
+   gint done;
+} ProbeRequest;
+
+static gpointer
+_probe_thread(gpointer user_data)
+{
+   ProbeRequest *request = user_data;
+
+   request->latency = au_proxy_probe(request->url, request->http_proxy, &request->error);
+
+   g_atomic_int_set(&request->done, TRUE);
+   g_main_context_wakeup(NULL);
+
+   return NULL;
+}
+
+/*
+ * The peer server accepts its connections from the main context, so probe
+ * from a separate thread while iterating it.
+ */
+static gint64
+_probe(const gchar *url, const gchar *http_proxy, GError **error)
+{
+   ProbeRequest request = { .url = url, .http_proxy = http_proxy };
+   GThread *thread = g_thread_new("probe", _probe_thread, &request);
+
+   while (!g_atomic_int_get(&request.done))
+      g_main_context_iteration(NULL, TRUE);
+
+   g_thread_join(thread);
+
+   if (request.error != NULL)
+      g_propagate_error(error, request.error);
+
+   return request.latency;
+}
+
+static void
+test_probe(Fixture *f, gconstpointer context)
+{
+   g_autoptr(AuPeerServer) server = NULL;
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *url = NULL;
+
+   server = au_peer_server_new(f->tmp_dir, 0, &error);
+   g_assert_no_error(error);
+   url = g_strdup_printf("http://127.0.0.1:%u/", au_peer_server_get_port(server));
+
+   g_test_message("Any answer from the server means that the path works");
+   g_assert_cmpint(_probe(url, NULL, &error), >=, 0);
+   g_assert_no_error(error);
+
+   g_test_message("Nothing is expected to listen on port 1, the proxy path is broken");
+   g_assert_cmpint(_probe(url, "127.0.0.1:1", &error), ==, -1);
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+   g_clear_error(&error);
+
+   g_assert_cmpint(_probe("http://127.0.0.1:1/", NULL, &error), ==, -1);
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_FAILED);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/proxy_probe/choose", test_choose);
+   test_add("/proxy_probe/probe", test_probe);
+
+   return g_test_run();
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "atomupd-daemon/rollout.h"
+#include "tests-utils.h"
+
+typedef struct {
+   gchar *tmpdir;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+   g_autoptr(GError) error = NULL;
+
+   f->tmpdir = g_dir_make_tmp("atomupd-rollout-XXXXXX", &error);
+   g_assert_no_error(error);
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   if (!rm_rf(f->tmpdir))
+      g_debug("Unable to remove temp directory: %s", f->tmpdir);
+
+   g_free(f->tmpdir);
+}
+
+/* 2024-01-16T00:00:00Z and 2024-01-18T00:00:00Z */
+#define JAN_16 1705363200
+#define JAN_18 1705536000
+
+typedef struct {
+   gint64 time;
+   gdouble percentage;
+} PercentageAt;
+
+typedef struct {
+   const gchar *group;
+   gboolean valid;
+   PercentageAt expected[4];
+} RolloutTest;
+
+static const RolloutTest rollout_tests[] = {
+   {
+      .group = "Percentage = 10",
+      .valid = TRUE,
+      .expected = { { 1, 10 }, { JAN_16, 10 } },
+   },
+
+   {
+      .group = "Percentage = 0",
+      .valid = TRUE,
+      .expected = { { JAN_16, 0 } },
+   },
+
+   {
+      .group = "Schedule = 2024-01-16T00:00:00Z 10;2024-01-18T00:00:00Z 100",
+      .valid = TRUE,
+      .expected = {
+         { JAN_16 - 1, 0 },
+         { JAN_16, 10 },
+         { (JAN_16 + JAN_18) / 2, 55 },
+         { JAN_18 + 1, 100 },
+      },
+   },
+
+   {
+      .group = "Schedule = 2024-01-16T00:00:00Z 25\nPercentage = 90",
+      .valid = TRUE,
+      .expected = { { JAN_16 - 1, 0 }, { JAN_18, 25 } },
+   },
+
+   {
+      .group = "Schedule = 2024-01-16T02:00:00+02:00 50",
+      .valid = TRUE,
+      .expected = { { JAN_16 - 1, 0 }, { JAN_16, 50 } },
+   },
+
+   {
+      .group = "Percentage = 101",
+      .valid = FALSE,
+   },
+
+   {
+      .group = "Percentage = ten",
+      .valid = FALSE,
+   },
+
+   {
+      .group = "Schedule = 2024-01-16T00:00:00Z",
+      .valid = FALSE,
+   },
+
+   {
+      .group = "Schedule = yesterday 10",
+      .valid = FALSE,
+   },
+
+   {
+      .group = "Schedule = 2024-01-18T00:00:00Z 100;2024-01-16T00:00:00Z 10",
+      .valid = FALSE,
+   },
+
+   {
+      .group = "",
+      .valid = FALSE,
+   },
+};
+
+static void
+test_rollout_parse(Fixture *f, gconstpointer context)
+{
+   gsize i;
+   gsize j;
+
+   for (i = 0; i < G_N_ELEMENTS(rollout_tests); i++) {
+      const RolloutTest *test = &rollout_tests[i];
+      g_autoptr(GKeyFile) key_file = g_key_file_new();
+      g_autoptr(AuRollout) rollout = NULL;
+      g_autoptr(GError) error = NULL;
+      g_autofree gchar *data = NULL;
+
+      g_test_message("%s", test->group);
+
+      data = g_strdup_printf("[Rollout 1]\n%s\n", test->group);
+      g_key_file_load_from_data(key_file, data, -1, G_KEY_FILE_NONE, &error);
+      g_assert_no_error(error);
+
+      rollout = au_rollout_new_from_key_file(key_file, "Rollout 1", &error);
+
+      if (!test->valid) {
+         g_assert_null(rollout);
+         g_assert_nonnull(error);
+         continue;
+      }
+
+      g_assert_no_error(error);
+      g_assert_nonnull(rollout);
+
+      for (j = 0; j < G_N_ELEMENTS(test->expected) && test->expected[j].time != 0; j++)
+         g_assert_cmpfloat_with_epsilon(
+            au_rollout_get_percentage(rollout, test->expected[j].time),
+            test->expected[j].percentage, 0.001);
+   }
+}
+
+static void
+test_rollout_bucket(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GKeyFile) key_file = g_key_file_new();
+   g_autoptr(AuRollout) rollout = NULL;
+   g_autoptr(GError) error = NULL;
+   guint exposed = 0;
+   guint changed = 0;
+   guint i;
+
+   /* The position of a machine depends only on its ID and on the build */
+   g_assert_cmpfloat(au_rollout_get_bucket("machine", "20240115.1"), ==,
+                     au_rollout_get_bucket("machine", "20240115.1"));
+
+   g_key_file_set_string(key_file, "Rollout 20240115.1", "Percentage", "10");
+   rollout = au_rollout_new_from_key_file(key_file, "Rollout 20240115.1", &error);
+   g_assert_no_error(error);
+
+   for (i = 0; i < 10000; i++) {
+      g_autofree gchar *machine_id = g_strdup_printf("%032x", i);
+      gdouble bucket = au_rollout_get_bucket(machine_id, "20240115.1");
+
+      g_assert_cmpfloat(bucket, >=, 0);
+      g_assert_cmpfloat(bucket, <, 100);
+
+      if (au_rollout_is_exposed(rollout, machine_id, "20240115.1", 0))
+         exposed++;
+
+      /* The first machines of a rollout are not always the same ones */
+      if ((bucket < 10) != (au_rollout_get_bucket(machine_id, "20240116.1") < 10))
+         changed++;
+   }
+
+   g_assert_cmpuint(exposed, >, 800);
+   g_assert_cmpuint(exposed, <, 1200);
+   g_assert_cmpuint(changed, >, 0);
+}
+
+static void
+test_rollout_load_all(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GKeyFile) key_file = g_key_file_new();
+   g_autoptr(GHashTable) rollouts = NULL;
+   g_autoptr(GError) error = NULL;
+   AuRollout *rollout = NULL;
+   const gchar *data = "[Server]\n"
+                       "Variants = steamdeck\n"
+                       "[Rollout 20240115.1]\n"
+                       "Percentage = 100\n"
+                       "[Rollout 20240116.1]\n"
+                       "Percentage = invalid\n"
+                       "[Rollout 20240117.1]\n"
+                       "Schedule = 2024-01-16T00:00:00Z 10\n";
+
+   g_key_file_load_from_data(key_file, data, -1, G_KEY_FILE_NONE, &error);
+   g_assert_no_error(error);
+
+   rollouts = au_rollout_load_all(key_file);
+   g_assert_cmpuint(g_hash_table_size(rollouts), ==, 2);
+
+   rollout = g_hash_table_lookup(rollouts, "20240115.1");
+   g_assert_nonnull(rollout);
+   g_assert_cmpfloat(au_rollout_get_percentage(rollout, JAN_16), ==, 100);
+   g_assert_true(au_rollout_is_exposed(rollout, "machine", "20240115.1", JAN_16));
+
+   g_assert_null(g_hash_table_lookup(rollouts, "20240116.1"));
+
+   rollout = g_hash_table_lookup(rollouts, "20240117.1");
+   g_assert_nonnull(rollout);
+   g_assert_false(au_rollout_is_exposed(rollout, "machine", "20240117.1", JAN_16 - 1));
+}
+
+static void
+test_rollout_machine_id(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *path = g_build_filename(f->tmpdir, "machine-id", NULL);
+   g_autofree gchar *machine_id = NULL;
+   g_autoptr(GError) error = NULL;
+
+   g_assert_null(au_rollout_read_machine_id(path));
+
+   g_file_set_contents(path, "\n", -1, &error);
+   g_assert_no_error(error);
+   g_assert_null(au_rollout_read_machine_id(path));
+
+   g_file_set_contents(path, "0123456789abcdef0123456789abcdef\n", -1, &error);
+   g_assert_no_error(error);
+   machine_id = au_rollout_read_machine_id(path);
+   g_assert_cmpstr(machine_id, ==, "0123456789abcdef0123456789abcdef");
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/rollout/parse", test_rollout_parse);
+   test_add("/rollout/bucket", test_rollout_bucket);
+   test_add("/rollout/load_all", test_rollout_load_all);
+   test_add("/rollout/machine_id", test_rollout_machine_id);
+
+   return g_test_run();
+}
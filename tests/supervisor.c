@@ -0,0 +1,279 @@
+/*
+ * Copyright © 2026 Collabora Ltd.
+ *
+ * SPDX-License-Identifier: MIT
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include <gio/gio.h>
+#include <glib.h>
+
+#include "atomupd-daemon/flight-recorder.h"
+#include "atomupd-daemon/supervisor.h"
+#include "tests-utils.h"
+
+typedef struct {
+   AuSupervisor *supervisor;
+   gboolean exited;
+   gint wait_status;
+   gboolean timed_out;
+   GBytes *standard_output;
+   gchar *standard_error;
+} Fixture;
+
+typedef struct {
+   int unused;
+} Config;
+
+static void
+setup(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   f->supervisor = au_supervisor_new();
+}
+
+static void
+teardown(Fixture *f, gconstpointer context)
+{
+   G_GNUC_UNUSED const Config *config = context;
+
+   g_clear_pointer(&f->standard_output, g_bytes_unref);
+   g_free(f->standard_error);
+   au_supervisor_free(f->supervisor);
+}
+
+static void
+_child_exited_cb(AuChild *child, gint wait_status, gpointer user_data)
+{
+   Fixture *f = user_data;
+
+   f->exited = TRUE;
+   f->wait_status = wait_status;
+   f->timed_out = au_child_get_timed_out(child);
+   f->standard_output = au_child_get_stdout(child);
+   f->standard_error = g_strdup(au_child_get_stderr(child));
+}
+
+static void
+_wait_for_exit(Fixture *f)
+{
+   while (!f->exited)
+      g_main_context_iteration(NULL, TRUE);
+}
+
+/*
+ * Returns: %TRUE if the default flight recorder has an event of type @type,
+ *  for the helper @pid
+ */
+static gboolean
+_has_flight_event(AuFlightEventType type, GPid pid)
+{
+   g_autoptr(GArray) events = NULL;
+   guint i;
+
+   events = au_flight_recorder_get_events(au_flight_recorder_get_default());
+
+   for (i = 0; i < events->len; i++) {
+      const AuFlightEvent *event = &g_array_index(events, AuFlightEvent, i);
+
+      if (event->type == type && event->value == pid)
+         return TRUE;
+   }
+
+   return FALSE;
+}
+
+static void
+test_capture(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GError) error = NULL;
+   AuHelperStats stats = { 0 };
+   AuChild *child = NULL;
+   gconstpointer data;
+   gsize len;
+   const gchar *expected_output = "line one\nline two\n";
+   const gchar *argv[] = {
+      "sh", "-c", "printf 'line one\\nline two\\n'; echo warning >&2; exit 3", NULL,
+   };
+
+   child = au_supervisor_spawn(f->supervisor, AU_HELPER_KIND_QUERY, argv, NULL,
+                               AU_CHILD_FLAGS_CAPTURE_STDOUT, 0, _child_exited_cb, f,
+                               NULL, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(child);
+   g_assert_cmpint(au_child_get_pid(child), >, 0);
+
+   au_supervisor_get_stats(f->supervisor, AU_HELPER_KIND_QUERY, &stats);
+   g_assert_cmpuint(stats.running, ==, 1);
+
+   _wait_for_exit(f);
+
+   g_assert_true(WIFEXITED(f->wait_status));
+   g_assert_cmpint(WEXITSTATUS(f->wait_status), ==, 3);
+   g_assert_false(f->timed_out);
+   data = g_bytes_get_data(f->standard_output, &len);
+   g_assert_cmpmem(data, len, expected_output, strlen(expected_output));
+   g_assert_cmpstr(f->standard_error, ==, "warning\n");
+
+   au_supervisor_get_stats(f->supervisor, AU_HELPER_KIND_QUERY, &stats);
+   g_assert_cmpuint(stats.running, ==, 0);
+   g_assert_cmpuint(stats.spawned, ==, 1);
+   g_assert_cmpuint(stats.failed, ==, 1);
+   g_assert_cmpuint(stats.timed_out, ==, 0);
+}
+
+static void
+test_stderr_tail(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GError) error = NULL;
+   AuChild *child = NULL;
+   const gchar *argv[] = {
+      "sh", "-c", "head -c 6000 /dev/zero | tr '\\0' a >&2; echo end >&2", NULL,
+   };
+
+   child = au_supervisor_spawn(f->supervisor, AU_HELPER_KIND_TOOL, argv, NULL,
+                               AU_CHILD_FLAGS_NONE, 0, _child_exited_cb, f, NULL,
+                               &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(child);
+
+   _wait_for_exit(f);
+
+   /* Only the last part of the standard error is kept */
+   g_assert_true(g_spawn_check_wait_status(f->wait_status, NULL));
+   g_assert_cmpuint(strlen(f->standard_error), ==, 4096);
+   g_assert_true(g_str_has_suffix(f->standard_error, "aaaaend\n"));
+}
+
+static void
+test_timeout(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GError) error = NULL;
+   AuHelperStats stats = { 0 };
+   AuChild *child = NULL;
+   GPid pid;
+   const gchar *argv[] = { "sleep", "60", NULL };
+
+   child = au_supervisor_spawn(f->supervisor, AU_HELPER_KIND_QUERY, argv, NULL,
+                               AU_CHILD_FLAGS_CAPTURE_STDOUT, 1, _child_exited_cb, f,
+                               NULL, &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(child);
+   pid = au_child_get_pid(child);
+   g_assert_true(_has_flight_event(AU_FLIGHT_EVENT_SPAWN, pid));
+
+   _wait_for_exit(f);
+
+   g_assert_true(f->timed_out);
+   g_assert_true(_has_flight_event(AU_FLIGHT_EVENT_KILL, pid));
+   g_assert_true(WIFSIGNALED(f->wait_status));
+   g_assert_cmpint(WTERMSIG(f->wait_status), ==, SIGKILL);
+
+   au_supervisor_get_stats(f->supervisor, AU_HELPER_KIND_QUERY, &stats);
+   g_assert_cmpuint(stats.running, ==, 0);
+   g_assert_cmpuint(stats.failed, ==, 1);
+   g_assert_cmpuint(stats.timed_out, ==, 1);
+   g_assert_cmpuint(stats.wall_time, >=, G_USEC_PER_SEC);
+}
+
+static void
+test_max_running(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GError) error = NULL;
+   AuHelperStats stats = { 0 };
+   AuChild *child = NULL;
+   AuChild *rejected = NULL;
+   const gchar *argv[] = { "sleep", "60", NULL };
+
+   /* Only one update helper can run at a time */
+   child = au_supervisor_spawn(f->supervisor, AU_HELPER_KIND_UPDATE, argv, NULL,
+                               AU_CHILD_FLAGS_NONE, 0, _child_exited_cb, f, NULL,
+                               &error);
+   g_assert_no_error(error);
+   g_assert_nonnull(child);
+
+   rejected = au_supervisor_spawn(f->supervisor, AU_HELPER_KIND_UPDATE, argv, NULL,
+                                  AU_CHILD_FLAGS_NONE, 0, _child_exited_cb, f, NULL,
+                                  &error);
+   g_assert_error(error, G_IO_ERROR, G_IO_ERROR_BUSY);
+   g_assert_null(rejected);
+   g_clear_error(&error);
+
+   /* The limit is per kind */
+   g_assert_true(au_supervisor_run_sync(f->supervisor, AU_HELPER_KIND_TOOL,
+                                        (const gchar *[]){ "true", NULL }, NULL,
+                                        &f->wait_status, &error));
+   g_assert_no_error(error);
+
+   au_child_send_signal(child, SIGTERM, &error);
+   g_assert_no_error(error);
+   _wait_for_exit(f);
+
+   g_assert_true(WIFSIGNALED(f->wait_status));
+   g_assert_cmpint(WTERMSIG(f->wait_status), ==, SIGTERM);
+
+   au_supervisor_get_stats(f->supervisor, AU_HELPER_KIND_UPDATE, &stats);
+   g_assert_cmpuint(stats.running, ==, 0);
+   g_assert_cmpuint(stats.spawned, ==, 1);
+   g_assert_cmpuint(stats.rejected, ==, 1);
+}
+
+static void
+test_run_sync(Fixture *f, gconstpointer context)
+{
+   g_autoptr(GError) error = NULL;
+   g_autofree gchar *output = NULL;
+   AuHelperStats stats = { 0 };
+   gint wait_status = 0;
+   const gchar *argv[] = { "echo", "MainPID=42", NULL };
+
+   g_assert_true(au_supervisor_run_sync(f->supervisor, AU_HELPER_KIND_TOOL, argv,
+                                        &output, &wait_status, &error));
+   g_assert_no_error(error);
+   g_assert_true(g_spawn_check_wait_status(wait_status, NULL));
+   g_assert_cmpstr(output, ==, "MainPID=42\n");
+
+   au_supervisor_get_stats(f->supervisor, AU_HELPER_KIND_TOOL, &stats);
+   g_assert_cmpuint(stats.running, ==, 0);
+   g_assert_cmpuint(stats.spawned, ==, 1);
+   g_assert_cmpuint(stats.failed, ==, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+   g_test_init(&argc, &argv, NULL);
+
+#define test_add(_name, _test) g_test_add(_name, Fixture, argv[0], setup, _test, teardown)
+
+   test_add("/supervisor/capture", test_capture);
+   test_add("/supervisor/stderr_tail", test_stderr_tail);
+   test_add("/supervisor/timeout", test_timeout);
+   test_add("/supervisor/max_running", test_max_running);
+   test_add("/supervisor/run_sync", test_run_sync);
+
+   return g_test_run();
+}
@@ -34,6 +34,7 @@
 #include <glib/gstdio.h>
 
 #include "atomupd-daemon/utils.h"
+#include "tests-utils.h"
 
 typedef struct {
    int unused;
@@ -514,6 +515,100 @@ test_desync_conf_update(Fixture *f, gconstpointer context)
    }
 }
 
+static void
+_write_fake_proc(const gchar *proc_path,
+                 const gchar *pid,
+                 const gchar *stat,
+                 const gchar *io)
+{
+   g_autofree gchar *pid_path = g_build_filename(proc_path, pid, NULL);
+   g_autofree gchar *stat_path = g_build_filename(pid_path, "stat", NULL);
+   g_autofree gchar *io_path = g_build_filename(pid_path, "io", NULL);
+   g_autoptr(GError) error = NULL;
+
+   g_assert_cmpint(g_mkdir_with_parents(pid_path, 0755), ==, 0);
+   g_file_set_contents(stat_path, stat, -1, &error);
+   g_assert_no_error(error);
+
+   if (io != NULL) {
+      g_file_set_contents(io_path, io, -1, &error);
+      g_assert_no_error(error);
+   }
+}
+
+static void
+test_procs_io_bytes(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *proc_path = NULL;
+   g_autoptr(GError) error = NULL;
+
+   proc_path = g_dir_make_tmp("atomupd-proc-XXXXXX", &error);
+   g_assert_no_error(error);
+
+   _write_fake_proc(proc_path, "100", "100 (rauc) S 1 100 100 0 -1",
+                    "rchar: 1000\nwchar: 200\nsyscr: 5\nsyscw: 2\n");
+   /* The command name can contain spaces and parentheses */
+   _write_fake_proc(proc_path, "200", "200 (desync (x) y) R 100 100 100 0 -1",
+                    "rchar: 30\nwchar: 4\n");
+   /* A child that can't be inspected is skipped */
+   _write_fake_proc(proc_path, "201", "201 (desync) R 100 100 100 0 -1", NULL);
+   /* Not a child of the RAUC service */
+   _write_fake_proc(proc_path, "300", "300 (other) S 1 300 300 0 -1",
+                    "rchar: 50000\nwchar: 50000\n");
+   _write_fake_proc(proc_path, "self", "300 (other) S 1 300 300 0 -1",
+                    "rchar: 50000\nwchar: 50000\n");
+
+   g_assert_cmpuint(_au_get_procs_io_bytes(proc_path, 100, FALSE), ==, 1200);
+   g_assert_cmpuint(_au_get_procs_io_bytes(proc_path, 100, TRUE), ==, 1234);
+   g_assert_cmpuint(_au_get_procs_io_bytes(proc_path, 200, TRUE), ==, 34);
+   g_assert_cmpuint(_au_get_procs_io_bytes(proc_path, 400, TRUE), ==, 0);
+   g_assert_cmpuint(_au_get_procs_io_bytes(proc_path, 0, TRUE), ==, 0);
+
+   if (!rm_rf(proc_path))
+      g_debug("Unable to remove temp directory: %s", proc_path);
+}
+
+static gint
+_compare_pids(gconstpointer a, gconstpointer b)
+{
+   return *(const GPid *)a - *(const GPid *)b;
+}
+
+static void
+test_pgrp_pids(Fixture *f, gconstpointer context)
+{
+   g_autofree gchar *proc_path = NULL;
+   g_autoptr(GArray) pids = NULL;
+   g_autoptr(GError) error = NULL;
+
+   proc_path = g_dir_make_tmp("atomupd-proc-XXXXXX", &error);
+   g_assert_no_error(error);
+
+   _write_fake_proc(proc_path, "100", "100 (rauc) S 1 100 100 0 -1", NULL);
+   _write_fake_proc(proc_path, "200", "200 (desync (x) y) R 100 100 100 0 -1", NULL);
+   /* Still a child of the RAUC service, but in its own process group */
+   _write_fake_proc(proc_path, "201", "201 (casync) R 100 201 100 0 -1", NULL);
+   _write_fake_proc(proc_path, "300", "300 (other) S 1 300 300 0 -1", NULL);
+   _write_fake_proc(proc_path, "self", "100 (rauc) S 1 100 100 0 -1", NULL);
+
+   pids = _au_get_pgrp_pids(proc_path, 100);
+   g_array_sort(pids, _compare_pids);
+   g_assert_cmpuint(pids->len, ==, 2);
+   g_assert_cmpint(g_array_index(pids, GPid, 0), ==, 100);
+   g_assert_cmpint(g_array_index(pids, GPid, 1), ==, 200);
+   g_clear_pointer(&pids, g_array_unref);
+
+   pids = _au_get_pgrp_pids(proc_path, 400);
+   g_assert_cmpuint(pids->len, ==, 0);
+   g_clear_pointer(&pids, g_array_unref);
+
+   pids = _au_get_pgrp_pids(proc_path, 0);
+   g_assert_cmpuint(pids->len, ==, 0);
+
+   if (!rm_rf(proc_path))
+      g_debug("Unable to remove temp directory: %s", proc_path);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -524,6 +619,8 @@ main(int argc, char **argv)
    test_add("/utils/host_from_url", test_host_from_url);
    test_add("/utils/netrc_update", test_netrc_update);
    test_add("/utils/desync_conf_update", test_desync_conf_update);
+   test_add("/utils/procs_io_bytes", test_procs_io_bytes);
+   test_add("/utils/pgrp_pids", test_pgrp_pids);
 
    return g_test_run();
 }